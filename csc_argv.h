@@ -14,29 +14,15 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include "csc_assert.h"
 #include "csc_type_str.h"
 #include "csc_u64.h"
+#include "csc_malloc_file.h"
 
 
 
 static void csc_argv_convert_flag (enum csc_type type, union csc_union * dst, uint64_t flag)
 {
 	ASSERT_PARAM_NOTNULL (dst);
-	switch (type)
-	{
-	case CSC_TYPE_U8:
-		dst->val_u8 |= flag;
-		break;
-	case CSC_TYPE_U16:
-		dst->val_u16 |= flag;
-		break;
-	case CSC_TYPE_U32:
-		dst->val_u32 |= flag;
-		break;
-	case CSC_TYPE_U64:
-		dst->val_u64 |= flag;
-		break;
-	default:
-		break;
-	}
+	csc_type_flagset_fn flagset = csc_type_desc (type)->flagset;
+	if (flagset) {flagset (dst, flag);}
 }
 
 
@@ -44,65 +30,7 @@ static void csc_argv_convert_value (enum csc_type type, union csc_union * dst, c
 {
 	ASSERT_PARAM_NOTNULL (dst);
 	ASSERT_PARAM_NOTNULL (src);
-	char * endptr = NULL;
-	union csc_union v;
-	switch (type)
-	{
-	case CSC_TYPE_STRING:
-		dst->val_string = src;
-		break;
-	case CSC_TYPE_FLOAT:
-		v.val_float = strtod (src, &endptr);
-		if (src != endptr) {dst->val_float = v.val_float;}
-		break;
-	case CSC_TYPE_DOUBLE:
-		v.val_double = strtod (src, &endptr);
-		if (src != endptr) {dst->val_double = v.val_float;}
-		break;
-	case CSC_TYPE_U8:
-		v.val_u8 = strtoumax (src, &endptr, 0);
-		if (src != endptr) {dst->val_u8 = v.val_float;}
-		break;
-	case CSC_TYPE_U16:
-		v.val_u16 = strtoumax (src, &endptr, 0);
-		if (src != endptr) {dst->val_u16 = v.val_float;}
-		break;
-	case CSC_TYPE_U32:
-		v.val_u32 = strtoumax (src, &endptr, 0);
-		if (src != endptr) {dst->val_u32 = v.val_float;}
-		break;
-	case CSC_TYPE_U64:
-		v.val_u64 = strtoumax (src, &endptr, 0);
-		if (src != endptr) {dst->val_u64 = v.val_float;}
-		break;
-	case CSC_TYPE_INT:
-		v.val_int = strtoimax (src, &endptr, 0);
-		if (src != endptr) {dst->val_int = v.val_float;}
-		break;
-	case CSC_TYPE_LONG:
-		v.val_long = strtoimax (src, &endptr, 0);
-		if (src != endptr) {dst->val_long = v.val_float;}
-		break;
-	case CSC_TYPE_I8:
-		v.val_i8 = strtoimax (src, &endptr, 0);
-		if (src != endptr) {dst->val_i8 = v.val_float;}
-		break;
-	case CSC_TYPE_I16:
-		v.val_i16 = strtoimax (src, &endptr, 0);
-		if (src != endptr) {dst->val_i16 = v.val_float;}
-		break;
-	case CSC_TYPE_I32:
-		v.val_i32 = strtoimax (src, &endptr, 0);
-		if (src != endptr) {dst->val_i32 = v.val_float;}
-		break;
-	case CSC_TYPE_I64:
-		v.val_i64 = strtoimax (src, &endptr, 0);
-		if (src != endptr) {dst->val_i64 = v.val_float;}
-		break;
-	default:
-		break;
-	}
-
+	csc_type_parse (type, dst, src, NULL);
 }
 
 
@@ -188,6 +116,196 @@ struct csc_argv_option
 };
 
 
+/*
+Option index.
+Long names are stored in a open addressing hash table and short names in a 256 entry table,
+options sharing the same name are chained with (next_long) and (next_short).
+This makes it possible to parse all arguments in one pass.
+*/
+#define CSC_ARGV_INDEX_NONE UINT32_MAX
+
+
+struct csc_argv_index
+{
+	struct csc_argv_option * options;
+	uint32_t count;
+	uint32_t mask;
+	uint32_t * table;
+	uint32_t * next_long;
+	uint32_t * next_short;
+	uint32_t short_head[256];
+};
+
+
+static uint32_t csc_argv_hash (char const * s, uint32_t len)
+{
+	//FNV-1a:
+	uint32_t h = 2166136261u;
+	for (uint32_t i = 0; i < len; ++i)
+	{
+		h ^= (uint8_t)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+
+static void csc_argv_index_init (struct csc_argv_index * idx, struct csc_argv_option * options)
+{
+	ASSERT_PARAM_NOTNULL (idx);
+	ASSERT_PARAM_NOTNULL (options);
+	uint32_t n = 0;
+	while (options[n].t != CSC_TYPE_NONE) {n++;}
+	idx->options = options;
+	idx->count = n;
+	uint32_t size = 16;
+	while (size < n * 2) {size *= 2;}
+	idx->mask = size - 1;
+	idx->table = malloc (size * sizeof (uint32_t));
+	idx->next_long = malloc ((n + 1) * sizeof (uint32_t));
+	idx->next_short = malloc ((n + 1) * sizeof (uint32_t));
+	ASSERT (idx->table && idx->next_long && idx->next_short);
+	memset (idx->table, 0xFF, size * sizeof (uint32_t));
+	memset (idx->short_head, 0xFF, sizeof (idx->short_head));
+	//Insert in reverse order so each chain is in table order:
+	for (uint32_t i = n; i-- > 0;)
+	{
+		struct csc_argv_option * o = options + i;
+		idx->next_long[i] = CSC_ARGV_INDEX_NONE;
+		idx->next_short[i] = CSC_ARGV_INDEX_NONE;
+		if (o->t == (enum csc_type)CSC_ARGV_GROUP) {continue;}
+		if (o->c)
+		{
+			idx->next_short[i] = idx->short_head[(uint8_t)o->c];
+			idx->short_head[(uint8_t)o->c] = i;
+		}
+		if (o->s == NULL) {continue;}
+		uint32_t len = (uint32_t) strlen (o->s);
+		uint32_t h = csc_argv_hash (o->s, len) & idx->mask;
+		while (idx->table[h] != CSC_ARGV_INDEX_NONE)
+		{
+			uint32_t j = idx->table[h];
+			if (strcmp (options[j].s, o->s) == 0)
+			{
+				idx->next_long[i] = j;
+				break;
+			}
+			h = (h + 1) & idx->mask;
+		}
+		idx->table[h] = i;
+	}
+}
+
+
+static void csc_argv_index_free (struct csc_argv_index * idx)
+{
+	ASSERT_PARAM_NOTNULL (idx);
+	free (idx->table);
+	free (idx->next_long);
+	free (idx->next_short);
+	memset (idx, 0, sizeof (struct csc_argv_index));
+}
+
+
+/**
+ * @brief Find the first option with long name (name) of length (len)
+ * @return Option index or CSC_ARGV_INDEX_NONE, more options with the same name follows (next_long)
+ */
+static uint32_t csc_argv_index_find (struct csc_argv_index const * idx, char const * name, uint32_t len)
+{
+	ASSERT_PARAM_NOTNULL (idx);
+	ASSERT_PARAM_NOTNULL (name);
+	uint32_t h = csc_argv_hash (name, len) & idx->mask;
+	while (1)
+	{
+		uint32_t i = idx->table[h];
+		if (i == CSC_ARGV_INDEX_NONE) {return i;}
+		char const * s = idx->options[i].s;
+		if (strncmp (s, name, len) == 0 && s[len] == '\0') {return i;}
+		h = (h + 1) & idx->mask;
+	}
+}
+
+
+/**
+ * @brief Give a value to all options with long name (name)
+ * @param value The value or NULL to set flags
+ * @param done Optional, options marked done are skipped and options getting a value are marked done
+ * @return Number of options found
+ */
+static uint32_t csc_argv_index_apply (struct csc_argv_index const * idx, char const * name, uint32_t len, char const * value, uint8_t done[])
+{
+	uint32_t n = 0;
+	for (uint32_t i = csc_argv_index_find (idx, name, len); i != CSC_ARGV_INDEX_NONE; i = idx->next_long[i])
+	{
+		struct csc_argv_option * o = idx->options + i;
+		n++;
+		if (done && done[i]) {continue;}
+		if (value)
+		{
+			csc_argv_convert_value (o->t, (union csc_union*)o->v, value);
+			if (done) {done[i] = 1;}
+		}
+		else if (o->f)
+		{
+			csc_argv_convert_flag (o->t, (union csc_union*)o->v, o->f);
+		}
+	}
+	return n;
+}
+
+
+/**
+ * @brief Parse all arguments in one pass using a option index
+ * Same rules as csc_argv_parse.
+ */
+static void csc_argv_parseall_index (char const * argv[], struct csc_argv_index const * idx)
+{
+	ASSERT_PARAM_NOTNULL (argv);
+	ASSERT_PARAM_NOTNULL (idx);
+	struct csc_argv_option * options = idx->options;
+	//Options that got a value from a long name are not changed anymore:
+	uint8_t * done = calloc (idx->count + 1, 1);
+	ASSERT (done);
+	for (; argv[0]; ++argv)
+	{
+		char const * s = argv[0];
+		if (s[0] != '-') {continue;}
+		//Handles long names: e.g: {"--read", "--write", "--year=2", "--name=Bob"}:
+		if (s[1] == '-')
+		{
+			char const * e = strchr (s + 2, '=');
+			uint32_t len = e ? (uint32_t)(e - (s + 2)) : (uint32_t) strlen (s + 2);
+			csc_argv_index_apply (idx, s + 2, len, e ? e + 1 : NULL, done);
+			continue;
+		}
+		//Handles short names for values: e.g: {"-aHello", "-a", "Hello"}:
+		for (uint32_t i = idx->short_head[(uint8_t)s[1]]; i != CSC_ARGV_INDEX_NONE; i = idx->next_short[i])
+		{
+			struct csc_argv_option * o = options + i;
+			if (o->f || done[i]) {continue;}
+			if (s[2]) {csc_argv_convert_value (o->t, (union csc_union*)o->v, s + 2);}
+			else if (argv[1]) {csc_argv_convert_value (o->t, (union csc_union*)o->v, argv[1]);}
+		}
+		//Handles short names for flags: e.g: {"-x", "-rw", -rWarren}:
+		uint64_t a[4] = {0};
+		for (char const * p = s; *p; ++p)
+		{
+			uint8_t c = (uint8_t)*p;
+			if (VU64_BITSET_GET (a, c)) {continue;}
+			VU64_BITSET_ADD (a, c);
+			for (uint32_t i = idx->short_head[c]; i != CSC_ARGV_INDEX_NONE; i = idx->next_short[i])
+			{
+				struct csc_argv_option * o = options + i;
+				if (o->f == 0 || done[i]) {continue;}
+				csc_argv_convert_flag (o->t, (union csc_union*)o->v, o->f);
+			}
+		}
+	}
+	free (done);
+}
+
+
 /**
  * @brief Parse all options
  * @param[in]      argv     The argv from the main function: main(int argc, char const * argv[])
@@ -197,27 +315,128 @@ static void csc_argv_parseall (char const * argv[], struct csc_argv_option * opt
 {
 	ASSERT_PARAM_NOTNULL (argv);
 	ASSERT_PARAM_NOTNULL (options);
+	struct csc_argv_index idx;
+	csc_argv_index_init (&idx, options);
+	csc_argv_parseall_index (argv, &idx);
+	csc_argv_index_free (&idx);
+}
+
 
-	//Find all characters that is used for flags:
-	/*
-	uint64_t flagmask = 0;
-	for (struct csc_argv_option * o = options; o->t != CSC_TYPE_NONE; ++o)
+/**
+ * @brief Parse a config file content in place, one "name=value" or "name" per line
+ * Lines starting with '#' or ';' are comments and whitespace around names and values is ignored.
+ * The line endings in (text) are replaced by NUL so string options can point into (text).
+ * @return Number of unknown names
+ */
+static uint32_t csc_argv_parse_config (struct csc_argv_index const * idx, char * text, size_t len)
+{
+	ASSERT_PARAM_NOTNULL (idx);
+	ASSERT_PARAM_NOTNULL (text);
+	uint32_t unknown = 0;
+	char * p = text;
+	char * end = text + len;
+	while (p < end)
 	{
-		if (o->f)
+		char * e = memchr (p, '\n', (size_t)(end - p));
+		if (e == NULL) {e = end;}
+		char * next = e + 1;
+		while (e > p && isspace ((unsigned char)e[-1])) {e--;}
+		while (p < e && isspace ((unsigned char)p[0])) {p++;}
+		if (p == e || p[0] == '#' || p[0] == ';')
 		{
-			flagmask |= csc_base64set_fromchar (o->c);
+			p = next;
+			continue;
 		}
+		char * eq = memchr (p, '=', (size_t)(e - p));
+		char * k = eq ? eq : e;
+		while (k > p && isspace ((unsigned char)k[-1])) {k--;}
+		char * value = NULL;
+		if (eq)
+		{
+			value = eq + 1;
+			while (value < e && isspace ((unsigned char)value[0])) {value++;}
+		}
+		//The terminator can be written at (e) because (e) is at most (end) which is the NUL sentinel:
+		e[0] = '\0';
+		if (csc_argv_index_apply (idx, p, (uint32_t)(k - p), value, NULL) == 0) {unknown++;}
+		p = next;
 	}
-	*/
+	return unknown;
+}
+
+
+/**
+ * @brief Load a config file with csc_argv_parse_config
+ * @param view Holds the file content, must be kept open while string options are used
+ * @return Number of unknown names or -1 if the file could not be opened
+ */
+static int csc_argv_load_config (struct csc_argv_index const * idx, char const * filename, struct csc_file_view * view)
+{
+	ASSERT_PARAM_NOTNULL (idx);
+	ASSERT_PARAM_NOTNULL (filename);
+	ASSERT_PARAM_NOTNULL (view);
+	if (csc_file_view_open (view, filename, 0) != 0) {return -1;}
+	return (int) csc_argv_parse_config (idx, view->data, view->size);
+}
 
-	//Go through all options:
-	for (struct csc_argv_option * o = options; o->t != CSC_TYPE_NONE; ++o)
+
+/**
+ * @brief Give values from environment variables (prefix)(NAME)=value
+ * The name after the prefix is lowercased and '_' becomes '-' before it is matched exactly against the long option names,
+ * e.g. PREFIX_NUM_THREADS and PREFIX_num_threads gives --num-threads.
+ * Long option names with uppercase letters can not be given from the environment.
+ * @param envp Environment as given to main, NULL to use environ
+ * @return Number of matching environment variables
+ */
+static uint32_t csc_argv_parse_env (struct csc_argv_index const * idx, char const * prefix, char const * envp[])
+{
+	ASSERT_PARAM_NOTNULL (idx);
+	ASSERT_PARAM_NOTNULL (prefix);
+#if !defined(WIN32)
+	extern char ** environ;
+	if (envp == NULL) {envp = (char const **)environ;}
+#endif
+	if (envp == NULL) {return 0;}
+	size_t plen = strlen (prefix);
+	uint32_t n = 0;
+	char name[128];
+	for (; envp[0]; ++envp)
 	{
-		if (o->t != (enum csc_type)CSC_ARGV_GROUP)
+		char const * s = envp[0];
+		if (strncmp (s, prefix, plen) != 0) {continue;}
+		s += plen;
+		char const * eq = strchr (s, '=');
+		if (eq == NULL || (size_t)(eq - s) >= sizeof (name)) {continue;}
+		uint32_t len = (uint32_t)(eq - s);
+		for (uint32_t i = 0; i < len; ++i)
 		{
-			csc_argv_parse (argv, o->c, o->s, o->t, o->v, o->f);
+			name[i] = (s[i] == '_') ? '-' : (char) tolower ((unsigned char)s[i]);
 		}
+		if (csc_argv_index_apply (idx, name, len, eq + 1, NULL)) {n++;}
 	}
+	return n;
+}
+
+
+/**
+ * @brief Parse options from all sources with one option index
+ * Precedence from lowest to highest: option defaults, config file, environment, command line.
+ * @param config Config filename or NULL
+ * @param prefix Environment variable prefix or NULL
+ * @param view Holds the config file content, close it when string options are no longer used
+ */
+static void csc_argv_parseall_sources (char const * argv[], struct csc_argv_option * options, char const * config, char const * prefix, struct csc_file_view * view)
+{
+	ASSERT_PARAM_NOTNULL (argv);
+	ASSERT_PARAM_NOTNULL (options);
+	ASSERT_PARAM_NOTNULL (view);
+	memset (view, 0, sizeof (struct csc_file_view));
+	struct csc_argv_index idx;
+	csc_argv_index_init (&idx, options);
+	if (config) {csc_argv_load_config (&idx, config, view);}
+	if (prefix) {csc_argv_parse_env (&idx, prefix, NULL);}
+	csc_argv_parseall_index (argv, &idx);
+	csc_argv_index_free (&idx);
 }
 
 
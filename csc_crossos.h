@@ -12,6 +12,8 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 //
 #define __USE_MINGW_ANSI_STDIO 1
 
+#include <time.h>
+
 
 
 #if defined(WIN32)
@@ -36,3 +38,12 @@ static void csc_crossos_enable_ansi_color ()
 }
 
 
+/**
+ * @brief Seconds from (t0) to (t1), both from clock_gettime
+ */
+static double csc_crossos_seconds (struct timespec const * t0, struct timespec const * t1)
+{
+	return (double)(t1->tv_sec - t0->tv_sec) + (double)(t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+
@@ -0,0 +1,606 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include "csc_basic.h"
+#include "csc_assert.h"
+
+
+/*
+Batched asynchronous file loader.
+Requests are submitted in batches and completed requests are handed back through
+csc_file_async_poll() which calls each request's callback in the polling thread.
+On Linux reads go through io_uring, otherwise or when io_uring or its IORING_OP_READ (Linux 5.6)
+is not available a pool of reader threads is used, (backend) tells which one runs.
+The loaded content is a malloc buffer with a NUL terminator, owned by the caller.
+Open and fstat are done in csc_file_async_submit(), only the reads are asynchronous.
+*/
+#define CSC_FILE_ASYNC_URING 1
+#define CSC_FILE_ASYNC_THREADS 2
+#define CSC_FILE_ASYNC_MAXTHREADS 16
+//Largest single read submitted to the ring:
+#define CSC_FILE_ASYNC_READMAX (1 << 30)
+
+
+struct csc_file_async_req;
+typedef void (*csc_file_async_cb)(struct csc_file_async_req * req, void * ptr);
+
+
+struct csc_file_async_req
+{
+	char const * filename;
+	csc_file_async_cb cb;
+	void * ptr;
+	//Result, (data) is NUL terminated and must be freed by the caller:
+	char * data;
+	size_t size;
+	//0 or errno:
+	int error;
+	int done;
+	//Internal:
+	int fd;
+	size_t offset;
+	struct csc_file_async_req * next;
+};
+
+
+struct csc_file_async_list
+{
+	struct csc_file_async_req * head;
+	struct csc_file_async_req * tail;
+};
+
+
+struct csc_file_async
+{
+	int backend;
+	//Number of submitted requests not yet returned by csc_file_async_poll:
+	uint32_t pending;
+	//Requests that finished but their callbacks has not been called yet:
+	struct csc_file_async_list done;
+	//io_uring:
+	int ring_fd;
+	uint32_t ring_entries;
+	uint32_t ring_inflight;
+	struct csc_file_async_list queue;
+	void * sq_ptr;
+	size_t sq_size;
+	void * cq_ptr;
+	size_t cq_size;
+	void * sqes_ptr;
+	size_t sqes_size;
+	uint32_t * sq_head;
+	uint32_t * sq_tail;
+	uint32_t * sq_mask;
+	uint32_t * sq_array;
+	uint32_t * cq_head;
+	uint32_t * cq_tail;
+	uint32_t * cq_mask;
+#if defined(__linux__)
+	struct io_uring_cqe * cqes;
+#endif
+	//Threads:
+	uint32_t nthreads;
+	int quit;
+	pthread_t threads[CSC_FILE_ASYNC_MAXTHREADS];
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_work;
+	pthread_cond_t cond_done;
+};
+
+
+static void csc_file_async_list_push (struct csc_file_async_list * list, struct csc_file_async_req * req)
+{
+	req->next = NULL;
+	if (list->tail) {list->tail->next = req;}
+	else {list->head = req;}
+	list->tail = req;
+}
+
+
+static struct csc_file_async_req * csc_file_async_list_pop (struct csc_file_async_list * list)
+{
+	struct csc_file_async_req * req = list->head;
+	if (req == NULL) {return NULL;}
+	list->head = req->next;
+	if (list->head == NULL) {list->tail = NULL;}
+	req->next = NULL;
+	return req;
+}
+
+
+static void csc_file_async_finish (struct csc_file_async_req * req, int error)
+{
+	if (req->fd >= 0)
+	{
+		close (req->fd);
+		req->fd = -1;
+	}
+	req->error = error;
+	if (error)
+	{
+		free (req->data);
+		req->data = NULL;
+		req->size = 0;
+	}
+	else
+	{
+		req->data[req->size] = 0;
+	}
+	req->done = 1;
+}
+
+
+/**
+ * @brief Blocking read of the rest of the request, grows the buffer when the size is not known
+ */
+static int csc_file_async_read_all (struct csc_file_async_req * req, size_t cap)
+{
+	while (1)
+	{
+		if (req->offset + 1 >= cap)
+		{
+			cap = MAX (cap * 2, 4096);
+			char * d = realloc (req->data, cap);
+			if (d == NULL) {return ENOMEM;}
+			req->data = d;
+		}
+		ssize_t r = read (req->fd, req->data + req->offset, cap - req->offset - 1);
+		if (r < 0)
+		{
+			if (errno == EINTR) {continue;}
+			return errno;
+		}
+		if (r == 0) {break;}
+		req->offset += (size_t) r;
+	}
+	req->size = req->offset;
+	return 0;
+}
+
+
+/**
+ * @brief Blocking read of a regular file up to the size given by fstat
+ */
+static int csc_file_async_read_size (struct csc_file_async_req * req)
+{
+	while (req->offset < req->size)
+	{
+		ssize_t r = read (req->fd, req->data + req->offset, req->size - req->offset);
+		if (r < 0)
+		{
+			if (errno == EINTR) {continue;}
+			return errno;
+		}
+		if (r == 0) {break;}
+		req->offset += (size_t) r;
+	}
+	req->size = req->offset;
+	return 0;
+}
+
+
+
+
+#if defined(__linux__)
+/**
+ * @brief Check that the ring (fd) supports IORING_OP_READ
+ * Rings can be set up from Linux 5.1 but IORING_OP_READ and IORING_REGISTER_PROBE needs Linux 5.6,
+ * on older kernels every read would complete with -EINVAL.
+ */
+static int csc_file_async_uring_probe (int fd)
+{
+	enum {OPS = 64};
+	char buf[sizeof (struct io_uring_probe) + OPS * sizeof (struct io_uring_probe_op)];
+	memset (buf, 0, sizeof (buf));
+	struct io_uring_probe * probe = (struct io_uring_probe *)buf;
+	if (syscall (__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, OPS) < 0) {return 0;}
+	if (probe->ops_len <= IORING_OP_READ) {return 0;}
+	return (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+
+/**
+ * @return 1 when io_uring with IORING_OP_READ is available
+ */
+static int csc_file_async_uring_available (void)
+{
+	struct io_uring_params p;
+	memset (&p, 0, sizeof (p));
+	int fd = (int) syscall (__NR_io_uring_setup, 1, &p);
+	if (fd < 0) {return 0;}
+	int r = csc_file_async_uring_probe (fd);
+	close (fd);
+	return r;
+}
+
+
+static int csc_file_async_uring_init (struct csc_file_async * a, uint32_t depth)
+{
+	struct io_uring_params p;
+	memset (&p, 0, sizeof (p));
+	int fd = (int) syscall (__NR_io_uring_setup, depth, &p);
+	if (fd < 0) {return -1;}
+	if (csc_file_async_uring_probe (fd) == 0)
+	{
+		close (fd);
+		return -1;
+	}
+	a->ring_fd = fd;
+	a->ring_entries = p.sq_entries;
+	a->sq_size = p.sq_off.array + p.sq_entries * sizeof (uint32_t);
+	a->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		a->sq_size = MAX (a->sq_size, a->cq_size);
+		a->cq_size = 0;
+	}
+	a->sq_ptr = mmap (NULL, a->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (a->sq_ptr == MAP_FAILED) {goto error_sq;}
+	a->cq_ptr = a->sq_ptr;
+	if (a->cq_size)
+	{
+		a->cq_ptr = mmap (NULL, a->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (a->cq_ptr == MAP_FAILED) {goto error_cq;}
+	}
+	a->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+	a->sqes_ptr = mmap (NULL, a->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (a->sqes_ptr == MAP_FAILED) {goto error_sqes;}
+	char * sq = a->sq_ptr;
+	char * cq = a->cq_ptr;
+	a->sq_head = (uint32_t *)(sq + p.sq_off.head);
+	a->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+	a->sq_mask = (uint32_t *)(sq + p.sq_off.ring_mask);
+	a->sq_array = (uint32_t *)(sq + p.sq_off.array);
+	a->cq_head = (uint32_t *)(cq + p.cq_off.head);
+	a->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+	a->cq_mask = (uint32_t *)(cq + p.cq_off.ring_mask);
+	a->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	a->backend = CSC_FILE_ASYNC_URING;
+	return 0;
+error_sqes:
+	if (a->cq_size) {munmap (a->cq_ptr, a->cq_size);}
+error_cq:
+	munmap (a->sq_ptr, a->sq_size);
+error_sq:
+	close (fd);
+	a->ring_fd = -1;
+	return -1;
+}
+
+
+static void csc_file_async_uring_free (struct csc_file_async * a)
+{
+	munmap (a->sqes_ptr, a->sqes_size);
+	if (a->cq_size) {munmap (a->cq_ptr, a->cq_size);}
+	munmap (a->sq_ptr, a->sq_size);
+	close (a->ring_fd);
+	a->ring_fd = -1;
+}
+
+
+/**
+ * @brief Move queued requests into the submission ring and enter the kernel
+ * @param wait Minimum number of completions to wait for
+ */
+static void csc_file_async_uring_enter (struct csc_file_async * a, uint32_t wait)
+{
+	uint32_t tail = *a->sq_tail;
+	while (a->queue.head && a->ring_inflight < a->ring_entries)
+	{
+		struct csc_file_async_req * req = csc_file_async_list_pop (&a->queue);
+		uint32_t i = tail & *a->sq_mask;
+		struct io_uring_sqe * sqe = (struct io_uring_sqe *)a->sqes_ptr + i;
+		memset (sqe, 0, sizeof (struct io_uring_sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = req->fd;
+		sqe->off = req->offset;
+		sqe->addr = (uint64_t)(uintptr_t)(req->data + req->offset);
+		sqe->len = (uint32_t) MIN (req->size - req->offset, CSC_FILE_ASYNC_READMAX);
+		sqe->user_data = (uint64_t)(uintptr_t)req;
+		a->sq_array[i] = i;
+		tail ++;
+		a->ring_inflight ++;
+	}
+	__atomic_store_n (a->sq_tail, tail, __ATOMIC_RELEASE);
+	//Entries left in the ring by an earlier short submission are submitted again:
+	uint32_t submit = tail - __atomic_load_n (a->sq_head, __ATOMIC_ACQUIRE);
+	wait = MIN (wait, a->ring_inflight);
+	if (submit == 0 && wait == 0) {return;}
+	while (1)
+	{
+		int r = (int) syscall (__NR_io_uring_enter, a->ring_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (r < 0)
+		{
+			ASSERTF (errno == EINTR || errno == EAGAIN || errno == EBUSY, "io_uring_enter %s", strerror (errno));
+			continue;
+		}
+		//The kernel can consume fewer entries than asked for and then does not wait:
+		submit -= MIN ((uint32_t) r, submit);
+		if (submit == 0) {break;}
+	}
+}
+
+
+/**
+ * @brief Harvest the completion ring, short reads are queued again
+ */
+static void csc_file_async_uring_reap (struct csc_file_async * a)
+{
+	uint32_t head = *a->cq_head;
+	uint32_t tail = __atomic_load_n (a->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail)
+	{
+		struct io_uring_cqe * cqe = a->cqes + (head & *a->cq_mask);
+		struct csc_file_async_req * req = (struct csc_file_async_req *)(uintptr_t)cqe->user_data;
+		int res = cqe->res;
+		head ++;
+		a->ring_inflight --;
+		if (res < 0)
+		{
+			if (res == -EINTR || res == -EAGAIN)
+			{
+				csc_file_async_list_push (&a->queue, req);
+				continue;
+			}
+			csc_file_async_finish (req, -res);
+			csc_file_async_list_push (&a->done, req);
+			continue;
+		}
+		req->offset += (size_t) res;
+		if (res == 0 || req->offset >= req->size)
+		{
+			//The file shrunk after fstat:
+			req->size = req->offset;
+			csc_file_async_finish (req, 0);
+			csc_file_async_list_push (&a->done, req);
+			continue;
+		}
+		csc_file_async_list_push (&a->queue, req);
+	}
+	__atomic_store_n (a->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+
+
+
+static void * csc_file_async_thread (void * arg)
+{
+	struct csc_file_async * a = arg;
+	pthread_mutex_lock (&a->mutex);
+	while (1)
+	{
+		while (a->queue.head == NULL && a->quit == 0)
+		{
+			pthread_cond_wait (&a->cond_work, &a->mutex);
+		}
+		if (a->queue.head == NULL) {break;}
+		struct csc_file_async_req * req = csc_file_async_list_pop (&a->queue);
+		pthread_mutex_unlock (&a->mutex);
+		int error = req->size ? csc_file_async_read_size (req) : csc_file_async_read_all (req, 1);
+		csc_file_async_finish (req, error);
+		pthread_mutex_lock (&a->mutex);
+		csc_file_async_list_push (&a->done, req);
+		pthread_cond_signal (&a->cond_done);
+	}
+	pthread_mutex_unlock (&a->mutex);
+	return NULL;
+}
+
+
+/**
+ * @brief Create a loader
+ * @param backend CSC_FILE_ASYNC_URING or CSC_FILE_ASYNC_THREADS, io_uring falls back to threads when not available
+ * @param depth Maximum number of reads in flight in io_uring
+ * @param nthreads Number of reader threads of the thread backend
+ */
+static void csc_file_async_init (struct csc_file_async * a, int backend, uint32_t depth, uint32_t nthreads)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	memset (a, 0, sizeof (struct csc_file_async));
+	a->ring_fd = -1;
+#if defined(__linux__)
+	if (backend == CSC_FILE_ASYNC_URING)
+	{
+		if (csc_file_async_uring_init (a, MAX (depth, 1)) == 0) {return;}
+	}
+#else
+	UNUSED (depth);
+#endif
+	UNUSED (backend);
+	a->backend = CSC_FILE_ASYNC_THREADS;
+	a->nthreads = CLAMP (nthreads, 1, CSC_FILE_ASYNC_MAXTHREADS);
+	pthread_mutex_init (&a->mutex, NULL);
+	pthread_cond_init (&a->cond_work, NULL);
+	pthread_cond_init (&a->cond_done, NULL);
+	for (uint32_t i = 0; i < a->nthreads; ++i)
+	{
+		int r = pthread_create (a->threads + i, NULL, csc_file_async_thread, a);
+		ASSERTF (r == 0, "pthread_create %i", r);
+	}
+}
+
+
+/**
+ * @brief Submit (n) requests, (filename), (cb) and (ptr) of each request must be set
+ * The requests must stay alive until they have been returned by csc_file_async_poll.
+ */
+static void csc_file_async_submit (struct csc_file_async * a, struct csc_file_async_req req[], uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	ASSERT_PARAM_NOTNULL (req);
+	struct csc_file_async_list list = {NULL, NULL};
+	struct csc_file_async_list done = {NULL, NULL};
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		struct csc_file_async_req * r = req + i;
+		ASSERT_PARAM_NOTNULL (r->filename);
+		r->data = NULL;
+		r->size = 0;
+		r->error = 0;
+		r->done = 0;
+		r->offset = 0;
+		r->fd = open (r->filename, O_RDONLY | O_CLOEXEC);
+		a->pending ++;
+		if (r->fd < 0)
+		{
+			r->error = errno;
+			r->done = 1;
+			csc_file_async_list_push (&done, r);
+			continue;
+		}
+		struct stat st;
+		//Files in /proc reports size 0, they are read as pipes:
+		int regular = (fstat (r->fd, &st) == 0) && S_ISREG (st.st_mode) && (st.st_size > 0);
+		r->size = regular ? (size_t) st.st_size : 0;
+		r->data = malloc (r->size + 1);
+		if (r->data == NULL)
+		{
+			csc_file_async_finish (r, ENOMEM);
+			csc_file_async_list_push (&done, r);
+			continue;
+		}
+		if (regular == 0 && a->backend == CSC_FILE_ASYNC_URING)
+		{
+			//Pipes and devices has no known size, read them here:
+			csc_file_async_finish (r, csc_file_async_read_all (r, 1));
+			csc_file_async_list_push (&done, r);
+			continue;
+		}
+		csc_file_async_list_push (&list, r);
+	}
+	if (a->backend == CSC_FILE_ASYNC_THREADS)
+	{
+		pthread_mutex_lock (&a->mutex);
+	}
+	if (done.head)
+	{
+		if (a->done.tail) {a->done.tail->next = done.head;}
+		else {a->done.head = done.head;}
+		a->done.tail = done.tail;
+	}
+	if (list.head)
+	{
+		if (a->queue.tail) {a->queue.tail->next = list.head;}
+		else {a->queue.head = list.head;}
+		a->queue.tail = list.tail;
+	}
+	if (a->backend == CSC_FILE_ASYNC_THREADS)
+	{
+		pthread_cond_broadcast (&a->cond_work);
+		pthread_mutex_unlock (&a->mutex);
+	}
+#if defined(__linux__)
+	else
+	{
+		csc_file_async_uring_enter (a, 0);
+	}
+#endif
+}
+
+
+/**
+ * @brief Call the callback of finished requests
+ * @param wait Block until at least one request is finished, unless there is nothing pending
+ * @return Number of requests finished by this call
+ */
+static uint32_t csc_file_async_poll (struct csc_file_async * a, int wait)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	struct csc_file_async_list done = {NULL, NULL};
+	if (a->backend == CSC_FILE_ASYNC_THREADS)
+	{
+		pthread_mutex_lock (&a->mutex);
+		while (wait && a->pending > 0 && a->done.head == NULL)
+		{
+			pthread_cond_wait (&a->cond_done, &a->mutex);
+		}
+		done = a->done;
+		a->done.head = NULL;
+		a->done.tail = NULL;
+		pthread_mutex_unlock (&a->mutex);
+	}
+#if defined(__linux__)
+	else
+	{
+		csc_file_async_uring_reap (a);
+		while (wait && a->pending > 0 && a->done.head == NULL)
+		{
+			csc_file_async_uring_enter (a, 1);
+			csc_file_async_uring_reap (a);
+		}
+		//Keep the ring busy while the callbacks run:
+		csc_file_async_uring_enter (a, 0);
+		done = a->done;
+		a->done.head = NULL;
+		a->done.tail = NULL;
+	}
+#endif
+	uint32_t n = 0;
+	while (1)
+	{
+		struct csc_file_async_req * req = csc_file_async_list_pop (&done);
+		if (req == NULL) {break;}
+		a->pending --;
+		n ++;
+		if (req->cb) {req->cb (req, req->ptr);}
+	}
+	return n;
+}
+
+
+/**
+ * @brief Poll until every submitted request is finished
+ */
+static void csc_file_async_wait (struct csc_file_async * a)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	while (a->pending > 0)
+	{
+		csc_file_async_poll (a, 1);
+	}
+}
+
+
+static void csc_file_async_free (struct csc_file_async * a)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	csc_file_async_wait (a);
+	if (a->backend == CSC_FILE_ASYNC_THREADS)
+	{
+		pthread_mutex_lock (&a->mutex);
+		a->quit = 1;
+		pthread_cond_broadcast (&a->cond_work);
+		pthread_mutex_unlock (&a->mutex);
+		for (uint32_t i = 0; i < a->nthreads; ++i)
+		{
+			pthread_join (a->threads[i], NULL);
+		}
+		pthread_mutex_destroy (&a->mutex);
+		pthread_cond_destroy (&a->cond_work);
+		pthread_cond_destroy (&a->cond_done);
+	}
+#if defined(__linux__)
+	else if (a->backend == CSC_FILE_ASYNC_URING)
+	{
+		csc_file_async_uring_free (a);
+	}
+#endif
+	memset (a, 0, sizeof (struct csc_file_async));
+}
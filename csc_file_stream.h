@@ -0,0 +1,309 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+
+
+/*
+Chunked streaming file reader.
+A background thread reads fixed size chunks into a ring of (nbuf) aligned buffers
+while the consumer processes the previous chunks, so files larger than RAM can be processed
+with a memory footprint of (nbuf * chunk) bytes.
+csc_file_stream_next() gives one chunk at a time,
+csc_file_stream_record() gives one record at a time where records are separated by a byte.
+Records inside one chunk point directly into the chunk,
+records spanning chunks are assembled in a carry buffer.
+*/
+#define CSC_FILE_STREAM_DIRECT 0x01 //Bypass the page cache with O_DIRECT when supported
+#define CSC_FILE_STREAM_ALIGN 4096
+#define CSC_FILE_STREAM_MAXBUF 16
+
+
+struct csc_file_stream_buf
+{
+	char * data;
+	size_t len;
+	//1 when filled by the reader and not yet released by the consumer:
+	int full;
+	//1 when this is the last chunk:
+	int eof;
+};
+
+
+struct csc_file_stream
+{
+	int fd;
+	int direct;
+	int error;
+	size_t chunk;
+	uint32_t nbuf;
+	struct csc_file_stream_buf buf[CSC_FILE_STREAM_MAXBUF];
+	//Consumer side:
+	uint32_t current;
+	int holding;
+	int eof;
+	//Record parsing state within the current chunk:
+	char const * p;
+	char const * e;
+	char * carry;
+	size_t carry_len;
+	size_t carry_cap;
+	//Reader thread:
+	int quit;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_full;
+	pthread_cond_t cond_free;
+};
+
+
+/**
+ * @brief Read until (n) bytes are read or end of file
+ * @return Number of bytes read or -1 on error
+ */
+static ssize_t csc_file_stream_read (int fd, char * data, size_t n, int direct)
+{
+	size_t m = 0;
+	while (m < n)
+	{
+		ssize_t r = read (fd, data + m, n - m);
+		if (r < 0)
+		{
+			if (errno == EINTR) {continue;}
+			return -1;
+		}
+		if (r == 0) {break;}
+		m += (size_t) r;
+		//O_DIRECT can not continue from an unaligned offset, an unaligned read is the end of the file:
+		if (direct && (m % CSC_FILE_STREAM_ALIGN)) {break;}
+	}
+	return (ssize_t) m;
+}
+
+
+static void * csc_file_stream_thread (void * arg)
+{
+	struct csc_file_stream * s = arg;
+	uint32_t i = 0;
+	while (1)
+	{
+		struct csc_file_stream_buf * b = s->buf + i;
+		pthread_mutex_lock (&s->mutex);
+		while (b->full && s->quit == 0)
+		{
+			pthread_cond_wait (&s->cond_free, &s->mutex);
+		}
+		int quit = s->quit;
+		pthread_mutex_unlock (&s->mutex);
+		if (quit) {break;}
+		ssize_t r = csc_file_stream_read (s->fd, b->data, s->chunk, s->direct);
+		pthread_mutex_lock (&s->mutex);
+		if (r < 0)
+		{
+			s->error = errno;
+			r = 0;
+		}
+		b->len = (size_t) r;
+		//A short read only happens at the end of the file:
+		b->eof = ((size_t) r < s->chunk);
+		b->full = 1;
+		pthread_cond_signal (&s->cond_full);
+		pthread_mutex_unlock (&s->mutex);
+		if (b->eof) {break;}
+		i = (i + 1) % s->nbuf;
+	}
+	return NULL;
+}
+
+
+/**
+ * @brief Open a file and start reading it in the background
+ * @param chunk Chunk size, rounded up to CSC_FILE_STREAM_ALIGN
+ * @param nbuf Number of chunk buffers, 2 gives double buffering
+ * @param flags CSC_FILE_STREAM_DIRECT
+ * @return 0 on success, -1 on error
+ */
+static int csc_file_stream_open (struct csc_file_stream * s, char const * filename, size_t chunk, uint32_t nbuf, int flags)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	ASSERT_PARAM_NOTNULL (filename);
+	memset (s, 0, sizeof (struct csc_file_stream));
+	s->fd = -1;
+#if defined(O_DIRECT)
+	if (flags & CSC_FILE_STREAM_DIRECT)
+	{
+		s->fd = open (filename, O_RDONLY | O_CLOEXEC | O_DIRECT);
+		s->direct = (s->fd >= 0);
+	}
+#else
+	UNUSED (flags);
+#endif
+	if (s->fd < 0)
+	{
+		//Filesystems like tmpfs does not support O_DIRECT:
+		s->fd = open (filename, O_RDONLY | O_CLOEXEC);
+	}
+	if (s->fd < 0) {return -1;}
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise (s->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	s->chunk = (MAX (chunk, 1) + CSC_FILE_STREAM_ALIGN - 1) & ~(size_t)(CSC_FILE_STREAM_ALIGN - 1);
+	s->nbuf = CLAMP (nbuf, 2, CSC_FILE_STREAM_MAXBUF);
+	for (uint32_t i = 0; i < s->nbuf; ++i)
+	{
+		void * data = NULL;
+		int r = posix_memalign (&data, CSC_FILE_STREAM_ALIGN, s->chunk);
+		ASSERTF (r == 0, "posix_memalign %zu bytes", s->chunk);
+		s->buf[i].data = data;
+	}
+	pthread_mutex_init (&s->mutex, NULL);
+	pthread_cond_init (&s->cond_full, NULL);
+	pthread_cond_init (&s->cond_free, NULL);
+	int r = pthread_create (&s->thread, NULL, csc_file_stream_thread, s);
+	ASSERTF (r == 0, "pthread_create %i", r);
+	return 0;
+}
+
+
+static void csc_file_stream_release (struct csc_file_stream * s)
+{
+	if (s->holding == 0) {return;}
+	pthread_mutex_lock (&s->mutex);
+	s->buf[s->current].full = 0;
+	pthread_cond_signal (&s->cond_free);
+	pthread_mutex_unlock (&s->mutex);
+	s->current = (s->current + 1) % s->nbuf;
+	s->holding = 0;
+}
+
+
+/**
+ * @brief Get the next chunk, the previous chunk is given back to the reader
+ * @param len Length of the chunk
+ * @return The chunk or NULL at end of file
+ */
+static char const * csc_file_stream_next (struct csc_file_stream * s, size_t * len)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	ASSERT_PARAM_NOTNULL (len);
+	csc_file_stream_release (s);
+	*len = 0;
+	if (s->eof) {return NULL;}
+	struct csc_file_stream_buf * b = s->buf + s->current;
+	pthread_mutex_lock (&s->mutex);
+	while (b->full == 0)
+	{
+		pthread_cond_wait (&s->cond_full, &s->mutex);
+	}
+	pthread_mutex_unlock (&s->mutex);
+	s->holding = 1;
+	s->eof = b->eof;
+	if (b->len == 0)
+	{
+		csc_file_stream_release (s);
+		return NULL;
+	}
+	*len = b->len;
+	return b->data;
+}
+
+
+static void csc_file_stream_carry (struct csc_file_stream * s, char const * p, size_t n)
+{
+	if (s->carry_len + n > s->carry_cap)
+	{
+		s->carry_cap = MAX (s->carry_len + n, s->carry_cap * 2);
+		s->carry = realloc (s->carry, s->carry_cap);
+		ASSERTF (s->carry != NULL, "realloc %zu bytes", s->carry_cap);
+	}
+	memcpy (s->carry + s->carry_len, p, n);
+	s->carry_len += n;
+}
+
+
+/**
+ * @brief Get the next record terminated by (sep), the separator is not included
+ * The record is valid until the next call.
+ * The last record does not need to be terminated.
+ * @return 1 when a record is returned, 0 at end of file
+ */
+static int csc_file_stream_record (struct csc_file_stream * s, char sep, char const ** rec, size_t * len)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	ASSERT_PARAM_NOTNULL (rec);
+	ASSERT_PARAM_NOTNULL (len);
+	s->carry_len = 0;
+	int carrying = 0;
+	while (1)
+	{
+		if (s->p < s->e)
+		{
+			char const * q = memchr (s->p, sep, (size_t)(s->e - s->p));
+			if (q)
+			{
+				if (carrying)
+				{
+					csc_file_stream_carry (s, s->p, (size_t)(q - s->p));
+					*rec = s->carry;
+					*len = s->carry_len;
+				}
+				else
+				{
+					*rec = s->p;
+					*len = (size_t)(q - s->p);
+				}
+				s->p = q + 1;
+				return 1;
+			}
+			//The record continues in the next chunk:
+			csc_file_stream_carry (s, s->p, (size_t)(s->e - s->p));
+			carrying = 1;
+		}
+		size_t n;
+		char const * chunk = csc_file_stream_next (s, &n);
+		if (chunk == NULL)
+		{
+			s->p = NULL;
+			s->e = NULL;
+			if (carrying == 0) {return 0;}
+			*rec = s->carry;
+			*len = s->carry_len;
+			return 1;
+		}
+		s->p = chunk;
+		s->e = chunk + n;
+	}
+}
+
+
+static void csc_file_stream_close (struct csc_file_stream * s)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	pthread_mutex_lock (&s->mutex);
+	s->quit = 1;
+	pthread_cond_signal (&s->cond_free);
+	pthread_mutex_unlock (&s->mutex);
+	pthread_join (s->thread, NULL);
+	pthread_mutex_destroy (&s->mutex);
+	pthread_cond_destroy (&s->cond_full);
+	pthread_cond_destroy (&s->cond_free);
+	for (uint32_t i = 0; i < s->nbuf; ++i)
+	{
+		free (s->buf[i].data);
+	}
+	free (s->carry);
+	close (s->fd);
+	memset (s, 0, sizeof (struct csc_file_stream));
+	s->fd = -1;
+}
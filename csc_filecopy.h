@@ -5,12 +5,236 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#include "csc_basic.h"
+#include "csc_assert.h"
 
-static void csc_filecopy_tofolder (char const * filename, char const * destination_folder)
+
+/*
+In-process file copy.
+The fastest available method is tried first and the next one is used when the
+method is not supported for the pair of files:
+1. copy_file_range, copies inside the kernel and shares extents (reflink) on filesystems that supports it.
+2. sendfile, copies inside the kernel.
+3. read and write through a user space buffer.
+*/
+#define CSC_FILECOPY_BUFSIZE (1 << 20)
+#define CSC_FILECOPY_MAXTHREADS 32
+
+
+static int csc_filecopy_unsupported (int e)
+{
+	return (e == ENOSYS) || (e == EXDEV) || (e == EINVAL) || (e == EOPNOTSUPP) || (e == EBADF);
+}
+
+
+/**
+ * @brief Copy (size) bytes from (src) to (dst), the file offsets are advanced
+ * @return Number of bytes copied or -1 on error
+ */
+static int64_t csc_filecopy_fd (int dst, int src, int64_t size)
+{
+	int64_t copied = 0;
+#if defined(__linux__)
+#if defined(__NR_copy_file_range)
+	//Called through syscall() as the libc wrapper requires _GNU_SOURCE:
+	while (copied < size)
+	{
+		ssize_t r = syscall (__NR_copy_file_range, src, NULL, dst, NULL, (size_t)(size - copied), 0);
+		if (r < 0 && errno == EINTR) {continue;}
+		if (r < 0 && csc_filecopy_unsupported (errno) && copied == 0) {break;}
+		if (r < 0) {return -1;}
+		//The file shrunk:
+		if (r == 0) {return copied;}
+		copied += r;
+	}
+#endif
+	while (copied < size)
+	{
+		ssize_t r = sendfile (dst, src, NULL, (size_t)(size - copied));
+		if (r < 0 && errno == EINTR) {continue;}
+		if (r < 0 && csc_filecopy_unsupported (errno) && copied == 0) {break;}
+		if (r < 0) {return -1;}
+		if (r == 0) {return copied;}
+		copied += r;
+	}
+	//Files in /proc reports size 0 and are copied through the buffer:
+	if (size > 0 && copied == size) {return copied;}
+#endif
+	char * buf = malloc (CSC_FILECOPY_BUFSIZE);
+	ASSERTF (buf != NULL, "malloc %i bytes", CSC_FILECOPY_BUFSIZE);
+	while (1)
+	{
+		ssize_t r = read (src, buf, CSC_FILECOPY_BUFSIZE);
+		if (r < 0 && errno == EINTR) {continue;}
+		if (r < 0) {copied = -1; break;}
+		if (r == 0) {break;}
+		ssize_t w = 0;
+		while (w < r)
+		{
+			ssize_t n = write (dst, buf + w, (size_t)(r - w));
+			if (n < 0 && errno == EINTR) {continue;}
+			if (n < 0) {break;}
+			w += n;
+		}
+		if (w < r) {copied = -1; break;}
+		copied += r;
+	}
+	free (buf);
+	return copied;
+}
+
+
+/**
+ * @brief Copy file (src) to (dst), (dst) is replaced and gets the permissions of (src)
+ * @return Number of bytes copied or -1 on error, copying a file onto itself is an error
+ */
+static int64_t csc_filecopy (char const * src, char const * dst)
+{
+	ASSERT_PARAM_NOTNULL (src);
+	ASSERT_PARAM_NOTNULL (dst);
+	int fsrc = open (src, O_RDONLY | O_CLOEXEC);
+	if (fsrc < 0) {return -1;}
+	struct stat st;
+	if (fstat (fsrc, &st) != 0)
+	{
+		close (fsrc);
+		return -1;
+	}
+	//Truncated after checking that (dst) is not (src):
+	int fdst = open (dst, O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 0777);
+	if (fdst < 0)
+	{
+		close (fsrc);
+		return -1;
+	}
+	struct stat sd;
+	if ((fstat (fdst, &sd) != 0) || ((sd.st_dev == st.st_dev) && (sd.st_ino == st.st_ino)) || (ftruncate (fdst, 0) != 0) || (fchmod (fdst, st.st_mode & 0777) != 0))
+	{
+		close (fsrc);
+		close (fdst);
+		return -1;
+	}
+	int64_t r = csc_filecopy_fd (fdst, fsrc, (int64_t) st.st_size);
+	close (fsrc);
+	if (close (fdst) != 0) {r = -1;}
+	return r;
+}
+
+
+/**
+ * @brief Copy (filename) to (destination_folder)/(filename)
+ * @return Number of bytes copied or -1 on error
+ */
+static int64_t csc_filecopy_tofolder (char const * filename, char const * destination_folder)
+{
+	ASSERT_PARAM_NOTNULL (filename);
+	ASSERT_PARAM_NOTNULL (destination_folder);
+	size_t n = strlen (filename) + strlen (destination_folder) + 2;
+	char * dst = malloc (n);
+	ASSERTF (dst != NULL, "malloc %zu bytes", n);
+	snprintf (dst, n, "%s/%s", destination_folder, filename);
+	int64_t r = csc_filecopy (filename, dst);
+	free (dst);
+	return r;
+}
+
+
+
+
+struct csc_filecopy_job
+{
+	char const * src;
+	char const * dst;
+	//Number of bytes copied or -1 on error:
+	int64_t result;
+};
+
+
+struct csc_filecopy_stats
+{
+	uint32_t files;
+	uint32_t errors;
+	uint64_t bytes;
+	double seconds;
+	//Bytes per second:
+	double throughput;
+};
+
+
+struct csc_filecopy_batch_ctx
+{
+	struct csc_filecopy_job * jobs;
+	uint32_t n;
+	uint32_t next;
+};
+
+
+static void * csc_filecopy_batch_thread (void * arg)
+{
+	struct csc_filecopy_batch_ctx * ctx = arg;
+	while (1)
+	{
+		uint32_t i = __atomic_fetch_add (&ctx->next, 1, __ATOMIC_RELAXED);
+		if (i >= ctx->n) {break;}
+		ctx->jobs[i].result = csc_filecopy (ctx->jobs[i].src, ctx->jobs[i].dst);
+	}
+	return NULL;
+}
+
+
+/**
+ * @brief Copy many files in parallel, the threads takes the next job from a shared counter
+ * @param stats Optional, receives total bytes, time and throughput
+ * @return Number of failed jobs
+ */
+static uint32_t csc_filecopy_batch (struct csc_filecopy_job jobs[], uint32_t n, uint32_t nthreads, struct csc_filecopy_stats * stats)
 {
-	char buf[100];
-	snprintf (buf, sizeof (buf), "cp %s %s/%s", filename, destination_folder, filename);
-	//printf ("%s\n", buf);
-	FILE * f = popen (buf, "r");
-	pclose (f);
+	ASSERT_PARAM_NOTNULL (jobs);
+	struct timespec t0, t1;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	struct csc_filecopy_batch_ctx ctx = {jobs, n, 0};
+	pthread_t threads[CSC_FILECOPY_MAXTHREADS];
+	nthreads = CLAMP (nthreads, 1, CSC_FILECOPY_MAXTHREADS);
+	nthreads = MIN (nthreads, MAX (n, 1));
+	//The calling thread is one of the workers:
+	for (uint32_t i = 1; i < nthreads; ++i)
+	{
+		int r = pthread_create (threads + i, NULL, csc_filecopy_batch_thread, &ctx);
+		ASSERTF (r == 0, "pthread_create %i", r);
+	}
+	csc_filecopy_batch_thread (&ctx);
+	for (uint32_t i = 1; i < nthreads; ++i)
+	{
+		pthread_join (threads[i], NULL);
+	}
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	uint32_t errors = 0;
+	uint64_t bytes = 0;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		if (jobs[i].result < 0) {errors++;}
+		else {bytes += (uint64_t) jobs[i].result;}
+	}
+	if (stats)
+	{
+		stats->files = n;
+		stats->errors = errors;
+		stats->bytes = bytes;
+		stats->seconds = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+		stats->throughput = stats->seconds > 0 ? (double)bytes / stats->seconds : 0;
+	}
+	return errors;
 }
@@ -31,32 +31,35 @@ void csc_gl_infolog_fput (GLuint shader, FILE * f)
 }
 
 
-GLint csc_gl_shader_from_file (char const * filename)
+GLenum csc_gl_shader_type (char const * filename)
 {
 	ASSERT (filename);
-	GLuint shader;
 	char const * ext = strrchr (filename, '.');
 	if (ext == NULL)
 	{
-		return -1;
+		return 0;
 	}
 	ext++;
 	if (strlen (ext) != 4)
 	{
-		return -1;
+		return 0;
 	}
 	switch (STR4_U32_LE (ext))
 	{
 	case U8_U32_LE ('g', 'l', 'v', 's'):
-		shader = glCreateShader (GL_VERTEX_SHADER);
-		break;
+		return GL_VERTEX_SHADER;
 	case U8_U32_LE ('g', 'l', 'f', 's'):
-		shader = glCreateShader (GL_FRAGMENT_SHADER);
-		break;
+		return GL_FRAGMENT_SHADER;
 	default:
-		return -1;
+		return 0;
 	}
-	char const * source = csc_malloc_file (filename);
+}
+
+
+GLint csc_gl_shader_from_source (GLenum type, char const * source)
+{
+	ASSERT (source);
+	GLuint shader = glCreateShader (type);
 	glShaderSource (shader, 1, (const GLchar **)&source, NULL);
 	glCompileShader (shader);
 	GLint status;
@@ -71,6 +74,26 @@ GLint csc_gl_shader_from_file (char const * filename)
 }
 
 
+GLint csc_gl_shader_from_file (char const * filename)
+{
+	ASSERT (filename);
+	GLenum type = csc_gl_shader_type (filename);
+	if (type == 0)
+	{
+		return -1;
+	}
+	struct csc_file_view view;
+	if (csc_file_view_open (&view, filename, 0) != 0)
+	{
+		fprintf (stderr, "can not open file '%s'\n", filename);
+		return -1;
+	}
+	GLint shader = csc_gl_shader_from_source (type, view.data);
+	csc_file_view_close (&view);
+	return shader;
+}
+
+
 GLint csc_gl_program_from_files (char const * filenames[])
 {
 	GLint program = glCreateProgram();
@@ -88,30 +111,14 @@ GLint csc_gl_program_from_files (char const * filenames[])
 
 
 #define CSC_GL_PROGRAM_FROM_FILES1_MAXFILENAME 128
-GLint csc_gl_program_from_files1 (char const * filenames)
+
+
+/**
+ * @brief Link (program) and print the link log
+ * @return The program or 0 if linking failed
+ */
+GLint csc_gl_program_link (GLint program)
 {
-	char buffer[CSC_GL_PROGRAM_FROM_FILES1_MAXFILENAME];
-	GLint program = glCreateProgram();
-	GLint shader;
-	while (1)
-	{
-		char * e = strchr (filenames, ';');
-		if (e)
-		{
-			int l = e - filenames;
-			memcpy (buffer, filenames, l);
-			buffer[l] = '\0';
-			shader = csc_gl_shader_from_file (buffer);
-			glAttachShader (program, shader);
-			filenames = e + 1;
-		}
-		else
-		{
-			shader = csc_gl_shader_from_file (filenames);
-			glAttachShader (program, shader);
-			break;
-		}
-	}
 	GLint logLength;
 	GLint status;
 	glLinkProgram (program);
@@ -126,7 +133,7 @@ GLint csc_gl_program_from_files1 (char const * filenames)
 		free(log);
 	}
 
-	glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+	glGetProgramiv (program, GL_LINK_STATUS, &status);
 	if (status == 0 )
 	{
 		return 0;
@@ -135,6 +142,30 @@ GLint csc_gl_program_from_files1 (char const * filenames)
 }
 
 
+/**
+ * @brief Create a program from a ';' separated list of shader files
+ * csc_gl_async.h loads the shader files of many programs in one batch.
+ */
+GLint csc_gl_program_from_files1 (char const * filenames)
+{
+	char buffer[CSC_GL_PROGRAM_FROM_FILES1_MAXFILENAME];
+	GLint program = glCreateProgram();
+	while (1)
+	{
+		char const * e = strchr (filenames, ';');
+		int l = e ? (int)(e - filenames) : (int)strlen (filenames);
+		ASSERT (l < CSC_GL_PROGRAM_FROM_FILES1_MAXFILENAME);
+		memcpy (buffer, filenames, l);
+		buffer[l] = '\0';
+		GLint shader = csc_gl_shader_from_file (buffer);
+		glAttachShader (program, shader);
+		if (e == NULL) {break;}
+		filenames = e + 1;
+	}
+	return csc_gl_program_link (program);
+}
+
+
 
 
 
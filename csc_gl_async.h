@@ -0,0 +1,108 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include "csc_gl.h"
+#include "csc_file_async.h"
+
+
+/*
+Shader programs loaded through csc_file_async.h.
+The shader files of any number of programs are submitted to one loader, so the reads of all
+programs are in flight together and the caller can do other work until it polls the loader.
+Each shader is compiled by the callback as soon as its file is loaded, the callbacks
+run in the thread that calls csc_file_async_poll() which must have the GL context current.
+A program is linked by csc_gl_async_program_link() after all of its files are loaded.
+
+Example:
+struct csc_file_async io;
+struct csc_gl_async_program p[2];
+csc_file_async_init (&io, CSC_FILE_ASYNC_URING, 16, 4);
+csc_gl_async_program_submit (p + 0, &io, "a.glvs;a.glfs");
+csc_gl_async_program_submit (p + 1, &io, "b.glvs;b.glfs");
+//Other work...
+csc_file_async_wait (&io);
+GLint a = csc_gl_async_program_link (p + 0);
+GLint b = csc_gl_async_program_link (p + 1);
+csc_file_async_free (&io);
+*/
+#define CSC_GL_ASYNC_MAXFILES 16
+
+
+struct csc_gl_async_program
+{
+	GLint program;
+	//Set when a file could not be loaded or a shader did not compile:
+	int error;
+	//Number of files and number of files whose callback has run:
+	uint32_t n;
+	uint32_t loaded;
+	char filename[CSC_GL_ASYNC_MAXFILES][CSC_GL_PROGRAM_FROM_FILES1_MAXFILENAME];
+	struct csc_file_async_req req[CSC_GL_ASYNC_MAXFILES];
+};
+
+
+static void csc_gl_async_program_cb (struct csc_file_async_req * req, void * ptr)
+{
+	struct csc_gl_async_program * p = ptr;
+	p->loaded ++;
+	if (req->error)
+	{
+		fprintf (stderr, "can not open file '%s'\n", req->filename);
+		p->error = 1;
+		return;
+	}
+	GLenum type = csc_gl_shader_type (req->filename);
+	if (type != 0)
+	{
+		GLint shader = csc_gl_shader_from_source (type, req->data);
+		if (shader < 0) {p->error = 1;}
+		else {glAttachShader (p->program, shader);}
+	}
+	free (req->data);
+	req->data = NULL;
+}
+
+
+/**
+ * @brief Create a program and submit reads of its ';' separated list of shader files to (io)
+ * @param p Must stay alive until all of its requests are returned by csc_file_async_poll
+ */
+static void csc_gl_async_program_submit (struct csc_gl_async_program * p, struct csc_file_async * io, char const * filenames)
+{
+	ASSERT_PARAM_NOTNULL (p);
+	ASSERT_PARAM_NOTNULL (io);
+	ASSERT_PARAM_NOTNULL (filenames);
+	memset (p, 0, sizeof (struct csc_gl_async_program));
+	p->program = glCreateProgram();
+	while (1)
+	{
+		ASSERTF (p->n < CSC_GL_ASYNC_MAXFILES, "More than %i shader files in '%s'", CSC_GL_ASYNC_MAXFILES, filenames);
+		char const * e = strchr (filenames, ';');
+		int l = e ? (int)(e - filenames) : (int)strlen (filenames);
+		ASSERT (l < CSC_GL_PROGRAM_FROM_FILES1_MAXFILENAME);
+		memcpy (p->filename[p->n], filenames, l);
+		p->filename[p->n][l] = '\0';
+		p->req[p->n].filename = p->filename[p->n];
+		p->req[p->n].cb = csc_gl_async_program_cb;
+		p->req[p->n].ptr = p;
+		p->n ++;
+		if (e == NULL) {break;}
+		filenames = e + 1;
+	}
+	csc_file_async_submit (io, p->req, p->n);
+}
+
+
+/**
+ * @brief Link the program after all of its files are loaded
+ * @return The program or 0 if a file, a shader or the link failed
+ */
+static GLint csc_gl_async_program_link (struct csc_gl_async_program * p)
+{
+	ASSERT_PARAM_NOTNULL (p);
+	ASSERTF (p->loaded == p->n, "%i of %i shader files loaded", p->loaded, p->n);
+	if (p->error) {return 0;}
+	return csc_gl_program_link (p->program);
+}
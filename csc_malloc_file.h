@@ -8,6 +8,16 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include <stdio.h> //fopen
 #include <string.h> //memset
 #include <stdlib.h> //malloc
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h> //open
+#if defined(WIN32)
+#include <io.h>
+#else
+#include <unistd.h> //read
+#include <sys/stat.h> //fstat
+#include <sys/mman.h> //mmap
+#endif
 
 static char * csc_malloc_file (char const * filename)
 {
@@ -23,8 +33,7 @@ static char * csc_malloc_file (char const * filename)
 	ASSERT (r == 0);
 	char * buffer = (char *) malloc ((unsigned) length + 1);
 	ASSERTF (buffer != NULL, "buffer is NULL%s", "");
-	memset (buffer, 0, (unsigned) length + 1);
-	//buffer [length + 1] = 0;
+	buffer [length] = 0;
 	if (length > 0)
 	{
 		size_t n = fread (buffer, (unsigned) length, 1, file);
@@ -55,8 +64,7 @@ static char * csc_malloc_file_ab (char const * a, char const * b)
 	ASSERT (r == 0);
 	char * buffer = (char *) malloc ((unsigned) length + 1);
 	ASSERTF (buffer != NULL, "buffer is NULL%s", "");
-	memset (buffer, 0, (unsigned) length + 1);
-	//buffer [length + 1] = 0;
+	buffer [length] = 0;
 	if (length > 0)
 	{
 		size_t n = fread (buffer, (unsigned) length, 1, file);
@@ -81,8 +89,7 @@ static char * csc_malloc_file1 (char const * filename, long * length)
 	ASSERT (r == 0);
 	char * buffer = (char *) malloc ((unsigned) (*length) + 1);
 	ASSERTF (buffer != NULL, "buffer is NULL%s", "");
-	memset (buffer, 0, (unsigned) (*length) + 1);
-	//buffer [length + 1] = 0;
+	buffer [*length] = 0;
 	if (*length > 0)
 	{
 		size_t n = fread (buffer, (unsigned) (*length), 1, file);
@@ -91,3 +98,160 @@ static char * csc_malloc_file1 (char const * filename, long * length)
 	fclose (file);
 	return buffer;
 }
+
+
+
+
+/*
+File view.
+A regular file is mapped read/write copy-on-write with mmap, the file is never copied.
+The mapping is one page larger than needed so data[size] is always a NUL sentinel:
+an anonymous zero mapping is reserved first and the file is mapped over the start of it.
+Pipes, character devices, empty files and platforms without mmap
+fall back to reading into a malloc buffer.
+*/
+#define CSC_FILE_VIEW_POPULATE 0x01 //Prefault all pages (MAP_POPULATE)
+#define CSC_FILE_VIEW_SEQUENTIAL 0x02 //Aggressive read-ahead (MADV_SEQUENTIAL)
+
+
+struct csc_file_view
+{
+	char * data;
+	size_t size;
+	//Unmap handle, 0 when (data) is a malloc buffer:
+	size_t mapsize;
+};
+
+
+static int csc_file_view_read (struct csc_file_view * view, int fd, size_t hint)
+{
+	size_t cap = MAX (hint + 1, 4096);
+	size_t n = 0;
+	char * data = malloc (cap);
+	if (data == NULL) {return -1;}
+	while (1)
+	{
+		if (n + 1 >= cap)
+		{
+			cap *= 2;
+			char * d = realloc (data, cap);
+			if (d == NULL) {free (data); return -1;}
+			data = d;
+		}
+#if defined(WIN32)
+		int r = _read (fd, data + n, (unsigned)(cap - n - 1));
+#else
+		ssize_t r = read (fd, data + n, cap - n - 1);
+#endif
+		if (r < 0)
+		{
+			if (errno == EINTR) {continue;}
+			free (data);
+			return -1;
+		}
+		if (r == 0) {break;}
+		n += (size_t) r;
+	}
+	data[n] = 0;
+	view->data = data;
+	view->size = n;
+	view->mapsize = 0;
+	return 0;
+}
+
+
+#if !defined(WIN32)
+static int csc_file_view_map (struct csc_file_view * view, int fd, size_t size, int flags)
+{
+	size_t page = (size_t) sysconf (_SC_PAGESIZE);
+	size_t filemap = (size + page - 1) & ~(page - 1);
+	//At least one zero byte after the file content:
+	size_t mapsize = (size + 1 + page - 1) & ~(page - 1);
+	char * base = mmap (NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {return -1;}
+	int mflags = MAP_PRIVATE | MAP_FIXED;
+#if defined(MAP_POPULATE)
+	if (flags & CSC_FILE_VIEW_POPULATE) {mflags |= MAP_POPULATE;}
+#endif
+	char * data = mmap (base, filemap, PROT_READ | PROT_WRITE, mflags, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		munmap (base, mapsize);
+		return -1;
+	}
+	if (flags & CSC_FILE_VIEW_SEQUENTIAL)
+	{
+		madvise (data, filemap, MADV_SEQUENTIAL);
+	}
+	view->data = data;
+	view->size = size;
+	view->mapsize = mapsize;
+	return 0;
+}
+#endif
+
+
+/**
+ * @brief Open a NUL terminated view of the content of a file
+ * @param flags CSC_FILE_VIEW_POPULATE, CSC_FILE_VIEW_SEQUENTIAL
+ * @return 0 on success, -1 on error
+ */
+static int csc_file_view_open_fd (struct csc_file_view * view, int fd, int flags)
+{
+	ASSERT_PARAM_NOTNULL (view);
+	memset (view, 0, sizeof (struct csc_file_view));
+#if defined(WIN32)
+	UNUSED (flags);
+	return csc_file_view_read (view, fd, 0);
+#else
+	struct stat st;
+	if (fstat (fd, &st) != 0) {return -1;}
+	if (S_ISREG (st.st_mode) && st.st_size > 0)
+	{
+		if (csc_file_view_map (view, fd, (size_t) st.st_size, flags) == 0) {return 0;}
+		return csc_file_view_read (view, fd, (size_t) st.st_size);
+	}
+	return csc_file_view_read (view, fd, 0);
+#endif
+}
+
+
+static int csc_file_view_open (struct csc_file_view * view, char const * filename, int flags)
+{
+	ASSERT_PARAM_NOTNULL (view);
+	ASSERT_PARAM_NOTNULL (filename);
+#if defined(WIN32)
+	int fd = _open (filename, _O_RDONLY | _O_BINARY);
+#else
+	int fd = open (filename, O_RDONLY | O_CLOEXEC);
+#endif
+	if (fd < 0)
+	{
+		memset (view, 0, sizeof (struct csc_file_view));
+		return -1;
+	}
+	int r = csc_file_view_open_fd (view, fd, flags);
+#if defined(WIN32)
+	_close (fd);
+#else
+	close (fd);
+#endif
+	return r;
+}
+
+
+static void csc_file_view_close (struct csc_file_view * view)
+{
+	ASSERT_PARAM_NOTNULL (view);
+#if !defined(WIN32)
+	if (view->mapsize)
+	{
+		munmap (view->data, view->mapsize);
+	}
+	else
+#endif
+	{
+		free (view->data);
+	}
+	memset (view, 0, sizeof (struct csc_file_view));
+}
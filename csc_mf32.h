@@ -7,21 +7,36 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include <stdint.h>
 #include "csc_math.h"
 #include "csc_vf32.h"
+#include "csc_strfrom.h"
+#include "csc_sink.h"
 
 
 
-static void mf32_print (float const m[], unsigned rn, unsigned cn, FILE * f)
+static void mf32_print_sink (float const m[], unsigned rn, unsigned cn, struct csc_sink * sink)
 {
+	//Shortest round-trip strings differ in length, right align all elements to the longest possible string:
+	uint32_t const need = STRFROM_F32_SIZE + 2;
 	for (unsigned r = 0; r < rn; ++ r)
 	{
 		for (unsigned c = 0; c < cn; ++ c)
 		{
-			//double v = m [c*rn+r];
-			fprintf (f, "%+10.3f ", (double) m [c*rn+r]);
+			char * o = csc_sink_reserve (sink, need);
+			ASSERT (o != NULL);
+			csc_sink_commit (sink, strfrom_vf32 (o, need, m + (c*rn+r), 1, rn, STRFROM_F32_WIDTH, '+', ' '));
 		}
-		fprintf (f, "\n");
+		csc_sink_putc (sink, '\n');
 	}
-	fprintf (f, "\n");
+	csc_sink_putc (sink, '\n');
+}
+
+
+static void mf32_print (float const m[], unsigned rn, unsigned cn, FILE * f)
+{
+	char buf [4096];
+	struct csc_sink sink;
+	csc_sink_init_file (&sink, buf, sizeof (buf), f);
+	mf32_print_sink (m, rn, cn, &sink);
+	csc_sink_flush (&sink);
 	fflush (f);
 }
 
@@ -0,0 +1,207 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+
+
+/*
+Thread pool with a parallel for loop.
+The index range [0, n) is split statically into one contiguous part per thread,
+the calling thread runs part 0 and the pool threads runs the other parts.
+The split points are multiples of (grain) after adding (skew),
+e.g. grain 16 and skew (address / 4 % 16) of a float array puts every split on a 64 byte cache line boundary
+so two threads never write the same cache line.
+Loops smaller than (nthreads * CSC_PARALLEL_MINPART) uses fewer threads.
+A NULL pool runs the loop in the calling thread.
+*/
+#define CSC_PARALLEL_MAXTHREADS 64
+#define CSC_PARALLEL_MINPART 16384
+#define CSC_PARALLEL_CACHELINE 64
+
+
+/**
+ * @brief Body of a parallel loop
+ * @param ptr User pointer
+ * @param a First index
+ * @param b One past the last index
+ * @param part Part number, 0 <= part < csc_parallel_parts()
+ */
+typedef void (*csc_parallel_fn) (void * ptr, size_t a, size_t b, uint32_t part);
+
+
+struct csc_parallel;
+
+
+struct csc_parallel_thread
+{
+	struct csc_parallel * pool;
+	uint32_t index;
+	pthread_t thread;
+};
+
+
+struct csc_parallel
+{
+	uint32_t nthreads;
+	struct csc_parallel_thread threads[CSC_PARALLEL_MAXTHREADS];
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_start;
+	pthread_cond_t cond_done;
+	uint32_t generation;
+	uint32_t running;
+	int quit;
+	//The current loop:
+	csc_parallel_fn fn;
+	void * ptr;
+	size_t n;
+	size_t grain;
+	size_t skew;
+	uint32_t parts;
+};
+
+
+/**
+ * @brief Start of part (i) of (parts)
+ */
+static size_t csc_parallel_split (size_t n, size_t grain, size_t skew, uint32_t parts, uint32_t i)
+{
+	if (i == 0) {return 0;}
+	if (i >= parts) {return n;}
+	size_t x = n / parts * i + n % parts * i / parts;
+	x = (x + skew) / grain * grain;
+	x = (x > skew) ? x - skew : 0;
+	return MIN (x, n);
+}
+
+
+/**
+ * @brief Number of parts a loop of (n) is split into
+ */
+static uint32_t csc_parallel_parts (struct csc_parallel const * p, size_t n)
+{
+	if (p == NULL) {return 1;}
+	size_t parts = MAX (n / CSC_PARALLEL_MINPART, 1);
+	return (uint32_t) MIN (parts, (size_t)p->nthreads);
+}
+
+
+static void csc_parallel_run (struct csc_parallel * p, uint32_t part)
+{
+	size_t a = csc_parallel_split (p->n, p->grain, p->skew, p->parts, part);
+	size_t b = csc_parallel_split (p->n, p->grain, p->skew, p->parts, part + 1);
+	if (a < b) {p->fn (p->ptr, a, b, part);}
+}
+
+
+static void * csc_parallel_thread_main (void * arg)
+{
+	struct csc_parallel_thread * t = arg;
+	struct csc_parallel * p = t->pool;
+	uint32_t seen = 0;
+	pthread_mutex_lock (&p->mutex);
+	while (1)
+	{
+		while (p->generation == seen && p->quit == 0)
+		{
+			pthread_cond_wait (&p->cond_start, &p->mutex);
+		}
+		if (p->quit) {break;}
+		seen = p->generation;
+		pthread_mutex_unlock (&p->mutex);
+		if (t->index < p->parts)
+		{
+			csc_parallel_run (p, t->index);
+		}
+		pthread_mutex_lock (&p->mutex);
+		p->running--;
+		if (p->running == 0)
+		{
+			pthread_cond_signal (&p->cond_done);
+		}
+	}
+	pthread_mutex_unlock (&p->mutex);
+	return NULL;
+}
+
+
+/**
+ * @param nthreads Number of threads including the calling thread
+ */
+static void csc_parallel_init (struct csc_parallel * p, uint32_t nthreads)
+{
+	ASSERT_PARAM_NOTNULL (p);
+	memset (p, 0, sizeof (struct csc_parallel));
+	p->nthreads = CLAMP (nthreads, 1, CSC_PARALLEL_MAXTHREADS);
+	pthread_mutex_init (&p->mutex, NULL);
+	pthread_cond_init (&p->cond_start, NULL);
+	pthread_cond_init (&p->cond_done, NULL);
+	for (uint32_t i = 1; i < p->nthreads; ++i)
+	{
+		p->threads[i].pool = p;
+		p->threads[i].index = i;
+		int r = pthread_create (&p->threads[i].thread, NULL, csc_parallel_thread_main, p->threads + i);
+		ASSERTF (r == 0, "pthread_create %i", r);
+	}
+}
+
+
+static void csc_parallel_free (struct csc_parallel * p)
+{
+	ASSERT_PARAM_NOTNULL (p);
+	pthread_mutex_lock (&p->mutex);
+	p->quit = 1;
+	pthread_cond_broadcast (&p->cond_start);
+	pthread_mutex_unlock (&p->mutex);
+	for (uint32_t i = 1; i < p->nthreads; ++i)
+	{
+		pthread_join (p->threads[i].thread, NULL);
+	}
+	pthread_mutex_destroy (&p->mutex);
+	pthread_cond_destroy (&p->cond_start);
+	pthread_cond_destroy (&p->cond_done);
+	memset (p, 0, sizeof (struct csc_parallel));
+}
+
+
+/**
+ * @brief Run fn (ptr, a, b, part) over [0, n) split into csc_parallel_parts (p, n) parts
+ * Returns when all parts are done. Only one thread at a time may start loops on a pool.
+ * @param grain Split points are multiples of (grain) after adding (skew)
+ */
+static void csc_parallel_for (struct csc_parallel * p, size_t n, size_t grain, size_t skew, csc_parallel_fn fn, void * ptr)
+{
+	ASSERT_PARAM_NOTNULL (fn);
+	ASSERT (grain > 0);
+	uint32_t parts = csc_parallel_parts (p, n);
+	if (parts <= 1)
+	{
+		if (n > 0) {fn (ptr, 0, n, 0);}
+		return;
+	}
+	pthread_mutex_lock (&p->mutex);
+	p->fn = fn;
+	p->ptr = ptr;
+	p->n = n;
+	p->grain = grain;
+	p->skew = skew % grain;
+	p->parts = parts;
+	//Every pool thread acknowledges the loop, also threads without a part:
+	p->running = p->nthreads - 1;
+	p->generation++;
+	pthread_cond_broadcast (&p->cond_start);
+	pthread_mutex_unlock (&p->mutex);
+	csc_parallel_run (p, 0);
+	pthread_mutex_lock (&p->mutex);
+	while (p->running > 0)
+	{
+		pthread_cond_wait (&p->cond_done, &p->mutex);
+	}
+	pthread_mutex_unlock (&p->mutex);
+}
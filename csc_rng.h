@@ -0,0 +1,257 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+
+
+/*
+Seedable and splittable pseudo random number generator.
+CSC_RNG_LANES independent xoshiro128++ generators are stepped together,
+the state is stored lane by lane so the step loop is vectorized by the compiler.
+Lane (i) starts (i) jumps of 2^64 steps after lane 0.
+csc_rng_split() seeds a new generator from 64 bits of output of the parent, so splits of splits
+and splits after any number of draws all start at independent points of the 2^128 period.
+Streams of length L from N splits overlap with probability about N^2 * L / 2^128.
+The output order only depends on the seed and the sequence of draws and splits, not on the CPU.
+
+csc_rng_default() is a per thread generator used by vf32_random() and friends.
+Thread number (k) gets the generator seeded by csc_rng_stream_seed (seed, k),
+a different seed domain than splits, so a split of one thread's default generator
+does not repeat the default generator of another thread.
+*/
+#define CSC_RNG_LANES 16
+
+
+struct csc_rng
+{
+	uint32_t s0[CSC_RNG_LANES];
+	uint32_t s1[CSC_RNG_LANES];
+	uint32_t s2[CSC_RNG_LANES];
+	uint32_t s3[CSC_RNG_LANES];
+	//Output buffer for single values and tails of batches:
+	uint32_t buf[CSC_RNG_LANES];
+	uint32_t pos;
+};
+
+
+static uint64_t csc_rng_splitmix64 (uint64_t * x)
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+
+static inline uint32_t csc_rng_rotl (uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+
+/**
+ * @brief Step all lanes and write one output per lane
+ */
+static void csc_rng_step (struct csc_rng * restrict r, uint32_t * restrict out)
+{
+	for (uint32_t i = 0; i < CSC_RNG_LANES; ++i)
+	{
+		uint32_t s0 = r->s0[i];
+		uint32_t s1 = r->s1[i];
+		uint32_t s2 = r->s2[i];
+		uint32_t s3 = r->s3[i];
+		out[i] = csc_rng_rotl (s0 + s3, 7) + s0;
+		uint32_t t = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = csc_rng_rotl (s3, 11);
+		r->s0[i] = s0;
+		r->s1[i] = s1;
+		r->s2[i] = s2;
+		r->s3[i] = s3;
+	}
+}
+
+
+/**
+ * @brief Advance lane (i) by the jump polynomial (jump)
+ */
+static void csc_rng_jump_lane (struct csc_rng * r, uint32_t i, uint32_t const jump[4])
+{
+	uint32_t a[4] = {0};
+	for (uint32_t j = 0; j < 4; ++j)
+	for (uint32_t b = 0; b < 32; ++b)
+	{
+		if (jump[j] & (UINT32_C(1) << b))
+		{
+			a[0] ^= r->s0[i];
+			a[1] ^= r->s1[i];
+			a[2] ^= r->s2[i];
+			a[3] ^= r->s3[i];
+		}
+		uint32_t t = r->s1[i] << 9;
+		r->s2[i] ^= r->s0[i];
+		r->s3[i] ^= r->s1[i];
+		r->s1[i] ^= r->s2[i];
+		r->s0[i] ^= r->s3[i];
+		r->s2[i] ^= t;
+		r->s3[i] = csc_rng_rotl (r->s3[i], 11);
+	}
+	r->s0[i] = a[0];
+	r->s1[i] = a[1];
+	r->s2[i] = a[2];
+	r->s3[i] = a[3];
+}
+
+
+//Equivalent to 2^64 steps:
+static uint32_t const csc_rng_jump64[4] = {0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b};
+
+
+static void csc_rng_init (struct csc_rng * r, uint64_t seed)
+{
+	ASSERT_PARAM_NOTNULL (r);
+	uint64_t x = seed;
+	uint64_t a = csc_rng_splitmix64 (&x);
+	uint64_t b = csc_rng_splitmix64 (&x);
+	r->s0[0] = (uint32_t)a;
+	r->s1[0] = (uint32_t)(a >> 32);
+	r->s2[0] = (uint32_t)b;
+	r->s3[0] = (uint32_t)(b >> 32);
+	for (uint32_t i = 1; i < CSC_RNG_LANES; ++i)
+	{
+		r->s0[i] = r->s0[i-1];
+		r->s1[i] = r->s1[i-1];
+		r->s2[i] = r->s2[i-1];
+		r->s3[i] = r->s3[i-1];
+		csc_rng_jump_lane (r, i, csc_rng_jump64);
+	}
+	r->pos = CSC_RNG_LANES;
+}
+
+
+/**
+ * @brief Seed of stream (stream) of (seed), used for the per thread default generators
+ */
+static uint64_t csc_rng_stream_seed (uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ull);
+	return csc_rng_splitmix64 (&x);
+}
+
+
+static uint32_t csc_rng_next_u32 (struct csc_rng * r)
+{
+	if (r->pos >= CSC_RNG_LANES)
+	{
+		csc_rng_step (r, r->buf);
+		r->pos = 0;
+	}
+	return r->buf[r->pos++];
+}
+
+
+/**
+ * @brief Start a new stream (child) seeded by the next 64 bits of (r)
+ */
+static void csc_rng_split (struct csc_rng * r, struct csc_rng * child)
+{
+	ASSERT_PARAM_NOTNULL (r);
+	ASSERT_PARAM_NOTNULL (child);
+	uint64_t a = csc_rng_next_u32 (r);
+	uint64_t b = csc_rng_next_u32 (r);
+	csc_rng_init (child, (a << 32) | b);
+}
+
+
+// Uniform float in [0, 1) from the upper 24 bits
+static inline float csc_rng_tof32 (uint32_t x)
+{
+	return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// r := {x | x = uniform u32}
+static void csc_rng_u32 (struct csc_rng * rng, uint32_t n, uint32_t r[])
+{
+	ASSERT_PARAM_NOTNULL (rng);
+	uint32_t i = 0;
+	if (rng->pos >= CSC_RNG_LANES)
+	{
+		for (; i + CSC_RNG_LANES <= n; i += CSC_RNG_LANES)
+		{
+			csc_rng_step (rng, r + i);
+		}
+	}
+	for (; i < n; ++i)
+	{
+		r[i] = csc_rng_next_u32 (rng);
+	}
+}
+
+
+// r := {x | x = uniform [0, 1)}
+static void csc_rng_f32 (struct csc_rng * rng, uint32_t n, float r[])
+{
+	ASSERT_PARAM_NOTNULL (rng);
+	uint32_t i = 0;
+	if (rng->pos >= CSC_RNG_LANES)
+	{
+		uint32_t u[CSC_RNG_LANES];
+		for (; i + CSC_RNG_LANES <= n; i += CSC_RNG_LANES)
+		{
+			csc_rng_step (rng, u);
+			for (uint32_t k = 0; k < CSC_RNG_LANES; ++k)
+			{
+				r[i + k] = csc_rng_tof32 (u[k]);
+			}
+		}
+	}
+	for (; i < n; ++i)
+	{
+		r[i] = csc_rng_tof32 (csc_rng_next_u32 (rng));
+	}
+}
+
+
+static uint64_t csc_rng_default_seedvalue = 0x853C49E6748FEA9Bull;
+static uint32_t csc_rng_default_streams = 0;
+static _Thread_local struct csc_rng csc_rng_default_tls;
+static _Thread_local int csc_rng_default_ready = 0;
+
+
+/**
+ * @brief The generator of the calling thread, the first call in a thread takes the next stream of the default seed
+ */
+static struct csc_rng * csc_rng_default (void)
+{
+	if (csc_rng_default_ready == 0)
+	{
+		uint32_t stream = __atomic_fetch_add (&csc_rng_default_streams, 1, __ATOMIC_RELAXED);
+		uint64_t seed = __atomic_load_n (&csc_rng_default_seedvalue, __ATOMIC_RELAXED);
+		csc_rng_init (&csc_rng_default_tls, csc_rng_stream_seed (seed, stream));
+		csc_rng_default_ready = 1;
+	}
+	return &csc_rng_default_tls;
+}
+
+
+/**
+ * @brief Reseed the default generator, the calling thread restarts at stream 0
+ * Threads that already used the default generator keeps their streams.
+ */
+static void csc_rng_default_seed (uint64_t seed)
+{
+	__atomic_store_n (&csc_rng_default_seedvalue, seed, __ATOMIC_RELAXED);
+	__atomic_store_n (&csc_rng_default_streams, 0, __ATOMIC_RELAXED);
+	csc_rng_default_ready = 0;
+	csc_rng_default ();
+}
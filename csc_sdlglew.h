@@ -7,6 +7,7 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include <GL/glew.h>
 #include "csc_gcam.h"
 #include "csc_xlog.h"
+#include "csc_rng.h"
 
 
 
@@ -63,6 +64,7 @@ void csc_sdlglew_create_window (SDL_Window ** window, SDL_GLContext * context, c
 		exit (1);
 	}
 	srand(42);
+	csc_rng_default_seed (42);
 
 	(*context) = SDL_GL_CreateContext (*window);
 	if ((*context) == NULL)
@@ -0,0 +1,238 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#if defined(WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "csc_basic.h"
+#include "csc_assert.h"
+
+
+/*
+Buffered output sink.
+Output is collected in a caller supplied fixed-capacity buffer (buf)
+and handed to the flush callback only when the buffer is full or
+when csc_sink_flush() is called. Flushing to a file descriptor is one write(2) call,
+flushing to a FILE is one fwrite call.
+A memory sink never flushes, output that does not fit is dropped and counted in (lost).
+*/
+struct csc_sink;
+typedef void (*csc_sink_flush_cb)(struct csc_sink * sink);
+
+
+struct csc_sink
+{
+	char * buf;
+	uint32_t cap;
+	uint32_t len;
+	csc_sink_flush_cb flush;
+	int fd;
+	FILE * file;
+	//Number of bytes that could not be written:
+	uint64_t lost;
+};
+
+
+static void csc_sink_flush_fd (struct csc_sink * sink)
+{
+	char const * p = sink->buf;
+	uint32_t n = sink->len;
+	while (n > 0)
+	{
+#if defined(WIN32)
+		int r = _write (sink->fd, p, n);
+#else
+		ssize_t r = write (sink->fd, p, n);
+#endif
+		if (r < 0)
+		{
+			if (errno == EINTR) {continue;}
+			sink->lost += n;
+			break;
+		}
+		p += r;
+		n -= (uint32_t) r;
+	}
+	sink->len = 0;
+}
+
+
+static void csc_sink_flush_file (struct csc_sink * sink)
+{
+	size_t r = fwrite (sink->buf, 1, sink->len, sink->file);
+	sink->lost += sink->len - r;
+	sink->len = 0;
+}
+
+
+static void csc_sink_init_fd (struct csc_sink * sink, char * buf, uint32_t cap, int fd)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT_PARAM_NOTNULL (buf);
+	memset (sink, 0, sizeof (struct csc_sink));
+	sink->buf = buf;
+	sink->cap = cap;
+	sink->fd = fd;
+	sink->flush = csc_sink_flush_fd;
+}
+
+
+static void csc_sink_init_file (struct csc_sink * sink, char * buf, uint32_t cap, FILE * file)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT_PARAM_NOTNULL (buf);
+	ASSERT_PARAM_NOTNULL (file);
+	memset (sink, 0, sizeof (struct csc_sink));
+	sink->buf = buf;
+	sink->cap = cap;
+	sink->fd = -1;
+	sink->file = file;
+	sink->flush = csc_sink_flush_file;
+}
+
+
+static void csc_sink_init_mem (struct csc_sink * sink, char * buf, uint32_t cap)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT_PARAM_NOTNULL (buf);
+	memset (sink, 0, sizeof (struct csc_sink));
+	sink->buf = buf;
+	sink->cap = cap;
+	sink->fd = -1;
+	sink->flush = NULL;
+}
+
+
+static void csc_sink_flush (struct csc_sink * sink)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	if (sink->flush && sink->len)
+	{
+		sink->flush (sink);
+	}
+}
+
+
+/**
+ * @brief Get a pointer to at least (n) free bytes, flushes if necessary
+ * @return Pointer to the free space or NULL if the sink can not hold (n) bytes
+ */
+static char * csc_sink_reserve (struct csc_sink * sink, uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	if ((sink->cap - sink->len) < n)
+	{
+		csc_sink_flush (sink);
+		if ((sink->cap - sink->len) < n) {return NULL;}
+	}
+	return sink->buf + sink->len;
+}
+
+
+/**
+ * @brief Mark (n) bytes of the reserved space as written
+ */
+static void csc_sink_commit (struct csc_sink * sink, uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT (sink->len + n <= sink->cap);
+	sink->len += n;
+}
+
+
+static void csc_sink_write (struct csc_sink * sink, void const * data, uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT_PARAM_NOTNULL (data);
+	char const * p = data;
+	while (n > 0)
+	{
+		uint32_t m = MIN (n, sink->cap - sink->len);
+		memcpy (sink->buf + sink->len, p, m);
+		sink->len += m;
+		p += m;
+		n -= m;
+		if (n == 0) {break;}
+		if (sink->flush == NULL)
+		{
+			sink->lost += n;
+			break;
+		}
+		sink->flush (sink);
+	}
+}
+
+
+static void csc_sink_putc (struct csc_sink * sink, char c)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	char * p = csc_sink_reserve (sink, 1);
+	if (p == NULL)
+	{
+		sink->lost ++;
+		return;
+	}
+	p[0] = c;
+	sink->len ++;
+}
+
+
+static void csc_sink_puts (struct csc_sink * sink, char const * str)
+{
+	ASSERT_PARAM_NOTNULL (str);
+	csc_sink_write (sink, str, (uint32_t) strlen (str));
+}
+
+
+static void csc_sink_vprintf (struct csc_sink * sink, char const * format, va_list va)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT_PARAM_NOTNULL (format);
+	va_list ap;
+	va_copy (ap, va);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+	uint32_t room = sink->cap - sink->len;
+	int n = vsnprintf (sink->buf + sink->len, room, format, ap);
+	va_end (ap);
+	if (n < 0) {return;}
+	if ((uint32_t) n < room)
+	{
+		sink->len += (uint32_t) n;
+		return;
+	}
+	//Did not fit, try again in a flushed sink or in a temporary buffer:
+	char * p = csc_sink_reserve (sink, (uint32_t) n + 1);
+	if (p)
+	{
+		vsnprintf (p, (uint32_t) n + 1, format, va);
+		sink->len += (uint32_t) n;
+		return;
+	}
+	p = malloc ((size_t) n + 1);
+	ASSERTF (p != NULL, "malloc %i bytes", n + 1);
+	vsnprintf (p, (size_t) n + 1, format, va);
+	csc_sink_write (sink, p, (uint32_t) n);
+	free (p);
+#pragma GCC diagnostic pop
+}
+
+
+__attribute__ ((format (printf, 2, 3)))
+static void csc_sink_printf (struct csc_sink * sink, char const * format, ...)
+{
+	va_list va;
+	va_start (va, format);
+	csc_sink_vprintf (sink, format, va);
+	va_end (va);
+}
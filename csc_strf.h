@@ -15,24 +15,111 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include "csc_str.h"
 #include "csc_strto.h"
 #include "csc_strfrom.h"
+#include "csc_type_str.h"
+#include "csc_sink.h"
 
 
 
 
 
+//Upper bound of characters written by one conversion without width, e.g. 64 binary digits and sign:
+#define STRF_CONV_SIZE 72
+
+
+struct strf_conv
+{
+	enum csc_type type;
+	int base;
+	uint32_t width;
+	char pad;
+	char sign;
+};
+
+
 //format specifier
-//%[width][u,i][size]_[base]
+//%[w<pad><width>][ ,+][u,i][size]_[base]
+static char const * strf_conv_parse (char const * f, struct strf_conv * c)
+{
+	ASSERT_PARAM_NOTNULL (f);
+	ASSERT_PARAM_NOTNULL (c);
+	c->type = CSC_TYPE_NONE;
+	c->base = 10;
+	c->width = 0;
+	c->pad = 0;
+	c->sign = 0;
+parser:
+	switch (f[0])
+	{
+	case 'w':
+		c->pad = f[1];
+		f += 2;
+		c->width = strto_u32 (&f, 10);
+		goto parser;
+	case ' ':
+	case '+':
+		c->sign = f[0];
+		f ++;
+		goto parser;
+	case 'u':
+		f ++;
+		c->type = CSC_TYPE_U;
+		break;
+	case 'i':
+		f ++;
+		c->type = CSC_TYPE_I;
+		break;
+	}
+	if (isdigit (*f))
+	{
+		c->type += strto_u32 (&f, 10);
+	}
+	if (*f == '_')
+	{
+		f ++;
+		c->base = (int) strto_i32 (&f, 10);
+	}
+	return f;
+}
+
+
+/**
+ * @brief Writes one argument from (va) using conversion (c)
+ * @param o Output, the conversion is truncated to (n) characters
+ * @param n Size of (o), room for MAX (c->width, STRF_CONV_SIZE) characters never truncates
+ * @return Number of characters written
+ */
+static uint32_t strf_conv_write (char * o, uint32_t n, struct strf_conv const * c, va_list * va)
+{
+	char buf [STRF_CONV_SIZE];
+	uint32_t k = c->width ? MIN (c->width, sizeof (buf)) : sizeof (buf);
+	csc_type_fromva_fn fromva = csc_type_desc (c->type)->fromva;
+	ASSERTF (fromva != NULL, "No conversion for type %i", c->type);
+	uint32_t m = fromva (buf, k, va, c->base, c->sign);
+	uint32_t len = k - m;
+	uint32_t pad = (c->width > len) ? MIN (c->width - len, n) : 0;
+	memset (o, c->pad, pad);
+	len = MIN (len, n - pad);
+	memcpy (o + pad, buf + m, len);
+	return pad + len;
+}
+
+
+/**
+ * @brief Format (f) with arguments (va) into (buffer)
+ * @param count Size of (buffer), the output is truncated to (count - 1) characters and always null terminated
+ */
 void strf_fmtv (char * buffer, uint32_t count, char const * f, va_list va)
 {
+	ASSERT_PARAM_NOTNULL (buffer);
+	ASSERT_PARAM_NOTNULL (f);
+	ASSERT (count > 0);
 	char * o = buffer;
-	uint32_t n = count;
-	uint32_t size = 0;
-	uint32_t width = 0;
-	char sign = 0;
-	enum csc_type type = CSC_TYPE_NONE;
-	int base = 0;
-	char pad = 0;
-	while (1)
+	//Last character is reserved for the null terminator:
+	char * e = buffer + count - 1;
+	struct strf_conv c;
+	va_list ap;
+	va_copy (ap, va);
+	while (o < e)
 	{
 		//Look for format specifier starting with '%'
 		switch (*f)
@@ -45,123 +132,153 @@ void strf_fmtv (char * buffer, uint32_t count, char const * f, va_list va)
 		default:
 			*o = *f;
 			o ++;
-			n --;
 			f ++;
 			continue;
 		}
-parser:
-		switch (f[0])
-		{
-		case 'w':
-			pad = f[1];
-			f += 2;
-			width = strto_u32 (&f, 10);
-			goto parser;
+		f = strf_conv_parse (f, &c);
+		o += strf_conv_write (o, (uint32_t) (e - o), &c, &ap);
+	}
+end:
+	o[0] = '\0';
+	va_end (ap);
+}
 
-			break;
-		case ' ':
-		case '+':
-			sign = f[0];
-			f ++;
-			goto parser;
-			break;
-		case 'u':
-			f ++;
-			type = CSC_TYPE_U;
-			break;
-		case 'i':
-			f ++;
-			type = CSC_TYPE_I;
-			break;
-		}
 
-		if (isdigit (*f))
-		{
-			size = strto_u32 (&f, 10);
-			type += size;
-		}
 
-		assert (sizeof (uint8_t) <= sizeof (unsigned));
-		assert (sizeof (uint16_t) <= sizeof (unsigned));
-		assert (sizeof (int8_t) <= sizeof (int));
-		assert (sizeof (int16_t) <= sizeof (int));
+/*
+Compile-once format plan.
+The format string is parsed once into literal spans and conversions,
+then the plan can be executed many times without parsing.
+The literal spans points into the format string which must outlive the plan.
+*/
+#define STRF_PLAN_MAX 32
 
 
-		switch (*f)
-		{
-		case '_':
-			f ++;
-			base = (int) strto_i32 (&f, 10);
-			break;
-		default:
-			base = 10;
-			break;
-		}
+struct strf_plan_step
+{
+	char const * lit;
+	uint32_t lit_n;
+	//Conversion after the literal, CSC_TYPE_NONE if none:
+	struct strf_conv conv;
+};
 
-		memset (o, pad, width);
-		n -= width;
 
-		uint32_t m = 0;
-		uint32_t k = width ? width : n;
-		switch (type)
-		{
-		case CSC_TYPE_U:
-		case CSC_TYPE_U8:
-		case CSC_TYPE_U16:
-		case CSC_TYPE_U32:
-			m = strfrom_umax (o, k, va_arg (va, uint32_t), base);
-			break;
-		case CSC_TYPE_U64:
-			m = strfrom_umax (o, k, va_arg (va, uint64_t), base);
-			break;
-		case CSC_TYPE_I:
-		case CSC_TYPE_I8:
-		case CSC_TYPE_I16:
-		case CSC_TYPE_I32:
-			m = strfrom_imax (o, k, va_arg (va, int32_t), base, sign);
-			break;
-		case CSC_TYPE_I64:
-			m = strfrom_imax (o, k, va_arg (va, int64_t), base, sign);
-			break;
-		default:
-			ASSERT (0);
-			break;
-		}
+struct strf_plan
+{
+	uint32_t count;
+	//Upper bound of characters written by one execution excluding the null terminator:
+	uint32_t size;
+	struct strf_plan_step steps [STRF_PLAN_MAX];
+};
+
+
+/**
+ * @brief Compile format string (f) into (plan)
+ * @return 0 on success, -1 if the format string has too many conversions
+ */
+static int strf_plan_compile (struct strf_plan * plan, char const * f)
+{
+	ASSERT_PARAM_NOTNULL (plan);
+	ASSERT_PARAM_NOTNULL (f);
+	plan->count = 0;
+	plan->size = 0;
+	while (1)
+	{
+		if (plan->count >= STRF_PLAN_MAX) {return -1;}
+		struct strf_plan_step * s = plan->steps + plan->count;
+		char const * a = f;
+		while ((*f != '\0') && (*f != '%')) {f ++;}
+		s->lit = a;
+		s->lit_n = (uint32_t) (f - a);
+		s->conv.type = CSC_TYPE_NONE;
+		plan->size += s->lit_n;
+		plan->count ++;
+		if (*f == '\0') {break;}
+		f = strf_conv_parse (f + 1, &s->conv);
+		plan->size += MAX (s->conv.width, STRF_CONV_SIZE);
+	}
+	return 0;
+}
 
-		// .....000000000000
-		//      o        ABC
-		// .....ABC000000ABC
-		//         o
-		if (width == 0)
-		{
-			memmove (o, o + m, k - m);
-			o += k - m;
-		}
-		else
+
+/**
+ * @brief Execute (plan) with arguments (va)
+ * @param o Output, null terminated
+ * @param n Size of (o), must be larger than (plan->size)
+ * @return Number of characters written excluding the null terminator, 0 if (o) is too small
+ */
+static uint32_t strf_plan_execv (struct strf_plan const * plan, char * o, uint32_t n, va_list va)
+{
+	ASSERT_PARAM_NOTNULL (plan);
+	ASSERT_PARAM_NOTNULL (o);
+	if (n <= plan->size) {return 0;}
+	char * p = o;
+	va_list ap;
+	va_copy (ap, va);
+	for (uint32_t i = 0; i < plan->count; ++i)
+	{
+		struct strf_plan_step const * s = plan->steps + i;
+		memcpy (p, s->lit, s->lit_n);
+		p += s->lit_n;
+		if (s->conv.type != CSC_TYPE_NONE)
 		{
-			o += width;
+			p += strf_conv_write (p, (uint32_t) (o + n - 1 - p), &s->conv, &ap);
 		}
-		o[0] = '\0';
+	}
+	va_end (ap);
+	p[0] = '\0';
+	return (uint32_t) (p - o);
+}
 
 
+static uint32_t strf_plan_exec (struct strf_plan const * plan, char * o, uint32_t n, ...)
+{
+	va_list va;
+	va_start (va, n);
+	uint32_t m = strf_plan_execv (plan, o, n, va);
+	va_end (va);
+	return m;
+}
 
-		//memset (o, '#', m);
-		//o += m;
-		//n -= m;
 
-		/*
-		//Apply padding
-		if (width > m)
-		{
-			width = MIN (n, width - m);
-			str_rep (o, width, '.');
-			o += width;
-			n -= width;
-		}
-		*/
-	}
-end:
-	return;
+
+/**
+ * @brief Execute (plan) into (sink)
+ */
+static void strf_plan_sinkv (struct csc_sink * sink, struct strf_plan const * plan, va_list va)
+{
+	ASSERT_PARAM_NOTNULL (sink);
+	ASSERT_PARAM_NOTNULL (plan);
+	char * o = csc_sink_reserve (sink, plan->size + 1);
+	ASSERTF (o != NULL, "The sink capacity %i is smaller than the plan size %i", sink->cap, plan->size + 1);
+	sink->len += strf_plan_execv (plan, o, plan->size + 1, va);
+}
+
+
+static void strf_plan_sink (struct csc_sink * sink, struct strf_plan const * plan, ...)
+{
+	va_list va;
+	va_start (va, plan);
+	strf_plan_sinkv (sink, plan, va);
+	va_end (va);
+}
+
+
+static void strf_sinkv (struct csc_sink * sink, char const * f, va_list va)
+{
+	struct strf_plan plan;
+	int r = strf_plan_compile (&plan, f);
+	ASSERTF (r == 0, "Too many conversions in format %s", f);
+	strf_plan_sinkv (sink, &plan, va);
+}
+
+
+static void strf_sink (struct csc_sink * sink, char const * f, ...)
+{
+	va_list va;
+	va_start (va, f);
+	strf_sinkv (sink, f, va);
+	va_end (va);
 }
 
 
@@ -178,9 +295,12 @@ void strf_printf (char const * f, ...)
 {
 	va_list va;
 	va_start (va, f);
-	char buf [1000] = {'\0'};
-	strf_fmtv (buf, 100, f, va);
-	puts (buf);
+	char buf [4096];
+	struct csc_sink sink;
+	csc_sink_init_file (&sink, buf, sizeof (buf), stdout);
+	strf_sinkv (&sink, f, va);
+	csc_sink_putc (&sink, '\n');
+	csc_sink_flush (&sink);
 	va_end (va);
 }
 
@@ -218,6 +338,42 @@ static void test_csc_strf()
 		puts (buf);
 	}
 
+	{
+		//Output is truncated to the buffer size:
+		char buf[16];
+		memset (buf, '#', sizeof (buf));
+		strf_fmt (buf, 8, "abc %i32 def", 12345);
+		ASSERTF (strcmp (buf, "abc 123") == 0, "%s", buf);
+		ASSERT (buf[8] == '#');
+		strf_fmt (buf, 8, "%w_12i32", 1);
+		ASSERTF (strcmp (buf, "_______") == 0, "%s", buf);
+		strf_fmt (buf, 4, "abcdef");
+		ASSERTF (strcmp (buf, "abc") == 0, "%s", buf);
+		strf_fmt (buf, 1, "abc%i32", 1);
+		ASSERT (buf[0] == '\0');
+	}
+
+	{
+		char buf[400+1] = {'\0'};
+		struct strf_plan plan;
+		int r = strf_plan_compile (&plan, "a=%w#4i32 b=%+i32_16 c=%u64_2;");
+		ASSERT (r == 0);
+		ASSERT (plan.count == 4);
+		uint32_t n = strf_plan_exec (&plan, buf, sizeof (buf), 12, 255, (uint64_t)5);
+		ASSERTF (strcmp (buf, "a=##12 b=+FF c=101;") == 0, "%s", buf);
+		ASSERT (n == strlen (buf));
+		n = strf_plan_exec (&plan, buf, sizeof (buf), -3, -1, (uint64_t)0);
+		ASSERTF (strcmp (buf, "a=##-3 b=-1 c=0;") == 0, "%s", buf);
+		ASSERT (strf_plan_exec (&plan, buf, plan.size, 0, 0, (uint64_t)0) == 0);
+
+		struct csc_sink sink;
+		csc_sink_init_mem (&sink, buf, sizeof (buf));
+		strf_plan_sink (&sink, &plan, 1, 2, (uint64_t)3);
+		strf_sink (&sink, "|%i32", 4);
+		csc_sink_putc (&sink, '\0');
+		ASSERTF (strcmp (buf, "a=###1 b=+2 c=11;|4") == 0, "%s", buf);
+	}
+
 }
 
 
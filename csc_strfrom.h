@@ -8,9 +8,11 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <math.h>
 #include "csc_str.h"
 #include "csc_basic.h"
 #include "csc_assert.h"
+#include "csc_strfrom_table.h"
 
 
 #define STRFROM_LOOKUP_0Z "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -100,6 +102,518 @@ static inline uint32_t strfrom_umax
 }
 
 
+/*
+Shortest round-trip float formatting.
+https://github.com/ulfjack/ryu
+The float is converted to the shortest decimal (mantissa * 10^exponent)
+that parses back to the same bits, then written without any stdio call.
+*/
+#define STRFROM_F32_SIZE 24
+//Longest string from strfrom_f32_unsafe including the sign, e.g. "-10000000000000000":
+#define STRFROM_F32_WIDTH 18
+#define STRFROM_F64_SIZE 32
+
+
+struct strfrom_decimal
+{
+	uint64_t mantissa;
+	int32_t exponent;
+};
+
+
+static inline int32_t strfrom_pow5bits (int32_t e)
+{
+	return (int32_t) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+
+
+static inline uint32_t strfrom_log10pow2 (int32_t e)
+{
+	return ((uint32_t) e * 78913) >> 18;
+}
+
+
+static inline uint32_t strfrom_log10pow5 (int32_t e)
+{
+	return ((uint32_t) e * 732923) >> 20;
+}
+
+
+static inline uint32_t strfrom_pow5factor (uint64_t value)
+{
+	uint32_t count = 0;
+	while (value % 5 == 0)
+	{
+		value /= 5;
+		count ++;
+	}
+	return count;
+}
+
+
+static inline int strfrom_multiple_pow5 (uint64_t value, uint32_t p)
+{
+	return strfrom_pow5factor (value) >= p;
+}
+
+
+static inline int strfrom_multiple_pow2 (uint64_t value, uint32_t p)
+{
+	return (value & ((UINT64_C (1) << p) - 1)) == 0;
+}
+
+
+static inline uint32_t strfrom_mulshift32 (uint32_t m, uint64_t factor, int32_t shift)
+{
+	ASSERT (shift > 32);
+	uint64_t bits0 = (uint64_t) m * (uint32_t) factor;
+	uint64_t bits1 = (uint64_t) m * (uint32_t) (factor >> 32);
+	uint64_t sum = (bits0 >> 32) + bits1;
+	return (uint32_t) (sum >> (shift - 32));
+}
+
+
+static inline uint64_t strfrom_mulshift64 (uint64_t m, uint64_t const mul[2], int32_t shift)
+{
+	ASSERT (shift > 64);
+	unsigned __int128 b0 = (unsigned __int128) m * mul[0];
+	unsigned __int128 b2 = (unsigned __int128) m * mul[1];
+	return (uint64_t) (((b0 >> 64) + b2) >> (shift - 64));
+}
+
+
+/**
+ * @brief Removes digits from the interval [vm, vp] until the shortest representation is found
+ */
+static inline uint64_t strfrom_shortest
+(uint64_t vr, uint64_t vp, uint64_t vm, int vm_trailing_zeros, int vr_trailing_zeros, int accept_bounds, uint32_t last_removed, int32_t * removed)
+{
+	if (vm_trailing_zeros || vr_trailing_zeros)
+	{
+		while (vp / 10 > vm / 10)
+		{
+			vm_trailing_zeros &= (vm % 10 == 0);
+			vr_trailing_zeros &= (last_removed == 0);
+			last_removed = (uint32_t) (vr % 10);
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			(*removed) ++;
+		}
+		if (vm_trailing_zeros)
+		{
+			while (vm % 10 == 0)
+			{
+				vr_trailing_zeros &= (last_removed == 0);
+				last_removed = (uint32_t) (vr % 10);
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				(*removed) ++;
+			}
+		}
+		if (vr_trailing_zeros && (last_removed == 5) && (vr % 2 == 0))
+		{
+			//Round even if the exact number is .....50..0.
+			last_removed = 4;
+		}
+		return vr + (((vr == vm) && (!accept_bounds || !vm_trailing_zeros)) || (last_removed >= 5));
+	}
+	while (vp / 10 > vm / 10)
+	{
+		last_removed = (uint32_t) (vr % 10);
+		vr /= 10;
+		vp /= 10;
+		vm /= 10;
+		(*removed) ++;
+	}
+	return vr + ((vr == vm) || (last_removed >= 5));
+}
+
+
+static struct strfrom_decimal strfrom_decimal_f32 (uint32_t ieee_mantissa, uint32_t ieee_exponent)
+{
+	int32_t e2;
+	uint32_t m2;
+	if (ieee_exponent == 0)
+	{
+		e2 = 1 - 127 - 23 - 2;
+		m2 = ieee_mantissa;
+	}
+	else
+	{
+		e2 = (int32_t) ieee_exponent - 127 - 23 - 2;
+		m2 = (UINT32_C (1) << 23) | ieee_mantissa;
+	}
+	int accept_bounds = (m2 & 1) == 0;
+	uint32_t mv = 4 * m2;
+	uint32_t mp = 4 * m2 + 2;
+	uint32_t mm_shift = (ieee_mantissa != 0) || (ieee_exponent <= 1);
+	uint32_t mm = 4 * m2 - 1 - mm_shift;
+	uint32_t vr;
+	uint32_t vp;
+	uint32_t vm;
+	int32_t e10;
+	int vm_trailing_zeros = 0;
+	int vr_trailing_zeros = 0;
+	uint32_t last_removed = 0;
+	int32_t const bitcount = STRFROM_POW5_INV_BITCOUNT - 64;
+	if (e2 >= 0)
+	{
+		uint32_t q = strfrom_log10pow2 (e2);
+		e10 = (int32_t) q;
+		int32_t k = bitcount + strfrom_pow5bits ((int32_t) q) - 1;
+		int32_t i = -e2 + (int32_t) q + k;
+		uint64_t f = STRFROM_POW5_INV_SPLIT [q][1] + 1;
+		vr = strfrom_mulshift32 (mv, f, i);
+		vp = strfrom_mulshift32 (mp, f, i);
+		vm = strfrom_mulshift32 (mm, f, i);
+		if ((q != 0) && ((vp - 1) / 10 <= vm / 10))
+		{
+			int32_t l = bitcount + strfrom_pow5bits ((int32_t) (q - 1)) - 1;
+			last_removed = strfrom_mulshift32 (mv, STRFROM_POW5_INV_SPLIT [q - 1][1] + 1, -e2 + (int32_t) q - 1 + l) % 10;
+		}
+		if (q <= 9)
+		{
+			if (mv % 5 == 0) {vr_trailing_zeros = strfrom_multiple_pow5 (mv, q);}
+			else if (accept_bounds) {vm_trailing_zeros = strfrom_multiple_pow5 (mm, q);}
+			else {vp -= (uint32_t) strfrom_multiple_pow5 (mp, q);}
+		}
+	}
+	else
+	{
+		uint32_t q = strfrom_log10pow5 (-e2);
+		e10 = (int32_t) q + e2;
+		int32_t i = -e2 - (int32_t) q;
+		int32_t k = strfrom_pow5bits (i) - bitcount;
+		int32_t j = (int32_t) q - k;
+		uint64_t f = STRFROM_POW5_SPLIT [i][1];
+		vr = strfrom_mulshift32 (mv, f, j);
+		vp = strfrom_mulshift32 (mp, f, j);
+		vm = strfrom_mulshift32 (mm, f, j);
+		if ((q != 0) && ((vp - 1) / 10 <= vm / 10))
+		{
+			j = (int32_t) q - 1 - (strfrom_pow5bits (i + 1) - bitcount);
+			last_removed = strfrom_mulshift32 (mv, STRFROM_POW5_SPLIT [i + 1][1], j) % 10;
+		}
+		if (q <= 1)
+		{
+			vr_trailing_zeros = 1;
+			if (accept_bounds) {vm_trailing_zeros = (mm_shift == 1);}
+			else {vp --;}
+		}
+		else if (q < 31)
+		{
+			vr_trailing_zeros = strfrom_multiple_pow2 (mv, q - 1);
+		}
+	}
+	struct strfrom_decimal d;
+	int32_t removed = 0;
+	d.mantissa = strfrom_shortest (vr, vp, vm, vm_trailing_zeros, vr_trailing_zeros, accept_bounds, last_removed, &removed);
+	d.exponent = e10 + removed;
+	return d;
+}
+
+
+static struct strfrom_decimal strfrom_decimal_f64 (uint64_t ieee_mantissa, uint32_t ieee_exponent)
+{
+	int32_t e2;
+	uint64_t m2;
+	if (ieee_exponent == 0)
+	{
+		e2 = 1 - 1023 - 52 - 2;
+		m2 = ieee_mantissa;
+	}
+	else
+	{
+		e2 = (int32_t) ieee_exponent - 1023 - 52 - 2;
+		m2 = (UINT64_C (1) << 52) | ieee_mantissa;
+	}
+	int accept_bounds = (m2 & 1) == 0;
+	uint64_t mv = 4 * m2;
+	uint32_t mm_shift = (ieee_mantissa != 0) || (ieee_exponent <= 1);
+	uint64_t vr;
+	uint64_t vp;
+	uint64_t vm;
+	int32_t e10;
+	int vm_trailing_zeros = 0;
+	int vr_trailing_zeros = 0;
+	if (e2 >= 0)
+	{
+		uint32_t q = strfrom_log10pow2 (e2) - (e2 > 3);
+		e10 = (int32_t) q;
+		int32_t k = STRFROM_POW5_INV_BITCOUNT + strfrom_pow5bits ((int32_t) q) - 1;
+		int32_t i = -e2 + (int32_t) q + k;
+		vr = strfrom_mulshift64 (mv, STRFROM_POW5_INV_SPLIT [q], i);
+		vp = strfrom_mulshift64 (mv + 2, STRFROM_POW5_INV_SPLIT [q], i);
+		vm = strfrom_mulshift64 (mv - 1 - mm_shift, STRFROM_POW5_INV_SPLIT [q], i);
+		if (q <= 21)
+		{
+			if (mv % 5 == 0) {vr_trailing_zeros = strfrom_multiple_pow5 (mv, q);}
+			else if (accept_bounds) {vm_trailing_zeros = strfrom_multiple_pow5 (mv - 1 - mm_shift, q);}
+			else {vp -= (uint64_t) strfrom_multiple_pow5 (mv + 2, q);}
+		}
+	}
+	else
+	{
+		uint32_t q = strfrom_log10pow5 (-e2) - (-e2 > 1);
+		e10 = (int32_t) q + e2;
+		int32_t i = -e2 - (int32_t) q;
+		int32_t k = strfrom_pow5bits (i) - STRFROM_POW5_BITCOUNT;
+		int32_t j = (int32_t) q - k;
+		vr = strfrom_mulshift64 (mv, STRFROM_POW5_SPLIT [i], j);
+		vp = strfrom_mulshift64 (mv + 2, STRFROM_POW5_SPLIT [i], j);
+		vm = strfrom_mulshift64 (mv - 1 - mm_shift, STRFROM_POW5_SPLIT [i], j);
+		if (q <= 1)
+		{
+			vr_trailing_zeros = 1;
+			if (accept_bounds) {vm_trailing_zeros = (mm_shift == 1);}
+			else {vp --;}
+		}
+		else if (q < 63)
+		{
+			vr_trailing_zeros = strfrom_multiple_pow2 (mv, q);
+		}
+	}
+	struct strfrom_decimal d;
+	int32_t removed = 0;
+	d.mantissa = strfrom_shortest (vr, vp, vm, vm_trailing_zeros, vr_trailing_zeros, accept_bounds, 0, &removed);
+	d.exponent = e10 + removed;
+	return d;
+}
+
+
+/**
+ * @brief Writes the decimal (d) as fixed notation when the decimal point is near, otherwise scientific notation
+ * @param o Must have room for STRFROM_F64_SIZE characters
+ * @return Number of characters written
+ */
+static inline uint32_t strfrom_decimal_write (char * o, struct strfrom_decimal d, int neg)
+{
+	char digits [20];
+	uint32_t nd = 0;
+	uint64_t m = d.mantissa;
+	do
+	{
+		digits [nd++] = (char) ('0' + (m % 10));
+		m /= 10;
+	}
+	while (m);
+	str_rev (digits, nd);
+	char * p = o;
+	if (neg) {*p++ = '-';}
+	//Position of the decimal point relative to the first digit:
+	int32_t point = (int32_t) nd + d.exponent;
+	if ((point > 0) && (point <= 17))
+	{
+		if ((uint32_t) point >= nd)
+		{
+			memcpy (p, digits, nd);
+			p += nd;
+			str_rep (p, (uint32_t) point - nd, '0');
+			p += (uint32_t) point - nd;
+		}
+		else
+		{
+			memcpy (p, digits, (size_t) point);
+			p += point;
+			*p++ = '.';
+			memcpy (p, digits + point, nd - (uint32_t) point);
+			p += nd - (uint32_t) point;
+		}
+	}
+	else if ((point <= 0) && (point > -4))
+	{
+		*p++ = '0';
+		*p++ = '.';
+		str_rep (p, (uint32_t) -point, '0');
+		p += -point;
+		memcpy (p, digits, nd);
+		p += nd;
+	}
+	else
+	{
+		int32_t e = point - 1;
+		*p++ = digits [0];
+		if (nd > 1)
+		{
+			*p++ = '.';
+			memcpy (p, digits + 1, nd - 1);
+			p += nd - 1;
+		}
+		*p++ = 'e';
+		*p++ = (e < 0) ? '-' : '+';
+		e = (e < 0) ? -e : e;
+		if (e >= 100) {*p++ = (char) ('0' + e / 100);}
+		if (e >= 10) {*p++ = (char) ('0' + (e / 10) % 10);}
+		*p++ = (char) ('0' + e % 10);
+	}
+	return (uint32_t) (p - o);
+}
+
+
+static inline uint32_t strfrom_special (char * o, int neg, int nan, int zero)
+{
+	char * p = o;
+	if (nan) {memcpy (p, "nan", 3); return 3;}
+	if (neg) {*p++ = '-';}
+	if (zero) {*p++ = '0';}
+	else {memcpy (p, "inf", 3); p += 3;}
+	return (uint32_t) (p - o);
+}
+
+
+/**
+ * @brief Converts float to the shortest string that parses back to the same float
+ * @param o Output, must have room for STRFROM_F32_SIZE characters. Not null terminated.
+ * @param value
+ * @return Number of characters written
+ */
+static inline uint32_t strfrom_f32_unsafe (char * o, float value)
+{
+	uint32_t bits;
+	memcpy (&bits, &value, sizeof (bits));
+	int neg = (bits >> 31) != 0;
+	uint32_t ieee_mantissa = bits & ((UINT32_C (1) << 23) - 1);
+	uint32_t ieee_exponent = (bits >> 23) & 0xFF;
+	if ((ieee_exponent == 0xFF) || ((ieee_exponent == 0) && (ieee_mantissa == 0)))
+	{
+		return strfrom_special (o, neg, (ieee_exponent == 0xFF) && ieee_mantissa, ieee_exponent == 0);
+	}
+	return strfrom_decimal_write (o, strfrom_decimal_f32 (ieee_mantissa, ieee_exponent), neg);
+}
+
+
+/**
+ * @brief Converts double to the shortest string that parses back to the same double
+ * @param o Output, must have room for STRFROM_F64_SIZE characters. Not null terminated.
+ * @param value
+ * @return Number of characters written
+ */
+static inline uint32_t strfrom_f64_unsafe (char * o, double value)
+{
+	uint64_t bits;
+	memcpy (&bits, &value, sizeof (bits));
+	int neg = (bits >> 63) != 0;
+	uint64_t ieee_mantissa = bits & ((UINT64_C (1) << 52) - 1);
+	uint32_t ieee_exponent = (uint32_t) ((bits >> 52) & 0x7FF);
+	if ((ieee_exponent == 0x7FF) || ((ieee_exponent == 0) && (ieee_mantissa == 0)))
+	{
+		return strfrom_special (o, neg, (ieee_exponent == 0x7FF) && ieee_mantissa, ieee_exponent == 0);
+	}
+	return strfrom_decimal_write (o, strfrom_decimal_f64 (ieee_mantissa, ieee_exponent), neg);
+}
+
+
+/**
+ * @brief Converts float to the shortest round-trip string, left align
+ * @param o Output, not null terminated
+ * @param n Size of (o)
+ * @param value
+ * @return Number of characters written, 0 if (o) is too small
+ */
+static inline uint32_t strfrom_f32 (char * o, uint32_t n, float value)
+{
+	ASSERT (o);
+	char buf [STRFROM_F32_SIZE];
+	uint32_t m = strfrom_f32_unsafe (buf, value);
+	if (m > n) {return 0;}
+	memcpy (o, buf, m);
+	return m;
+}
+
+
+/**
+ * @brief Converts double to the shortest round-trip string, left align
+ * @param o Output, not null terminated
+ * @param n Size of (o)
+ * @param value
+ * @return Number of characters written, 0 if (o) is too small
+ */
+static inline uint32_t strfrom_f64 (char * o, uint32_t n, double value)
+{
+	ASSERT (o);
+	char buf [STRFROM_F64_SIZE];
+	uint32_t m = strfrom_f64_unsafe (buf, value);
+	if (m > n) {return 0;}
+	memcpy (o, buf, m);
+	return m;
+}
+
+
+/**
+ * @brief Moves the (m) characters at (o) to the right of a (width) field and fills the rest with (pad)
+ */
+static inline uint32_t strfrom_align_right (char * o, uint32_t m, uint32_t width, char pad)
+{
+	if (m >= width) {return m;}
+	memmove (o + (width - m), o, m);
+	str_rep (o, width - m, pad);
+	return width;
+}
+
+
+/**
+ * @brief Converts array of floats to strings separated by (sep)
+ * @param o      Output, not null terminated
+ * @param n      Size of (o)
+ * @param v      Input array
+ * @param vn     Number of elements to convert
+ * @param stride Element stride of (v)
+ * @param width  Minimum field width, right align with spaces
+ * @param sign   Prefix non negative numbers with this character. Can be 0.
+ * @param sep    Separator written after each element. Can be 0.
+ * @return Number of characters written. Stops before the first element that does not fit.
+ */
+static uint32_t strfrom_vf32
+(char * o, uint32_t n, float const v[], uint32_t vn, uint32_t stride, uint32_t width, char sign, char sep)
+{
+	ASSERT (o);
+	ASSERT (v);
+	char * p = o;
+	char * e = o + n;
+	uint32_t need = MAX (width, STRFROM_F32_SIZE) + 2;
+	for (uint32_t i = 0; i < vn; ++i)
+	{
+		if ((uint32_t) (e - p) < need) {break;}
+		float x = v [i * stride];
+		char * q = p;
+		if (sign && !signbit (x)) {*q++ = sign;}
+		q += strfrom_f32_unsafe (q, x);
+		p += strfrom_align_right (p, (uint32_t) (q - p), width, ' ');
+		if (sep) {*p++ = sep;}
+	}
+	return (uint32_t) (p - o);
+}
+
+
+/**
+ * @brief Converts array of doubles to strings separated by (sep)
+ * @see strfrom_vf32
+ */
+static uint32_t strfrom_vf64
+(char * o, uint32_t n, double const v[], uint32_t vn, uint32_t stride, uint32_t width, char sign, char sep)
+{
+	ASSERT (o);
+	ASSERT (v);
+	char * p = o;
+	char * e = o + n;
+	uint32_t need = MAX (width, STRFROM_F64_SIZE) + 2;
+	for (uint32_t i = 0; i < vn; ++i)
+	{
+		if ((uint32_t) (e - p) < need) {break;}
+		double x = v [i * stride];
+		char * q = p;
+		if (sign && !signbit (x)) {*q++ = sign;}
+		q += strfrom_f64_unsafe (q, x);
+		p += strfrom_align_right (p, (uint32_t) (q - p), width, ' ');
+		if (sep) {*p++ = sep;}
+	}
+	return (uint32_t) (p - o);
+}
+
+
+
 
 
 
@@ -146,3 +660,61 @@ static void test_strfrom_imax_cases()
 	test_strfrom_imax (/*value*/10, /*base*/16, /*plus*/'+', /*pad*/'#', /*expect_str*/ "#+A", /*expect_return*/1);
 	test_strfrom_imax (/*value*/10, /*base*/16, /*plus*/'+', /*pad*/'#', /*expect_str*/"##+A", /*expect_return*/2);
 }
+
+
+static void test_strfrom_f32 (float value, char const * expect_str)
+{
+	char s[100] = {'\0'};
+	uint32_t m = strfrom_f32 (s, sizeof (s), value);
+	ASSERTF (m == strlen (expect_str), "%i == %i, %s, %s", m, (int)strlen (expect_str), s, expect_str);
+	ASSERTF (strncmp (s, expect_str, m) == 0, "%s == %s", s, expect_str);
+	ASSERTF (strtof (s, NULL) == value || isnan (value), "%s", s);
+}
+
+
+static void test_strfrom_f64 (double value, char const * expect_str)
+{
+	char s[100] = {'\0'};
+	uint32_t m = strfrom_f64 (s, sizeof (s), value);
+	ASSERTF (m == strlen (expect_str), "%i == %i, %s, %s", m, (int)strlen (expect_str), s, expect_str);
+	ASSERTF (strncmp (s, expect_str, m) == 0, "%s == %s", s, expect_str);
+	ASSERTF (strtod (s, NULL) == value || isnan (value), "%s", s);
+}
+
+
+static void test_strfrom_float_cases()
+{
+	test_strfrom_f32 (0.0f, "0");
+	test_strfrom_f32 (-0.0f, "-0");
+	test_strfrom_f32 (1.0f, "1");
+	test_strfrom_f32 (0.1f, "0.1");
+	test_strfrom_f32 (0.3f, "0.3");
+	test_strfrom_f32 (-123.5f, "-123.5");
+	test_strfrom_f32 (3.14159265f, "3.1415927");
+	test_strfrom_f32 (1e-7f, "1e-7");
+	test_strfrom_f32 (16777216.0f, "16777216");
+	test_strfrom_f32 (1.17549435e-38f, "1.1754944e-38");
+	test_strfrom_f32 (3.4028235e38f, "3.4028235e+38");
+	test_strfrom_f32 (1e-45f, "1e-45");
+	test_strfrom_f32 (INFINITY, "inf");
+	test_strfrom_f32 (-INFINITY, "-inf");
+	test_strfrom_f32 (NAN, "nan");
+	//Longest string, STRFROM_F32_WIDTH was found by formatting every float:
+	test_strfrom_f32 (-1e16f, "-10000000000000000");
+
+	test_strfrom_f64 (0.1, "0.1");
+	test_strfrom_f64 (2.0 / 3.0, "0.6666666666666666");
+	test_strfrom_f64 (1e23, "1e+23");
+	test_strfrom_f64 (5e-324, "5e-324");
+	test_strfrom_f64 (1.7976931348623157e308, "1.7976931348623157e+308");
+	test_strfrom_f64 (0.0001, "0.0001");
+
+	{
+		char s[100] = {'\0'};
+		float v[] = {1.0f, -0.5f, 2.25f};
+		uint32_t m = strfrom_vf32 (s, sizeof (s), v, 3, 1, 6, '+', ' ');
+		ASSERTF (strncmp (s, "    +1   -0.5  +2.25 ", m) == 0, "%s", s);
+		m = strfrom_vf32 (s, STRFROM_F32_SIZE + 3, v, 3, 1, 0, 0, ',');
+		ASSERTF (m == 2, "Not enough room for more than one element %s", s);
+	}
+}
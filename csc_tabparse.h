@@ -0,0 +1,392 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_type_str.h"
+#include "csc_malloc_file.h"
+
+
+/*
+Columnar table parser.
+Text tables with one row per line are parsed into one typed array per column.
+The schema is a enum csc_type per column.
+Only fixed size value types are supported, CSC_TYPE_STRING cells would point into the text which is not kept.
+Cells are separated by (sep) or by spaces and tabs when (sep) is 0.
+Empty lines and lines starting with '#' are skipped.
+Integer columns use a bounded decimal parser, other columns use the parse function of the type descriptor.
+A cell is counted in (errors) when it is empty, has characters after the value or is out of range of the column type.
+Large tables are split into row ranges at line boundaries and parsed by multiple threads,
+each thread counts its rows first so every thread knows where to write its rows.
+*/
+#define CSC_TABPARSE_MAXCOL 64
+#define CSC_TABPARSE_MAXTHREADS 32
+//Do not split tables smaller than this per thread:
+#define CSC_TABPARSE_MINCHUNK (256 * 1024)
+//Longest cell of a non integer column including the NUL terminator:
+#define CSC_TABPARSE_MAXCELL 128
+
+
+enum csc_tabparse_kind
+{
+	CSC_TABPARSE_KIND_OTHER,
+	CSC_TABPARSE_KIND_UINT,
+	CSC_TABPARSE_KIND_INT,
+};
+
+
+struct csc_tabparse_column
+{
+	enum csc_type type;
+	enum csc_tabparse_kind kind;
+	uint32_t size;
+	csc_type_parse_fn parse;
+	//Array of (rows) elements of type (type):
+	void * data;
+};
+
+
+struct csc_tabparse
+{
+	char sep;
+	uint32_t ncols;
+	struct csc_tabparse_column col[CSC_TABPARSE_MAXCOL];
+	uint32_t rows;
+	//Number of missing or unparsable cells:
+	uint32_t errors;
+};
+
+
+static void csc_tabparse_init (struct csc_tabparse * t, enum csc_type const types[], uint32_t ncols, char sep)
+{
+	ASSERT_PARAM_NOTNULL (t);
+	ASSERT_PARAM_NOTNULL (types);
+	ASSERT (ncols <= CSC_TABPARSE_MAXCOL);
+	memset (t, 0, sizeof (struct csc_tabparse));
+	t->sep = sep;
+	t->ncols = ncols;
+	for (uint32_t i = 0; i < ncols; ++i)
+	{
+		struct csc_tabparse_column * c = t->col + i;
+		struct csc_type_desc const * d = csc_type_desc (types[i]);
+		ASSERTF (d->parse != NULL, "Column %i has no parser", i);
+		ASSERTF (types[i] != CSC_TYPE_STRING, "Column %i is a string, only fixed size value types are supported", i);
+		c->type = types[i];
+		c->size = d->size;
+		c->parse = d->parse;
+		switch (types[i])
+		{
+		case CSC_TYPE_U:
+		case CSC_TYPE_U8:
+		case CSC_TYPE_U16:
+		case CSC_TYPE_U32:
+		case CSC_TYPE_U64:
+			c->kind = CSC_TABPARSE_KIND_UINT;
+			break;
+		case CSC_TYPE_INT:
+		case CSC_TYPE_LONG:
+		case CSC_TYPE_I:
+		case CSC_TYPE_I8:
+		case CSC_TYPE_I16:
+		case CSC_TYPE_I32:
+		case CSC_TYPE_I64:
+			c->kind = CSC_TABPARSE_KIND_INT;
+			break;
+		default:
+			c->kind = CSC_TABPARSE_KIND_OTHER;
+			break;
+		}
+	}
+}
+
+
+static void csc_tabparse_free (struct csc_tabparse * t)
+{
+	ASSERT_PARAM_NOTNULL (t);
+	for (uint32_t i = 0; i < t->ncols; ++i)
+	{
+		free (t->col[i].data);
+		t->col[i].data = NULL;
+	}
+	t->rows = 0;
+}
+
+
+static int csc_tabparse_skipline (char const * p, char const * e)
+{
+	while (p < e && (*p == ' ' || *p == '\t' || *p == '\r')) {p++;}
+	return (p == e) || (*p == '#');
+}
+
+
+/**
+ * @brief Count the rows in [a, b)
+ */
+static uint32_t csc_tabparse_count (char const * a, char const * b)
+{
+	uint32_t n = 0;
+	while (a < b)
+	{
+		char const * e = memchr (a, '\n', (size_t)(b - a));
+		if (e == NULL) {e = b;}
+		n += !csc_tabparse_skipline (a, e);
+		a = e + 1;
+	}
+	return n;
+}
+
+
+/**
+ * @brief Store the low (c->size) bytes of a integer
+ */
+static void csc_tabparse_store (struct csc_tabparse_column const * c, uint32_t row, uintmax_t v)
+{
+	void * dst = (char *)c->data + (size_t)row * c->size;
+	switch (c->size)
+	{
+	case 1:{uint8_t x = (uint8_t)v; memcpy (dst, &x, 1); break;}
+	case 2:{uint16_t x = (uint16_t)v; memcpy (dst, &x, 2); break;}
+	case 4:{uint32_t x = (uint32_t)v; memcpy (dst, &x, 4); break;}
+	default:{uint64_t x = (uint64_t)v; memcpy (dst, &x, 8); break;}
+	}
+}
+
+
+/**
+ * @brief Largest unsigned value of a integer of (size) bytes
+ */
+static inline uintmax_t csc_tabparse_umax (uint32_t size)
+{
+	if (size >= sizeof (uintmax_t)) {return UINTMAX_MAX;}
+	return ((uintmax_t)1 << (size * 8)) - 1;
+}
+
+
+/**
+ * @brief Parse decimal digits in [p, q) into (v)
+ * @return End of the digits, (p) if there are no digits or the value overflows
+ */
+static char const * csc_tabparse_digits (char const * p, char const * q, uintmax_t * v)
+{
+	uintmax_t x = 0;
+	char const * s = p;
+	while (s < q && *s >= '0' && *s <= '9')
+	{
+		unsigned d = (unsigned)(*s - '0');
+		if (x > (UINTMAX_MAX - d) / 10) {return p;}
+		x = x * 10 + d;
+		s++;
+	}
+	*v = x;
+	return s;
+}
+
+
+/**
+ * @brief Parse one cell [p, q)
+ * @return 1 on success, 0 if the cell is empty, has trailing characters or is out of range
+ */
+static int csc_tabparse_cell (struct csc_tabparse_column const * c, uint32_t row, char const * p, char const * q)
+{
+	if (p == q) {return 0;}
+	switch (c->kind)
+	{
+	case CSC_TABPARSE_KIND_UINT:{
+		uintmax_t v;
+		char const * s = csc_tabparse_digits (p, q, &v);
+		if (s == p || s != q || v > csc_tabparse_umax (c->size)) {return 0;}
+		csc_tabparse_store (c, row, v);
+		return 1;}
+	case CSC_TABPARSE_KIND_INT:{
+		int neg = (p[0] == '-');
+		char const * a = p + (neg || p[0] == '+');
+		uintmax_t v;
+		char const * s = csc_tabparse_digits (a, q, &v);
+		//The negative range is one larger than the positive range:
+		if (s == a || s != q || v > (csc_tabparse_umax (c->size) >> 1) + (uintmax_t)neg) {return 0;}
+		csc_tabparse_store (c, row, neg ? (0 - v) : v);
+		return 1;}
+	default:{
+		//Copy to a NUL terminated buffer so the parser can not read past the cell:
+		char buf [CSC_TABPARSE_MAXCELL];
+		size_t n = (size_t)(q - p);
+		if (n >= sizeof (buf)) {return 0;}
+		memcpy (buf, p, n);
+		buf[n] = '\0';
+		//Parse to a temporary so a rejected cell keeps the value 0:
+		union {uintmax_t u; long double f; char b [32];} v;
+		ASSERT (c->size <= sizeof (v));
+		char const * end;
+		if (c->parse (&v, buf, &end) == 0 || end != (buf + n)) {return 0;}
+		memcpy ((char *)c->data + (size_t)row * c->size, &v, c->size);
+		return 1;}
+	}
+}
+
+
+/**
+ * @brief Parse rows in [a, b) into rows starting at (row)
+ * @return Number of missing or unparsable cells
+ */
+static uint32_t csc_tabparse_range (struct csc_tabparse const * t, char const * a, char const * b, uint32_t row)
+{
+	uint32_t errors = 0;
+	while (a < b)
+	{
+		char const * e = memchr (a, '\n', (size_t)(b - a));
+		if (e == NULL) {e = b;}
+		if (csc_tabparse_skipline (a, e))
+		{
+			a = e + 1;
+			continue;
+		}
+		char const * p = a;
+		for (uint32_t i = 0; i < t->ncols; ++i)
+		{
+			char const * q;
+			if (t->sep)
+			{
+				while (p < e && (*p == ' ' || *p == '\t')) {p++;}
+				//The cell can not extend past the end of the line (e):
+				size_t rem = (p < e) ? (size_t)(e - p) : 0;
+				q = memchr (p, t->sep, rem);
+				if (q == NULL) {q = e;}
+				//Trim trailing whitespace and the '\r' of CRLF line endings:
+				char const * r = q;
+				while (r > p && (r[-1] == ' ' || r[-1] == '\t' || r[-1] == '\r')) {r--;}
+				errors += !csc_tabparse_cell (t->col + i, row, p, r);
+				p = (q < e) ? q + 1 : e;
+			}
+			else
+			{
+				while (p < e && (*p == ' ' || *p == '\t' || *p == '\r')) {p++;}
+				q = p;
+				while (q < e && *q != ' ' && *q != '\t' && *q != '\r') {q++;}
+				errors += !csc_tabparse_cell (t->col + i, row, p, q);
+				p = q;
+			}
+		}
+		row++;
+		a = e + 1;
+	}
+	return errors;
+}
+
+
+struct csc_tabparse_job
+{
+	struct csc_tabparse const * t;
+	char const * a;
+	char const * b;
+	uint32_t row;
+	uint32_t rows;
+	uint32_t errors;
+	int pass;
+};
+
+
+static void * csc_tabparse_thread (void * arg)
+{
+	struct csc_tabparse_job * j = arg;
+	if (j->pass == 0)
+	{
+		j->rows = csc_tabparse_count (j->a, j->b);
+	}
+	else
+	{
+		j->errors = csc_tabparse_range (j->t, j->a, j->b, j->row);
+	}
+	return NULL;
+}
+
+
+static void csc_tabparse_pass (struct csc_tabparse_job jobs[], uint32_t n, int pass)
+{
+	pthread_t threads[CSC_TABPARSE_MAXTHREADS];
+	for (uint32_t i = 0; i < n; ++i) {jobs[i].pass = pass;}
+	for (uint32_t i = 1; i < n; ++i)
+	{
+		int r = pthread_create (threads + i, NULL, csc_tabparse_thread, jobs + i);
+		ASSERTF (r == 0, "pthread_create %i", r);
+	}
+	csc_tabparse_thread (jobs + 0);
+	for (uint32_t i = 1; i < n; ++i)
+	{
+		pthread_join (threads[i], NULL);
+	}
+}
+
+
+/**
+ * @brief Parse the table in [a, b) into newly allocated column arrays
+ * @param nthreads Maximum number of threads, small tables uses fewer threads
+ * @return Number of rows
+ */
+static uint32_t csc_tabparse_run (struct csc_tabparse * t, char const * a, char const * b, uint32_t nthreads)
+{
+	ASSERT_PARAM_NOTNULL (t);
+	ASSERT_PARAM_NOTNULL (a);
+	ASSERT_PARAM_NOTNULL (b);
+	csc_tabparse_free (t);
+	size_t size = (size_t)(b - a);
+	nthreads = CLAMP (nthreads, 1, CSC_TABPARSE_MAXTHREADS);
+	nthreads = (uint32_t) MIN ((size_t)nthreads, size / CSC_TABPARSE_MINCHUNK + 1);
+	//Split at line boundaries:
+	struct csc_tabparse_job jobs[CSC_TABPARSE_MAXTHREADS];
+	char const * p = a;
+	for (uint32_t i = 0; i < nthreads; ++i)
+	{
+		char const * q = (i + 1 == nthreads) ? b : a + size * (i + 1) / nthreads;
+		if (q < p) {q = p;}
+		if (q < b)
+		{
+			char const * nl = memchr (q, '\n', (size_t)(b - q));
+			q = nl ? nl + 1 : b;
+		}
+		jobs[i] = (struct csc_tabparse_job){t, p, q, 0, 0, 0, 0};
+		p = q;
+	}
+	csc_tabparse_pass (jobs, nthreads, 0);
+	uint32_t rows = 0;
+	for (uint32_t i = 0; i < nthreads; ++i)
+	{
+		jobs[i].row = rows;
+		rows += jobs[i].rows;
+	}
+	for (uint32_t i = 0; i < t->ncols; ++i)
+	{
+		t->col[i].data = calloc ((size_t)MAX (rows, 1), t->col[i].size);
+		ASSERTF (t->col[i].data != NULL, "calloc %u rows", rows);
+	}
+	csc_tabparse_pass (jobs, nthreads, 1);
+	t->rows = rows;
+	t->errors = 0;
+	for (uint32_t i = 0; i < nthreads; ++i)
+	{
+		t->errors += jobs[i].errors;
+	}
+	return rows;
+}
+
+
+/**
+ * @brief Parse a table file, the file is mapped and not copied
+ * @return Number of rows or -1 if the file could not be opened
+ */
+static int64_t csc_tabparse_file (struct csc_tabparse * t, char const * filename, uint32_t nthreads)
+{
+	ASSERT_PARAM_NOTNULL (t);
+	ASSERT_PARAM_NOTNULL (filename);
+	struct csc_file_view view;
+	if (csc_file_view_open (&view, filename, CSC_FILE_VIEW_SEQUENTIAL) != 0) {return -1;}
+	uint32_t rows = csc_tabparse_run (t, view.data, view.data + view.size, nthreads);
+	csc_file_view_close (&view);
+	return rows;
+}
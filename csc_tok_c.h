@@ -3,6 +3,10 @@ SPDX-License-Identifier: GPL-2.0
 SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
 */
 #pragma once
+#include <stdint.h>
+#include <string.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
 
 
 enum csc_tok_c_type
@@ -12,7 +16,41 @@ enum csc_tok_c_type
 	CSC_TOK_C_INT,
 	CSC_TOK_C_IDENTIFIER,
 	CSC_TOK_C_LITERAL_INTEGER,
-	CSC_TOK_C_IF
+	CSC_TOK_C_IF,
+	CSC_TOK_C_LITERAL_FLOAT,
+	CSC_TOK_C_LITERAL_STRING,
+	CSC_TOK_C_LITERAL_CHAR,
+	CSC_TOK_C_AUTO,
+	CSC_TOK_C_BREAK,
+	CSC_TOK_C_CASE,
+	CSC_TOK_C_CHAR,
+	CSC_TOK_C_CONTINUE,
+	CSC_TOK_C_DEFAULT,
+	CSC_TOK_C_DO,
+	CSC_TOK_C_DOUBLE,
+	CSC_TOK_C_ELSE,
+	CSC_TOK_C_ENUM,
+	CSC_TOK_C_EXTERN,
+	CSC_TOK_C_FLOAT,
+	CSC_TOK_C_FOR,
+	CSC_TOK_C_GOTO,
+	CSC_TOK_C_INLINE,
+	CSC_TOK_C_LONG,
+	CSC_TOK_C_REGISTER,
+	CSC_TOK_C_RESTRICT,
+	CSC_TOK_C_RETURN,
+	CSC_TOK_C_SHORT,
+	CSC_TOK_C_SIGNED,
+	CSC_TOK_C_SIZEOF,
+	CSC_TOK_C_STATIC,
+	CSC_TOK_C_STRUCT,
+	CSC_TOK_C_SWITCH,
+	CSC_TOK_C_TYPEDEF,
+	CSC_TOK_C_UNION,
+	CSC_TOK_C_UNSIGNED,
+	CSC_TOK_C_VOLATILE,
+	CSC_TOK_C_WHILE,
+	CSC_TOK_C_BOOL,
 };
 
 
@@ -38,11 +76,715 @@ char const * tok_type_tostr (int t)
 	case '>': return ">";
 	case '|': return "|";
 	case '^': return "^";
+	case ';': return ";";
+	case '=': return "=";
+	case '[': return "[";
+	case ']': return "]";
+	case '.': return ".";
+	case '&': return "&";
+	case '!': return "!";
+	case '~': return "~";
+	case '%': return "%";
+	case '#': return "#";
 	case CSC_TOK_C_VOID: return "VOID";
 	case CSC_TOK_C_CONST: return "CONST";
 	case CSC_TOK_C_IDENTIFIER: return "IDENTIFIER";
 	case CSC_TOK_C_INT: return "INT";
 	case CSC_TOK_C_LITERAL_INTEGER: return "LITERAL_INTEGER";
+	case CSC_TOK_C_IF: return "IF";
+	case CSC_TOK_C_LITERAL_FLOAT: return "LITERAL_FLOAT";
+	case CSC_TOK_C_LITERAL_STRING: return "LITERAL_STRING";
+	case CSC_TOK_C_LITERAL_CHAR: return "LITERAL_CHAR";
+	case CSC_TOK_C_AUTO: return "AUTO";
+	case CSC_TOK_C_BREAK: return "BREAK";
+	case CSC_TOK_C_CASE: return "CASE";
+	case CSC_TOK_C_CHAR: return "CHAR";
+	case CSC_TOK_C_CONTINUE: return "CONTINUE";
+	case CSC_TOK_C_DEFAULT: return "DEFAULT";
+	case CSC_TOK_C_DO: return "DO";
+	case CSC_TOK_C_DOUBLE: return "DOUBLE";
+	case CSC_TOK_C_ELSE: return "ELSE";
+	case CSC_TOK_C_ENUM: return "ENUM";
+	case CSC_TOK_C_EXTERN: return "EXTERN";
+	case CSC_TOK_C_FLOAT: return "FLOAT";
+	case CSC_TOK_C_FOR: return "FOR";
+	case CSC_TOK_C_GOTO: return "GOTO";
+	case CSC_TOK_C_INLINE: return "INLINE";
+	case CSC_TOK_C_LONG: return "LONG";
+	case CSC_TOK_C_REGISTER: return "REGISTER";
+	case CSC_TOK_C_RESTRICT: return "RESTRICT";
+	case CSC_TOK_C_RETURN: return "RETURN";
+	case CSC_TOK_C_SHORT: return "SHORT";
+	case CSC_TOK_C_SIGNED: return "SIGNED";
+	case CSC_TOK_C_SIZEOF: return "SIZEOF";
+	case CSC_TOK_C_STATIC: return "STATIC";
+	case CSC_TOK_C_STRUCT: return "STRUCT";
+	case CSC_TOK_C_SWITCH: return "SWITCH";
+	case CSC_TOK_C_TYPEDEF: return "TYPEDEF";
+	case CSC_TOK_C_UNION: return "UNION";
+	case CSC_TOK_C_UNSIGNED: return "UNSIGNED";
+	case CSC_TOK_C_VOLATILE: return "VOLATILE";
+	case CSC_TOK_C_WHILE: return "WHILE";
+	case CSC_TOK_C_BOOL: return "BOOL";
 	}
 	return 0;
 }
+
+
+
+
+/*
+Zero-copy tokenizer.
+Tokens are views [a, b) into the source buffer, nothing is copied.
+Whitespace and comments are skipped.
+Punctuation is returned as the character itself e.g. '{', '+'.
+*/
+struct csc_tok
+{
+	int type;
+	char const * a;
+	char const * b;
+	uint32_t line;
+	uint32_t col;
+};
+
+
+struct csc_tok_c
+{
+	char const * p; //Current position
+	char const * e; //End of source
+	char const * stop; //No token starts at or after this position, tokens can extend to (e)
+	char const * linestart;
+	uint32_t line;
+};
+
+
+enum csc_tok_c_class
+{
+	CSC_TOK_C_CLASS_PUNCT,
+	CSC_TOK_C_CLASS_SPACE,
+	CSC_TOK_C_CLASS_NEWLINE,
+	CSC_TOK_C_CLASS_ALPHA,
+	CSC_TOK_C_CLASS_DIGIT,
+	CSC_TOK_C_CLASS_QUOTE,
+	CSC_TOK_C_CLASS_SLASH,
+	CSC_TOK_C_CLASS_DOT,
+};
+
+
+static uint8_t const csc_tok_c_class [256] =
+{
+	['\t'] = CSC_TOK_C_CLASS_SPACE,
+	['\v'] = CSC_TOK_C_CLASS_SPACE,
+	['\f'] = CSC_TOK_C_CLASS_SPACE,
+	['\r'] = CSC_TOK_C_CLASS_SPACE,
+	[' '] = CSC_TOK_C_CLASS_SPACE,
+	['\n'] = CSC_TOK_C_CLASS_NEWLINE,
+	['a' ... 'z'] = CSC_TOK_C_CLASS_ALPHA,
+	['A' ... 'Z'] = CSC_TOK_C_CLASS_ALPHA,
+	['_'] = CSC_TOK_C_CLASS_ALPHA,
+	[0x80 ... 0xFF] = CSC_TOK_C_CLASS_ALPHA,
+	['0' ... '9'] = CSC_TOK_C_CLASS_DIGIT,
+	['"'] = CSC_TOK_C_CLASS_QUOTE,
+	['\''] = CSC_TOK_C_CLASS_QUOTE,
+	['/'] = CSC_TOK_C_CLASS_SLASH,
+	['.'] = CSC_TOK_C_CLASS_DOT,
+};
+
+
+//Characters that can continue a identifier or a number:
+#define CSC_TOK_C_ISALNUM(c) (csc_tok_c_class [(uint8_t)(c)] == CSC_TOK_C_CLASS_ALPHA || csc_tok_c_class [(uint8_t)(c)] == CSC_TOK_C_CLASS_DIGIT)
+
+
+struct csc_tok_c_keyword
+{
+	char const * str;
+	uint32_t len;
+	int type;
+};
+
+
+/*
+Perfect hash of all keywords, collision free for this keyword set.
+Generated by searching the constants of CSC_TOK_C_KEYWORD_HASH.
+*/
+#define CSC_TOK_C_KEYWORD_HASH(s, n) (((n)*15 + (uint8_t)(s)[0]*39 + (uint8_t)(s)[(n)-1]*10 + (uint8_t)(s)[1]) & 63)
+static struct csc_tok_c_keyword const csc_tok_c_keywords [64] =
+{
+	[0] = {"short", 5, CSC_TOK_C_SHORT},
+	[1] = {"extern", 6, CSC_TOK_C_EXTERN},
+	[3] = {"restrict", 8, CSC_TOK_C_RESTRICT},
+	[4] = {"sizeof", 6, CSC_TOK_C_SIZEOF},
+	[6] = {"while", 5, CSC_TOK_C_WHILE},
+	[9] = {"float", 5, CSC_TOK_C_FLOAT},
+	[10] = {"typedef", 7, CSC_TOK_C_TYPEDEF},
+	[13] = {"void", 4, CSC_TOK_C_VOID},
+	[14] = {"auto", 4, CSC_TOK_C_AUTO},
+	[15] = {"enum", 4, CSC_TOK_C_ENUM},
+	[18] = {"default", 7, CSC_TOK_C_DEFAULT},
+	[19] = {"volatile", 8, CSC_TOK_C_VOLATILE},
+	[23] = {"const", 5, CSC_TOK_C_CONST},
+	[24] = {"union", 5, CSC_TOK_C_UNION},
+	[25] = {"break", 5, CSC_TOK_C_BREAK},
+	[26] = {"for", 3, CSC_TOK_C_FOR},
+	[27] = {"struct", 6, CSC_TOK_C_STRUCT},
+	[31] = {"do", 2, CSC_TOK_C_DO},
+	[33] = {"unsigned", 8, CSC_TOK_C_UNSIGNED},
+	[34] = {"int", 3, CSC_TOK_C_INT},
+	[36] = {"case", 4, CSC_TOK_C_CASE},
+	[37] = {"long", 4, CSC_TOK_C_LONG},
+	[38] = {"switch", 6, CSC_TOK_C_SWITCH},
+	[41] = {"return", 6, CSC_TOK_C_RETURN},
+	[45] = {"char", 4, CSC_TOK_C_CHAR},
+	[46] = {"continue", 8, CSC_TOK_C_CONTINUE},
+	[47] = {"register", 8, CSC_TOK_C_REGISTER},
+	[48] = {"signed", 6, CSC_TOK_C_SIGNED},
+	[49] = {"static", 6, CSC_TOK_C_STATIC},
+	[50] = {"goto", 4, CSC_TOK_C_GOTO},
+	[55] = {"double", 6, CSC_TOK_C_DOUBLE},
+	[57] = {"inline", 6, CSC_TOK_C_INLINE},
+	[61] = {"else", 4, CSC_TOK_C_ELSE},
+	[62] = {"_Bool", 5, CSC_TOK_C_BOOL},
+	[63] = {"if", 2, CSC_TOK_C_IF},
+};
+
+
+static inline int csc_tok_c_keyword (char const * a, uint32_t n)
+{
+	if ((n < 2) || (n > 8)) {return CSC_TOK_C_IDENTIFIER;}
+	struct csc_tok_c_keyword const * k = csc_tok_c_keywords + CSC_TOK_C_KEYWORD_HASH (a, n);
+	if ((k->len == n) && (memcmp (k->str, a, n) == 0)) {return k->type;}
+	return CSC_TOK_C_IDENTIFIER;
+}
+
+
+static void csc_tok_c_init (struct csc_tok_c * t, char const * a, char const * b)
+{
+	ASSERT_PARAM_NOTNULL (t);
+	ASSERT_PARAM_NOTNULL (a);
+	ASSERT_PARAM_NOTNULL (b);
+	t->p = a;
+	t->e = b;
+	t->stop = b;
+	t->linestart = a;
+	t->line = 1;
+}
+
+
+//Skip number or identifier characters including exponent sign e.g. 1.5e-3
+static inline char const * csc_tok_c_skip_number (char const * p, char const * e, int * type)
+{
+	while (p < e)
+	{
+		char c = *p;
+		if (CSC_TOK_C_ISALNUM (c)) {}
+		else if (c == '.') {*type = CSC_TOK_C_LITERAL_FLOAT;}
+		else if (((c == '+') || (c == '-')) && ((p[-1] == 'e') || (p[-1] == 'E') || (p[-1] == 'p') || (p[-1] == 'P')))
+		{
+			*type = CSC_TOK_C_LITERAL_FLOAT;
+		}
+		else {break;}
+		p ++;
+	}
+	return p;
+}
+
+
+//Skip string or char literal starting at (p) which points to the quote character
+//(*open) is set when (e) is reached before the closing quote
+static inline char const * csc_tok_c_skip_quote (char const * p, char const * e, int * open)
+{
+	char q = *p;
+	p ++;
+	while (p < e)
+	{
+		char c = *p;
+		if (c == '\\') {p += 2; continue;}
+		if (c == q) {return p + 1;}
+		//Unterminated literal ends at newline:
+		if (c == '\n') {return p;}
+		p ++;
+	}
+	*open = 1;
+	return e;
+}
+
+
+//Type of skipped whitespace and comments:
+#define CSC_TOK_C_SKIP (-1)
+
+
+/**
+ * @brief Scan one token, whitespace or comment starting at (p)
+ * @param p    Start, must be less than (e)
+ * @param e    End of available input
+ * @param type Token type or CSC_TOK_C_SKIP for whitespace and comments
+ * @param open Set to 1 when the scanned construct reached (e) and could continue in more input
+ * @return End of the scanned construct
+ */
+static inline char const * csc_tok_c_scan (char const * p, char const * e, int * type, int * open)
+{
+	char const * a = p;
+	*open = 0;
+	switch (csc_tok_c_class [(uint8_t)*p])
+	{
+	case CSC_TOK_C_CLASS_SPACE:
+	case CSC_TOK_C_CLASS_NEWLINE:
+		*type = CSC_TOK_C_SKIP;
+		return p + 1;
+	case CSC_TOK_C_CLASS_SLASH:
+		if (p + 1 == e)
+		{
+			*type = '/';
+			*open = 1;
+			return e;
+		}
+		if (p[1] == '/')
+		{
+			*type = CSC_TOK_C_SKIP;
+			p = memchr (p + 2, '\n', (size_t)(e - (p + 2)));
+			if (p == NULL) {*open = 1; return e;}
+			return p;
+		}
+		if (p[1] == '*')
+		{
+			*type = CSC_TOK_C_SKIP;
+			p += 2;
+			while (1)
+			{
+				p = memchr (p, '*', (size_t)(e - p));
+				if ((p == NULL) || (p + 1 == e)) {*open = 1; return e;}
+				if (p[1] == '/') {return p + 2;}
+				p ++;
+			}
+		}
+		*type = '/';
+		return p + 1;
+	case CSC_TOK_C_CLASS_ALPHA:
+		p ++;
+		while ((p < e) && CSC_TOK_C_ISALNUM (*p)) {p ++;}
+		*open = (p == e);
+		*type = csc_tok_c_keyword (a, (uint32_t)(p - a));
+		return p;
+	case CSC_TOK_C_CLASS_DOT:
+		if (p + 1 == e)
+		{
+			*type = '.';
+			*open = 1;
+			return e;
+		}
+		if (csc_tok_c_class [(uint8_t)p[1]] == CSC_TOK_C_CLASS_DIGIT)
+		{
+			*type = CSC_TOK_C_LITERAL_FLOAT;
+			p = csc_tok_c_skip_number (p + 1, e, type);
+			*open = (p == e);
+			return p;
+		}
+		*type = '.';
+		return p + 1;
+	case CSC_TOK_C_CLASS_DIGIT:
+		*type = CSC_TOK_C_LITERAL_INTEGER;
+		p = csc_tok_c_skip_number (p + 1, e, type);
+		*open = (p == e);
+		return p;
+	case CSC_TOK_C_CLASS_QUOTE:
+		*type = (*p == '"') ? CSC_TOK_C_LITERAL_STRING : CSC_TOK_C_LITERAL_CHAR;
+		return csc_tok_c_skip_quote (p, e, open);
+	default:
+		*type = (uint8_t)*p;
+		return p + 1;
+	}
+}
+
+
+/**
+ * @brief Count newlines in [a, b)
+ * @param ls Set to the start of the last line if any newline is found
+ */
+static inline uint32_t csc_tok_c_lines (char const * a, char const * b, char const ** ls)
+{
+	uint32_t n = 0;
+	while (a < b)
+	{
+		a = memchr (a, '\n', (size_t)(b - a));
+		if (a == NULL) {break;}
+		a ++;
+		(*ls) = a;
+		n ++;
+	}
+	return n;
+}
+
+
+/**
+ * @brief Tokenize next batch of tokens
+ * @param t   Tokenizer state
+ * @param tok Output tokens
+ * @param n   Capacity of (tok)
+ * @return Number of tokens written to (tok). 0 when the source is exhausted.
+ */
+static uint32_t csc_tok_c_next (struct csc_tok_c * t, struct csc_tok tok[], uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (t);
+	ASSERT_PARAM_NOTNULL (tok);
+	char const * p = t->p;
+	char const * e = t->e;
+	char const * stop = t->stop;
+	char const * ls = t->linestart;
+	uint32_t line = t->line;
+	uint32_t i = 0;
+	while ((i < n) && (p < stop))
+	{
+		switch (csc_tok_c_class [(uint8_t)*p])
+		{
+		case CSC_TOK_C_CLASS_SPACE:
+			p ++;
+			continue;
+		case CSC_TOK_C_CLASS_NEWLINE:
+			p ++;
+			line ++;
+			ls = p;
+			continue;
+		}
+		char const * a = p;
+		int type;
+		int open;
+		p = csc_tok_c_scan (p, e, &type, &open);
+		if (type == CSC_TOK_C_SKIP)
+		{
+			line += csc_tok_c_lines (a, p, &ls);
+			continue;
+		}
+		tok[i].type = type;
+		tok[i].a = a;
+		tok[i].b = p;
+		tok[i].line = line;
+		tok[i].col = (uint32_t)(a - ls) + 1;
+		i ++;
+		//String and char literals can continue over escaped newlines:
+		if ((type == CSC_TOK_C_LITERAL_STRING) || (type == CSC_TOK_C_LITERAL_CHAR))
+		{
+			line += csc_tok_c_lines (a, p, &ls);
+		}
+	}
+	t->p = p;
+	t->linestart = ls;
+	t->line = line;
+	return i;
+}
+
+
+
+
+/*
+Streaming tokenizer.
+The source is fed in chunks of any size. Tokens that are complete within a chunk
+point into the chunk, a token that straddles chunks is assembled in (carry) and points there.
+All tokens are handed to the callback in batches before csc_tok_c_stream_feed returns,
+so the chunk can be reused by the caller afterwards.
+Only the carried token and the batch are stored, memory does not depend on input size.
+*/
+#define CSC_TOK_C_STREAM_BATCH 256
+typedef void (*csc_tok_c_stream_cb)(struct csc_tok const tok[], uint32_t n, void * ptr);
+
+
+struct csc_tok_c_stream
+{
+	csc_tok_c_stream_cb cb;
+	void * ptr;
+	//Partial token from previous chunk:
+	char * carry;
+	uint32_t carry_n;
+	uint32_t carry_cap;
+	uint32_t carry_line;
+	uint32_t carry_col;
+	//Inside a comment that continues in the next chunk, 1 line comment, 2 block comment:
+	int comment;
+	//Block comment: last character of previous chunk was '*':
+	int star;
+	//Position of the next character:
+	uint32_t line;
+	uint32_t col;
+	uint32_t tok_n;
+	struct csc_tok tok [CSC_TOK_C_STREAM_BATCH];
+};
+
+
+static void csc_tok_c_stream_init (struct csc_tok_c_stream * s, csc_tok_c_stream_cb cb, void * ptr)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	ASSERT_PARAM_NOTNULL (cb);
+	memset (s, 0, sizeof (struct csc_tok_c_stream));
+	s->cb = cb;
+	s->ptr = ptr;
+	s->line = 1;
+	s->col = 1;
+}
+
+
+static void csc_tok_c_stream_free (struct csc_tok_c_stream * s)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	free (s->carry);
+	s->carry = NULL;
+	s->carry_n = 0;
+	s->carry_cap = 0;
+}
+
+
+static void csc_tok_c_stream_flush (struct csc_tok_c_stream * s)
+{
+	if (s->tok_n == 0) {return;}
+	s->cb (s->tok, s->tok_n, s->ptr);
+	s->tok_n = 0;
+}
+
+
+static inline void csc_tok_c_stream_emit (struct csc_tok_c_stream * s, int type, char const * a, char const * b, uint32_t line, uint32_t col)
+{
+	struct csc_tok * t = s->tok + s->tok_n;
+	t->type = type;
+	t->a = a;
+	t->b = b;
+	t->line = line;
+	t->col = col;
+	s->tok_n ++;
+	if (s->tok_n == CSC_TOK_C_STREAM_BATCH)
+	{
+		csc_tok_c_stream_flush (s);
+	}
+}
+
+
+static void csc_tok_c_stream_append (struct csc_tok_c_stream * s, char const * a, char const * b)
+{
+	uint32_t n = (uint32_t)(b - a);
+	if (s->carry_n + n > s->carry_cap)
+	{
+		s->carry_cap = MAX (64, (s->carry_n + n) * 2);
+		s->carry = realloc (s->carry, s->carry_cap);
+		ASSERTF (s->carry != NULL, "realloc %i bytes", s->carry_cap);
+	}
+	memcpy (s->carry + s->carry_n, a, n);
+	s->carry_n += n;
+}
+
+
+//Move the position (line, col) over the characters [a, b)
+static inline void csc_tok_c_stream_advance (struct csc_tok_c_stream * s, char const * a, char const * b)
+{
+	char const * ls = NULL;
+	uint32_t n = csc_tok_c_lines (a, b, &ls);
+	if (n)
+	{
+		s->line += n;
+		s->col = (uint32_t)(b - ls) + 1;
+	}
+	else
+	{
+		s->col += (uint32_t)(b - a);
+	}
+}
+
+
+//Enter comment mode for a comment [a, e) that continues in the next chunk
+static inline void csc_tok_c_stream_open_comment (struct csc_tok_c_stream * s, char const * a, char const * e)
+{
+	s->comment = (a[1] == '/') ? 1 : 2;
+	s->star = (s->comment == 2) && (e - a > 2) && (e[-1] == '*');
+	csc_tok_c_stream_advance (s, a, e);
+}
+
+
+/**
+ * @brief Continue a comment from the previous chunk
+ * @return Position after the comment or (e) if the comment continues
+ */
+static char const * csc_tok_c_stream_comment (struct csc_tok_c_stream * s, char const * p, char const * e)
+{
+	char const * a = p;
+	if (s->comment == 1)
+	{
+		p = memchr (p, '\n', (size_t)(e - p));
+		if (p == NULL) {p = e;}
+		else {s->comment = 0;}
+	}
+	else if (s->star && (p < e) && (*p == '/'))
+	{
+		p ++;
+		s->comment = 0;
+	}
+	else
+	{
+		while (1)
+		{
+			p = memchr (p, '*', (size_t)(e - p));
+			if ((p == NULL) || (p + 1 == e))
+			{
+				//An empty chunk keeps the pending '*' from the previous chunk:
+				if (a < e) {s->star = (p != NULL);}
+				p = e;
+				break;
+			}
+			if (p[1] == '/')
+			{
+				p += 2;
+				s->comment = 0;
+				break;
+			}
+			p ++;
+		}
+	}
+	csc_tok_c_stream_advance (s, a, p);
+	return p;
+}
+
+
+/**
+ * @brief Complete the carried token with characters from the chunk
+ * @return Position in the chunk after the carried token, (e) if the token continues
+ */
+static char const * csc_tok_c_stream_carry (struct csc_tok_c_stream * s, char const * p, char const * e, int last)
+{
+	while (1)
+	{
+		//Tokens can only continue over a newline by escape, append one line at a time:
+		char const * q = memchr (p, '\n', (size_t)(e - p));
+		q = q ? (q + 1) : e;
+		uint32_t n0 = s->carry_n;
+		csc_tok_c_stream_append (s, p, q);
+		int type;
+		int open;
+		char const * end = csc_tok_c_scan (s->carry, s->carry + s->carry_n, &type, &open);
+		if (open && (type == CSC_TOK_C_SKIP) && !last)
+		{
+			//Do not carry comments, continue them in comment mode:
+			s->line = s->carry_line;
+			s->col = s->carry_col;
+			csc_tok_c_stream_open_comment (s, s->carry, s->carry + s->carry_n);
+			s->carry_n = 0;
+			return q;
+		}
+		if (open && (q < e))
+		{
+			p = q;
+			continue;
+		}
+		if (open && !last)
+		{
+			return e;
+		}
+		//The carried token ended at (end), step back to it in the chunk:
+		uint32_t used = (uint32_t)(end - s->carry);
+		ASSERT (used >= n0);
+		p = q - (s->carry_n - used);
+		if (type != CSC_TOK_C_SKIP)
+		{
+			csc_tok_c_stream_emit (s, type, s->carry, end, s->carry_line, s->carry_col);
+		}
+		s->line = s->carry_line;
+		s->col = s->carry_col;
+		csc_tok_c_stream_advance (s, s->carry, end);
+		//The carry buffer is reused only after the batch is flushed:
+		s->carry_n = 0;
+		return p;
+	}
+}
+
+
+/**
+ * @brief Tokenize chunk
+ * @param s     Stream state
+ * @param chunk Next part of the source
+ * @param len   Number of characters in (chunk)
+ * @param last  Set to 1 when this is the last chunk
+ */
+static void csc_tok_c_stream_feed (struct csc_tok_c_stream * s, char const * chunk, uint32_t len, int last)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	ASSERT (chunk || (len == 0));
+	if (len == 0)
+	{
+		//(chunk) can be NULL, finish the carried token of the last chunk without reading (chunk):
+		char const * z = "";
+		if (last && s->carry_n) {csc_tok_c_stream_carry (s, z, z, 1);}
+		csc_tok_c_stream_flush (s);
+		return;
+	}
+	char const * p = chunk;
+	char const * e = chunk + len;
+	if (s->carry_n)
+	{
+		p = csc_tok_c_stream_carry (s, p, e, last);
+		if (s->carry_n) {goto done;}
+	}
+	if (s->comment)
+	{
+		p = csc_tok_c_stream_comment (s, p, e);
+		if (s->comment) {goto done;}
+	}
+	{
+		//Column of a position (x) is (x - ls + 1) after a newline in the chunk,
+		//otherwise (col0 + x - p0):
+		char const * p0 = p;
+		char const * ls = NULL;
+		uint32_t col0 = s->col;
+		uint32_t line = s->line;
+		while (p < e)
+		{
+			switch (csc_tok_c_class [(uint8_t)*p])
+			{
+			case CSC_TOK_C_CLASS_SPACE:
+				p ++;
+				continue;
+			case CSC_TOK_C_CLASS_NEWLINE:
+				p ++;
+				line ++;
+				ls = p;
+				continue;
+			}
+			char const * a = p;
+			int type;
+			int open;
+			p = csc_tok_c_scan (p, e, &type, &open);
+			uint32_t col = ls ? (uint32_t)(a - ls) + 1 : col0 + (uint32_t)(a - p0);
+			if (open && !last)
+			{
+				s->line = line;
+				s->col = col;
+				if (type == CSC_TOK_C_SKIP)
+				{
+					csc_tok_c_stream_open_comment (s, a, e);
+				}
+				else
+				{
+					//Tokens in the batch may point into (carry), flush before reusing it:
+					csc_tok_c_stream_flush (s);
+					s->carry_n = 0;
+					s->carry_line = line;
+					s->carry_col = col;
+					csc_tok_c_stream_append (s, a, e);
+				}
+				goto done;
+			}
+			if (type == CSC_TOK_C_SKIP)
+			{
+				line += csc_tok_c_lines (a, p, &ls);
+				continue;
+			}
+			csc_tok_c_stream_emit (s, type, a, p, line, col);
+			if ((type == CSC_TOK_C_LITERAL_STRING) || (type == CSC_TOK_C_LITERAL_CHAR))
+			{
+				line += csc_tok_c_lines (a, p, &ls);
+			}
+		}
+		s->line = line;
+		s->col = ls ? (uint32_t)(e - ls) + 1 : col0 + (uint32_t)(e - p0);
+	}
+done:
+	if (last && s->carry_n)
+	{
+		csc_tok_c_stream_carry (s, e, e, 1);
+	}
+	csc_tok_c_stream_flush (s);
+}
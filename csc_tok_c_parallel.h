@@ -0,0 +1,179 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_tok_c.h"
+
+
+/*
+Parallel tokenizer.
+The source is split after newlines into one chunk per thread. Each thread speculates
+that its chunk starts outside of any comment or literal and tokenizes it independently.
+The chunks are then stitched in order: a chunk is accepted when the previous chunk stopped
+exactly at its start, otherwise (e.g. a block comment crossing the split) it is tokenized
+again from where the previous chunk stopped. Line numbers are offset while stitching.
+*/
+#define CSC_TOK_C_PARALLEL_MAX 64
+#define CSC_TOK_C_PARALLEL_MINCHUNK (256 * 1024)
+
+
+struct csc_tok_c_chunk
+{
+	char const * a; //Speculative start
+	char const * b; //Start of next chunk
+	char const * e; //End of source
+	char const * stop; //Position where the tokenizer stopped, at or after (b)
+	uint32_t lines; //Number of newlines in [a, stop)
+	struct csc_tok * tok;
+	uint32_t tok_n;
+	uint32_t tok_cap;
+};
+
+
+/**
+ * @brief Tokenize from state (t) until (t->stop) appending to the chunk token array
+ */
+static void csc_tok_c_chunk_run (struct csc_tok_c_chunk * c, struct csc_tok_c * t)
+{
+	while (1)
+	{
+		if (c->tok_cap - c->tok_n < 1024)
+		{
+			//Start with a guess of one token per 4 characters:
+			c->tok_cap = MAX ((uint32_t)((c->b - c->a) / 4) + 1024, c->tok_cap * 2);
+			c->tok = realloc (c->tok, c->tok_cap * sizeof (struct csc_tok));
+			ASSERTF (c->tok != NULL, "realloc %i tokens", c->tok_cap);
+		}
+		uint32_t n = csc_tok_c_next (t, c->tok + c->tok_n, c->tok_cap - c->tok_n);
+		if (n == 0) {break;}
+		c->tok_n += n;
+	}
+	c->stop = t->p;
+	c->lines = t->line - 1;
+}
+
+
+static void * csc_tok_c_chunk_thread (void * ptr)
+{
+	struct csc_tok_c_chunk * c = ptr;
+	struct csc_tok_c t;
+	csc_tok_c_init (&t, c->a, c->e);
+	t.stop = c->b;
+	csc_tok_c_chunk_run (c, &t);
+	return NULL;
+}
+
+
+/**
+ * @brief Tokenize [a, b) using (nthreads) threads
+ * @param count Number of tokens returned
+ * @return Array of tokens allocated with malloc, same result as csc_tok_c_next over the whole source
+ */
+static struct csc_tok * csc_tok_c_parallel (char const * a, char const * b, uint32_t nthreads, uint32_t * count)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	ASSERT_PARAM_NOTNULL (b);
+	ASSERT_PARAM_NOTNULL (count);
+	size_t size = (size_t)(b - a);
+	nthreads = CLAMP (nthreads, 1, CSC_TOK_C_PARALLEL_MAX);
+	nthreads = (uint32_t) MIN (nthreads, MAX (size / CSC_TOK_C_PARALLEL_MINCHUNK, 1));
+	struct csc_tok_c_chunk chunk [CSC_TOK_C_PARALLEL_MAX];
+	memset (chunk, 0, sizeof (chunk));
+
+	//Split after newlines:
+	char const * p = a;
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < nthreads; ++i)
+	{
+		char const * q = a + (size * (i + 1)) / nthreads;
+		if (i + 1 < nthreads)
+		{
+			q = memchr (MAX (q, p), '\n', (size_t)(b - MAX (q, p)));
+			q = q ? (q + 1) : b;
+		}
+		if (q <= p) {continue;}
+		chunk[n].a = p;
+		chunk[n].b = q;
+		chunk[n].e = b;
+		n ++;
+		p = q;
+		if (p == b) {break;}
+	}
+
+	pthread_t thread [CSC_TOK_C_PARALLEL_MAX];
+	for (uint32_t i = 1; i < n; ++i)
+	{
+		int r = pthread_create (thread + i, NULL, csc_tok_c_chunk_thread, chunk + i);
+		ASSERTF (r == 0, "pthread_create %i", r);
+	}
+	if (n == 0)
+	{
+		*count = 0;
+		return malloc (sizeof (struct csc_tok));
+	}
+	csc_tok_c_chunk_thread (chunk + 0);
+	for (uint32_t i = 1; i < n; ++i)
+	{
+		pthread_join (thread[i], NULL);
+	}
+
+	//Stitch, the first chunk is always valid and its array is reused for the result:
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < n; ++i) {total += chunk[i].tok_n;}
+	uint32_t tok_cap = MAX (total, 1);
+	struct csc_tok * tok = realloc (chunk[0].tok, tok_cap * sizeof (struct csc_tok));
+	ASSERTF (tok != NULL, "realloc %i tokens", tok_cap);
+	uint32_t tok_n = chunk[0].tok_n;
+	uint32_t line = chunk[0].lines;
+	p = chunk[0].stop;
+	for (uint32_t i = 1; i < n; ++i)
+	{
+		struct csc_tok_c_chunk * c = chunk + i;
+		if (p >= c->b)
+		{
+			//Previous chunk stopped after the whole chunk, nothing to keep:
+			free (c->tok);
+			continue;
+		}
+		if (p != c->a)
+		{
+			//Speculation failed, tokenize again from where the previous chunk stopped:
+			struct csc_tok_c t;
+			csc_tok_c_init (&t, p, b);
+			t.stop = c->b;
+			c->tok_n = 0;
+			csc_tok_c_chunk_run (c, &t);
+			//The restart is in the middle of a line:
+			char const * ls = p;
+			while ((ls > a) && (ls[-1] != '\n')) {ls --;}
+			for (uint32_t j = 0; (j < c->tok_n) && (c->tok[j].line == 1); ++j)
+			{
+				c->tok[j].col += (uint32_t)(p - ls);
+			}
+		}
+		if (tok_n + c->tok_n > tok_cap)
+		{
+			tok_cap = tok_n + c->tok_n;
+			tok = realloc (tok, tok_cap * sizeof (struct csc_tok));
+			ASSERTF (tok != NULL, "realloc %i tokens", tok_cap);
+		}
+		for (uint32_t j = 0; j < c->tok_n; ++j)
+		{
+			tok[tok_n] = c->tok[j];
+			tok[tok_n].line += line;
+			tok_n ++;
+		}
+		line += c->lines;
+		p = c->stop;
+		free (c->tok);
+	}
+	*count = tok_n;
+	return tok;
+}
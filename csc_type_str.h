@@ -6,119 +6,316 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <ctype.h>
 #include <inttypes.h>
 
 #include "csc_basic.h"
+#include "csc_strfrom.h"
+
+
+/*
+Per type descriptor table.
+The table is generated from CSC_TYPE_STR_LIST so each type has its own
+parse, format, flag and bulk functions and no function switches over enum csc_type.
+Values are accessed with memcpy so destinations does not need to be aligned.
+X (type, name, ctype, kind, printf format, printf argument type)
+kind U = unsigned, I = signed, F = float, D = double, C = char
+*/
+#define CSC_TYPE_STR_LIST(X) \
+X (CSC_TYPE_CHAR,   char,   char,     C, "%c",  int) \
+X (CSC_TYPE_INT,    int,    int,      I, "%i",  int) \
+X (CSC_TYPE_LONG,   long,   long,     I, "%li", long) \
+X (CSC_TYPE_FLOAT,  float,  float,    F, "%f",  double) \
+X (CSC_TYPE_DOUBLE, double, double,   D, "%f",  double) \
+X (CSC_TYPE_U,      u,      unsigned, U, "%u",  unsigned) \
+X (CSC_TYPE_U8,     u8,     uint8_t,  U, "%u",  unsigned) \
+X (CSC_TYPE_U16,    u16,    uint16_t, U, "%u",  unsigned) \
+X (CSC_TYPE_U32,    u32,    uint32_t, U, "%u",  unsigned) \
+X (CSC_TYPE_U64,    u64,    uint64_t, U, "%ju", uintmax_t) \
+X (CSC_TYPE_I,      i,      int,      I, "%i",  int) \
+X (CSC_TYPE_I8,     i8,     int8_t,   I, "%i",  int) \
+X (CSC_TYPE_I16,    i16,    int16_t,  I, "%i",  int) \
+X (CSC_TYPE_I32,    i32,    int32_t,  I, "%i",  int) \
+X (CSC_TYPE_I64,    i64,    int64_t,  I, "%ji", intmax_t) \
+X (CSC_TYPE_F32,    f32,    float,    F, "%f",  double) \
+X (CSC_TYPE_F64,    f64,    double,   D, "%f",  double)
+
+#define CSC_TYPE_STR_COUNT (CSC_TYPE_TEXTURE2D + 1)
+
+
+typedef int (*csc_type_parse_fn)(void * dst, char const * src, char const ** end);
+typedef int (*csc_type_format_fn)(char * o, uint32_t n, void const * src);
+typedef uint32_t (*csc_type_parsev_fn)(void * dst, char const * const src[], uint32_t n);
+typedef uint32_t (*csc_type_parset_fn)(void * dst, uint32_t n, char const ** p);
+typedef void (*csc_type_flagset_fn)(void * dst, uint64_t flag);
+typedef int (*csc_type_flagget_fn)(void const * src, uint64_t flag);
+typedef uint32_t (*csc_type_fromva_fn)(char * o, uint32_t n, va_list * va, int base, char sign);
+
+
+struct csc_type_desc
+{
+	char const * name;
+	uint32_t size;
+	uint32_t align;
+	//Parse one value, returns 1 on success and 0 if nothing was parsed:
+	csc_type_parse_fn parse;
+	//Format one value like snprintf:
+	csc_type_format_fn format;
+	//Parse (n) strings into a array, returns number of parsed strings:
+	csc_type_parsev_fn parsev;
+	//Parse up to (n) values separated by whitespace, ',' or ';', returns number of values:
+	csc_type_parset_fn parset;
+	//Flag operations, only integer types:
+	csc_type_flagset_fn flagset;
+	csc_type_flagget_fn flagget;
+	//Write a variadic argument with strfrom, only integer types:
+	csc_type_fromva_fn fromva;
+};
+
+
+static inline char csc_type_str_strtoc (char const * s, char ** e)
+{
+	*e = (char *)s + (s[0] != '\0');
+	return s[0];
+}
+
+
+#define CSC_TYPE_STR_STRTO_U(s,e) strtoumax ((s), (e), 0)
+#define CSC_TYPE_STR_STRTO_I(s,e) strtoimax ((s), (e), 0)
+#define CSC_TYPE_STR_STRTO_F(s,e) strtof ((s), (e))
+#define CSC_TYPE_STR_STRTO_D(s,e) strtod ((s), (e))
+#define CSC_TYPE_STR_STRTO_C(s,e) csc_type_str_strtoc ((s), (e))
+
+
+#define CSC_TYPE_STR_FLAGS_U(name, T) \
+static void csc_type_flagset_##name (void * dst, uint64_t flag) \
+{ \
+	T v; \
+	memcpy (&v, dst, sizeof (T)); \
+	v |= (T)flag; \
+	memcpy (dst, &v, sizeof (T)); \
+} \
+static int csc_type_flagget_##name (void const * src, uint64_t flag) \
+{ \
+	T v; \
+	memcpy (&v, src, sizeof (T)); \
+	return (v & (T)flag) != 0; \
+} \
+static uint32_t csc_type_fromva_##name (char * o, uint32_t n, va_list * va, int base, char sign) \
+{ \
+	UNUSED (sign); \
+	return strfrom_umax (o, n, (T) va_arg (*va, CSC_TYPE_STR_VA_##name), base); \
+}
+#define CSC_TYPE_STR_FLAGS_I(name, T) \
+static void csc_type_flagset_##name (void * dst, uint64_t flag) \
+{ \
+	T v; \
+	memcpy (&v, dst, sizeof (T)); \
+	v |= (T)flag; \
+	memcpy (dst, &v, sizeof (T)); \
+} \
+static int csc_type_flagget_##name (void const * src, uint64_t flag) \
+{ \
+	T v; \
+	memcpy (&v, src, sizeof (T)); \
+	return (v & (T)flag) != 0; \
+} \
+static uint32_t csc_type_fromva_##name (char * o, uint32_t n, va_list * va, int base, char sign) \
+{ \
+	return strfrom_imax (o, n, (T) va_arg (*va, CSC_TYPE_STR_VA_##name), base, sign); \
+}
+#define CSC_TYPE_STR_FLAGS_F(name, T)
+#define CSC_TYPE_STR_FLAGS_D(name, T)
+#define CSC_TYPE_STR_FLAGS_C(name, T)
+#define CSC_TYPE_STR_FLAGFN_U(fn, name) fn##name
+#define CSC_TYPE_STR_FLAGFN_I(fn, name) fn##name
+#define CSC_TYPE_STR_FLAGFN_F(fn, name) NULL
+#define CSC_TYPE_STR_FLAGFN_D(fn, name) NULL
+#define CSC_TYPE_STR_FLAGFN_C(fn, name) NULL
+
+//Type of a promoted variadic argument:
+#define CSC_TYPE_STR_VA_int int
+#define CSC_TYPE_STR_VA_long long
+#define CSC_TYPE_STR_VA_u unsigned
+#define CSC_TYPE_STR_VA_u8 unsigned
+#define CSC_TYPE_STR_VA_u16 unsigned
+#define CSC_TYPE_STR_VA_u32 uint32_t
+#define CSC_TYPE_STR_VA_u64 uint64_t
+#define CSC_TYPE_STR_VA_i int
+#define CSC_TYPE_STR_VA_i8 int
+#define CSC_TYPE_STR_VA_i16 int
+#define CSC_TYPE_STR_VA_i32 int32_t
+#define CSC_TYPE_STR_VA_i64 int64_t
+
+
+#define CSC_TYPE_STR_DEFINE(type, name, T, kind, fmt, PT) \
+static int csc_type_parse_##name (void * dst, char const * src, char const ** end) \
+{ \
+	char * e; \
+	T v = (T) CSC_TYPE_STR_STRTO_##kind (src, &e); \
+	if (end) {*end = e;} \
+	if (e == src) {return 0;} \
+	memcpy (dst, &v, sizeof (T)); \
+	return 1; \
+} \
+static int csc_type_format_##name (char * o, uint32_t n, void const * src) \
+{ \
+	T v; \
+	memcpy (&v, src, sizeof (T)); \
+	return snprintf (o, n, fmt, (PT) v); \
+} \
+static uint32_t csc_type_parsev_##name (void * dst, char const * const src[], uint32_t n) \
+{ \
+	char * d = dst; \
+	uint32_t k = 0; \
+	for (uint32_t i = 0; i < n; ++i) \
+	{ \
+		char * e; \
+		T v = (T) CSC_TYPE_STR_STRTO_##kind (src[i], &e); \
+		if (e == src[i]) {continue;} \
+		memcpy (d + i * sizeof (T), &v, sizeof (T)); \
+		k++; \
+	} \
+	return k; \
+} \
+static uint32_t csc_type_parset_##name (void * dst, uint32_t n, char const ** p) \
+{ \
+	char * d = dst; \
+	char const * s = *p; \
+	uint32_t i; \
+	for (i = 0; i < n; ++i) \
+	{ \
+		char const * q = s; \
+		while (isspace ((unsigned char)q[0]) || q[0] == ',' || q[0] == ';') {q++;} \
+		char * e; \
+		T v = (T) CSC_TYPE_STR_STRTO_##kind (q, &e); \
+		if (e == q) {break;} \
+		memcpy (d + i * sizeof (T), &v, sizeof (T)); \
+		s = e; \
+	} \
+	*p = s; \
+	return i; \
+} \
+CSC_TYPE_STR_FLAGS_##kind (name, T)
+
+CSC_TYPE_STR_LIST (CSC_TYPE_STR_DEFINE)
+
+
+static int csc_type_parse_string (void * dst, char const * src, char const ** end)
+{
+	if (end) {*end = src + strlen (src);}
+	memcpy (dst, &src, sizeof (char const *));
+	return 1;
+}
+
+
+static int csc_type_format_string (char * o, uint32_t n, void const * src)
+{
+	char const * v;
+	memcpy (&v, src, sizeof (char const *));
+	return snprintf (o, n, "%s", v);
+}
+
+
+static uint32_t csc_type_parsev_string (void * dst, char const * const src[], uint32_t n)
+{
+	memcpy (dst, src, n * sizeof (char const *));
+	return n;
+}
+
+
+#define CSC_TYPE_STR_ENTRY(type, name, T, kind, fmt, PT) \
+[type] = {#name, sizeof (T), _Alignof (T), \
+csc_type_parse_##name, csc_type_format_##name, csc_type_parsev_##name, csc_type_parset_##name, \
+CSC_TYPE_STR_FLAGFN_##kind (csc_type_flagset_, name), \
+CSC_TYPE_STR_FLAGFN_##kind (csc_type_flagget_, name), \
+CSC_TYPE_STR_FLAGFN_##kind (csc_type_fromva_, name)},
+
+static struct csc_type_desc const csc_type_desc_table [CSC_TYPE_STR_COUNT] =
+{
+	[CSC_TYPE_STRING] = {"string", sizeof (char const *), _Alignof (char const *),
+	csc_type_parse_string, csc_type_format_string, csc_type_parsev_string, NULL, NULL, NULL, NULL},
+	CSC_TYPE_STR_LIST (CSC_TYPE_STR_ENTRY)
+};
+
+
+/**
+ * @brief Get the descriptor of a type, unknown types gets a descriptor with all fields zero
+ */
+static inline struct csc_type_desc const * csc_type_desc (enum csc_type t)
+{
+	if ((uint32_t)t >= CSC_TYPE_STR_COUNT) {return csc_type_desc_table + CSC_TYPE_NONE;}
+	return csc_type_desc_table + t;
+}
 
 
 static char const * csc_type_tostr (enum csc_type t)
 {
-	switch (t)
-	{
-	case CSC_TYPE_STRING:return "string";
-	case CSC_TYPE_INT:return "int";
-	case CSC_TYPE_LONG:return "long";
-	case CSC_TYPE_U8:return "u8";
-	case CSC_TYPE_U16:return "u16";
-	case CSC_TYPE_U32:return "u32";
-	case CSC_TYPE_U64:return "u64";
-	case CSC_TYPE_I8:return "i8";
-	case CSC_TYPE_I16:return "i16";
-	case CSC_TYPE_I32:return "i32";
-	case CSC_TYPE_I64:return "i64";
-	case CSC_TYPE_FLOAT:return "float";
-	case CSC_TYPE_DOUBLE:return "double";
-	default:return "unknown";
-	}
+	char const * name = csc_type_desc (t)->name;
+	return name ? name : "unknown";
+}
+
+
+/**
+ * @brief Parse one value of type (type) from (src) into (dst)
+ * @return 1 on success, 0 if nothing was parsed or the type is unknown
+ */
+static int csc_type_parse (enum csc_type type, void * dst, char const * src, char const ** end)
+{
+	csc_type_parse_fn parse = csc_type_desc (type)->parse;
+	if (parse == NULL) {return 0;}
+	return parse (dst, src, end);
+}
+
+
+/**
+ * @brief Parse a column of (n) strings into a typed array (dst)
+ * @return Number of parsed strings, unparsed elements in (dst) are not changed
+ */
+static uint32_t csc_type_parsev (enum csc_type type, void * dst, char const * const src[], uint32_t n)
+{
+	csc_type_parsev_fn parsev = csc_type_desc (type)->parsev;
+	if (parsev == NULL) {return 0;}
+	return parsev (dst, src, n);
+}
+
+
+/**
+ * @brief Parse up to (n) values from text, (p) is moved past the last parsed value
+ * @return Number of parsed values
+ */
+static uint32_t csc_type_parset (enum csc_type type, void * dst, uint32_t n, char const ** p)
+{
+	csc_type_parset_fn parset = csc_type_desc (type)->parset;
+	if (parset == NULL) {return 0;}
+	return parset (dst, n, p);
 }
 
 
 static void csc_type_print (enum csc_type type, void * value, FILE * f)
 {
-	switch (type)
+	csc_type_format_fn format = csc_type_desc (type)->format;
+	if (format == NULL) {return;}
+	char buf [128];
+	int n = format (buf, sizeof (buf), value);
+	if (n < 0) {return;}
+	if ((uint32_t)n < sizeof (buf))
 	{
-	case CSC_TYPE_DOUBLE:
-		fprintf (f, "%f\n", *(double*)value);
-		break;
-	case CSC_TYPE_FLOAT:
-		fprintf (f, "%f\n", *(float*)value);
-		break;
-	case CSC_TYPE_INT:
-		fprintf (f, "%i\n", *(int*)value);
-		break;
-	case CSC_TYPE_LONG:
-		fprintf (f, "%li\n", *(long*)value);
-		break;
-	case CSC_TYPE_I8:
-		fprintf (f, "%i\n", *(int8_t*)value);
-		break;
-	case CSC_TYPE_I16:
-		fprintf (f, "%i\n", *(int16_t*)value);
-		break;
-	case CSC_TYPE_I32:
-		fprintf (f, "%i\n", *(int32_t*)value);
-		break;
-	case CSC_TYPE_I64:
-		fprintf (f, "%ji\n", *(int64_t*)value);
-		break;
-	case CSC_TYPE_U8:
-		fprintf (f, "%u\n", *(uint8_t*)value);
-		break;
-	case CSC_TYPE_U16:
-		fprintf (f, "%u\n", *(uint16_t*)value);
-		break;
-	case CSC_TYPE_U32:
-		fprintf (f, "%u\n", *(uint32_t*)value);
-		break;
-	case CSC_TYPE_U64:
-		fprintf (f, "%ju\n", *(uint64_t*)value);
-		break;
-	case CSC_TYPE_STRING:
-		fprintf (f, "%s\n", *(char**)value);
-		break;
-	default:
-		break;
+		fprintf (f, "%s\n", buf);
+		return;
 	}
+	char * p = malloc ((size_t)n + 1);
+	format (p, (uint32_t)n + 1, value);
+	fprintf (f, "%s\n", p);
+	free (p);
 }
 
 
 static void csc_type_printflag (enum csc_type type, void * value, uint64_t flag)
 {
-	switch (type)
-	{
-	case CSC_TYPE_INT:
-		fprintf (stdout, "%s\n", (*(int*)value & (int)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_LONG:
-		fprintf (stdout, "%s\n", (*(long*)value & (int)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_I8:
-		fprintf (stdout, "%s\n", (*(int8_t*)value & (int8_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_I16:
-		fprintf (stdout, "%s\n", (*(int16_t*)value & (int16_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_I32:
-		fprintf (stdout, "%s\n", (*(int32_t*)value & (int32_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_I64:
-		fprintf (stdout, "%s\n", (*(int64_t*)value & (int64_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_U8:
-		fprintf (stdout, "%s\n", (*(uint8_t*)value & (uint8_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_U16:
-		fprintf (stdout, "%s\n", (*(uint16_t*)value & (uint16_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_U32:
-		fprintf (stdout, "%s\n", (*(uint32_t*)value & (uint32_t)flag) ? "True" : "False");
-		break;
-	case CSC_TYPE_U64:
-		fprintf (stdout, "%s\n", (*(uint64_t*)value & (uint64_t)flag) ? "True" : "False");
-		break;
-	default:
-		break;
-	}
+	csc_type_flagget_fn flagget = csc_type_desc (type)->flagget;
+	if (flagget == NULL) {return;}
+	fprintf (stdout, "%s\n", flagget (value, flag) ? "True" : "False");
 }
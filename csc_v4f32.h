@@ -256,11 +256,7 @@ static void v4f32_set_w_repeat (uint32_t n, float r [], float w)
 static void v4f32_repeat_random (unsigned n, float r [])
 {
 	uint32_t const dim = 4;
-	while (n--)
-	{
-		vf32_random (dim, r);
-		r += dim;
-	}
+	vf32_random (n * dim, r);
 }
 
 
@@ -6,6 +6,8 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 
 #include <stdint.h>
 #include "csc_math.h"
+#include "csc_vf32_simd.h"
+#include "csc_rng.h"
 
 
 // r := a < b
@@ -31,50 +33,184 @@ static void vvf32_gt (uint32_t n, float r [], float const a [], float const b []
 // r := a + b
 static void vvf32_add (uint32_t n, float r [], float const a [], float const b [])
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r [i] = a [i] + b [i];
-	}
+	csc_vf32_simd ()->vv_add (n, r, a, b);
 }
 
 
 // r := a - b
 static void vvf32_sub (uint32_t n, float r [], float const a [], float const b [])
 {
-	for (uint32_t i = 0; i < n; ++i)
+	csc_vf32_simd ()->vv_sub (n, r, a, b);
+}
+
+
+/*
+Strided vector operations.
+(n) vectors of (dim) floats, vector (j) of (y) starts at y[j*y_stride].
+A stride of 0 repeats the same vector for all (j).
+Common layouts are mapped to the SIMD kernels using a tile of CSC_VF32_STRIDED_K vectors,
+other layouts uses loops specialized for dim 2, 3 and 4.
+*/
+#define CSC_VF32_STRIDED_K 64
+#define CSC_VF32_STRIDED_MAXSTRIDE 16
+
+
+static int vf32_overlap (float const a[], size_t an, float const b[], size_t bn)
+{
+	return (a < b + bn) && (b < a + an);
+}
+
+
+// r := sum x_j
+static void vf32_sumv (uint32_t dim, float r[], float const x[], uint32_t x_stride, uint32_t n)
+{
+	for (uint32_t c = 0; c < dim; ++c) {r[c] = 0.0f;}
+	uint32_t j = 0;
+	if (x_stride >= dim && x_stride <= CSC_VF32_STRIDED_MAXSTRIDE && n > CSC_VF32_STRIDED_K)
 	{
-		r [i] = a [i] - b [i];
+		//Sum K vectors per iteration including the padding between vectors,
+		//the last vector is not included as it might not have padding:
+		struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+		float acc[CSC_VF32_STRIDED_K * CSC_VF32_STRIDED_MAXSTRIDE];
+		uint32_t const p = CSC_VF32_STRIDED_K * x_stride;
+		o->set1 (p, acc, 0.0f);
+		for (; j + CSC_VF32_STRIDED_K < n; j += CSC_VF32_STRIDED_K)
+		{
+			o->vv_add (p, acc, acc, x + (size_t)j * x_stride);
+		}
+		for (uint32_t k = 0; k < CSC_VF32_STRIDED_K; ++k)
+		for (uint32_t c = 0; c < dim; ++c)
+		{
+			r[c] += acc[k * x_stride + c];
+		}
+	}
+	for (; j < n; ++j)
+	{
+		float const * v = x + (size_t)j * x_stride;
+		for (uint32_t c = 0; c < dim; ++c) {r[c] += v[c];}
 	}
 }
 
 
-static void vf32_addv (uint32_t dim, float y[], uint32_t y_stride, float const a[], uint32_t a_stride, float const b[], uint32_t b_stride, uint32_t n)
+// y_j := a_j + k * b_j, where k is 1 or -1
+static void vf32_addv_loop (uint32_t dim, float y[], uint32_t y_stride, float const a[], uint32_t a_stride, float const b[], uint32_t b_stride, uint32_t n, float k)
 {
-	for (uint32_t i = 0; i < n; ++i)
+	switch (dim)
 	{
-		vvf32_add (dim, y, a, b);
-		y += y_stride;
-		a += a_stride;
-		b += b_stride;
+	case 2:
+		for (uint32_t i = 0; i < n; ++i, y += y_stride, a += a_stride, b += b_stride)
+		{
+			y[0] = a[0] + k * b[0];
+			y[1] = a[1] + k * b[1];
+		}
+		break;
+	case 3:
+		for (uint32_t i = 0; i < n; ++i, y += y_stride, a += a_stride, b += b_stride)
+		{
+			y[0] = a[0] + k * b[0];
+			y[1] = a[1] + k * b[1];
+			y[2] = a[2] + k * b[2];
+		}
+		break;
+	case 4:
+		for (uint32_t i = 0; i < n; ++i, y += y_stride, a += a_stride, b += b_stride)
+		{
+			y[0] = a[0] + k * b[0];
+			y[1] = a[1] + k * b[1];
+			y[2] = a[2] + k * b[2];
+			y[3] = a[3] + k * b[3];
+		}
+		break;
+	default:
+		for (uint32_t i = 0; i < n; ++i, y += y_stride, a += a_stride, b += b_stride)
+		{
+			for (uint32_t c = 0; c < dim; ++c) {y[c] = a[c] + k * b[c];}
+		}
+		break;
 	}
 }
 
 
-static void vf32_subv (uint32_t dim, float y[], uint32_t y_stride, float const a[], uint32_t a_stride, float const b[], uint32_t b_stride, uint32_t n)
+// y_j := a_j + b_j or y_j := a_j - b_j
+static void vf32_addsubv (int sub, uint32_t dim, float y[], uint32_t y_stride, float const a[], uint32_t a_stride, float const b[], uint32_t b_stride, uint32_t n)
 {
-	for (uint32_t i = 0; i < n; ++i)
+	if (n == 0 || dim == 0) {return;}
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	csc_vf32_simd_vv_fn op = sub ? o->vv_sub : o->vv_add;
+	size_t const total = (size_t)n * dim;
+	size_t const bn = (size_t)(n - 1) * b_stride + dim;
+	//Accumulate all (b) into (y):
+	if (y == a && y_stride == 0 && a_stride == 0 && dim <= CSC_VF32_STRIDED_MAXSTRIDE && !vf32_overlap (y, dim, b, bn))
+	{
+		float s[CSC_VF32_STRIDED_MAXSTRIDE];
+		vf32_sumv (dim, s, b, b_stride, n);
+		op (dim, y, y, s);
+		return;
+	}
+	//Packed arrays are one long vector:
+	if (y_stride == dim && a_stride == dim && b_stride == dim)
+	{
+		if ((y == a || !vf32_overlap (y, total, a, total)) && (y == b || !vf32_overlap (y, total, b, total)))
+		{
+			op (total, y, a, b);
+			return;
+		}
+	}
+	//Packed (y) and one packed input, the other input is one vector repeated in a tile:
+	if (y_stride == dim && dim <= CSC_VF32_STRIDED_MAXSTRIDE && (a_stride == 0 || b_stride == 0) && (a_stride == dim || b_stride == dim))
 	{
-		vvf32_sub (dim, y, a, b);
-		y += y_stride;
-		a += a_stride;
-		b += b_stride;
+		float const * v = (a_stride == 0) ? a : b;
+		float const * x = (a_stride == 0) ? b : a;
+		if ((y == x || !vf32_overlap (y, total, x, total)) && !vf32_overlap (y, total, v, dim))
+		{
+			float tile[CSC_VF32_STRIDED_K * CSC_VF32_STRIDED_MAXSTRIDE];
+			for (uint32_t k = 0; k < CSC_VF32_STRIDED_K; ++k)
+			{
+				for (uint32_t c = 0; c < dim; ++c) {tile[k * dim + c] = v[c];}
+			}
+			size_t const p = (size_t)CSC_VF32_STRIDED_K * dim;
+			for (size_t i = 0; i < total; i += p)
+			{
+				uint32_t m = (uint32_t)MIN (p, total - i);
+				if (a_stride == 0) {op (m, y + i, tile, b + i);}
+				else {op (m, y + i, a + i, tile);}
+			}
+			return;
+		}
 	}
+	vf32_addv_loop (dim, y, y_stride, a, a_stride, b, b_stride, n, sub ? -1.0f : 1.0f);
+}
+
+
+static void vf32_addv (uint32_t dim, float y[], uint32_t y_stride, float const a[], uint32_t a_stride, float const b[], uint32_t b_stride, uint32_t n)
+{
+	vf32_addsubv (0, dim, y, y_stride, a, a_stride, b, b_stride, n);
+}
+
+
+static void vf32_subv (uint32_t dim, float y[], uint32_t y_stride, float const a[], uint32_t a_stride, float const b[], uint32_t b_stride, uint32_t n)
+{
+	vf32_addsubv (1, dim, y, y_stride, a, a_stride, b, b_stride, n);
 }
 
 
 static void vf32_set1_strided (float v[], float x, uint32_t n, unsigned inc)
 {
-	for (uint32_t i = 0; i < n; ++i)
+	if (inc == 1)
+	{
+		csc_vf32_simd ()->set1 (n, v, x);
+		return;
+	}
+	uint32_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		v[0] = x;
+		v[inc] = x;
+		v[2*inc] = x;
+		v[3*inc] = x;
+		v += 4*inc;
+	}
+	for (; i < n; ++i)
 	{
 		v[0] = x;
 		v += inc;
@@ -110,22 +246,14 @@ static void vf32_set4 (float v[], float v0, float v1, float v2, float v3)
 // r := a . b
 static float vf32_dot (uint32_t n, float const a [], float const b [])
 {
-	float r = 0.0f;
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r += a[i] * b[i];
-	}
-	return r;
+	return csc_vf32_simd_dot (n, a, b, CSC_VF32_SIMD_SUM_DEFAULT);
 }
 
 
 
 static void vf32_cpy (uint32_t n, float des[], float const src[])
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		des[i] = src[i];
-	}
+	csc_vf32_simd ()->cpy (n, des, src);
 }
 
 
@@ -176,15 +304,11 @@ static int vf32_lt (unsigned n, float const a[], float const b[])
 }
 
 
-// Set all element (x) of r to b
-// r := {x | x = ?}
+// Set all element (x) of r to a uniform random value from the default generator of the calling thread
+// r := {x | x = [0, 1)}
 static void vf32_random (uint32_t n, float r [])
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r [i] = (float)rand() / (float)RAND_MAX;
-		//r [i] = 1.0f;
-	}
+	csc_rng_f32 (csc_rng_default (), n, r);
 }
 
 
@@ -192,41 +316,27 @@ static void vf32_random (uint32_t n, float r [])
 // r := {x | x = b}
 static void vf32_set1 (uint32_t n, float r [], float const b)
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r[i] = b;
-	}
+	csc_vf32_simd ()->set1 (n, r, b);
 }
 
 
 // r := a * b
 static void vvf32_hadamard (unsigned n, float r[], float const a[], float const b[])
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r[i] = a[i] * b[i];
-	}
+	csc_vf32_simd ()->vv_mul (n, r, a, b);
 }
 
 
 // r := r + a * b
 static void vvf32_macc (uint32_t n, float r [], float const a [], float const b [])
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r[i] += a[i] * b[i];
-	}
+	csc_vf32_simd ()->vv_macc (n, r, a, b);
 }
 
 
 static float vf32_sum (uint32_t n, float const v [])
 {
-	float sum = 0;
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		sum += v[i];
-	}
-	return sum;
+	return csc_vf32_simd_sum (n, v, CSC_VF32_SIMD_SUM_DEFAULT);
 }
 
 
@@ -285,12 +395,7 @@ static void vf32_setl (float r [], uint32_t n, ...)
 static float vf32_avg (uint32_t n, float v[])
 {
 	ASSERT (n > 0);
-	float sum = 0.0f;
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		sum += v[i];
-	}
-	return sum / n;
+	return vf32_sum (n, v) / n;
 }
 
 
@@ -298,31 +403,14 @@ static float vf32_avg (uint32_t n, float v[])
 static float vf32_max (uint32_t n, float v[])
 {
 	ASSERT (n >= 1);
-	float max = v[0];
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		if (v[i] > max)
-		{
-			max = v[i];
-		}
-	}
-	return max;
+	return csc_vf32_simd ()->max (n, v);
 }
 
 
 static float vf32_maxabs (uint32_t n, float v[])
 {
 	ASSERT (n >= 1);
-	float max = v[0];
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		float x = fabs (v[i]);
-		if (x > max)
-		{
-			max = x;
-		}
-	}
-	return max;
+	return csc_vf32_simd ()->maxabs (n, v);
 }
 
 
@@ -351,27 +439,18 @@ static float vf32_maxabs (uint32_t n, float v[])
 // r := a - b
 static void vsf32_sub (unsigned n, float r [], float const a [], float b)
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r [i] = a [i] - b;
-	}
+	csc_vf32_simd ()->vs_sub (n, r, a, b);
 }
 
 static void vsf32_macc (uint32_t n, float vy[], float const vx[], float sb)
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		vy [i] += vx [i] * sb;
-	}
+	csc_vf32_simd ()->vs_macc (n, vy, vx, sb);
 }
 
 // r := a + b
 static void vsf32_add (uint32_t n, float r [], float const a [], float const b)
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r [i] = a [i] + b;
-	}
+	csc_vf32_simd ()->vs_add (n, r, a, b);
 }
 
 // r := a + b
@@ -389,10 +468,7 @@ static void vsf32_add_max (uint32_t n, float r [], float const a [], float const
 // r := a * b
 static void vsf32_mul (uint32_t n, float r [], float const a [], float const b)
 {
-	for (uint32_t i = 0; i < n; ++i)
-	{
-		r [i] = a [i] * b;
-	}
+	csc_vf32_simd ()->vs_mul (n, r, a, b);
 }
 
 
@@ -5,104 +5,736 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #pragma once
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "csc_math.h"
 #include "csc_vf32.h"
+#include "csc_parallel.h"
 
 
-static void vf32_convolution1d (float const q[], uint32_t n, float u[], float k[], uint32_t kn)
+/*
+2D convolution engine.
+Computes pix2[y][x] = sum k[ky][kx] * pix[y + ky - kyn/2][x + kx - kxn/2], the kernel is not flipped.
+Methods:
+DIRECT accumulates one kernel tap at a time over a whole output row with the SIMD macc kernel.
+SEPARABLE is used for rank 1 kernels k[ky][kx] = ky[ky] * kx[kx], one horizontal and one vertical 1D pass.
+FFT multiplies the spectrums of the image and the kernel, used for large kernels.
+AUTO picks SEPARABLE for rank 1 kernels larger than 3x3, otherwise DIRECT or FFT by an estimate of the number of operations.
+Border modes decides the pixels outside of the image, SKIP does not write the border pixels of the output.
+The output rows are split into blocks that are processed by the threads of a csc_parallel pool.
+The masked convolution multiplies mask and image in tiles of CSC_VF32_CONV_TILE_X * CSC_VF32_CONV_TILE_Y outputs.
+*/
+#define CSC_VF32_CONV_SEPARABLE_EPS 1e-6f
+#define CSC_VF32_CONV_TILE_X 256
+#define CSC_VF32_CONV_TILE_Y 32
+
+
+enum csc_vf32_conv_border
 {
-	uint32_t kn0 = kn / 2;
-	vf32_normalize (kn, k, k);
-	for (uint32_t i = kn0; i < n-kn0; ++i)
+	CSC_VF32_CONV_SKIP, //Border pixels of the output are not written
+	CSC_VF32_CONV_ZERO, //Outside pixels are 0
+	CSC_VF32_CONV_CLAMP, //Outside pixels are the nearest edge pixel
+	CSC_VF32_CONV_MIRROR, //Reflected without repeating the edge pixel, dcb|abcd|cba
+	CSC_VF32_CONV_WRAP, //Periodic
+};
+
+
+enum csc_vf32_conv_method
+{
+	CSC_VF32_CONV_AUTO,
+	CSC_VF32_CONV_DIRECT,
+	CSC_VF32_CONV_SEPARABLE,
+	CSC_VF32_CONV_FFT,
+};
+
+
+struct csc_vf32_conv
+{
+	int32_t kxn;
+	int32_t kyn;
+	//Copy of the kernel, kyn rows of kxn:
+	float * k;
+	//Factors of a separable kernel or NULL:
+	float * kx;
+	float * ky;
+	enum csc_vf32_conv_border border;
+	enum csc_vf32_conv_method method;
+};
+
+
+/**
+ * @brief Find (kx) and (ky) where k[i][j] = ky[i] * kx[j]
+ * @return 1 when the kernel is separable
+ */
+static int csc_vf32_conv_factor (float const k[], int32_t kxn, int32_t kyn, float kx[], float ky[])
+{
+	//Use the row and column of the largest element as factors:
+	int32_t m = 0;
+	for (int32_t i = 1; i < kxn * kyn; ++i)
+	{
+		if (fabsf (k[i]) > fabsf (k[m])) {m = i;}
+	}
+	float const p = k[m];
+	if (p == 0.0f) {return 0;}
+	int32_t const r = m / kxn;
+	int32_t const c = m % kxn;
+	for (int32_t j = 0; j < kxn; ++j) {kx[j] = k[r * kxn + j] / p;}
+	for (int32_t i = 0; i < kyn; ++i) {ky[i] = k[i * kxn + c];}
+	float const eps = CSC_VF32_CONV_SEPARABLE_EPS * fabsf (p);
+	for (int32_t i = 0; i < kyn; ++i)
+	for (int32_t j = 0; j < kxn; ++j)
+	{
+		if (fabsf (k[i * kxn + j] - ky[i] * kx[j]) > eps) {return 0;}
+	}
+	return 1;
+}
+
+
+/**
+ * @param k Kernel with (kyn) rows of (kxn) elements, it is copied
+ * @param method CSC_VF32_CONV_AUTO or a forced method, SEPARABLE is only used for separable kernels
+ */
+static void csc_vf32_conv_init (struct csc_vf32_conv * c, float const k[], int32_t kxn, int32_t kyn, enum csc_vf32_conv_border border, enum csc_vf32_conv_method method)
+{
+	ASSERT_PARAM_NOTNULL (c);
+	ASSERT_PARAM_NOTNULL (k);
+	ASSERT (kxn > 0);
+	ASSERT (kyn > 0);
+	c->kxn = kxn;
+	c->kyn = kyn;
+	c->border = border;
+	c->method = method;
+	c->k = malloc ((size_t)kxn * kyn * sizeof (float));
+	c->kx = malloc ((size_t)kxn * sizeof (float));
+	c->ky = malloc ((size_t)kyn * sizeof (float));
+	ASSERT (c->k && c->kx && c->ky);
+	memcpy (c->k, k, (size_t)kxn * kyn * sizeof (float));
+	if (csc_vf32_conv_factor (k, kxn, kyn, c->kx, c->ky) == 0)
+	{
+		free (c->kx);
+		free (c->ky);
+		c->kx = NULL;
+		c->ky = NULL;
+		if (c->method == CSC_VF32_CONV_SEPARABLE) {c->method = CSC_VF32_CONV_AUTO;}
+	}
+}
+
+
+static void csc_vf32_conv_free (struct csc_vf32_conv * c)
+{
+	ASSERT_PARAM_NOTNULL (c);
+	free (c->k);
+	free (c->kx);
+	free (c->ky);
+	memset (c, 0, sizeof (struct csc_vf32_conv));
+}
+
+
+/**
+ * @brief Map coordinate (i) to [0, n) by border mode (b)
+ * @return Coordinate or -1 for a zero pixel
+ */
+static int32_t csc_vf32_conv_index (int32_t i, int32_t n, enum csc_vf32_conv_border b)
+{
+	if (i >= 0 && i < n) {return i;}
+	switch (b)
+	{
+	case CSC_VF32_CONV_CLAMP:
+		return (i < 0) ? 0 : n - 1;
+	case CSC_VF32_CONV_MIRROR:{
+		if (n == 1) {return 0;}
+		int32_t p = 2 * (n - 1);
+		i %= p;
+		if (i < 0) {i += p;}
+		return (i < n) ? i : p - i;}
+	case CSC_VF32_CONV_WRAP:
+		i %= n;
+		return (i < 0) ? i + n : i;
+	default:
+		return -1;
+	}
+}
+
+
+/**
+ * @brief Pad the image with (px0, px1) columns and (py0, py1) rows using border mode (b)
+ * @return Image of (xn + px0 + px1) * (yn + py0 + py1) pixels allocated by malloc
+ */
+static float * csc_vf32_conv_pad (float const pix[], int32_t xn, int32_t yn, int32_t px0, int32_t px1, int32_t py0, int32_t py1, enum csc_vf32_conv_border b)
+{
+	int32_t const pw = xn + px0 + px1;
+	int32_t const ph = yn + py0 + py1;
+	float * p = malloc ((size_t)pw * ph * sizeof (float));
+	ASSERT (p);
+	for (int32_t y = 0; y < ph; ++y)
 	{
-		float sum = 0.0f;
-		for (uint32_t j = 0; j < kn; ++j)
+		float * row = p + (size_t)y * pw;
+		int32_t sy = csc_vf32_conv_index (y - py0, yn, b);
+		if (sy < 0)
+		{
+			memset (row, 0, (size_t)pw * sizeof (float));
+			continue;
+		}
+		float const * s = pix + (size_t)sy * xn;
+		for (int32_t x = 0; x < px0; ++x)
+		{
+			int32_t sx = csc_vf32_conv_index (x - px0, xn, b);
+			row[x] = (sx < 0) ? 0.0f : s[sx];
+		}
+		memcpy (row + px0, s, (size_t)xn * sizeof (float));
+		for (int32_t x = px0 + xn; x < pw; ++x)
 		{
-			sum += q[i - kn0 + j] * k[j];
+			int32_t sx = csc_vf32_conv_index (x - px0, xn, b);
+			row[x] = (sx < 0) ? 0.0f : s[sx];
 		}
-		u[i] = sum;
 	}
+	return p;
 }
 
 
-static void vf32_convolution2d (float pix2[], float const pix[], int32_t xn, int32_t yn, float k[], int32_t kxn, int32_t kyn)
+//Output block of a valid convolution: dst[y][x] = sum k[ky][kx] * src[y + ky][x + kx]
+//The parallel loops runs over pixels with a grain of one row, so the split only depends on the number of pixels.
+struct csc_vf32_conv_job
+{
+	struct csc_vf32_conv const * c;
+	float * dst;
+	size_t dst_stride;
+	float const * src;
+	size_t src_stride;
+	int32_t w;
+	int32_t h;
+};
+
+
+static void csc_vf32_conv_direct_rows (void * ptr, size_t a, size_t b, uint32_t part)
 {
-	int32_t kxn0 = kxn / 2;
-	int32_t kyn0 = kyn / 2;
-	//printf ("kxn0 %i\n", kxn0);
-	//printf ("kyn0 %i\n", kyn0);
-	for (int32_t y = kyn0; y < (yn-kyn0); ++y)
+	struct csc_vf32_conv_job const * j = ptr;
+	struct csc_vf32_conv const * c = j->c;
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	UNUSED (part);
+	a /= (size_t)j->w;
+	b /= (size_t)j->w;
+	for (size_t y = a; y < b; ++y)
 	{
-		for (int32_t x = kxn0; x < (xn-kxn0); ++x)
+		float * d = j->dst + y * j->dst_stride;
+		o->set1 (j->w, d, 0.0f);
+		for (int32_t ky = 0; ky < c->kyn; ++ky)
 		{
-			float sum = 0.0f;
-			for (int32_t ky = 0; ky < kyn; ++ky)
+			float const * s = j->src + (y + ky) * j->src_stride;
+			float const * k = c->k + ky * c->kxn;
+			for (int32_t kx = 0; kx < c->kxn; ++kx)
 			{
-				for (int32_t kx = 0; kx < kxn; ++kx)
-				{
-					int32_t xx = x + kx - kxn0;
-					int32_t yy = y + ky - kyn0;
-					sum += pix[yy * xn + xx] * k[ky * kxn + kx];
-				}
+				if (k[kx] != 0.0f) {o->vs_macc (j->w, d, s + kx, k[kx]);}
 			}
-			pix2[y * xn + x] = sum;
-			//pix2[y * xn + x] = pix[y * xn + x];
 		}
 	}
 }
 
 
-static void vf32_convolution2d_masked (float pix2[], float const pix[], float const mask[], int32_t xn, int32_t yn, float k[], int32_t kxn, int32_t kyn)
+static void csc_vf32_conv_separable_rows (void * ptr, size_t a, size_t b, uint32_t part)
 {
-	int32_t kxn0 = kxn / 2;
-	int32_t kyn0 = kyn / 2;
-	//printf ("kxn0 %i\n", kxn0);
-	//printf ("kyn0 %i\n", kyn0);
-	for (int32_t y = kyn0; y < (yn-kyn0); ++y)
+	struct csc_vf32_conv_job const * j = ptr;
+	struct csc_vf32_conv const * c = j->c;
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	UNUSED (part);
+	a /= (size_t)j->w;
+	b /= (size_t)j->w;
+	//Horizontal pass of the input rows needed by output rows [a, b):
+	size_t const rows = (b - a) + (size_t)c->kyn - 1;
+	float * t = malloc (rows * j->w * sizeof (float));
+	ASSERT (t);
+	for (size_t r = 0; r < rows; ++r)
 	{
-		for (int32_t x = kxn0; x < (xn-kxn0); ++x)
+		float * tr = t + r * j->w;
+		float const * s = j->src + (a + r) * j->src_stride;
+		o->set1 (j->w, tr, 0.0f);
+		for (int32_t kx = 0; kx < c->kxn; ++kx)
 		{
-			float sum = 0.0f;
-			for (int32_t ky = 0; ky < kyn; ++ky)
-			{
-				for (int32_t kx = 0; kx < kxn; ++kx)
-				{
-					int32_t xx = x + kx - kxn0;
-					int32_t yy = y + ky - kyn0;
-					int32_t index = yy * xn + xx;
-					sum += mask[index] * pix[index] * k[ky * kxn + kx];
-				}
-			}
-			pix2[y * xn + x] = sum;
-			//pix2[y * xn + x] = pix[y * xn + x];
+			if (c->kx[kx] != 0.0f) {o->vs_macc (j->w, tr, s + kx, c->kx[kx]);}
+		}
+	}
+	//Vertical pass:
+	for (size_t y = a; y < b; ++y)
+	{
+		float * d = j->dst + y * j->dst_stride;
+		o->set1 (j->w, d, 0.0f);
+		for (int32_t ky = 0; ky < c->kyn; ++ky)
+		{
+			if (c->ky[ky] != 0.0f) {o->vs_macc (j->w, d, t + (y - a + ky) * j->w, c->ky[ky]);}
 		}
 	}
+	free (t);
 }
 
 
-static void vf32_convolution2d_clean (float pix2[], float const pix[], int32_t xn, int32_t yn, int32_t kxn, int32_t kyn)
+
+
+/**
+ * @brief Twiddle factors exp(-2 pi i j / n) for j < n/2, interleaved real and imaginary
+ */
+static float * csc_vf32_fft_twiddles (uint32_t n)
+{
+	float * tw = malloc (MAX (n, 2) * sizeof (float));
+	ASSERT (tw);
+	for (uint32_t j = 0; j < n / 2; ++j)
+	{
+		double a = -2.0 * M_PI * (double)j / (double)n;
+		tw[2*j+0] = (float)cos (a);
+		tw[2*j+1] = (float)sin (a);
+	}
+	return tw;
+}
+
+
+/*
+The 2D FFT only transforms columns, the rows are transformed by transposing and transforming columns again.
+A radix 2 butterfly of two rows is applied over a contiguous range of columns which is vectorized by the compiler,
+a row by row FFT would access the twiddles and the values with strides instead.
+The spectrum is left transposed, the inverse transform undoes the transpose.
+*/
+struct csc_vf32_fft_job
+{
+	//(h) rows of (w) complex values, interleaved real and imaginary:
+	float * x;
+	float * t;
+	uint32_t w;
+	uint32_t h;
+	//Twiddles of (h):
+	float const * tw;
+	int inverse;
+};
+
+
+/**
+ * @brief In place radix 2 FFT of the columns [a/h, b/h), (h) is a power of 2, the inverse is not scaled
+ */
+static void csc_vf32_fft_cols (void * ptr, size_t a, size_t b, uint32_t part)
 {
-	int32_t kxn0 = kxn / 2;
-	int32_t kyn0 = kyn / 2;
-	//printf ("kxn0 %i\n", kxn0);
-	//printf ("kyn0 %i\n", kyn0);
-	for (int32_t y = kyn0; y < (yn-kyn0); ++y)
+	struct csc_vf32_fft_job const * j = ptr;
+	UNUSED (part);
+	size_t const stride = 2 * (size_t)j->w;
+	uint32_t const n = j->h;
+	float const sign = j->inverse ? -1.0f : 1.0f;
+	size_t const c0 = 2 * (a / j->h);
+	size_t const c1 = 2 * (b / j->h);
+	for (uint32_t i = 1, k = 0; i < n; ++i)
 	{
-		for (int32_t x = kxn0; x < (xn-kxn0); ++x)
+		uint32_t bit = n >> 1;
+		for (; k & bit; bit >>= 1) {k ^= bit;}
+		k ^= bit;
+		if (i < k)
 		{
-			float sum = 1.0f;
-			for (int32_t ky = 0; ky < kyn; ++ky)
+			float * u = j->x + i * stride;
+			float * v = j->x + k * stride;
+			for (size_t c = c0; c < c1; ++c)
 			{
-				for (int32_t kx = 0; kx < kxn; ++kx)
-				{
-					int32_t xx = x + kx - kxn0;
-					int32_t yy = y + ky - kyn0;
-					int32_t index = yy * xn + xx;
-					sum *= pix[index];
-				}
+				float t = u[c];
+				u[c] = v[c];
+				v[c] = t;
 			}
-			pix2[y * xn + x] = sum;
-			//pix2[y * xn + x] = pix[y * xn + x];
 		}
 	}
+	for (uint32_t len = 2; len <= n; len <<= 1)
+	{
+		uint32_t const half = len / 2;
+		uint32_t const step = n / len;
+		for (uint32_t i = 0; i < n; i += len)
+		for (uint32_t k = 0; k < half; ++k)
+		{
+			float const wr = j->tw[2*k*step+0];
+			float const wi = sign * j->tw[2*k*step+1];
+			float * restrict u = j->x + (i+k) * stride;
+			float * restrict v = j->x + (i+k+half) * stride;
+			for (size_t c = c0; c < c1; c += 2)
+			{
+				float const tr = v[c]*wr - v[c+1]*wi;
+				float const ti = v[c]*wi + v[c+1]*wr;
+				v[c+0] = u[c+0] - tr;
+				v[c+1] = u[c+1] - ti;
+				u[c+0] += tr;
+				u[c+1] += ti;
+			}
+		}
+	}
+}
+
+
+/**
+ * @brief Transpose the rows [a/w, b/w) of (x) into the columns of (t), in blocks of 16x16 complex values
+ */
+static void csc_vf32_fft_transpose (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_fft_job const * j = ptr;
+	UNUSED (part);
+	size_t const r0 = a / j->w;
+	size_t const r1 = b / j->w;
+	for (size_t rb = r0; rb < r1; rb += 16)
+	for (size_t cb = 0; cb < j->w; cb += 16)
+	for (size_t r = rb; r < MIN (rb + 16, r1); ++r)
+	for (size_t c = cb; c < MIN (cb + 16, (size_t)j->w); ++c)
+	{
+		j->t[2 * (c * j->h + r) + 0] = j->x[2 * (r * j->w + c) + 0];
+		j->t[2 * (c * j->h + r) + 1] = j->x[2 * (r * j->w + c) + 1];
+	}
+}
+
+
+/**
+ * @brief 2D FFT of (x) with (h) rows of (w) complex values into (t) as (w) rows of (h), (x) is overwritten
+ * The inverse takes the transposed spectrum (x) with (h) rows of (w) and writes the image to (t).
+ */
+static void csc_vf32_fft2 (struct csc_parallel * pool, float x[], float t[], uint32_t w, uint32_t h, float const tww[], float const twh[], int inverse)
+{
+	size_t const n = (size_t)w * h;
+	struct csc_vf32_fft_job j = {x, t, w, h, twh, inverse};
+	csc_parallel_for (pool, n, h, 0, csc_vf32_fft_cols, &j);
+	csc_parallel_for (pool, n, w, 0, csc_vf32_fft_transpose, &j);
+	j = (struct csc_vf32_fft_job){t, NULL, h, w, tww, inverse};
+	csc_parallel_for (pool, n, w, 0, csc_vf32_fft_cols, &j);
+}
+
+
+static uint32_t csc_vf32_conv_pow2 (uint32_t n)
+{
+	uint32_t p = 1;
+	while (p < n) {p <<= 1;}
+	return p;
+}
+
+
+/**
+ * @brief Valid convolution by FFT, circular convolution of size >= the input does not alias the valid outputs
+ */
+static void csc_vf32_conv_fft (struct csc_vf32_conv const * c, struct csc_vf32_conv_job const * j, int32_t sw, int32_t sh, struct csc_parallel * pool)
+{
+	uint32_t const px = csc_vf32_conv_pow2 ((uint32_t)sw);
+	uint32_t const py = csc_vf32_conv_pow2 ((uint32_t)sh);
+	size_t const size = 2 * (size_t)px * py;
+	float * a = calloc (size, sizeof (float));
+	float * k = calloc (size, sizeof (float));
+	float * t = malloc (size * sizeof (float));
+	ASSERT (a && k && t);
+	for (int32_t y = 0; y < sh; ++y)
+	for (int32_t x = 0; x < sw; ++x)
+	{
+		a[2 * ((size_t)y * px + x)] = j->src[y * j->src_stride + x];
+	}
+	//The kernel is flipped to turn the convolution into a correlation:
+	for (int32_t y = 0; y < c->kyn; ++y)
+	for (int32_t x = 0; x < c->kxn; ++x)
+	{
+		k[2 * ((size_t)(c->kyn - 1 - y) * px + (c->kxn - 1 - x))] = c->k[y * c->kxn + x];
+	}
+	float * twx = csc_vf32_fft_twiddles (px);
+	float * twy = csc_vf32_fft_twiddles (py);
+	//Kernel spectrum to (t) and image spectrum to (k):
+	csc_vf32_fft2 (pool, k, t, px, py, twx, twy, 0);
+	csc_vf32_fft2 (pool, a, k, px, py, twx, twy, 0);
+	float const scale = 1.0f / ((float)px * (float)py);
+	for (size_t i = 0; i < size; i += 2)
+	{
+		float re = k[i] * t[i] - k[i+1] * t[i+1];
+		float im = k[i] * t[i+1] + k[i+1] * t[i];
+		k[i] = re * scale;
+		k[i+1] = im * scale;
+	}
+	csc_vf32_fft2 (pool, k, a, py, px, twy, twx, 1);
+	for (int32_t y = 0; y < j->h; ++y)
+	for (int32_t x = 0; x < j->w; ++x)
+	{
+		j->dst[y * j->dst_stride + x] = a[2 * ((size_t)(y + c->kyn - 1) * px + (x + c->kxn - 1))];
+	}
+	free (a);
+	free (k);
+	free (t);
+	free (twx);
+	free (twy);
+}
+
+
+/**
+ * @brief The method used for a (w) * (h) output from a (sw) * (sh) input
+ */
+static enum csc_vf32_conv_method csc_vf32_conv_choose (struct csc_vf32_conv const * c, int32_t w, int32_t h, int32_t sw, int32_t sh)
+{
+	if (c->method != CSC_VF32_CONV_AUTO) {return c->method;}
+	//Two passes are slower than one for tiny kernels:
+	if (c->kx && c->kxn * c->kyn >= 2 * (c->kxn + c->kyn)) {return CSC_VF32_CONV_SEPARABLE;}
+	double direct = (double)w * h * c->kxn * c->kyn;
+	double px = csc_vf32_conv_pow2 ((uint32_t)sw);
+	double py = csc_vf32_conv_pow2 ((uint32_t)sh);
+	//Three 2D FFTs against one SIMD macc per tap, the constant is measured with a 512x512 image:
+	double fft = 64.0 * px * py * log2 (px * py);
+	return (fft < direct) ? CSC_VF32_CONV_FFT : CSC_VF32_CONV_DIRECT;
+}
+
+
+/**
+ * @brief Convolve image (pix) of (xn) * (yn) pixels into (pix2)
+ * @param pix2 Output image of the same size, must not overlap (pix)
+ * @param pool Thread pool or NULL
+ */
+static void csc_vf32_conv_run (struct csc_vf32_conv const * c, float pix2[], float const pix[], int32_t xn, int32_t yn, struct csc_parallel * pool)
+{
+	ASSERT_PARAM_NOTNULL (c);
+	ASSERT_PARAM_NOTNULL (pix2);
+	ASSERT_PARAM_NOTNULL (pix);
+	int32_t const kxn0 = c->kxn / 2;
+	int32_t const kyn0 = c->kyn / 2;
+	struct csc_vf32_conv_job j = {c, pix2, (size_t)xn, pix, (size_t)xn, xn, yn};
+	float * padded = NULL;
+	int32_t sw = xn;
+	int32_t sh = yn;
+	if (c->border == CSC_VF32_CONV_SKIP)
+	{
+		//Same pixels as the original loops, x in [kxn0, xn-kxn0) and y in [kyn0, yn-kyn0):
+		j.w = xn - 2 * kxn0;
+		j.h = yn - 2 * kyn0;
+		if (j.w <= 0 || j.h <= 0) {return;}
+		j.dst = pix2 + (size_t)kyn0 * xn + kxn0;
+		sw = j.w + c->kxn - 1;
+		sh = j.h + c->kyn - 1;
+	}
+	else
+	{
+		padded = csc_vf32_conv_pad (pix, xn, yn, kxn0, c->kxn - 1 - kxn0, kyn0, c->kyn - 1 - kyn0, c->border);
+		sw = xn + c->kxn - 1;
+		sh = yn + c->kyn - 1;
+		j.src = padded;
+		j.src_stride = (size_t)sw;
+	}
+	switch (csc_vf32_conv_choose (c, j.w, j.h, sw, sh))
+	{
+	case CSC_VF32_CONV_SEPARABLE:
+		if (c->kx)
+		{
+			csc_parallel_for (pool, (size_t)j.h * j.w, (size_t)j.w, 0, csc_vf32_conv_separable_rows, &j);
+			break;
+		}
+		//fallthrough
+	case CSC_VF32_CONV_AUTO:
+	case CSC_VF32_CONV_DIRECT:
+		csc_parallel_for (pool, (size_t)j.h * j.w, (size_t)j.w, 0, csc_vf32_conv_direct_rows, &j);
+		break;
+	case CSC_VF32_CONV_FFT:
+		csc_vf32_conv_fft (c, &j, sw, sh, pool);
+		break;
+	}
+	free (padded);
+}
+
+
+
+
+//Tiles of the masked convolution:
+struct csc_vf32_conv_masked_job
+{
+	struct csc_vf32_conv const * c;
+	enum csc_vf32_conv_method method;
+	float * pix2;
+	float const * pix;
+	float const * mask;
+	int32_t xn;
+	int32_t w;
+	int32_t h;
+};
+
+
+/**
+ * @brief Convolve the tile rows [a/w, b/w) of the masked image
+ * Each tile of mask * pix is multiplied once into a scratch block that stays in cache while the tile is convolved.
+ */
+static void csc_vf32_conv_masked_tiles (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_conv_masked_job const * m = ptr;
+	struct csc_vf32_conv const * c = m->c;
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	UNUSED (part);
+	int32_t const y0 = (int32_t)(a / (size_t)m->w);
+	int32_t const y1 = (int32_t)(b / (size_t)m->w);
+	float * scratch = malloc ((size_t)(CSC_VF32_CONV_TILE_X + c->kxn - 1) * (CSC_VF32_CONV_TILE_Y + c->kyn - 1) * sizeof (float));
+	ASSERT (scratch);
+	for (int32_t ty = y0; ty < y1; ty += CSC_VF32_CONV_TILE_Y)
+	for (int32_t tx = 0; tx < m->w; tx += CSC_VF32_CONV_TILE_X)
+	{
+		int32_t const tw = MIN (CSC_VF32_CONV_TILE_X, m->w - tx);
+		int32_t const th = MIN (CSC_VF32_CONV_TILE_Y, y1 - ty);
+		int32_t const sw = tw + c->kxn - 1;
+		int32_t const sh = th + c->kyn - 1;
+		for (int32_t r = 0; r < sh; ++r)
+		{
+			size_t const i = (size_t)(ty + r) * m->xn + tx;
+			o->vv_mul (sw, scratch + r * sw, m->mask + i, m->pix + i);
+		}
+		float * dst = m->pix2 + (size_t)(ty + c->kyn / 2) * m->xn + tx + c->kxn / 2;
+		struct csc_vf32_conv_job j = {c, dst, (size_t)m->xn, scratch, (size_t)sw, tw, th};
+		if (m->method == CSC_VF32_CONV_SEPARABLE)
+		{
+			csc_vf32_conv_separable_rows (&j, 0, (size_t)th * tw, 0);
+		}
+		else
+		{
+			csc_vf32_conv_direct_rows (&j, 0, (size_t)th * tw, 0);
+		}
+	}
+	free (scratch);
+}
+
+
+/**
+ * @brief Convolve (mask * pix) into (pix2), the product is computed once per pixel
+ * The SKIP border mode runs in cache blocked tiles, other border modes and the FFT method multiplies the whole image first.
+ */
+static void csc_vf32_conv_run_masked (struct csc_vf32_conv const * c, float pix2[], float const pix[], float const mask[], int32_t xn, int32_t yn, struct csc_parallel * pool)
+{
+	ASSERT_PARAM_NOTNULL (c);
+	ASSERT_PARAM_NOTNULL (pix2);
+	ASSERT_PARAM_NOTNULL (pix);
+	ASSERT_PARAM_NOTNULL (mask);
+	int32_t const w = xn - 2 * (c->kxn / 2);
+	int32_t const h = yn - 2 * (c->kyn / 2);
+	enum csc_vf32_conv_method method = csc_vf32_conv_choose (c, w, h, w + c->kxn - 1, h + c->kyn - 1);
+	if (method == CSC_VF32_CONV_SEPARABLE && c->kx == NULL) {method = CSC_VF32_CONV_DIRECT;}
+	if (c->border != CSC_VF32_CONV_SKIP || method == CSC_VF32_CONV_FFT)
+	{
+		float * mp = malloc ((size_t)xn * yn * sizeof (float));
+		ASSERT (mp);
+		csc_vf32_simd ()->vv_mul ((uint32_t)((size_t)xn * yn), mp, mask, pix);
+		csc_vf32_conv_run (c, pix2, mp, xn, yn, pool);
+		free (mp);
+		return;
+	}
+	if (w <= 0 || h <= 0) {return;}
+	struct csc_vf32_conv_masked_job m = {c, method, pix2, pix, mask, xn, w, h};
+	//Splits are on tile rows:
+	csc_parallel_for (pool, (size_t)w * h, (size_t)w * CSC_VF32_CONV_TILE_Y, 0, csc_vf32_conv_masked_tiles, &m);
+}
+
+
+
+
+static void vf32_convolution1d (float const q[], uint32_t n, float u[], float k[], uint32_t kn)
+{
+	//The kernel is used as normalized, the scale is applied without modifying (k):
+	uint32_t kn0 = kn / 2;
+	if (n < 2 * kn0 + 1) {return;}
+	float const l = vf32_norm (kn, k);
+	float const s = l > 0.0f ? 1.0f / l : 0.0f;
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	uint32_t const w = n - 2 * kn0;
+	o->set1 (w, u + kn0, 0.0f);
+	for (uint32_t j = 0; j < kn; ++j)
+	{
+		o->vs_macc (w, u + kn0, q + j, k[j] * s);
+	}
+}
+
+
+static void vf32_convolution2d (float pix2[], float const pix[], int32_t xn, int32_t yn, float k[], int32_t kxn, int32_t kyn)
+{
+	struct csc_vf32_conv c;
+	csc_vf32_conv_init (&c, k, kxn, kyn, CSC_VF32_CONV_SKIP, CSC_VF32_CONV_AUTO);
+	csc_vf32_conv_run (&c, pix2, pix, xn, yn, NULL);
+	csc_vf32_conv_free (&c);
+}
+
+
+static void vf32_convolution2d_masked (float pix2[], float const pix[], float const mask[], int32_t xn, int32_t yn, float k[], int32_t kxn, int32_t kyn)
+{
+	struct csc_vf32_conv c;
+	csc_vf32_conv_init (&c, k, kxn, kyn, CSC_VF32_CONV_SKIP, CSC_VF32_CONV_AUTO);
+	csc_vf32_conv_run_masked (&c, pix2, pix, mask, xn, yn, NULL);
+	csc_vf32_conv_free (&c);
+}
+
+
+/**
+ * @brief Windowed product of a binary (0 or 1) image by counting zeros
+ * The zeros of each horizontal window is a running count along the row,
+ * the zeros of the whole window is a running sum of the last (kyn) row counts.
+ */
+static void csc_vf32_conv_clean_binary (float pix2[], float const pix[], int32_t xn, int32_t w, int32_t h, int32_t kxn, int32_t kyn)
+{
+	uint32_t * rows = malloc ((size_t)kyn * w * sizeof (uint32_t));
+	uint32_t * sum = calloc ((size_t)w, sizeof (uint32_t));
+	ASSERT (rows && sum);
+	for (int32_t r = 0; r < h + kyn - 1; ++r)
+	{
+		uint32_t * z = rows + (size_t)(r % kyn) * w;
+		float const * p = pix + (size_t)r * xn;
+		if (r >= kyn)
+		{
+			for (int32_t x = 0; x < w; ++x) {sum[x] -= z[x];}
+		}
+		uint32_t count = 0;
+		for (int32_t x = 0; x < kxn - 1; ++x) {count += (p[x] == 0.0f);}
+		for (int32_t x = 0; x < w; ++x)
+		{
+			count += (p[x + kxn - 1] == 0.0f);
+			z[x] = count;
+			count -= (p[x] == 0.0f);
+		}
+		for (int32_t x = 0; x < w; ++x) {sum[x] += z[x];}
+		if (r >= kyn - 1)
+		{
+			float * d = pix2 + (size_t)(r - kyn + 1 + kyn / 2) * xn + kxn / 2;
+			for (int32_t x = 0; x < w; ++x) {d[x] = (sum[x] == 0) ? 1.0f : 0.0f;}
+		}
+	}
+	free (rows);
+	free (sum);
+}
+
+
+/**
+ * @brief Windowed product as a horizontal and a vertical product pass
+ */
+static void csc_vf32_conv_clean_product (float pix2[], float const pix[], int32_t xn, int32_t w, int32_t h, int32_t kxn, int32_t kyn)
+{
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	int32_t const sh = h + kyn - 1;
+	float * t = malloc ((size_t)sh * w * sizeof (float));
+	ASSERT (t);
+	for (int32_t r = 0; r < sh; ++r)
+	{
+		float * tr = t + (size_t)r * w;
+		float const * p = pix + (size_t)r * xn;
+		o->cpy (w, tr, p);
+		for (int32_t kx = 1; kx < kxn; ++kx) {o->vv_mul (w, tr, tr, p + kx);}
+	}
+	for (int32_t y = 0; y < h; ++y)
+	{
+		float * d = pix2 + (size_t)(y + kyn / 2) * xn + kxn / 2;
+		o->cpy (w, d, t + (size_t)y * w);
+		for (int32_t ky = 1; ky < kyn; ++ky) {o->vv_mul (w, d, d, t + (size_t)(y + ky) * w);}
+	}
+	free (t);
+}
+
+
+/**
+ * @brief pix2 := product of pix over the (kxn) * (kyn) window, border pixels are not written
+ * Binary images uses running counts of zeros, other images uses two product passes.
+ * The product passes multiplies in a different order than a row by row product, the rounding can differ.
+ */
+static void vf32_convolution2d_clean (float pix2[], float const pix[], int32_t xn, int32_t yn, int32_t kxn, int32_t kyn)
+{
+	int32_t const w = xn - 2 * (kxn / 2);
+	int32_t const h = yn - 2 * (kyn / 2);
+	if (w <= 0 || h <= 0) {return;}
+	int32_t const sw = w + kxn - 1;
+	int binary = 1;
+	for (int32_t r = 0; r < h + kyn - 1; ++r)
+	{
+		float const * p = pix + (size_t)r * xn;
+		for (int32_t x = 0; x < sw; ++x) {binary &= (p[x] == 0.0f) | (p[x] == 1.0f);}
+	}
+	if (binary)
+	{
+		csc_vf32_conv_clean_binary (pix2, pix, xn, w, h, kxn, kyn);
+	}
+	else
+	{
+		csc_vf32_conv_clean_product (pix2, pix, xn, w, h, kxn, kyn);
+	}
 }
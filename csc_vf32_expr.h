@@ -0,0 +1,261 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_vf32_simd.h"
+
+
+/*
+Lazy vf32 expressions.
+A chain of elementwise operations and reductions is built as a list of nodes and evaluated in one pass.
+The arrays are processed in blocks of CSC_VF32_EXPR_BLOCK floats,
+all nodes are evaluated for one block before the next block,
+so intermediate values stay in L1 cache and every input element is read from memory once.
+Each node is evaluated by the SIMD kernels of csc_vf32_simd.h.
+
+Example, r := (a - b) * 0.5 and d := |a - b|^2 in one pass:
+	struct csc_vf32_expr e;
+	csc_vf32_expr_init (&e);
+	uint32_t x = csc_vf32_expr_sub (&e, csc_vf32_expr_input (&e, a), csc_vf32_expr_input (&e, b));
+	csc_vf32_expr_store (&e, csc_vf32_expr_muls (&e, x, 0.5f), r);
+	csc_vf32_expr_dot (&e, x, x, &d);
+	csc_vf32_expr_eval (&e, n);
+
+Nodes are evaluated in the order they are added.
+An output array may be the same array as an input array,
+nodes added after the store reads the stored values.
+*/
+#define CSC_VF32_EXPR_MAXNODE 16
+#define CSC_VF32_EXPR_BLOCK 256
+
+
+enum csc_vf32_expr_op
+{
+	CSC_VF32_EXPR_INPUT, // a
+	CSC_VF32_EXPR_ADD, // x + y
+	CSC_VF32_EXPR_SUB, // x - y
+	CSC_VF32_EXPR_MUL, // x * y
+	CSC_VF32_EXPR_MACC, // x + y * z
+	CSC_VF32_EXPR_ADDS, // x + s
+	CSC_VF32_EXPR_MULS, // x * s
+	CSC_VF32_EXPR_SUM, // *output := sum x
+	CSC_VF32_EXPR_DOT, // *output := x . y
+	CSC_VF32_EXPR_MAX, // *output := max x
+};
+
+
+struct csc_vf32_expr_node
+{
+	enum csc_vf32_expr_op op;
+	//Operand nodes:
+	uint32_t x;
+	uint32_t y;
+	uint32_t z;
+	float s;
+	float const * input;
+	//Store target of elementwise nodes or the result of reductions:
+	float * output;
+};
+
+
+struct csc_vf32_expr
+{
+	uint32_t count;
+	struct csc_vf32_expr_node node[CSC_VF32_EXPR_MAXNODE];
+};
+
+
+static void csc_vf32_expr_init (struct csc_vf32_expr * e)
+{
+	ASSERT_PARAM_NOTNULL (e);
+	e->count = 0;
+}
+
+
+static uint32_t csc_vf32_expr_push (struct csc_vf32_expr * e, enum csc_vf32_expr_op op, uint32_t x, uint32_t y, uint32_t z)
+{
+	ASSERT_PARAM_NOTNULL (e);
+	ASSERTF (e->count < CSC_VF32_EXPR_MAXNODE, "Too many nodes %i", e->count);
+	//Operands must be added before the node using them:
+	ASSERT (op == CSC_VF32_EXPR_INPUT || (x < e->count && y < e->count && z < e->count));
+	//Reductions has no elementwise values and can not be operands:
+	ASSERTF (op == CSC_VF32_EXPR_INPUT || (e->node[x].op <= CSC_VF32_EXPR_MULS && e->node[y].op <= CSC_VF32_EXPR_MULS && e->node[z].op <= CSC_VF32_EXPR_MULS), "Operand of node %i is a reduction", e->count);
+	uint32_t i = e->count++;
+	e->node[i] = (struct csc_vf32_expr_node){op, x, y, z, 0.0f, NULL, NULL};
+	return i;
+}
+
+
+static uint32_t csc_vf32_expr_input (struct csc_vf32_expr * e, float const a[])
+{
+	ASSERT_PARAM_NOTNULL (a);
+	uint32_t i = csc_vf32_expr_push (e, CSC_VF32_EXPR_INPUT, 0, 0, 0);
+	e->node[i].input = a;
+	return i;
+}
+
+
+static uint32_t csc_vf32_expr_add (struct csc_vf32_expr * e, uint32_t x, uint32_t y)
+{
+	return csc_vf32_expr_push (e, CSC_VF32_EXPR_ADD, x, y, x);
+}
+
+
+static uint32_t csc_vf32_expr_sub (struct csc_vf32_expr * e, uint32_t x, uint32_t y)
+{
+	return csc_vf32_expr_push (e, CSC_VF32_EXPR_SUB, x, y, x);
+}
+
+
+static uint32_t csc_vf32_expr_mul (struct csc_vf32_expr * e, uint32_t x, uint32_t y)
+{
+	return csc_vf32_expr_push (e, CSC_VF32_EXPR_MUL, x, y, x);
+}
+
+
+static uint32_t csc_vf32_expr_macc (struct csc_vf32_expr * e, uint32_t x, uint32_t y, uint32_t z)
+{
+	return csc_vf32_expr_push (e, CSC_VF32_EXPR_MACC, x, y, z);
+}
+
+
+static uint32_t csc_vf32_expr_adds (struct csc_vf32_expr * e, uint32_t x, float s)
+{
+	uint32_t i = csc_vf32_expr_push (e, CSC_VF32_EXPR_ADDS, x, x, x);
+	e->node[i].s = s;
+	return i;
+}
+
+
+static uint32_t csc_vf32_expr_muls (struct csc_vf32_expr * e, uint32_t x, float s)
+{
+	uint32_t i = csc_vf32_expr_push (e, CSC_VF32_EXPR_MULS, x, x, x);
+	e->node[i].s = s;
+	return i;
+}
+
+
+/**
+ * @brief Store the values of node (x) to (r) when evaluated
+ */
+static void csc_vf32_expr_store (struct csc_vf32_expr * e, uint32_t x, float r[])
+{
+	ASSERT_PARAM_NOTNULL (e);
+	ASSERT_PARAM_NOTNULL (r);
+	ASSERT (x < e->count);
+	ASSERT (e->node[x].op <= CSC_VF32_EXPR_MULS);
+	ASSERTF (e->node[x].output == NULL, "Node %i is already stored", x);
+	if (e->node[x].op == CSC_VF32_EXPR_INPUT)
+	{
+		//Copy the input through a node that can have a output:
+		x = csc_vf32_expr_muls (e, x, 1.0f);
+	}
+	e->node[x].output = r;
+}
+
+
+static uint32_t csc_vf32_expr_sum (struct csc_vf32_expr * e, uint32_t x, float * result)
+{
+	ASSERT_PARAM_NOTNULL (result);
+	uint32_t i = csc_vf32_expr_push (e, CSC_VF32_EXPR_SUM, x, x, x);
+	e->node[i].output = result;
+	return i;
+}
+
+
+static uint32_t csc_vf32_expr_dot (struct csc_vf32_expr * e, uint32_t x, uint32_t y, float * result)
+{
+	ASSERT_PARAM_NOTNULL (result);
+	uint32_t i = csc_vf32_expr_push (e, CSC_VF32_EXPR_DOT, x, y, x);
+	e->node[i].output = result;
+	return i;
+}
+
+
+static uint32_t csc_vf32_expr_max (struct csc_vf32_expr * e, uint32_t x, float * result)
+{
+	ASSERT_PARAM_NOTNULL (result);
+	uint32_t i = csc_vf32_expr_push (e, CSC_VF32_EXPR_MAX, x, x, x);
+	e->node[i].output = result;
+	return i;
+}
+
+
+/**
+ * @brief Evaluate all nodes for (n) elements in one pass
+ * Reductions are written when the evaluation is done, the sum of an empty array is 0 and the max is -INFINITY.
+ */
+static void csc_vf32_expr_eval (struct csc_vf32_expr const * e, uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (e);
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	float buf[CSC_VF32_EXPR_MAXNODE][CSC_VF32_EXPR_BLOCK];
+	float const * v[CSC_VF32_EXPR_MAXNODE];
+	//Reductions are accumulated with Kahan summation over the block results:
+	float acc[CSC_VF32_EXPR_MAXNODE];
+	float comp[CSC_VF32_EXPR_MAXNODE];
+	for (uint32_t k = 0; k < e->count; ++k)
+	{
+		acc[k] = (e->node[k].op == CSC_VF32_EXPR_MAX) ? -INFINITY : 0.0f;
+		comp[k] = 0.0f;
+	}
+	for (uint32_t i = 0; i < n; i += CSC_VF32_EXPR_BLOCK)
+	{
+		uint32_t const m = MIN (n - i, CSC_VF32_EXPR_BLOCK);
+		for (uint32_t k = 0; k < e->count; ++k)
+		{
+			struct csc_vf32_expr_node const * node = e->node + k;
+			float * dst = node->output ? node->output + i : buf[k];
+			switch (node->op)
+			{
+			case CSC_VF32_EXPR_INPUT:
+				v[k] = node->input + i;
+				continue;
+			case CSC_VF32_EXPR_ADD:
+				o->vv_add (m, dst, v[node->x], v[node->y]);
+				break;
+			case CSC_VF32_EXPR_SUB:
+				o->vv_sub (m, dst, v[node->x], v[node->y]);
+				break;
+			case CSC_VF32_EXPR_MUL:
+				o->vv_mul (m, dst, v[node->x], v[node->y]);
+				break;
+			case CSC_VF32_EXPR_MACC:
+				//(dst) might be the array of operand (y) or (z):
+				o->cpy (m, buf[k], v[node->x]);
+				o->vv_macc (m, buf[k], v[node->y], v[node->z]);
+				if (dst != buf[k]) {o->cpy (m, dst, buf[k]);}
+				break;
+			case CSC_VF32_EXPR_ADDS:
+				o->vs_add (m, dst, v[node->x], node->s);
+				break;
+			case CSC_VF32_EXPR_MULS:
+				o->vs_mul (m, dst, v[node->x], node->s);
+				break;
+			case CSC_VF32_EXPR_SUM:
+				csc_vf32_simd_kahan_add (acc + k, comp + k, o->sum (m, v[node->x]));
+				continue;
+			case CSC_VF32_EXPR_DOT:
+				csc_vf32_simd_kahan_add (acc + k, comp + k, o->dot (m, v[node->x], v[node->y]));
+				continue;
+			case CSC_VF32_EXPR_MAX:{
+				float x = o->max (m, v[node->x]);
+				acc[k] = (x > acc[k]) ? x : acc[k];
+				continue;}
+			}
+			v[k] = dst;
+		}
+	}
+	for (uint32_t k = 0; k < e->count; ++k)
+	{
+		if (e->node[k].op >= CSC_VF32_EXPR_SUM)
+		{
+			e->node[k].output[0] = acc[k];
+		}
+	}
+}
@@ -5,8 +5,11 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #pragma once
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "csc_math.h"
 #include "csc_vf32.h"
+#include "csc_vf32_stats.h"
 
 
 
@@ -51,63 +54,101 @@ static uint32_t vf32_amount_negative (float q[], uint32_t qn, uint32_t * qi, uin
 
 
 
-/**
- * @brief Find peaks.
- * @param q[in,out] The array
- * @param qn[in]    Number of elements in \p q
- * @param g[out]    The index where the peak is located
- * @param gn[in]    Number of elements in \p g
- */
-static void vf32_find_peaks (float q[], uint32_t qn, uint32_t g[], uint32_t gn, uint32_t r, uint32_t margin)
+//Heap order of peak candidates, larger value first and lower index first for equal values:
+static int vf32_find_peaks_before (float const q[], uint32_t a, uint32_t b)
+{
+	return (q[a] > q[b]) || (q[a] == q[b] && a < b);
+}
+
+
+static void vf32_find_peaks_sift (float const q[], uint32_t h[], uint32_t n, uint32_t i)
 {
-	for (uint32_t gi = 0; gi < gn; ++gi)
+	while (1)
 	{
-		float qmax = 0.0f;
-		uint32_t qimax = 0;
-		for (uint32_t qi = margin; qi < qn-margin; ++qi)
+		uint32_t c = 2 * i + 1;
+		if (c >= n) {break;}
+		if (c + 1 < n && vf32_find_peaks_before (q, h[c + 1], h[c])) {c++;}
+		if (vf32_find_peaks_before (q, h[i], h[c]) == 0)
 		{
-			if (qmax < q[qi])
-			{
-				qmax = q[qi];
-				qimax = qi;
-			}
+			uint32_t t = h[i];
+			h[i] = h[c];
+			h[c] = t;
+			i = c;
 		}
-		g[gi] = qimax;
-		uint32_t qi0 = r <= qimax ? (qimax-r) : 0;
-		uint32_t qi1 = MIN (qimax+r, qn);
-		for (uint32_t qi = qi0; qi < qi1; ++qi)
+		else
 		{
-			q[qi] = 0.0f;
+			break;
 		}
 	}
 }
 
 
+/**
+ * @brief Find the largest peaks with non-maximum suppression.
+ * The candidates are the positive local maxima in [margin, qn-margin), found in one SIMD pass,
+ * a flat top gives its leftmost element.
+ * The candidates are taken largest first from a heap, a taken peak suppresses itself and the candidates in [peak-r, peak+r).
+ * Runs in O(qn + c log c + gn r) for (c) candidates and does not modify the array.
+ * @param q[in]     The array
+ * @param qn[in]    Number of elements in \p q
+ * @param g[out]    The index where the peak is located, largest first, unused elements are set to 0
+ * @param gn[in]    Number of elements in \p g
+ * @param r[in]     Suppression radius
+ * @param margin[in] Number of elements ignored at both ends of \p q
+ * @return Number of peaks found
+ */
+static uint32_t vf32_find_peaks (float const q[], uint32_t qn, uint32_t g[], uint32_t gn, uint32_t r, uint32_t margin)
+{
+	memset (g, 0, sizeof (uint32_t) * gn);
+	if (qn <= 2 * margin || gn == 0) {return 0;}
+	float const * a = q + margin;
+	uint32_t const n = qn - 2 * margin;
+	uint32_t * h = malloc ((n / 2 + 2) * sizeof (uint32_t));
+	uint8_t * suppressed = calloc (n, sizeof (uint8_t));
+	ASSERT (h && suppressed);
+	//The ends only have one neighbor inside the range:
+	uint32_t m = 0;
+	if (a[0] > 0.0f && (n == 1 || a[0] >= a[1])) {h[m++] = 0;}
+	m += csc_vf32_simd ()->peaks (n, a, h + m);
+	if (n > 1 && a[n-1] > 0.0f && a[n-1] > a[n-2]) {h[m++] = n - 1;}
+	for (uint32_t i = m / 2; i-- > 0;)
+	{
+		vf32_find_peaks_sift (a, h, m, i);
+	}
+	uint32_t gi = 0;
+	while (m > 0 && gi < gn)
+	{
+		uint32_t p = h[0];
+		h[0] = h[--m];
+		vf32_find_peaks_sift (a, h, m, 0);
+		if (suppressed[p]) {continue;}
+		g[gi++] = p + margin;
+		uint32_t i0 = r <= p ? (p - r) : 0;
+		uint32_t i1 = MIN (p + r, n);
+		memset (suppressed + i0, 1, i1 - i0);
+	}
+	free (h);
+	free (suppressed);
+	return gi;
+}
+
+
 
 
 
 
+/**
+ * @brief Set the values between 0 and the mean of the positive values and
+ * between 0 and the mean of the negative values to 0.
+ */
 static void vf32_remove_low_values (float q[], uint32_t qn)
 {
-	float pos = 0.0f;
-	float neg = 0.0f;
-	float pos_n = 0;
-	float neg_n = 0;
-	for (uint32_t i = 0; i < qn; ++i)
-	{
-		if (q[i] > 0.0f)
-		{
-			pos += q[i];
-			pos_n += 1.0f;
-		}
-		else if (q[i] < 0.0f)
-		{
-			neg += q[i];
-			neg_n += 1.0f;
-		}
-	}
-	pos /= pos_n;
-	neg /= neg_n;
+	//The positive and negative means in one pass:
+	struct csc_vf32_stats s;
+	csc_vf32_stats_init (&s);
+	csc_vf32_stats_update (&s, qn, q);
+	float const pos = csc_vf32_stats_pos_mean (&s);
+	float const neg = csc_vf32_stats_neg_mean (&s);
 	for (uint32_t i = 0; i < qn; ++i)
 	{
 		if ((q[i] > 0.0f) && (q[i] < pos))
@@ -0,0 +1,273 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_parallel.h"
+#include "csc_vf32.h"
+#include "csc_vu32.h"
+#include "csc_vf32_stats.h"
+
+
+/*
+Multi-threaded variants of the bandwidth bound csc_vf32.h, csc_vu32.h and csc_vf32_stats.h operations.
+Each function takes a thread pool, NULL runs the single-threaded function.
+The arrays are split on cache line boundaries of the output array.
+Every part runs the SIMD kernels of csc_vf32_simd.h.
+Reductions sum one partial result per part in part order,
+the result only depends on the number of parts.
+*/
+
+
+struct csc_vf32_parallel_args
+{
+	float * r;
+	float const * a;
+	float const * b;
+	float s;
+	uint32_t const * ua;
+	uint32_t * ur;
+	uint32_t us;
+	csc_vf32_simd_vv_fn vv;
+	csc_vf32_simd_vs_fn vs;
+	enum csc_vf32_simd_summode mode;
+	float partial[CSC_PARALLEL_MAXTHREADS];
+};
+
+
+static size_t csc_vf32_parallel_skew (void const * p, size_t size)
+{
+	return ((uintptr_t)p % CSC_PARALLEL_CACHELINE) / size;
+}
+
+
+static void csc_vf32_parallel_vv_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	UNUSED (part);
+	x->vv ((uint32_t)(b - a), x->r + a, x->a + a, x->b + a);
+}
+
+
+static void csc_vf32_parallel_vs_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	UNUSED (part);
+	x->vs ((uint32_t)(b - a), x->r + a, x->a + a, x->s);
+}
+
+
+static void csc_vf32_parallel_vv (struct csc_parallel * p, csc_vf32_simd_vv_fn vv, uint32_t n, float r[], float const a[], float const b[])
+{
+	struct csc_vf32_parallel_args x = {.r = r, .a = a, .b = b, .vv = vv};
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (float), csc_vf32_parallel_skew (r, sizeof (float)), csc_vf32_parallel_vv_part, &x);
+}
+
+
+static void csc_vf32_parallel_vs (struct csc_parallel * p, csc_vf32_simd_vs_fn vs, uint32_t n, float r[], float const a[], float s)
+{
+	struct csc_vf32_parallel_args x = {.r = r, .a = a, .s = s, .vs = vs};
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (float), csc_vf32_parallel_skew (r, sizeof (float)), csc_vf32_parallel_vs_part, &x);
+}
+
+
+// r := a + b
+static void vvf32_add_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float const b[])
+{
+	csc_vf32_parallel_vv (p, csc_vf32_simd ()->vv_add, n, r, a, b);
+}
+
+
+// r := a - b
+static void vvf32_sub_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float const b[])
+{
+	csc_vf32_parallel_vv (p, csc_vf32_simd ()->vv_sub, n, r, a, b);
+}
+
+
+// r := a * b
+static void vvf32_hadamard_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float const b[])
+{
+	csc_vf32_parallel_vv (p, csc_vf32_simd ()->vv_mul, n, r, a, b);
+}
+
+
+// r := r + a * b
+static void vvf32_macc_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float const b[])
+{
+	csc_vf32_parallel_vv (p, csc_vf32_simd ()->vv_macc, n, r, a, b);
+}
+
+
+// r := a + b
+static void vsf32_add_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float b)
+{
+	csc_vf32_parallel_vs (p, csc_vf32_simd ()->vs_add, n, r, a, b);
+}
+
+
+// r := a - b
+static void vsf32_sub_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float b)
+{
+	csc_vf32_parallel_vs (p, csc_vf32_simd ()->vs_sub, n, r, a, b);
+}
+
+
+// r := a * b
+static void vsf32_mul_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float b)
+{
+	csc_vf32_parallel_vs (p, csc_vf32_simd ()->vs_mul, n, r, a, b);
+}
+
+
+// r := r + a * b
+static void vsf32_macc_parallel (struct csc_parallel * p, uint32_t n, float r[], float const a[], float b)
+{
+	csc_vf32_parallel_vs (p, csc_vf32_simd ()->vs_macc, n, r, a, b);
+}
+
+
+static void csc_vf32_parallel_set1_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	UNUSED (part);
+	csc_vf32_simd ()->set1 ((uint32_t)(b - a), x->r + a, x->s);
+}
+
+
+// r := {x | x = b}
+static void vf32_set1_parallel (struct csc_parallel * p, uint32_t n, float r[], float b)
+{
+	struct csc_vf32_parallel_args x = {.r = r, .s = b};
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (float), csc_vf32_parallel_skew (r, sizeof (float)), csc_vf32_parallel_set1_part, &x);
+}
+
+
+static void csc_vf32_parallel_cpy_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	UNUSED (part);
+	csc_vf32_simd ()->cpy ((uint32_t)(b - a), x->r + a, x->a + a);
+}
+
+
+static void vf32_cpy_parallel (struct csc_parallel * p, uint32_t n, float des[], float const src[])
+{
+	struct csc_vf32_parallel_args x = {.r = des, .a = src};
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (float), csc_vf32_parallel_skew (des, sizeof (float)), csc_vf32_parallel_cpy_part, &x);
+}
+
+
+static void csc_vf32_parallel_sum_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	x->partial[part] = csc_vf32_simd_sum ((uint32_t)(b - a), x->a + a, x->mode);
+}
+
+
+static void csc_vf32_parallel_dot_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	x->partial[part] = csc_vf32_simd_dot ((uint32_t)(b - a), x->a + a, x->b + a, x->mode);
+}
+
+
+static float csc_vf32_parallel_reduce (struct csc_parallel * p, size_t n, csc_parallel_fn fn, struct csc_vf32_parallel_args * x)
+{
+	uint32_t parts = csc_parallel_parts (p, n);
+	memset (x->partial, 0, sizeof (x->partial));
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (float), csc_vf32_parallel_skew (x->a, sizeof (float)), fn, x);
+	float sum = 0.0f;
+	float c = 0.0f;
+	for (uint32_t i = 0; i < parts; ++i)
+	{
+		csc_vf32_simd_kahan_add (&sum, &c, x->partial[i]);
+	}
+	return sum;
+}
+
+
+static float vf32_sum_parallel (struct csc_parallel * p, uint32_t n, float const v[])
+{
+	struct csc_vf32_parallel_args x = {.a = v, .mode = CSC_VF32_SIMD_SUM_DEFAULT};
+	return csc_vf32_parallel_reduce (p, n, csc_vf32_parallel_sum_part, &x);
+}
+
+
+// r := a . b
+static float vf32_dot_parallel (struct csc_parallel * p, uint32_t n, float const a[], float const b[])
+{
+	struct csc_vf32_parallel_args x = {.a = a, .b = b, .mode = CSC_VF32_SIMD_SUM_DEFAULT};
+	return csc_vf32_parallel_reduce (p, n, csc_vf32_parallel_dot_part, &x);
+}
+
+
+static void csc_vu32_parallel_cpy_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	UNUSED (part);
+	memcpy (x->ur + a, x->ua + a, (b - a) * sizeof (uint32_t));
+}
+
+
+static void vu32_cpy_parallel (struct csc_parallel * p, uint32_t n, uint32_t des[], uint32_t const src[])
+{
+	struct csc_vf32_parallel_args x = {.ur = des, .ua = src};
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (uint32_t), csc_vf32_parallel_skew (des, sizeof (uint32_t)), csc_vu32_parallel_cpy_part, &x);
+}
+
+
+static void csc_vu32_parallel_set1_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_parallel_args * x = ptr;
+	UNUSED (part);
+	vu32_set1 ((uint32_t)(b - a), x->ur + a, x->us);
+}
+
+
+static void vu32_set1_parallel (struct csc_parallel * p, uint32_t n, uint32_t r[], uint32_t v)
+{
+	struct csc_vf32_parallel_args x = {.ur = r, .us = v};
+	csc_parallel_for (p, n, CSC_PARALLEL_CACHELINE / sizeof (uint32_t), csc_vf32_parallel_skew (r, sizeof (uint32_t)), csc_vu32_parallel_set1_part, &x);
+}
+
+
+struct csc_vf32_stats_parallel_args
+{
+	float const * x;
+	struct csc_vf32_stats partial[CSC_PARALLEL_MAXTHREADS];
+};
+
+
+static void csc_vf32_stats_parallel_part (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	struct csc_vf32_stats_parallel_args * p = ptr;
+	csc_vf32_stats_update (p->partial + part, (uint32_t)(b - a), p->x + a);
+}
+
+
+/**
+ * @brief Add (n) values to the stats using a thread pool, the parts are merged in part order
+ * @param pool Thread pool or NULL
+ */
+static void csc_vf32_stats_update_parallel (struct csc_parallel * pool, struct csc_vf32_stats * s, uint32_t n, float const x[])
+{
+	ASSERT_PARAM_NOTNULL (s);
+	uint32_t parts = csc_parallel_parts (pool, n);
+	struct csc_vf32_stats_parallel_args * p = malloc (sizeof (struct csc_vf32_stats_parallel_args));
+	ASSERT (p);
+	p->x = x;
+	for (uint32_t i = 0; i < parts; ++i)
+	{
+		csc_vf32_stats_init (p->partial + i);
+	}
+	csc_parallel_for (pool, n, CSC_VF32_STATS_BLOCK, 0, csc_vf32_stats_parallel_part, p);
+	for (uint32_t i = 0; i < parts; ++i)
+	{
+		csc_vf32_stats_merge (s, p->partial + i);
+	}
+	free (p);
+}
@@ -7,19 +7,52 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 #include <stdint.h>
 #include <stdio.h>
 #include "csc_math.h"
+#include "csc_strfrom.h"
+#include "csc_sink.h"
 
 
+static void vf32_print_sink (struct csc_sink * sink, float const x [], size_t n)
+{
+	//Each element needs at most (STRFROM_F32_SIZE + 2) characters:
+	uint32_t const chunk = 64;
+	uint32_t const need = (STRFROM_F32_SIZE + 2) * chunk;
+	csc_sink_putc (sink, '(');
+	for (size_t i = 0; i < n; i += chunk)
+	{
+		char * o = csc_sink_reserve (sink, need);
+		ASSERT (o != NULL);
+		csc_sink_commit (sink, strfrom_vf32 (o, need, x + i, (uint32_t) MIN (n - i, chunk), 1, 0, 0, ' '));
+	}
+	csc_sink_puts (sink, "\b)\n");
+}
+
+
+/**
+ * @brief Print vector
+ * @param format Format for each element. If NULL the shortest round-trip representation is used.
+ */
 static void vf32_print (FILE * f, float const x [], size_t n, char const * format)
 {
-	fprintf (f, "(");
-	for (size_t i = 0; i < n; ++ i)
+	char buf [4096];
+	struct csc_sink sink;
+	csc_sink_init_file (&sink, buf, sizeof (buf), f);
+	if (format == NULL)
+	{
+		vf32_print_sink (&sink, x, n);
+	}
+	else
 	{
+		csc_sink_putc (&sink, '(');
+		for (size_t i = 0; i < n; ++ i)
+		{
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-nonliteral"
-		fprintf (f, format, (double) x [i]);
+			csc_sink_printf (&sink, format, (double) x [i]);
 #pragma GCC diagnostic pop
+		}
+		csc_sink_puts (&sink, "\b)\n");
 	}
-	fprintf (f, "\b)\n");
+	csc_sink_flush (&sink);
 	fflush (f);
 }
 
@@ -0,0 +1,517 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CSC_VF32_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+SIMD backends for the elementwise float kernels and reductions in csc_vf32.h.
+Every backend is compiled with a function target attribute so no global compiler flags are needed.
+The best backend supported by the CPU is selected by CPUID at the first call,
+csc_vf32_simd_select() can force a lower backend for testing and benchmarking.
+The elementwise kernels do the same operation per element in every backend,
+so their results are bitwise identical to the scalar backend except for macc that the compiler may contract to FMA.
+Reductions are not bitwise identical across backends, each backend adds 4*W partial sums of its own vector width (W)
+so the order of the additions and therefore the rounding of sum and dot differs between CPUs.
+The output (r) can be the same array as (a) or (b) but must not partially overlap them.
+
+Reductions (sum, dot) have three summation modes:
+FAST uses 4 independent vector accumulators, 4*W partial sums that are added at the end.
+PAIRWISE splits the array in halves recursively down to blocks that are summed by FAST,
+the rounding error grows with log(n) instead of n.
+KAHAN keeps a compensation term per lane, the rounding error is independent of n.
+Kahan summation does not survive -ffast-math or -fassociative-math.
+*/
+
+
+enum csc_vf32_simd_level
+{
+	CSC_VF32_SIMD_SCALAR,
+	CSC_VF32_SIMD_SSE2,
+	CSC_VF32_SIMD_AVX2,
+	CSC_VF32_SIMD_AVX512,
+	CSC_VF32_SIMD_COUNT
+};
+
+
+static char const * csc_vf32_simd_level_tostr (enum csc_vf32_simd_level level)
+{
+	switch (level)
+	{
+	case CSC_VF32_SIMD_SCALAR: return "SCALAR";
+	case CSC_VF32_SIMD_SSE2: return "SSE2";
+	case CSC_VF32_SIMD_AVX2: return "AVX2";
+	case CSC_VF32_SIMD_AVX512: return "AVX512";
+	default: return "";
+	}
+}
+
+
+typedef void (*csc_vf32_simd_vv_fn) (uint32_t n, float r[], float const a[], float const b[]);
+typedef void (*csc_vf32_simd_vs_fn) (uint32_t n, float r[], float const a[], float b);
+typedef void (*csc_vf32_simd_set_fn) (uint32_t n, float r[], float b);
+typedef void (*csc_vf32_simd_cpy_fn) (uint32_t n, float r[], float const a[]);
+typedef float (*csc_vf32_simd_sum_fn) (uint32_t n, float const a[]);
+typedef float (*csc_vf32_simd_dot_fn) (uint32_t n, float const a[], float const b[]);
+typedef uint32_t (*csc_vf32_simd_peaks_fn) (uint32_t n, float const a[], uint32_t r[]);
+
+
+enum csc_vf32_simd_summode
+{
+	CSC_VF32_SIMD_SUM_FAST,
+	CSC_VF32_SIMD_SUM_PAIRWISE,
+	CSC_VF32_SIMD_SUM_KAHAN,
+	//Use the mode set by csc_vf32_simd_set_summode():
+	CSC_VF32_SIMD_SUM_DEFAULT,
+};
+
+
+struct csc_vf32_simd_ops
+{
+	enum csc_vf32_simd_level level;
+	csc_vf32_simd_vv_fn vv_add; // r := a + b
+	csc_vf32_simd_vv_fn vv_sub; // r := a - b
+	csc_vf32_simd_vv_fn vv_mul; // r := a * b
+	csc_vf32_simd_vv_fn vv_macc; // r := r + a * b
+	csc_vf32_simd_vs_fn vs_add; // r := a + b
+	csc_vf32_simd_vs_fn vs_sub; // r := a - b
+	csc_vf32_simd_vs_fn vs_mul; // r := a * b
+	csc_vf32_simd_vs_fn vs_macc; // r := r + a * b
+	csc_vf32_simd_set_fn set1; // r := b
+	csc_vf32_simd_cpy_fn cpy; // r := a
+	csc_vf32_simd_sum_fn sum; // ret sum a
+	csc_vf32_simd_dot_fn dot; // ret a . b
+	csc_vf32_simd_sum_fn sum_kahan; // ret sum a
+	csc_vf32_simd_dot_fn dot_kahan; // ret a . b
+	csc_vf32_simd_sum_fn max; // ret max a
+	csc_vf32_simd_sum_fn maxabs; // ret max |a|
+	csc_vf32_simd_peaks_fn peaks; // r := {i | a[i] > 0, a[i] > a[i-1], a[i] >= a[i+1]}
+};
+
+
+static void csc_vf32_simd_kahan_add (float * sum, float * c, float x)
+{
+	float y = x - *c;
+	float t = *sum + y;
+	*c = (t - *sum) - y;
+	*sum = t;
+}
+
+
+/*
+Generates the kernels of one backend.
+(W) floats per vector of type (T), the remaining (n % W) elements are done by a scalar loop.
+The reductions requires n >= 1 for max and maxabs.
+GTMASK and GEMASK compares two vectors into a bitmask with one bit per lane.
+The peaks kernel writes at most n/2 indices.
+*/
+#define CSC_VF32_SIMD_KERNELS(isa, attr, W, T, LOAD, STORE, ADD, SUB, MUL, SET1, MAX, ABS, GTMASK, GEMASK) \
+attr static void csc_vf32_simd_vv_add_##isa (uint32_t n, float r[], float const a[], float const b[]) \
+{ \
+	uint32_t i = 0; \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, ADD (LOAD (a + i), LOAD (b + i)));} \
+	for (; i < n; ++i) {r[i] = a[i] + b[i];} \
+} \
+attr static void csc_vf32_simd_vv_sub_##isa (uint32_t n, float r[], float const a[], float const b[]) \
+{ \
+	uint32_t i = 0; \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, SUB (LOAD (a + i), LOAD (b + i)));} \
+	for (; i < n; ++i) {r[i] = a[i] - b[i];} \
+} \
+attr static void csc_vf32_simd_vv_mul_##isa (uint32_t n, float r[], float const a[], float const b[]) \
+{ \
+	uint32_t i = 0; \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, MUL (LOAD (a + i), LOAD (b + i)));} \
+	for (; i < n; ++i) {r[i] = a[i] * b[i];} \
+} \
+attr static void csc_vf32_simd_vv_macc_##isa (uint32_t n, float r[], float const a[], float const b[]) \
+{ \
+	uint32_t i = 0; \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, ADD (LOAD (r + i), MUL (LOAD (a + i), LOAD (b + i))));} \
+	for (; i < n; ++i) {r[i] += a[i] * b[i];} \
+} \
+attr static void csc_vf32_simd_vs_add_##isa (uint32_t n, float r[], float const a[], float b) \
+{ \
+	uint32_t i = 0; \
+	T const vb = SET1 (b); \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, ADD (LOAD (a + i), vb));} \
+	for (; i < n; ++i) {r[i] = a[i] + b;} \
+} \
+attr static void csc_vf32_simd_vs_sub_##isa (uint32_t n, float r[], float const a[], float b) \
+{ \
+	uint32_t i = 0; \
+	T const vb = SET1 (b); \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, SUB (LOAD (a + i), vb));} \
+	for (; i < n; ++i) {r[i] = a[i] - b;} \
+} \
+attr static void csc_vf32_simd_vs_mul_##isa (uint32_t n, float r[], float const a[], float b) \
+{ \
+	uint32_t i = 0; \
+	T const vb = SET1 (b); \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, MUL (LOAD (a + i), vb));} \
+	for (; i < n; ++i) {r[i] = a[i] * b;} \
+} \
+attr static void csc_vf32_simd_vs_macc_##isa (uint32_t n, float r[], float const a[], float b) \
+{ \
+	uint32_t i = 0; \
+	T const vb = SET1 (b); \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, ADD (LOAD (r + i), MUL (LOAD (a + i), vb)));} \
+	for (; i < n; ++i) {r[i] += a[i] * b;} \
+} \
+attr static void csc_vf32_simd_set1_##isa (uint32_t n, float r[], float b) \
+{ \
+	uint32_t i = 0; \
+	T const vb = SET1 (b); \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, vb);} \
+	for (; i < n; ++i) {r[i] = b;} \
+} \
+attr static void csc_vf32_simd_cpy_##isa (uint32_t n, float r[], float const a[]) \
+{ \
+	uint32_t i = 0; \
+	for (; i + (W) <= n; i += (W)) {STORE (r + i, LOAD (a + i));} \
+	for (; i < n; ++i) {r[i] = a[i];} \
+} \
+attr static float csc_vf32_simd_sum_##isa (uint32_t n, float const a[]) \
+{ \
+	uint32_t i = 0; \
+	T s0 = SET1 (0.0f), s1 = s0, s2 = s0, s3 = s0; \
+	for (; i + 4*(W) <= n; i += 4*(W)) \
+	{ \
+		s0 = ADD (s0, LOAD (a + i + 0*(W))); \
+		s1 = ADD (s1, LOAD (a + i + 1*(W))); \
+		s2 = ADD (s2, LOAD (a + i + 2*(W))); \
+		s3 = ADD (s3, LOAD (a + i + 3*(W))); \
+	} \
+	for (; i + (W) <= n; i += (W)) {s0 = ADD (s0, LOAD (a + i));} \
+	float t[W]; \
+	STORE (t, ADD (ADD (s0, s1), ADD (s2, s3))); \
+	float sum = 0.0f; \
+	for (uint32_t k = 0; k < (W); ++k) {sum += t[k];} \
+	for (; i < n; ++i) {sum += a[i];} \
+	return sum; \
+} \
+attr static float csc_vf32_simd_dot_##isa (uint32_t n, float const a[], float const b[]) \
+{ \
+	uint32_t i = 0; \
+	T s0 = SET1 (0.0f), s1 = s0, s2 = s0, s3 = s0; \
+	for (; i + 4*(W) <= n; i += 4*(W)) \
+	{ \
+		s0 = ADD (s0, MUL (LOAD (a + i + 0*(W)), LOAD (b + i + 0*(W)))); \
+		s1 = ADD (s1, MUL (LOAD (a + i + 1*(W)), LOAD (b + i + 1*(W)))); \
+		s2 = ADD (s2, MUL (LOAD (a + i + 2*(W)), LOAD (b + i + 2*(W)))); \
+		s3 = ADD (s3, MUL (LOAD (a + i + 3*(W)), LOAD (b + i + 3*(W)))); \
+	} \
+	for (; i + (W) <= n; i += (W)) {s0 = ADD (s0, MUL (LOAD (a + i), LOAD (b + i)));} \
+	float t[W]; \
+	STORE (t, ADD (ADD (s0, s1), ADD (s2, s3))); \
+	float sum = 0.0f; \
+	for (uint32_t k = 0; k < (W); ++k) {sum += t[k];} \
+	for (; i < n; ++i) {sum += a[i] * b[i];} \
+	return sum; \
+} \
+attr static float csc_vf32_simd_sum_kahan_##isa (uint32_t n, float const a[]) \
+{ \
+	uint32_t i = 0; \
+	T s = SET1 (0.0f), c = s; \
+	for (; i + (W) <= n; i += (W)) \
+	{ \
+		T y = SUB (LOAD (a + i), c); \
+		T u = ADD (s, y); \
+		c = SUB (SUB (u, s), y); \
+		s = u; \
+	} \
+	float ts[W]; \
+	float tc[W]; \
+	STORE (ts, s); \
+	STORE (tc, c); \
+	float sum = 0.0f; \
+	float comp = 0.0f; \
+	for (uint32_t k = 0; k < (W); ++k) \
+	{ \
+		csc_vf32_simd_kahan_add (&sum, &comp, ts[k]); \
+		csc_vf32_simd_kahan_add (&sum, &comp, -tc[k]); \
+	} \
+	for (; i < n; ++i) {csc_vf32_simd_kahan_add (&sum, &comp, a[i]);} \
+	return sum; \
+} \
+attr static float csc_vf32_simd_dot_kahan_##isa (uint32_t n, float const a[], float const b[]) \
+{ \
+	uint32_t i = 0; \
+	T s = SET1 (0.0f), c = s; \
+	for (; i + (W) <= n; i += (W)) \
+	{ \
+		T y = SUB (MUL (LOAD (a + i), LOAD (b + i)), c); \
+		T u = ADD (s, y); \
+		c = SUB (SUB (u, s), y); \
+		s = u; \
+	} \
+	float ts[W]; \
+	float tc[W]; \
+	STORE (ts, s); \
+	STORE (tc, c); \
+	float sum = 0.0f; \
+	float comp = 0.0f; \
+	for (uint32_t k = 0; k < (W); ++k) \
+	{ \
+		csc_vf32_simd_kahan_add (&sum, &comp, ts[k]); \
+		csc_vf32_simd_kahan_add (&sum, &comp, -tc[k]); \
+	} \
+	for (; i < n; ++i) {csc_vf32_simd_kahan_add (&sum, &comp, a[i] * b[i]);} \
+	return sum; \
+} \
+attr static float csc_vf32_simd_max_##isa (uint32_t n, float const a[]) \
+{ \
+	uint32_t i = 0; \
+	T m0 = SET1 (a[0]), m1 = m0, m2 = m0, m3 = m0; \
+	for (; i + 4*(W) <= n; i += 4*(W)) \
+	{ \
+		m0 = MAX (LOAD (a + i + 0*(W)), m0); \
+		m1 = MAX (LOAD (a + i + 1*(W)), m1); \
+		m2 = MAX (LOAD (a + i + 2*(W)), m2); \
+		m3 = MAX (LOAD (a + i + 3*(W)), m3); \
+	} \
+	for (; i + (W) <= n; i += (W)) {m0 = MAX (LOAD (a + i), m0);} \
+	float t[W]; \
+	STORE (t, MAX (MAX (m0, m1), MAX (m2, m3))); \
+	float r = a[0]; \
+	for (uint32_t k = 0; k < (W); ++k) {if (t[k] > r) {r = t[k];}} \
+	for (; i < n; ++i) {if (a[i] > r) {r = a[i];}} \
+	return r; \
+} \
+attr static float csc_vf32_simd_maxabs_##isa (uint32_t n, float const a[]) \
+{ \
+	uint32_t i = 0; \
+	T m0 = ABS (SET1 (a[0])), m1 = m0, m2 = m0, m3 = m0; \
+	for (; i + 4*(W) <= n; i += 4*(W)) \
+	{ \
+		m0 = MAX (ABS (LOAD (a + i + 0*(W))), m0); \
+		m1 = MAX (ABS (LOAD (a + i + 1*(W))), m1); \
+		m2 = MAX (ABS (LOAD (a + i + 2*(W))), m2); \
+		m3 = MAX (ABS (LOAD (a + i + 3*(W))), m3); \
+	} \
+	for (; i + (W) <= n; i += (W)) {m0 = MAX (ABS (LOAD (a + i)), m0);} \
+	float t[W]; \
+	STORE (t, MAX (MAX (m0, m1), MAX (m2, m3))); \
+	float r = fabsf (a[0]); \
+	for (uint32_t k = 0; k < (W); ++k) {if (t[k] > r) {r = t[k];}} \
+	for (; i < n; ++i) {if (fabsf (a[i]) > r) {r = fabsf (a[i]);}} \
+	return r; \
+} \
+attr static uint32_t csc_vf32_simd_peaks_##isa (uint32_t n, float const a[], uint32_t r[]) \
+{ \
+	uint32_t m = 0; \
+	uint32_t i = 1; \
+	T const zero = SET1 (0.0f); \
+	for (; i + (W) + 1 <= n; i += (W)) \
+	{ \
+		T const x = LOAD (a + i); \
+		uint32_t bits = GTMASK (x, zero) & GTMASK (x, LOAD (a + i - 1)) & GEMASK (x, LOAD (a + i + 1)); \
+		for (; bits; bits &= bits - 1) {r[m++] = i + (uint32_t)__builtin_ctz (bits);} \
+	} \
+	for (; i + 1 < n; ++i) \
+	{ \
+		if (a[i] > 0.0f && a[i] > a[i-1] && a[i] >= a[i+1]) {r[m++] = i;} \
+	} \
+	return m; \
+}
+
+
+//The scalar backend is the reference, one float per "vector":
+#define CSC_VF32_SIMD_SCALAR_LOAD(p) (*(p))
+#define CSC_VF32_SIMD_SCALAR_STORE(p,x) (*(p) = (x))
+#define CSC_VF32_SIMD_SCALAR_ADD(x,y) ((x) + (y))
+#define CSC_VF32_SIMD_SCALAR_SUB(x,y) ((x) - (y))
+#define CSC_VF32_SIMD_SCALAR_MUL(x,y) ((x) * (y))
+#define CSC_VF32_SIMD_SCALAR_SET1(x) (x)
+#define CSC_VF32_SIMD_SCALAR_MAX(x,y) ((x) > (y) ? (x) : (y))
+#define CSC_VF32_SIMD_SCALAR_GTMASK(x,y) ((uint32_t)((x) > (y)))
+#define CSC_VF32_SIMD_SCALAR_GEMASK(x,y) ((uint32_t)((x) >= (y)))
+CSC_VF32_SIMD_KERNELS (scalar, , 1, float,
+CSC_VF32_SIMD_SCALAR_LOAD, CSC_VF32_SIMD_SCALAR_STORE,
+CSC_VF32_SIMD_SCALAR_ADD, CSC_VF32_SIMD_SCALAR_SUB, CSC_VF32_SIMD_SCALAR_MUL, CSC_VF32_SIMD_SCALAR_SET1,
+CSC_VF32_SIMD_SCALAR_MAX, fabsf, CSC_VF32_SIMD_SCALAR_GTMASK, CSC_VF32_SIMD_SCALAR_GEMASK)
+
+
+#if defined(CSC_VF32_SIMD_X86)
+//The max intrinsics returns the second operand when any operand is NaN, same as CSC_VF32_SIMD_SCALAR_MAX:
+#define CSC_VF32_SIMD_SSE2_ABS(x) _mm_and_ps ((x), _mm_castsi128_ps (_mm_set1_epi32 (0x7FFFFFFF)))
+#define CSC_VF32_SIMD_AVX2_ABS(x) _mm256_and_ps ((x), _mm256_castsi256_ps (_mm256_set1_epi32 (0x7FFFFFFF)))
+//Ordered compares are false for NaN, same as the scalar compares:
+#define CSC_VF32_SIMD_SSE2_GTMASK(x,y) ((uint32_t)_mm_movemask_ps (_mm_cmpgt_ps ((x), (y))))
+#define CSC_VF32_SIMD_SSE2_GEMASK(x,y) ((uint32_t)_mm_movemask_ps (_mm_cmpge_ps ((x), (y))))
+#define CSC_VF32_SIMD_AVX2_GTMASK(x,y) ((uint32_t)_mm256_movemask_ps (_mm256_cmp_ps ((x), (y), _CMP_GT_OQ)))
+#define CSC_VF32_SIMD_AVX2_GEMASK(x,y) ((uint32_t)_mm256_movemask_ps (_mm256_cmp_ps ((x), (y), _CMP_GE_OQ)))
+#define CSC_VF32_SIMD_AVX512_GTMASK(x,y) ((uint32_t)_mm512_cmp_ps_mask ((x), (y), _CMP_GT_OQ))
+#define CSC_VF32_SIMD_AVX512_GEMASK(x,y) ((uint32_t)_mm512_cmp_ps_mask ((x), (y), _CMP_GE_OQ))
+CSC_VF32_SIMD_KERNELS (sse2, __attribute__((target("sse2"))), 4, __m128,
+_mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps,
+_mm_max_ps, CSC_VF32_SIMD_SSE2_ABS, CSC_VF32_SIMD_SSE2_GTMASK, CSC_VF32_SIMD_SSE2_GEMASK)
+CSC_VF32_SIMD_KERNELS (avx2, __attribute__((target("avx2"))), 8, __m256,
+_mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps,
+_mm256_max_ps, CSC_VF32_SIMD_AVX2_ABS, CSC_VF32_SIMD_AVX2_GTMASK, CSC_VF32_SIMD_AVX2_GEMASK)
+CSC_VF32_SIMD_KERNELS (avx512, __attribute__((target("avx512f"))), 16, __m512,
+_mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_sub_ps, _mm512_mul_ps, _mm512_set1_ps,
+_mm512_max_ps, _mm512_abs_ps, CSC_VF32_SIMD_AVX512_GTMASK, CSC_VF32_SIMD_AVX512_GEMASK)
+#endif
+
+
+#define CSC_VF32_SIMD_OPS(level, isa) \
+{ \
+	level, \
+	csc_vf32_simd_vv_add_##isa, \
+	csc_vf32_simd_vv_sub_##isa, \
+	csc_vf32_simd_vv_mul_##isa, \
+	csc_vf32_simd_vv_macc_##isa, \
+	csc_vf32_simd_vs_add_##isa, \
+	csc_vf32_simd_vs_sub_##isa, \
+	csc_vf32_simd_vs_mul_##isa, \
+	csc_vf32_simd_vs_macc_##isa, \
+	csc_vf32_simd_set1_##isa, \
+	csc_vf32_simd_cpy_##isa, \
+	csc_vf32_simd_sum_##isa, \
+	csc_vf32_simd_dot_##isa, \
+	csc_vf32_simd_sum_kahan_##isa, \
+	csc_vf32_simd_dot_kahan_##isa, \
+	csc_vf32_simd_max_##isa, \
+	csc_vf32_simd_maxabs_##isa, \
+	csc_vf32_simd_peaks_##isa, \
+}
+
+
+static struct csc_vf32_simd_ops const csc_vf32_simd_table[CSC_VF32_SIMD_COUNT] =
+{
+	[CSC_VF32_SIMD_SCALAR] = CSC_VF32_SIMD_OPS (CSC_VF32_SIMD_SCALAR, scalar),
+#if defined(CSC_VF32_SIMD_X86)
+	[CSC_VF32_SIMD_SSE2] = CSC_VF32_SIMD_OPS (CSC_VF32_SIMD_SSE2, sse2),
+	[CSC_VF32_SIMD_AVX2] = CSC_VF32_SIMD_OPS (CSC_VF32_SIMD_AVX2, avx2),
+	[CSC_VF32_SIMD_AVX512] = CSC_VF32_SIMD_OPS (CSC_VF32_SIMD_AVX512, avx512),
+#endif
+};
+
+
+//The selected backend, NULL until the first call:
+static struct csc_vf32_simd_ops const * csc_vf32_simd_current = NULL;
+
+
+/**
+ * @brief Check CPUID and OS support for a backend
+ */
+static int csc_vf32_simd_supported (enum csc_vf32_simd_level level)
+{
+#if defined(CSC_VF32_SIMD_X86)
+	__builtin_cpu_init();
+	switch (level)
+	{
+	case CSC_VF32_SIMD_SCALAR: return 1;
+	case CSC_VF32_SIMD_SSE2: return __builtin_cpu_supports ("sse2");
+	case CSC_VF32_SIMD_AVX2: return __builtin_cpu_supports ("avx2");
+	case CSC_VF32_SIMD_AVX512: return __builtin_cpu_supports ("avx512f");
+	default: return 0;
+	}
+#else
+	return level == CSC_VF32_SIMD_SCALAR;
+#endif
+}
+
+
+/**
+ * @brief Select the best supported backend not above (level)
+ * @param level Use CSC_VF32_SIMD_COUNT for the best supported backend
+ * @return The selected backend
+ */
+static enum csc_vf32_simd_level csc_vf32_simd_select (enum csc_vf32_simd_level level)
+{
+	int i = MIN ((int)level, CSC_VF32_SIMD_COUNT - 1);
+	while (i > CSC_VF32_SIMD_SCALAR && csc_vf32_simd_supported ((enum csc_vf32_simd_level)i) == 0) {i--;}
+	__atomic_store_n (&csc_vf32_simd_current, csc_vf32_simd_table + i, __ATOMIC_RELEASE);
+	return (enum csc_vf32_simd_level)i;
+}
+
+
+/**
+ * @brief Get the selected backend, the backend is selected at the first call
+ */
+static struct csc_vf32_simd_ops const * csc_vf32_simd (void)
+{
+	struct csc_vf32_simd_ops const * ops = __atomic_load_n (&csc_vf32_simd_current, __ATOMIC_ACQUIRE);
+	if (ops == NULL)
+	{
+		csc_vf32_simd_select (CSC_VF32_SIMD_COUNT);
+		ops = __atomic_load_n (&csc_vf32_simd_current, __ATOMIC_ACQUIRE);
+	}
+	return ops;
+}
+
+
+
+
+//The summation mode used by CSC_VF32_SIMD_SUM_DEFAULT:
+static enum csc_vf32_simd_summode csc_vf32_simd_summode = CSC_VF32_SIMD_SUM_FAST;
+//Pairwise summation sums blocks of this size with the FAST kernel:
+#define CSC_VF32_SIMD_PAIRWISE_BLOCK 256
+
+
+static void csc_vf32_simd_set_summode (enum csc_vf32_simd_summode mode)
+{
+	ASSERT (mode < CSC_VF32_SIMD_SUM_DEFAULT);
+	csc_vf32_simd_summode = mode;
+}
+
+
+static float csc_vf32_simd_sum_pairwise (struct csc_vf32_simd_ops const * o, uint32_t n, float const a[])
+{
+	if (n <= CSC_VF32_SIMD_PAIRWISE_BLOCK) {return o->sum (n, a);}
+	//Split at a block boundary so every block except the last is full:
+	uint32_t h = ((n / CSC_VF32_SIMD_PAIRWISE_BLOCK + 1) / 2) * CSC_VF32_SIMD_PAIRWISE_BLOCK;
+	return csc_vf32_simd_sum_pairwise (o, h, a) + csc_vf32_simd_sum_pairwise (o, n - h, a + h);
+}
+
+
+static float csc_vf32_simd_dot_pairwise (struct csc_vf32_simd_ops const * o, uint32_t n, float const a[], float const b[])
+{
+	if (n <= CSC_VF32_SIMD_PAIRWISE_BLOCK) {return o->dot (n, a, b);}
+	uint32_t h = ((n / CSC_VF32_SIMD_PAIRWISE_BLOCK + 1) / 2) * CSC_VF32_SIMD_PAIRWISE_BLOCK;
+	return csc_vf32_simd_dot_pairwise (o, h, a, b) + csc_vf32_simd_dot_pairwise (o, n - h, a + h, b + h);
+}
+
+
+/**
+ * @brief Sum of (a) using summation mode (mode)
+ */
+static float csc_vf32_simd_sum (uint32_t n, float const a[], enum csc_vf32_simd_summode mode)
+{
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	if (mode == CSC_VF32_SIMD_SUM_DEFAULT) {mode = csc_vf32_simd_summode;}
+	switch (mode)
+	{
+	case CSC_VF32_SIMD_SUM_PAIRWISE: return csc_vf32_simd_sum_pairwise (o, n, a);
+	case CSC_VF32_SIMD_SUM_KAHAN: return o->sum_kahan (n, a);
+	default: return o->sum (n, a);
+	}
+}
+
+
+/**
+ * @brief Dot product of (a) and (b) using summation mode (mode)
+ */
+static float csc_vf32_simd_dot (uint32_t n, float const a[], float const b[], enum csc_vf32_simd_summode mode)
+{
+	struct csc_vf32_simd_ops const * o = csc_vf32_simd ();
+	if (mode == CSC_VF32_SIMD_SUM_DEFAULT) {mode = csc_vf32_simd_summode;}
+	switch (mode)
+	{
+	case CSC_VF32_SIMD_SUM_PAIRWISE: return csc_vf32_simd_dot_pairwise (o, n, a, b);
+	case CSC_VF32_SIMD_SUM_KAHAN: return o->dot_kahan (n, a, b);
+	default: return o->dot (n, a, b);
+	}
+}
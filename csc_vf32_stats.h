@@ -0,0 +1,394 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_vf32_simd.h"
+
+
+/*
+Streaming statistics of float arrays.
+A csc_vf32_stats is updated with chunks of any size and never keeps the values,
+so a continuous stream can be processed chunk by chunk without buffering.
+Each chunk is processed in blocks of CSC_VF32_STATS_BLOCK floats:
+count, sum, min, max and the positive and negative sums are accumulated in the CSC_VF32_STATS_LANES
+lanes of SSE2 vectors, the squared deviations from the block mean are summed
+while the block is still in L1 cache, so every value is read from memory once.
+The scalar loop is used when the csc_vf32_simd.h backend is SCALAR or the CPU is not x86.
+Blocks are merged with the pairwise update of Chan et al. in double precision,
+the merged variance is as accurate as Welford's update without its dependency chain per value.
+Two stats of different chunks or threads can be merged with csc_vf32_stats_merge().
+NaN values propagates to the mean and the variance and are ignored by min and max.
+
+A csc_vf32_hist counts values in equal bins of [lo, hi), with separate counts
+for values below, above and NaN, histograms of different chunks are merged by adding the counts.
+*/
+#define CSC_VF32_STATS_BLOCK 1024
+#define CSC_VF32_STATS_LANES 4
+
+
+struct csc_vf32_stats
+{
+	uint64_t n;
+	double mean;
+	//Sum of squared deviations from the mean:
+	double m2;
+	float min;
+	float max;
+	uint64_t pos_n;
+	uint64_t neg_n;
+	double pos_sum;
+	double neg_sum;
+};
+
+
+static void csc_vf32_stats_init (struct csc_vf32_stats * s)
+{
+	ASSERT_PARAM_NOTNULL (s);
+	memset (s, 0, sizeof (struct csc_vf32_stats));
+	s->min = INFINITY;
+	s->max = -INFINITY;
+}
+
+
+/**
+ * @brief Merge the stats (b) into (a), the result is the stats of both chunks
+ */
+static void csc_vf32_stats_merge (struct csc_vf32_stats * a, struct csc_vf32_stats const * b)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	ASSERT_PARAM_NOTNULL (b);
+	if (b->n == 0) {return;}
+	uint64_t const n = a->n + b->n;
+	double const delta = b->mean - a->mean;
+	a->mean += delta * ((double)b->n / (double)n);
+	a->m2 += b->m2 + delta * delta * ((double)a->n * (double)b->n / (double)n);
+	a->n = n;
+	a->min = (b->min < a->min) ? b->min : a->min;
+	a->max = (b->max > a->max) ? b->max : a->max;
+	a->pos_n += b->pos_n;
+	a->neg_n += b->neg_n;
+	a->pos_sum += b->pos_sum;
+	a->neg_sum += b->neg_sum;
+}
+
+
+//Lanes of the block accumulators:
+enum csc_vf32_stats_lane
+{
+	CSC_VF32_STATS_SUM,
+	CSC_VF32_STATS_POS,
+	CSC_VF32_STATS_NEG,
+	CSC_VF32_STATS_POSN,
+	CSC_VF32_STATS_NEGN,
+	CSC_VF32_STATS_MIN,
+	CSC_VF32_STATS_MAX,
+	CSC_VF32_STATS_COUNT
+};
+
+
+#if defined(CSC_VF32_SIMD_X86)
+/**
+ * @brief Accumulate the first multiple of 4 values of (x) into the lanes of (acc)
+ * @return Number of values done
+ */
+__attribute__((target("sse2")))
+static uint32_t csc_vf32_stats_acc_sse2 (uint32_t m, float const x[], float acc[CSC_VF32_STATS_COUNT][CSC_VF32_STATS_LANES])
+{
+	__m128 const zero = _mm_setzero_ps ();
+	__m128 const one = _mm_set1_ps (1.0f);
+	__m128 sum = _mm_loadu_ps (acc[CSC_VF32_STATS_SUM]);
+	__m128 pos = _mm_loadu_ps (acc[CSC_VF32_STATS_POS]);
+	__m128 neg = _mm_loadu_ps (acc[CSC_VF32_STATS_NEG]);
+	__m128 posn = _mm_loadu_ps (acc[CSC_VF32_STATS_POSN]);
+	__m128 negn = _mm_loadu_ps (acc[CSC_VF32_STATS_NEGN]);
+	__m128 mn = _mm_loadu_ps (acc[CSC_VF32_STATS_MIN]);
+	__m128 mx = _mm_loadu_ps (acc[CSC_VF32_STATS_MAX]);
+	uint32_t i = 0;
+	for (; i + CSC_VF32_STATS_LANES <= m; i += CSC_VF32_STATS_LANES)
+	{
+		__m128 v = _mm_loadu_ps (x + i);
+		sum = _mm_add_ps (sum, v);
+		//min and max returns the second operand for NaN, so NaN is ignored:
+		pos = _mm_add_ps (pos, _mm_max_ps (v, zero));
+		neg = _mm_add_ps (neg, _mm_min_ps (v, zero));
+		posn = _mm_add_ps (posn, _mm_and_ps (_mm_cmpgt_ps (v, zero), one));
+		negn = _mm_add_ps (negn, _mm_and_ps (_mm_cmplt_ps (v, zero), one));
+		mn = _mm_min_ps (v, mn);
+		mx = _mm_max_ps (v, mx);
+	}
+	_mm_storeu_ps (acc[CSC_VF32_STATS_SUM], sum);
+	_mm_storeu_ps (acc[CSC_VF32_STATS_POS], pos);
+	_mm_storeu_ps (acc[CSC_VF32_STATS_NEG], neg);
+	_mm_storeu_ps (acc[CSC_VF32_STATS_POSN], posn);
+	_mm_storeu_ps (acc[CSC_VF32_STATS_NEGN], negn);
+	_mm_storeu_ps (acc[CSC_VF32_STATS_MIN], mn);
+	_mm_storeu_ps (acc[CSC_VF32_STATS_MAX], mx);
+	return i;
+}
+
+
+/**
+ * @brief Accumulate (x - mean)^2 of the first multiple of 4 values into the lanes of (d2)
+ * @return Number of values done
+ */
+__attribute__((target("sse2")))
+static uint32_t csc_vf32_stats_dev_sse2 (uint32_t m, float const x[], float mean, float d2[CSC_VF32_STATS_LANES])
+{
+	__m128 const u = _mm_set1_ps (mean);
+	__m128 a = _mm_loadu_ps (d2);
+	uint32_t i = 0;
+	for (; i + CSC_VF32_STATS_LANES <= m; i += CSC_VF32_STATS_LANES)
+	{
+		__m128 d = _mm_sub_ps (_mm_loadu_ps (x + i), u);
+		a = _mm_add_ps (a, _mm_mul_ps (d, d));
+	}
+	_mm_storeu_ps (d2, a);
+	return i;
+}
+#endif
+
+
+/**
+ * @brief Stats of one block of (m) <= CSC_VF32_STATS_BLOCK values
+ */
+static void csc_vf32_stats_block (struct csc_vf32_stats * s, uint32_t m, float const x[])
+{
+	float acc[CSC_VF32_STATS_COUNT][CSC_VF32_STATS_LANES] = {{0}};
+	for (uint32_t k = 0; k < CSC_VF32_STATS_LANES; ++k)
+	{
+		acc[CSC_VF32_STATS_MIN][k] = INFINITY;
+		acc[CSC_VF32_STATS_MAX][k] = -INFINITY;
+	}
+	uint32_t i = 0;
+#if defined(CSC_VF32_SIMD_X86)
+	int const sse2 = csc_vf32_simd ()->level >= CSC_VF32_SIMD_SSE2;
+	if (sse2) {i = csc_vf32_stats_acc_sse2 (m, x, acc);}
+#endif
+	//The rest goes into lane 0:
+	for (; i < m; ++i)
+	{
+		float v = x[i];
+		acc[CSC_VF32_STATS_SUM][0] += v;
+		if (v > 0.0f)
+		{
+			acc[CSC_VF32_STATS_POS][0] += v;
+			acc[CSC_VF32_STATS_POSN][0] += 1.0f;
+		}
+		if (v < 0.0f)
+		{
+			acc[CSC_VF32_STATS_NEG][0] += v;
+			acc[CSC_VF32_STATS_NEGN][0] += 1.0f;
+		}
+		if (v < acc[CSC_VF32_STATS_MIN][0]) {acc[CSC_VF32_STATS_MIN][0] = v;}
+		if (v > acc[CSC_VF32_STATS_MAX][0]) {acc[CSC_VF32_STATS_MAX][0] = v;}
+	}
+	struct csc_vf32_stats b;
+	csc_vf32_stats_init (&b);
+	double total = 0.0;
+	for (uint32_t k = 0; k < CSC_VF32_STATS_LANES; ++k)
+	{
+		total += acc[CSC_VF32_STATS_SUM][k];
+		b.pos_sum += acc[CSC_VF32_STATS_POS][k];
+		b.neg_sum += acc[CSC_VF32_STATS_NEG][k];
+		b.pos_n += (uint64_t)acc[CSC_VF32_STATS_POSN][k];
+		b.neg_n += (uint64_t)acc[CSC_VF32_STATS_NEGN][k];
+		b.min = (acc[CSC_VF32_STATS_MIN][k] < b.min) ? acc[CSC_VF32_STATS_MIN][k] : b.min;
+		b.max = (acc[CSC_VF32_STATS_MAX][k] > b.max) ? acc[CSC_VF32_STATS_MAX][k] : b.max;
+	}
+	b.n = m;
+	b.mean = total / m;
+	//Second pass over the block while it is in cache:
+	float const mean = (float)b.mean;
+	float d2[CSC_VF32_STATS_LANES] = {0};
+	i = 0;
+#if defined(CSC_VF32_SIMD_X86)
+	if (sse2) {i = csc_vf32_stats_dev_sse2 (m, x, mean, d2);}
+#endif
+	for (; i < m; ++i)
+	{
+		float d = x[i] - mean;
+		d2[0] += d * d;
+	}
+	for (uint32_t k = 0; k < CSC_VF32_STATS_LANES; ++k)
+	{
+		b.m2 += d2[k];
+	}
+	csc_vf32_stats_merge (s, &b);
+}
+
+
+/**
+ * @brief Add (n) values to the stats
+ */
+static void csc_vf32_stats_update (struct csc_vf32_stats * s, uint32_t n, float const x[])
+{
+	ASSERT_PARAM_NOTNULL (s);
+	for (uint32_t i = 0; i < n; i += CSC_VF32_STATS_BLOCK)
+	{
+		csc_vf32_stats_block (s, MIN (n - i, CSC_VF32_STATS_BLOCK), x + i);
+	}
+}
+
+
+static float csc_vf32_stats_mean (struct csc_vf32_stats const * s)
+{
+	return (s->n > 0) ? (float)s->mean : 0.0f;
+}
+
+
+/**
+ * @brief Population variance, divided by n
+ */
+static float csc_vf32_stats_variance (struct csc_vf32_stats const * s)
+{
+	return (s->n > 0) ? (float)(s->m2 / (double)s->n) : 0.0f;
+}
+
+
+/**
+ * @brief Sample variance, divided by n - 1
+ */
+static float csc_vf32_stats_sample_variance (struct csc_vf32_stats const * s)
+{
+	return (s->n > 1) ? (float)(s->m2 / (double)(s->n - 1)) : 0.0f;
+}
+
+
+static float csc_vf32_stats_stddev (struct csc_vf32_stats const * s)
+{
+	return sqrtf (csc_vf32_stats_variance (s));
+}
+
+
+/**
+ * @brief Mean of the values > 0, 0 when there are none
+ */
+static float csc_vf32_stats_pos_mean (struct csc_vf32_stats const * s)
+{
+	return (s->pos_n > 0) ? (float)(s->pos_sum / (double)s->pos_n) : 0.0f;
+}
+
+
+/**
+ * @brief Mean of the values < 0, 0 when there are none
+ */
+static float csc_vf32_stats_neg_mean (struct csc_vf32_stats const * s)
+{
+	return (s->neg_n > 0) ? (float)(s->neg_sum / (double)s->neg_n) : 0.0f;
+}
+
+
+
+
+struct csc_vf32_hist
+{
+	float lo;
+	float hi;
+	//Bins per unit:
+	float scale;
+	uint32_t nbins;
+	uint64_t * bins;
+	uint64_t under;
+	uint64_t over;
+	uint64_t nan;
+};
+
+
+/**
+ * @brief Histogram of (nbins) equal bins over [lo, hi)
+ */
+static void csc_vf32_hist_init (struct csc_vf32_hist * h, float lo, float hi, uint32_t nbins)
+{
+	ASSERT_PARAM_NOTNULL (h);
+	ASSERT (nbins > 0);
+	ASSERT (lo < hi);
+	memset (h, 0, sizeof (struct csc_vf32_hist));
+	h->lo = lo;
+	h->hi = hi;
+	h->scale = (float)nbins / (hi - lo);
+	h->nbins = nbins;
+	h->bins = calloc (nbins, sizeof (uint64_t));
+	ASSERT (h->bins);
+}
+
+
+static void csc_vf32_hist_free (struct csc_vf32_hist * h)
+{
+	ASSERT_PARAM_NOTNULL (h);
+	free (h->bins);
+	memset (h, 0, sizeof (struct csc_vf32_hist));
+}
+
+
+/**
+ * @brief Count (n) values
+ * The bin indices of a block are computed in one vectorizable loop before the counts are incremented.
+ */
+static void csc_vf32_hist_update (struct csc_vf32_hist * h, uint32_t n, float const x[])
+{
+	ASSERT_PARAM_NOTNULL (h);
+	//Index 0 is under, 1..nbins are the bins and nbins+1 is over:
+	uint32_t idx[CSC_VF32_STATS_BLOCK];
+	float const last = (float)h->nbins;
+	float const top = last + 1.0f;
+	for (uint32_t i = 0; i < n; i += CSC_VF32_STATS_BLOCK)
+	{
+		uint32_t const m = MIN (n - i, CSC_VF32_STATS_BLOCK);
+		for (uint32_t k = 0; k < m; ++k)
+		{
+			float v = x[i + k];
+			//Clamped to [1, nbins] also for NaN and for rounding up just below (hi):
+			float f = (v - h->lo) * h->scale + 1.0f;
+			f = (f >= 1.0f) ? f : 1.0f;
+			f = (f < last) ? f : last;
+			f = (v < h->lo) ? 0.0f : f;
+			f = (v >= h->hi) ? top : f;
+			idx[k] = (uint32_t)f;
+		}
+		for (uint32_t k = 0; k < m; ++k)
+		{
+			float v = x[i + k];
+			if (v != v)
+			{
+				h->nan++;
+			}
+			else if (idx[k] == 0)
+			{
+				h->under++;
+			}
+			else if (idx[k] > h->nbins)
+			{
+				h->over++;
+			}
+			else
+			{
+				h->bins[idx[k] - 1]++;
+			}
+		}
+	}
+}
+
+
+/**
+ * @brief Add the counts of (b) to (a), both must have the same bins
+ */
+static void csc_vf32_hist_merge (struct csc_vf32_hist * a, struct csc_vf32_hist const * b)
+{
+	ASSERT_PARAM_NOTNULL (a);
+	ASSERT_PARAM_NOTNULL (b);
+	ASSERT (a->nbins == b->nbins && a->lo == b->lo && a->hi == b->hi);
+	for (uint32_t i = 0; i < a->nbins; ++i)
+	{
+		a->bins[i] += b->bins[i];
+	}
+	a->under += b->under;
+	a->over += b->over;
+	a->nan += b->nan;
+}
@@ -6,6 +6,7 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 
 #include <stdint.h>
 #include "csc_math.h"
+#include "csc_rng.h"
 
 
 static void vu32_cpy (unsigned n, uint32_t des [], uint32_t const src [])
@@ -98,12 +99,9 @@ static void vu32_linespace (uint32_t n, uint32_t x [], uint32_t x1, uint32_t x2)
 }
 
 
+// r := {x | x = uniform u32 & mask}
 static void vu32_repeat_random_mask (unsigned n, uint32_t r [], uint32_t mask)
 {
-	for (unsigned i = 0; i < n; ++i)
-	{
-		uint32_t g = rand ();
-		g *= (UINT32_MAX / RAND_MAX);
-		r[i] = g & mask;
-	}
+	csc_rng_u32 (csc_rng_default (), n, r);
+	vu32_and1 (n, r, r, mask);
 }
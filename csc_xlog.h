@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include "csc_tcol.h"
+#include "csc_sink.h"
 
 
 
@@ -81,9 +82,13 @@ static void xlog(int counter, char const * file, int line, char const * func, en
 {
 	va_list args;
 	va_start (args, format);
-	printf (TFG(100,100,100) "@%04i " TCOL_RST "%s %s " TFG(100,100,100) "%s:%i " TFG(130, 110, 60) "%s() " TCOL_RST, counter, xloglvl_tostr(level), xlogcategory_tostr(category), file, line, func);
-	vprintf (format, args);
-	putc ('\n', stdout);
+	//Build the whole line and write it with one call:
+	char buf [1024];
+	struct csc_sink sink;
+	csc_sink_init_file (&sink, buf, sizeof (buf), stdout);
+	csc_sink_printf (&sink, TFG(100,100,100) "@%04i " TCOL_RST "%s %s " TFG(100,100,100) "%s:%i " TFG(130, 110, 60) "%s() " TCOL_RST, counter, xloglvl_tostr(level), xlogcategory_tostr(category), file, line, func);
+	csc_sink_vprintf (&sink, format, args);
+	csc_sink_putc (&sink, '\n');
+	csc_sink_flush (&sink);
 	va_end (args);
 }
-
@@ -7,6 +7,7 @@
 #include <GL/glew.h>
 #include "../csc_basic.h"
 #include "../csc_debug.h"
+#include "../csc_rng.h"
 
 
 
@@ -37,11 +38,12 @@ void csc_glpointcloud_init (struct csc_glpointcloud * item)
 	item->vcol = calloc (item->cap * CSC_GLPOINTCLOUD_COL_DIM, sizeof(uint32_t));
 
 	float * p = item->vpos;
+	csc_rng_f32 (csc_rng_default (), item->cap * CSC_GLPOINTCLOUD_POS_DIM, p);
 	for (uint32_t i = 0; i < item->cap; ++i)
 	{
-		p[0] = (((float)rand() / (float)RAND_MAX)-0.5f) * 1.0f;
-		p[1] = (((float)rand() / (float)RAND_MAX)-0.5f) * 1.0f;
-		p[2] = (((float)rand() / (float)RAND_MAX)-0.5f) * 1.0f;
+		p[0] = (p[0]-0.5f) * 1.0f;
+		p[1] = (p[1]-0.5f) * 1.0f;
+		p[2] = (p[2]-0.5f) * 1.0f;
 		p[3] = 1.0f;
 		item->vcol[i] = 0xFFFFAAFF;
 		p += CSC_GLPOINTCLOUD_POS_DIM;
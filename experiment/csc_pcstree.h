@@ -6,8 +6,9 @@ SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@g
 
 #include <stdint.h>
 #include <stddef.h>
-#include "csc_debug.h"
+#include "csc_assert.h"
 #include "csc_dlist.h"
+#include "csc_tok_c.h"
 
 
 /*
@@ -248,3 +249,115 @@ csc_pcstree_traverse
 	}
 	return NULL;
 }
+
+
+
+
+/*
+Bulk builder.
+Builds the tree from a token stream in one pass into contiguous storage.
+Node 0 is the root and node (i+1) belongs to token (i).
+An opening bracket becomes the parent of the tokens up to and including the matching closing bracket.
+All fields of every node are written while building, (parent), (prev) and (child_count) are not deferred.
+The builder already holds the open node and its last child on its stack when a node is appended,
+so the links cost two stores to a cache line that is being written anyway, while a deferred link pass
+would walk the whole tree a second time and every reader of (parent) would need to check for it.
+Siblings are NULL terminated in both directions as csc_pcstree_traverse, csc_pcstree_remove and csc_pcstree_addparent2 expect.
+Arena nodes must not be passed to the circular sibling helpers (csc_pcstree_addsibling, csc_pcstree_addchild,
+csc_pcstree_replace, csc_pcstree_addparent), they follow (prev) and (next) without NULL checks.
+Nodes can not be added to an arena, build a new tree instead.
+The stack of open brackets grows with the nesting depth and is kept in the arena for reuse.
+*/
+struct csc_pcstree_arena_open
+{
+	struct csc_pcstree * node;
+	//Last child of (node) so far:
+	struct csc_pcstree * last;
+};
+
+
+struct csc_pcstree_arena
+{
+	struct csc_pcstree * node;
+	uint32_t count;
+	uint32_t cap;
+	struct csc_pcstree_arena_open * open;
+	uint32_t open_cap;
+};
+
+
+static void csc_pcstree_arena_free (struct csc_pcstree_arena * arena)
+{
+	ASSERT_PARAM_NOTNULL (arena);
+	free (arena->node);
+	free (arena->open);
+	memset (arena, 0, sizeof (struct csc_pcstree_arena));
+}
+
+
+static struct csc_pcstree * csc_pcstree_build (struct csc_pcstree_arena * arena, struct csc_tok const tok[], uint32_t n)
+{
+	ASSERT_PARAM_NOTNULL (arena);
+	ASSERT_PARAM_NOTNULL (tok);
+	if (arena->cap < n + 1)
+	{
+		arena->cap = n + 1;
+		arena->node = realloc (arena->node, arena->cap * sizeof (struct csc_pcstree));
+		ASSERTF (arena->node != NULL, "realloc %i nodes", arena->cap);
+	}
+	arena->count = n + 1;
+	if (arena->open_cap == 0)
+	{
+		arena->open_cap = 64;
+		arena->open = malloc (arena->open_cap * sizeof (struct csc_pcstree_arena_open));
+		ASSERTF (arena->open != NULL, "malloc %i open nodes", arena->open_cap);
+	}
+	struct csc_pcstree * node = arena->node;
+	struct csc_pcstree_arena_open * open = arena->open;
+	uint32_t depth = 0;
+	open[0].node = node;
+	open[0].last = NULL;
+	node[0].prev = NULL;
+	node[0].next = NULL;
+	node[0].parent = NULL;
+	node[0].child = NULL;
+	node[0].child_count = 0;
+	node[0].ptr = NULL;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		struct csc_pcstree * x = node + i + 1;
+		x->prev = open[depth].last;
+		x->next = NULL;
+		x->parent = open[depth].node;
+		x->child = NULL;
+		x->child_count = 0;
+		x->ptr = tok[i].a;
+		if (open[depth].last) {open[depth].last->next = x;}
+		else {open[depth].node->child = x;}
+		open[depth].node->child_count ++;
+		open[depth].last = x;
+		switch (tok[i].type)
+		{
+		case '(':
+		case '[':
+		case '{':
+			depth ++;
+			if (depth >= arena->open_cap)
+			{
+				arena->open_cap *= 2;
+				arena->open = realloc (arena->open, arena->open_cap * sizeof (struct csc_pcstree_arena_open));
+				ASSERTF (arena->open != NULL, "realloc %i open nodes", arena->open_cap);
+				open = arena->open;
+			}
+			open[depth].node = x;
+			open[depth].last = NULL;
+			break;
+		case ')':
+		case ']':
+		case '}':
+			if (depth > 0) {depth --;}
+			break;
+		}
+	}
+	return node;
+}
@@ -254,6 +254,134 @@ static void test_flags8()
 	ASSERT (perm == (FLAG_DEFAULT|FLAG_EXEC|FLAG_READ|FLAG_WRITE|FLAG_A|FLAG_B|FLAG_C|FLAG_D));
 	ASSERT (value == 4.0);
 }
+static void test_parseall_equal()
+{
+	char const * a[] = {"-rx", "-xrb", "-cw", "-Dwwww", "-D4", "--name=Bob", "--count=7", "--exec", "-n", "Alice", "--Duration=2.5", "-j3", NULL};
+	float value[2] = {1.0f, 1.0f};
+	uint32_t perm[2] = {FLAG_DEFAULT, FLAG_DEFAULT};
+	char const * name[2] = {NULL, NULL};
+	int count[2] = {0, 0};
+	int threads[2] = {0, 0};
+	for (int k = 0; k < 2; ++k)
+	{
+		struct csc_argv_option o[] =
+		{
+			{CSC_ARGV_DEFINE_GROUP("Options")},
+			{'a', "a", CSC_TYPE_U32, perm + k, FLAG_A, ""},
+			{'b', "b", CSC_TYPE_U32, perm + k, 0, ""},
+			{'c', "c", CSC_TYPE_U32, perm + k, FLAG_C, ""},
+			{'r', "read", CSC_TYPE_U32, perm + k, FLAG_READ, ""},
+			{'w', "write", CSC_TYPE_U32, perm + k, FLAG_WRITE, ""},
+			{'x', "exec", CSC_TYPE_U32, perm + k, FLAG_EXEC|FLAG_A, ""},
+			{'D', "Duration", CSC_TYPE_FLOAT, value + k, 0, ""},
+			{'D', "Dflag", CSC_TYPE_U32, perm + k, FLAG_D, ""},
+			{'4', "4", CSC_TYPE_U32, perm + k, FLAG_B, ""},
+			{'n', "name", CSC_TYPE_STRING, name + k, 0, ""},
+			{'k', "count", CSC_TYPE_INT, count + k, 0, ""},
+			{'j', "threads", CSC_TYPE_INT, threads + k, 0, ""},
+			{CSC_ARGV_END}
+		};
+		if (k == 0)
+		{
+			for (struct csc_argv_option * i = o; i->t != CSC_TYPE_NONE; ++i)
+			{
+				if (i->t == (enum csc_type)CSC_ARGV_GROUP) {continue;}
+				csc_argv_parse (a, i->c, i->s, i->t, i->v, i->f);
+			}
+		}
+		else
+		{
+			csc_argv_parseall (a, o);
+		}
+	}
+	ASSERT (value[0] == value[1]);
+	ASSERT (perm[0] == perm[1]);
+	ASSERT (strcmp (name[0], name[1]) == 0);
+	ASSERT (count[0] == count[1]);
+	ASSERT (threads[0] == threads[1]);
+	ASSERT (value[1] == 2.5f);
+	ASSERT (perm[1] == (FLAG_DEFAULT|FLAG_EXEC|FLAG_READ|FLAG_WRITE|FLAG_A|FLAG_B|FLAG_C|FLAG_D));
+	//The first long value ends the search for that option:
+	ASSERT (strcmp (name[1], "Bob") == 0);
+	ASSERT (count[1] == 7);
+	ASSERT (threads[1] == 3);
+}
+
+
+static void test_parseall_many()
+{
+	enum {N = 500};
+	static struct csc_argv_option o[N + 1];
+	static char names[N][16];
+	static char args[N][32];
+	static char const * a[N + 1];
+	static float values[N];
+	for (int i = 0; i < N; ++i)
+	{
+		snprintf (names[i], sizeof (names[i]), "option%i", i);
+		snprintf (args[i], sizeof (args[i]), "--option%i=%i", i, i * 3);
+		o[i] = (struct csc_argv_option){0, names[i], CSC_TYPE_FLOAT, values + i, 0, ""};
+		a[i] = args[i];
+	}
+	o[N] = (struct csc_argv_option){CSC_ARGV_END};
+	a[N] = NULL;
+	csc_argv_parseall (a, o);
+	for (int i = 0; i < N; ++i)
+	{
+		ASSERT (values[i] == (float)(i * 3));
+	}
+}
+static void test_sources()
+{
+	FILE * f = fopen ("test_csc_argv.tmp", "wb");
+	ASSERT (f != NULL);
+	fputs ("# comment\n  name = Bob  \n\nduration=2.5\nread\n;write\nunknown=1\nlevel=1\nsize=3", f);
+	fclose (f);
+	setenv ("TEST_CSC_ARGV_LEVEL", "2", 1);
+	setenv ("TEST_CSC_ARGV_SIZE", "4", 1);
+	setenv ("TEST_CSC_ARGV_NUM_THREADS", "6", 1);
+	char const * a[] = {"--size=5", NULL};
+	char const * name = NULL;
+	float duration = 0.0f;
+	float level = 0.0f;
+	float size = 0.0f;
+	uint32_t perm = 0;
+	int threads = 0;
+	struct csc_argv_option o[] =
+	{
+		{'n', "name", CSC_TYPE_STRING, &name, 0, ""},
+		{'t', "num-threads", CSC_TYPE_INT, &threads, 0, ""},
+		{'d', "duration", CSC_TYPE_FLOAT, &duration, 0, ""},
+		{'l', "level", CSC_TYPE_FLOAT, &level, 0, ""},
+		{'s', "size", CSC_TYPE_FLOAT, &size, 0, ""},
+		{'r', "read", CSC_TYPE_U32, &perm, FLAG_READ, ""},
+		{'w', "write", CSC_TYPE_U32, &perm, FLAG_WRITE, ""},
+		{CSC_ARGV_END}
+	};
+	struct csc_file_view view;
+	csc_argv_parseall_sources (a, o, "test_csc_argv.tmp", "TEST_CSC_ARGV_", &view);
+	ASSERT (strcmp (name, "Bob") == 0);
+	ASSERT (duration == 2.5f);
+	ASSERT (perm == FLAG_READ);
+	//Config < environment < command line:
+	ASSERT (level == 2.0f);
+	ASSERT (size == 5.0f);
+	//Underscores in environment names match dashes in option names:
+	ASSERT (threads == 6);
+	csc_file_view_close (&view);
+	struct csc_argv_index idx;
+	csc_argv_index_init (&idx, o);
+	{
+		char const * envp[] = {"X_NUM_THREADS=8", "X_NUM-THREADS=9", "X_NUM_THREAD=1", "Y_SIZE=1", NULL};
+		ASSERT (csc_argv_parse_env (&idx, "X_", envp) == 2);
+		ASSERT (threads == 9);
+	}
+	ASSERT (csc_argv_load_config (&idx, "test_csc_argv.tmp", &view) == 1);
+	csc_file_view_close (&view);
+	ASSERT (csc_argv_load_config (&idx, "test_csc_argv_missing.tmp", &view) == -1);
+	csc_argv_index_free (&idx);
+	remove ("test_csc_argv.tmp");
+}
 
 
 
@@ -281,6 +409,9 @@ int main (int argc, char const * argv [])
 	test_flags7();
 	test_flags8();
 	test_expanded();
+	test_parseall_equal();
+	test_parseall_many();
+	test_sources();
 
 	/*
 	char const * a [4] =
@@ -0,0 +1,141 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_file_async.h"
+
+#define TEST_FILES 8
+
+
+static void test_write_file (char const * filename, size_t size)
+{
+	FILE * f = fopen (filename, "wb");
+	ASSERT (f != NULL);
+	for (size_t i = 0; i < size; ++i)
+	{
+		fputc ('a' + (int)(i % 26), f);
+	}
+	fclose (f);
+}
+
+
+static void test_cb (struct csc_file_async_req * req, void * ptr)
+{
+	uint32_t * count = ptr;
+	(*count) ++;
+	ASSERT (req->done);
+}
+
+
+static void test_async_cases (int backend)
+{
+	size_t sizes[TEST_FILES] = {0, 1, 100, 4095, 4096, 4097, 100000, 3000000};
+	char names[TEST_FILES][64];
+	struct csc_file_async_req req[TEST_FILES + 2];
+	uint32_t count = 0;
+	memset (req, 0, sizeof (req));
+	for (uint32_t i = 0; i < TEST_FILES; ++i)
+	{
+		snprintf (names[i], sizeof (names[i]), "test_csc_file_async_%u.tmp", i);
+		test_write_file (names[i], sizes[i]);
+		req[i].filename = names[i];
+		req[i].cb = test_cb;
+		req[i].ptr = &count;
+	}
+	req[TEST_FILES + 0].filename = "test_csc_file_async_missing.tmp";
+	req[TEST_FILES + 0].cb = test_cb;
+	req[TEST_FILES + 0].ptr = &count;
+	//Regular file with unknown size:
+	req[TEST_FILES + 1].filename = "/proc/self/status";
+	req[TEST_FILES + 1].cb = test_cb;
+	req[TEST_FILES + 1].ptr = &count;
+
+	struct csc_file_async a;
+	//Small depth to test queueing when the ring is full:
+	csc_file_async_init (&a, backend, 2, 3);
+	//io_uring is only used when the kernel supports its reads:
+	int expect = CSC_FILE_ASYNC_THREADS;
+#if defined(__linux__)
+	if (backend == CSC_FILE_ASYNC_URING && csc_file_async_uring_available()) {expect = CSC_FILE_ASYNC_URING;}
+#endif
+	ASSERT_EQ_U (a.backend, expect);
+	printf ("csc_file_async backend %i ran as %i\n", backend, a.backend);
+	csc_file_async_submit (&a, req, 4);
+	csc_file_async_submit (&a, req + 4, countof (req) - 4);
+	while (a.pending > 0)
+	{
+		csc_file_async_poll (&a, 1);
+	}
+	ASSERT_EQ_U (count, countof (req));
+	for (uint32_t i = 0; i < TEST_FILES; ++i)
+	{
+		ASSERT (req[i].error == 0);
+		ASSERT_EQ_U (req[i].size, sizes[i]);
+		for (size_t j = 0; j < sizes[i]; ++j)
+		{
+			ASSERT (req[i].data[j] == 'a' + (int)(j % 26));
+		}
+		ASSERT (req[i].data[sizes[i]] == 0);
+		free (req[i].data);
+		remove (names[i]);
+	}
+	ASSERT (req[TEST_FILES + 0].error == ENOENT);
+	ASSERT (req[TEST_FILES + 0].data == NULL);
+	ASSERT (req[TEST_FILES + 1].error == 0);
+	ASSERT (strncmp (req[TEST_FILES + 1].data, "Name:", 5) == 0);
+	ASSERT (strlen (req[TEST_FILES + 1].data) == req[TEST_FILES + 1].size);
+	free (req[TEST_FILES + 1].data);
+	csc_file_async_free (&a);
+}
+
+
+static void bench_async()
+{
+	enum {N = 256};
+	static char names[N][64];
+	static struct csc_file_async_req req[N];
+	for (uint32_t i = 0; i < N; ++i)
+	{
+		snprintf (names[i], sizeof (names[i]), "test_csc_file_async_%u.tmp", i);
+		test_write_file (names[i], 64 * 1024);
+	}
+	char const * backends[] = {"", "io_uring", "threads"};
+	for (int backend = CSC_FILE_ASYNC_URING; backend <= CSC_FILE_ASYNC_THREADS; ++backend)
+	{
+		memset (req, 0, sizeof (req));
+		for (uint32_t i = 0; i < N; ++i) {req[i].filename = names[i];}
+		struct csc_file_async a;
+		csc_file_async_init (&a, backend, 64, 4);
+		struct timespec t0, t1;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		csc_file_async_submit (&a, req, N);
+		csc_file_async_wait (&a);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		printf ("csc_file_async %s: %u files, %f s\n", backends[a.backend], N, csc_crossos_seconds (&t0, &t1));
+		csc_file_async_free (&a);
+		for (uint32_t i = 0; i < N; ++i) {free (req[i].data);}
+	}
+	for (uint32_t i = 0; i < N; ++i) {remove (names[i]);}
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_async_cases (CSC_FILE_ASYNC_URING);
+	test_async_cases (CSC_FILE_ASYNC_THREADS);
+	bench_async();
+
+	return EXIT_SUCCESS;
+}
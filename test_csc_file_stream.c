@@ -0,0 +1,141 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_file_stream.h"
+
+
+//Write (n) lines of varying length, returns the file size:
+static size_t test_write_lines (char const * filename, uint32_t n)
+{
+	FILE * f = fopen (filename, "wb");
+	ASSERT (f != NULL);
+	size_t size = 0;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		uint32_t len = (i * 7919) % 9000;
+		for (uint32_t j = 0; j < len; ++j)
+		{
+			fputc ('a' + (int)((i + j) % 26), f);
+		}
+		fputc ('\n', f);
+		size += len + 1;
+	}
+	fclose (f);
+	return size;
+}
+
+
+static void test_stream_cases (int flags)
+{
+	char const * filename = "test_csc_file_stream.tmp";
+	uint32_t lines = 2000;
+	size_t size = test_write_lines (filename, lines);
+	size_t chunks[] = {1, 4096, 10000, 1 << 20};
+	for (uint32_t c = 0; c < countof (chunks); ++c)
+	{
+		struct csc_file_stream s;
+		ASSERT (csc_file_stream_open (&s, filename, chunks[c], 2 + c, flags) == 0);
+		size_t total = 0;
+		size_t n;
+		while (csc_file_stream_next (&s, &n))
+		{
+			total += n;
+		}
+		ASSERT_EQ_U (total, size);
+		csc_file_stream_close (&s);
+
+		ASSERT (csc_file_stream_open (&s, filename, chunks[c], 2, flags) == 0);
+		char const * rec;
+		uint32_t i = 0;
+		while (csc_file_stream_record (&s, '\n', &rec, &n))
+		{
+			ASSERT (i < lines);
+			ASSERT_EQ_U (n, (i * 7919) % 9000);
+			for (uint32_t j = 0; j < n; ++j)
+			{
+				ASSERT (rec[j] == 'a' + (int)((i + j) % 26));
+			}
+			i++;
+		}
+		ASSERT_EQ_U (i, lines);
+		ASSERT (s.error == 0);
+		csc_file_stream_close (&s);
+	}
+	//Last record without separator and empty file:
+	{
+		FILE * f = fopen (filename, "wb");
+		fputs ("ab\n\ncd", f);
+		fclose (f);
+		struct csc_file_stream s;
+		ASSERT (csc_file_stream_open (&s, filename, 1, 2, flags) == 0);
+		char const * rec;
+		size_t n;
+		ASSERT (csc_file_stream_record (&s, '\n', &rec, &n) == 1 && n == 2 && memcmp (rec, "ab", 2) == 0);
+		ASSERT (csc_file_stream_record (&s, '\n', &rec, &n) == 1 && n == 0);
+		ASSERT (csc_file_stream_record (&s, '\n', &rec, &n) == 1 && n == 2 && memcmp (rec, "cd", 2) == 0);
+		ASSERT (csc_file_stream_record (&s, '\n', &rec, &n) == 0);
+		csc_file_stream_close (&s);
+		f = fopen (filename, "wb");
+		fclose (f);
+		ASSERT (csc_file_stream_open (&s, filename, 1, 2, flags) == 0);
+		ASSERT (csc_file_stream_next (&s, &n) == NULL);
+		ASSERT (csc_file_stream_record (&s, '\n', &rec, &n) == 0);
+		csc_file_stream_close (&s);
+	}
+	//Close before reaching the end:
+	{
+		test_write_lines (filename, lines);
+		struct csc_file_stream s;
+		ASSERT (csc_file_stream_open (&s, filename, 4096, 2, flags) == 0);
+		size_t n;
+		ASSERT (csc_file_stream_next (&s, &n) != NULL);
+		csc_file_stream_close (&s);
+	}
+	remove (filename);
+}
+
+
+static void bench_stream()
+{
+	char const * filename = "test_csc_file_stream.tmp";
+	size_t size = test_write_lines (filename, 40000);
+	for (uint32_t nbuf = 2; nbuf <= 8; nbuf *= 2)
+	{
+		struct timespec t0, t1;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		struct csc_file_stream s;
+		ASSERT (csc_file_stream_open (&s, filename, 1 << 20, nbuf, 0) == 0);
+		char const * rec;
+		size_t n;
+		uint64_t count = 0;
+		while (csc_file_stream_record (&s, '\n', &rec, &n)) {count++;}
+		csc_file_stream_close (&s);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		double dt = csc_crossos_seconds (&t0, &t1);
+		printf ("csc_file_stream_record %u buffers: %ju records, %f s, %f MB/s\n", nbuf, (uintmax_t)count, dt, (double)size / dt / 1e6);
+	}
+	remove (filename);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_stream_cases (0);
+	test_stream_cases (CSC_FILE_STREAM_DIRECT);
+	bench_stream();
+
+	return EXIT_SUCCESS;
+}
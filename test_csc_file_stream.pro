@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_file_stream.h
+SOURCES += test_csc_file_stream.c
+LIBS += -lpthread
@@ -0,0 +1,131 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_filecopy.h"
+#include "csc_malloc_file.h"
+
+
+static void test_write_file (char const * filename, size_t size)
+{
+	FILE * f = fopen (filename, "wb");
+	ASSERT (f != NULL);
+	for (size_t i = 0; i < size; ++i)
+	{
+		fputc ('a' + (int)((i * 31) % 26), f);
+	}
+	fclose (f);
+}
+
+
+static void test_same_content (char const * a, char const * b)
+{
+	long na;
+	long nb;
+	char * da = csc_malloc_file1 (a, &na);
+	char * db = csc_malloc_file1 (b, &nb);
+	ASSERT (na == nb);
+	ASSERT (memcmp (da, db, (size_t)na) == 0);
+	free (da);
+	free (db);
+}
+
+
+static void test_filecopy_cases()
+{
+	size_t sizes[] = {0, 1, 4096, 100000, 3 * CSC_FILECOPY_BUFSIZE + 7};
+	for (uint32_t i = 0; i < countof (sizes); ++i)
+	{
+		test_write_file ("test_csc_filecopy_a.tmp", sizes[i]);
+		//Existing destination is truncated:
+		test_write_file ("test_csc_filecopy_b.tmp", 5000);
+		ASSERT (csc_filecopy ("test_csc_filecopy_a.tmp", "test_csc_filecopy_b.tmp") == (int64_t)sizes[i]);
+		test_same_content ("test_csc_filecopy_a.tmp", "test_csc_filecopy_b.tmp");
+	}
+	//Size 0 in stat but not empty:
+	ASSERT (csc_filecopy ("/proc/self/maps", "test_csc_filecopy_b.tmp") > 0);
+	ASSERT (csc_filecopy ("test_csc_filecopy_missing.tmp", "test_csc_filecopy_b.tmp") == -1);
+	ASSERT (csc_filecopy ("test_csc_filecopy_a.tmp", "test_csc_filecopy_missing/b.tmp") == -1);
+	//Long destination path:
+	char folder[300];
+	memset (folder, 'd', 250);
+	folder[250] = 0;
+	mkdir (folder, 0777);
+	ASSERT (csc_filecopy_tofolder ("test_csc_filecopy_a.tmp", folder) == (int64_t)sizes[countof (sizes) - 1]);
+	char path[400];
+	snprintf (path, sizeof (path), "%s/%s", folder, "test_csc_filecopy_a.tmp");
+	test_same_content ("test_csc_filecopy_a.tmp", path);
+	remove (path);
+	rmdir (folder);
+	//Copy onto itself fails and keeps the file:
+	ASSERT (csc_filecopy_tofolder ("test_csc_filecopy_a.tmp", ".") == -1);
+	ASSERT (csc_filecopy ("test_csc_filecopy_a.tmp", "./test_csc_filecopy_a.tmp") == -1);
+	struct stat st;
+	ASSERT (stat ("test_csc_filecopy_a.tmp", &st) == 0);
+	ASSERT (st.st_size == (off_t)sizes[countof (sizes) - 1]);
+	//Permissions of the source:
+	chmod ("test_csc_filecopy_a.tmp", 0640);
+	ASSERT (csc_filecopy ("test_csc_filecopy_a.tmp", "test_csc_filecopy_b.tmp") >= 0);
+	ASSERT (stat ("test_csc_filecopy_b.tmp", &st) == 0);
+	ASSERT ((st.st_mode & 0777) == 0640);
+	remove ("test_csc_filecopy_a.tmp");
+	remove ("test_csc_filecopy_b.tmp");
+}
+
+
+static void test_batch (uint32_t n, size_t size, uint32_t nthreads, int print)
+{
+	char (*names)[2][64] = malloc (n * sizeof (*names));
+	struct csc_filecopy_job * jobs = malloc (n * sizeof (struct csc_filecopy_job));
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		snprintf (names[i][0], 64, "test_csc_filecopy_src%u.tmp", i);
+		snprintf (names[i][1], 64, "test_csc_filecopy_dst%u.tmp", i);
+		test_write_file (names[i][0], size + i);
+		jobs[i].src = names[i][0];
+		jobs[i].dst = names[i][1];
+	}
+	struct csc_filecopy_stats stats;
+	ASSERT (csc_filecopy_batch (jobs, n, nthreads, &stats) == 0);
+	ASSERT_EQ_U (stats.files, n);
+	ASSERT_EQ_U (stats.bytes, (uint64_t)n * size + (uint64_t)n * (n - 1) / 2);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		ASSERT (jobs[i].result == (int64_t)(size + i));
+		test_same_content (names[i][0], names[i][1]);
+		remove (names[i][0]);
+		remove (names[i][1]);
+	}
+	if (print)
+	{
+		printf ("csc_filecopy_batch %u threads: %u files, %ju bytes, %f s, %f MB/s\n", nthreads, n, (uintmax_t)stats.bytes, stats.seconds, stats.throughput / 1e6);
+	}
+	free (jobs);
+	free (names);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_filecopy_cases();
+	test_batch (10, 1000, 3, 0);
+	test_batch (0, 1000, 3, 0);
+	for (uint32_t nthreads = 1; nthreads <= 8; nthreads *= 2)
+	{
+		test_batch (64, 1024 * 1024, nthreads, 1);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_filecopy.h
+SOURCES += test_csc_filecopy.c
+LIBS += -lpthread
@@ -0,0 +1,165 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_malloc_file.h"
+
+
+static void test_write_file (char const * filename, size_t size)
+{
+	FILE * f = fopen (filename, "wb");
+	ASSERT (f != NULL);
+	for (size_t i = 0; i < size; ++i)
+	{
+		fputc ('a' + (int)(i % 26), f);
+	}
+	fclose (f);
+}
+
+
+static void test_check_view (struct csc_file_view const * view, size_t size)
+{
+	ASSERT_EQ_U (view->size, size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		ASSERT (view->data[i] == 'a' + (int)(i % 26));
+	}
+	ASSERT (view->data[size] == 0);
+}
+
+
+static void test_view_cases()
+{
+	char const * filename = "test_csc_malloc_file.tmp";
+	long page = sysconf (_SC_PAGESIZE);
+	size_t sizes[] = {1, 100, (size_t)page - 1, (size_t)page, (size_t)page + 1, (size_t)page * 3};
+	for (uint32_t i = 0; i < countof (sizes); ++i)
+	{
+		test_write_file (filename, sizes[i]);
+		struct csc_file_view view;
+		ASSERT (csc_file_view_open (&view, filename, 0) == 0);
+		ASSERT (view.mapsize > 0);
+		test_check_view (&view, sizes[i]);
+		//Copy-on-write, the file is not changed:
+		view.data[0] = 'z';
+		csc_file_view_close (&view);
+		ASSERT (csc_file_view_open (&view, filename, CSC_FILE_VIEW_POPULATE | CSC_FILE_VIEW_SEQUENTIAL) == 0);
+		test_check_view (&view, sizes[i]);
+		csc_file_view_close (&view);
+		long length;
+		char * buffer = csc_malloc_file1 (filename, &length);
+		ASSERT_EQ_U ((size_t)length, sizes[i]);
+		ASSERT (memcmp (buffer, "abc", MIN (sizes[i], 3)) == 0);
+		ASSERT (buffer[length] == 0);
+		free (buffer);
+	}
+	//Empty file:
+	test_write_file (filename, 0);
+	{
+		struct csc_file_view view;
+		ASSERT (csc_file_view_open (&view, filename, 0) == 0);
+		ASSERT_EQ_U (view.size, 0);
+		ASSERT (view.data[0] == 0);
+		csc_file_view_close (&view);
+	}
+	remove (filename);
+	//Missing file:
+	{
+		struct csc_file_view view;
+		ASSERT (csc_file_view_open (&view, filename, 0) == -1);
+		ASSERT (view.data == NULL);
+	}
+	//Pipe falls back to read:
+	{
+		int fd[2];
+		ASSERT (pipe (fd) == 0);
+		ASSERT (write (fd[1], "abcdefghij", 10) == 10);
+		close (fd[1]);
+		struct csc_file_view view;
+		ASSERT (csc_file_view_open_fd (&view, fd[0], 0) == 0);
+		close (fd[0]);
+		ASSERT_EQ_U (view.mapsize, 0);
+		test_check_view (&view, 10);
+		csc_file_view_close (&view);
+	}
+}
+
+
+//Evict the file from the page cache so the next load is a cold load:
+static void bench_evict (char const * filename)
+{
+	int fd = open (filename, O_RDONLY);
+	ASSERT (fd >= 0);
+	fdatasync (fd);
+	posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+	close (fd);
+}
+
+
+//Load and touch every byte:
+static uint64_t bench_load (char const * filename, int method)
+{
+	uint64_t sum = 0;
+	if (method == 0)
+	{
+		long length;
+		char * buffer = csc_malloc_file1 (filename, &length);
+		for (long i = 0; i < length; ++i) {sum += (uint8_t)buffer[i];}
+		free (buffer);
+	}
+	else
+	{
+		struct csc_file_view view;
+		int flags = (method == 2) ? (CSC_FILE_VIEW_POPULATE | CSC_FILE_VIEW_SEQUENTIAL) : 0;
+		ASSERT (csc_file_view_open (&view, filename, flags) == 0);
+		for (size_t i = 0; i < view.size; ++i) {sum += (uint8_t)view.data[i];}
+		csc_file_view_close (&view);
+	}
+	return sum;
+}
+
+
+static void bench_malloc_file()
+{
+	char const * filename = "test_csc_malloc_file.tmp";
+	size_t size = 128 * 1024 * 1024;
+	test_write_file (filename, size);
+	char const * names[] = {"csc_malloc_file1", "csc_file_view_open", "csc_file_view_open POPULATE|SEQUENTIAL"};
+	for (int method = 0; method < 3; ++method)
+	{
+		for (int warm = 0; warm < 2; ++warm)
+		{
+			if (warm == 0) {bench_evict (filename);}
+			struct timespec t0, t1;
+			clock_gettime (CLOCK_MONOTONIC, &t0);
+			uint64_t sum = bench_load (filename, method);
+			clock_gettime (CLOCK_MONOTONIC, &t1);
+			double dt = csc_crossos_seconds (&t0, &t1);
+			printf ("%s %s: %f s, %f MB/s (%ju)\n", names[method], warm ? "warm" : "cold", dt, (double)size / dt / 1e6, (uintmax_t)sum);
+		}
+	}
+	remove (filename);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_view_cases();
+	bench_malloc_file();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,7 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_malloc_file.h
+SOURCES += test_csc_malloc_file.c
@@ -0,0 +1,175 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_parallel.h"
+#include "csc_vf32_parallel.h"
+
+
+static void test_fill (uint32_t n, float v[], uint32_t seed)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v[i] = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+	}
+}
+
+
+static void test_parallel_count (void * ptr, size_t a, size_t b, uint32_t part)
+{
+	uint8_t * visited = ptr;
+	UNUSED (part);
+	for (size_t i = a; i < b; ++i) {visited[i]++;}
+}
+
+
+static void test_parallel_split()
+{
+	//Parts cover [0, n) exactly once and splits are on grain boundaries:
+	for (uint32_t parts = 1; parts <= 9; ++parts)
+	for (size_t n = 0; n < 500; n += 7)
+	for (size_t skew = 0; skew < 16; skew += 5)
+	{
+		size_t prev = 0;
+		for (uint32_t i = 0; i <= parts; ++i)
+		{
+			size_t x = csc_parallel_split (n, 16, skew, parts, i);
+			ASSERT (x >= prev);
+			ASSERT (x <= n);
+			if (i > 0 && i < parts && x > 0 && x < n) {ASSERT ((x + skew) % 16 == 0);}
+			prev = x;
+		}
+		ASSERT (prev == n);
+	}
+	size_t const n = 1000003;
+	uint8_t * visited = calloc (n, 1);
+	for (uint32_t nthreads = 1; nthreads <= 5; ++nthreads)
+	{
+		struct csc_parallel pool;
+		csc_parallel_init (&pool, nthreads);
+		for (uint32_t j = 0; j < 3; ++j)
+		{
+			memset (visited, 0, n);
+			csc_parallel_for (&pool, n, 16, 3, test_parallel_count, visited);
+			for (size_t i = 0; i < n; ++i) {ASSERT (visited[i] == 1);}
+		}
+		//Small loops runs in fewer parts:
+		ASSERT (csc_parallel_parts (&pool, 100) == 1);
+		csc_parallel_for (&pool, 0, 16, 0, test_parallel_count, visited);
+		csc_parallel_free (&pool);
+	}
+	csc_parallel_for (NULL, 10, 1, 0, test_parallel_count, visited);
+	ASSERT (visited[9] == 2);
+	free (visited);
+}
+
+
+static void test_parallel_vf32()
+{
+	uint32_t const n = 300001;
+	float * a = malloc (n * sizeof (float));
+	float * b = malloc (n * sizeof (float));
+	float * r0 = malloc (n * sizeof (float));
+	float * r1 = malloc (n * sizeof (float));
+	uint32_t * u = malloc (n * sizeof (uint32_t));
+	uint32_t * v = malloc (n * sizeof (uint32_t));
+	test_fill (n, a, 1);
+	test_fill (n, b, 2);
+	struct csc_parallel pool;
+	csc_parallel_init (&pool, 4);
+	vvf32_add (n, r0, a, b); vvf32_add_parallel (&pool, n, r1, a, b);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vvf32_sub (n, r0, a, b); vvf32_sub_parallel (&pool, n, r1, a, b);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vvf32_hadamard (n, r0, a, b); vvf32_hadamard_parallel (&pool, n, r1, a, b);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vvf32_macc (n, r0, a, b); vvf32_macc_parallel (&pool, n, r1, a, b);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vsf32_add (n, r0, a, 2.0f); vsf32_add_parallel (&pool, n, r1, a, 2.0f);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vsf32_sub (n, r0, a, 2.0f); vsf32_sub_parallel (&pool, n, r1, a, 2.0f);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vsf32_mul (n, r0, a, 2.0f); vsf32_mul_parallel (&pool, n, r1, a, 2.0f);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vsf32_macc (n, r0, a, 2.0f); vsf32_macc_parallel (&pool, n, r1, a, 2.0f);
+	ASSERT (memcmp (r0, r1, n * sizeof (float)) == 0);
+	vf32_set1 (n, r0, 3.0f); vf32_set1_parallel (&pool, n - 1, r1 + 1, 3.0f);
+	ASSERT (memcmp (r0, r1 + 1, (n - 1) * sizeof (float)) == 0);
+	vf32_cpy_parallel (&pool, n, r1, a);
+	ASSERT (memcmp (a, r1, n * sizeof (float)) == 0);
+	ASSERT (fabsf (vf32_sum (n, a) - vf32_sum_parallel (&pool, n, a)) < 1e-2f);
+	ASSERT (fabsf (vf32_dot (n, a, b) - vf32_dot_parallel (&pool, n, a, b)) < 1e-2f);
+	ASSERT (vf32_sum_parallel (NULL, n, a) == vf32_sum (n, a));
+	vu32_set1_parallel (&pool, n, u, 7);
+	for (uint32_t i = 0; i < n; ++i) {ASSERT (u[i] == 7);}
+	for (uint32_t i = 0; i < n; ++i) {u[i] = i;}
+	vu32_cpy_parallel (&pool, n, v, u);
+	ASSERT (memcmp (u, v, n * sizeof (uint32_t)) == 0);
+	csc_parallel_free (&pool);
+	free (a);
+	free (b);
+	free (r0);
+	free (r1);
+	free (u);
+	free (v);
+}
+
+
+/*
+Memory bandwidth of add and dot with 1 to 8 threads.
+*/
+static void bench_parallel()
+{
+	uint32_t const n = 1 << 24;
+	uint32_t const reps = 5;
+	float * a = malloc (n * sizeof (float));
+	float * b = malloc (n * sizeof (float));
+	float * r = malloc (n * sizeof (float));
+	test_fill (n, a, 3);
+	test_fill (n, b, 4);
+	vf32_set1 (n, r, 0.0f);
+	for (uint32_t nthreads = 1; nthreads <= 8; nthreads *= 2)
+	{
+		struct csc_parallel pool;
+		csc_parallel_init (&pool, nthreads);
+		float volatile sink = 0;
+		struct timespec t0, t1, t2;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		for (uint32_t j = 0; j < reps; ++j) {vvf32_add_parallel (&pool, n, r, a, b);}
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		for (uint32_t j = 0; j < reps; ++j) {sink += vf32_dot_parallel (&pool, n, a, b);}
+		clock_gettime (CLOCK_MONOTONIC, &t2);
+		UNUSED (sink);
+		printf ("%u threads: vvf32_add %.2f GB/s, vf32_dot %.2f GB/s\n", nthreads,
+		12.0 * n * reps / csc_crossos_seconds (&t0, &t1) * 1e-9,
+		8.0 * n * reps / csc_crossos_seconds (&t1, &t2) * 1e-9);
+		csc_parallel_free (&pool);
+	}
+	free (a);
+	free (b);
+	free (r);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_parallel_split();
+	test_parallel_vf32();
+	bench_parallel();
+
+	return EXIT_SUCCESS;
+}
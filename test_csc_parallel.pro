@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_parallel.h
+HEADERS += csc_vf32_parallel.h
+SOURCES += test_csc_parallel.c
+LIBS += -lpthread
@@ -1,4 +1,7 @@
+#include "csc_basic.h"
 #include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_tok_c.h"
 #include "csc_pcstree.h"
 
 typedef void (*csc_pcstree_print_traverse_cb)(struct csc_pcstree const * node, void *ptr);
@@ -59,68 +62,129 @@ void traverse_cb (struct csc_pcstree const * nodepos, void * ptr)
 }
 */
 
-enum testnode
+//Check (parent), (prev) and (child_count) of every node against the child lists:
+static void test_links (struct csc_pcstree_arena const * arena)
 {
-	TESTNODE_A,
-	TESTNODE_B,
-	TESTNODE_C,
-	TESTNODE_D,
-	TESTNODE_E,
-	TESTNODE_F,
-	TESTNODE_G,
-	TESTNODE_H,
-	TESTNODE_I,
-	TESTNODE_J,
-	TESTNODE_K,
-	TESTNODE_L,
-	TESTNODE_M,
-	TESTNODE_N
-};
+	struct csc_pcstree const * node = arena->node;
+	ASSERT (node[0].parent == NULL);
+	ASSERT (node[0].prev == NULL);
+	ASSERT (node[0].next == NULL);
+	for (uint32_t i = 0; i < arena->count; ++i)
+	{
+		struct csc_pcstree const * p = node + i;
+		struct csc_pcstree const * prev = NULL;
+		int count = 0;
+		for (struct csc_pcstree const * c = p->child; c; c = c->next)
+		{
+			ASSERT (c->parent == p);
+			ASSERT (c->prev == prev);
+			prev = c;
+			count ++;
+		}
+		ASSERT_EQ_U (p->child_count, count);
+	}
+}
 
 
-int main (int argc, char * argv [])
+static void test_build (struct csc_pcstree_arena * arena, char const * src, int const depth[], uint32_t n)
 {
-	ASSERT (argc);
-	ASSERT (argv);
+	struct csc_tok tok[64];
+	struct csc_tok_c t;
+	csc_tok_c_init (&t, src, src + strlen (src));
+	uint32_t tok_n = csc_tok_c_next (&t, tok, countof (tok));
+	ASSERT_EQ_U (tok_n, n);
+	//Reused storage must not leak links from the previous tree:
+	if (arena->node) {memset (arena->node, 0xA5, arena->cap * sizeof (struct csc_pcstree));}
+	struct csc_pcstree * root = csc_pcstree_build (arena, tok, tok_n);
+	ASSERT (root == arena->node);
+	ASSERT_EQ_U (arena->count, n + 1);
+	test_links (arena);
+	//Preorder traversal visits the tokens in source order:
+	int d = 0;
+	struct csc_pcstree const * x = csc_pcstree_traverse (root, &d);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		ASSERT (x == root + i + 1);
+		ASSERT (x->ptr == tok[i].a);
+		ASSERTF (d == depth[i], "%i: depth %i == %i", i, d, depth[i]);
+		x = csc_pcstree_traverse (x, &d);
+	}
+	ASSERT (x == NULL);
+}
 
 
-	struct csc_pcstree node [20];
-	int x [20] = {INT_MAX};
-	node [TESTNODE_A].name = "A";
-	node [TESTNODE_B].name = "B";
-	node [TESTNODE_C].name = "C";
-	node [TESTNODE_D].name = "D";
-	node [TESTNODE_E].name = "E";
-	node [TESTNODE_F].name = "F";
-	node [TESTNODE_G].name = "G";
-	node [TESTNODE_H].name = "H";
-	node [TESTNODE_I].name = "I";
-	node [TESTNODE_J].name = "J";
-	node [TESTNODE_K].name = "K";
-	node [TESTNODE_L].name = "L";
-	node [TESTNODE_M].name = "M";
-	node [TESTNODE_N].name = "N";
-	csc_pcstree_init (node + TESTNODE_A);
-	csc_pcstree_init (node + TESTNODE_B);
-	csc_pcstree_init (node + TESTNODE_C);
-	csc_pcstree_init (node + TESTNODE_D);
-	csc_pcstree_init (node + TESTNODE_E);
-	csc_pcstree_init (node + TESTNODE_F);
-	csc_pcstree_init (node + TESTNODE_G);
-	csc_pcstree_init (node + TESTNODE_H);
-	csc_pcstree_init (node + TESTNODE_I);
-	csc_pcstree_init (node + TESTNODE_J);
-	csc_pcstree_init (node + TESTNODE_K);
-	csc_pcstree_init (node + TESTNODE_L);
-	csc_pcstree_init (node + TESTNODE_M);
-	csc_pcstree_init (node + TESTNODE_N);
-
-
-	csc_pcstree_add (node+TESTNODE_A, node+TESTNODE_B);
-	csc_pcstree_add (node+TESTNODE_B, node+TESTNODE_C);
+static void test_build_cases()
+{
+	struct csc_pcstree_arena arena = {0};
+	{
+		//Allocate more nodes than the next trees use:
+		char const * src = "a b c d e f g h i j k l m n o p q r s t u v w x y z";
+		int depth[26] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+		test_build (&arena, src, depth, countof (depth));
+	}
+	{
+		char const * src = "f(a,b){x[1];}";
+		int depth[] = {1, 1, 2, 2, 2, 2, 1, 2, 2, 3, 3, 2, 2};
+		test_build (&arena, src, depth, countof (depth));
+		struct csc_pcstree const * node = arena.node;
+		ASSERT_EQ_U (node[0].child_count, 3);
+		ASSERT_EQ_U (node[2].child_count, 4);
+		ASSERT_EQ_U (node[7].child_count, 4);
+		ASSERT (node[9].parent == node + 7);
+		ASSERT (node[9].prev == node + 8);
+		ASSERT (node[13].next == NULL);
+	}
+	{
+		//Unmatched closing bracket stays at the root:
+		char const * src = ") ( ]";
+		int depth[] = {1, 1, 2};
+		test_build (&arena, src, depth, countof (depth));
+	}
+	csc_pcstree_arena_free (&arena);
+}
+
+
+static void test_build_deep (uint32_t levels)
+{
+	//Nesting much deeper than the initial stack of open brackets:
+	uint32_t n = levels * 2 + 1;
+	char * src = malloc (n + 1);
+	for (uint32_t i = 0; i < levels; ++i)
+	{
+		src[i] = "([{"[i % 3];
+		src[n - 1 - i] = ")]}"[i % 3];
+	}
+	src[levels] = 'x';
+	src[n] = '\0';
+	struct csc_tok * tok = malloc (n * sizeof (struct csc_tok));
+	struct csc_tok_c t;
+	csc_tok_c_init (&t, src, src + n);
+	ASSERT_EQ_U (csc_tok_c_next (&t, tok, n), n);
+	struct csc_pcstree_arena arena = {0};
+	struct csc_pcstree * root = csc_pcstree_build (&arena, tok, n);
+	test_links (&arena);
+	//The identifier is the only child of the innermost bracket:
+	struct csc_pcstree const * x = root + levels + 1;
+	ASSERT (x->ptr == src + levels);
+	ASSERT (x->parent == root + levels);
+	ASSERT_EQ_U (x->parent->child_count, 2);
+	int d = 0;
+	for (struct csc_pcstree const * p = x; p != root; p = p->parent) {d++;}
+	ASSERT_EQ_U (d, levels + 1);
+	csc_pcstree_arena_free (&arena);
+	free (tok);
+	free (src);
+}
 
 
+int main (int argc, char * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
 
+	test_build_cases();
+	test_build_deep (100000);
 
 	return EXIT_SUCCESS;
 }
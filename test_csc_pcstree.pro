@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += experiment
+HEADERS += experiment/csc_pcstree.h csc_tok_c.h
+SOURCES += test_csc_pcstree.c
@@ -0,0 +1,217 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_rng.h"
+#include "csc_vf32.h"
+#include "csc_vu32.h"
+
+
+//Reference xoshiro128++ for one lane:
+static uint32_t test_xoshiro128pp (uint32_t s[4])
+{
+	uint32_t const result = csc_rng_rotl (s[0] + s[3], 7) + s[0];
+	uint32_t const t = s[1] << 9;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = csc_rng_rotl (s[3], 11);
+	return result;
+}
+
+
+static void test_rng_reference()
+{
+	struct csc_rng r;
+	csc_rng_init (&r, 1234);
+	uint32_t s[CSC_RNG_LANES][4];
+	for (uint32_t i = 0; i < CSC_RNG_LANES; ++i)
+	{
+		s[i][0] = r.s0[i];
+		s[i][1] = r.s1[i];
+		s[i][2] = r.s2[i];
+		s[i][3] = r.s3[i];
+	}
+	uint32_t u[CSC_RNG_LANES * 100];
+	csc_rng_u32 (&r, countof (u), u);
+	for (uint32_t j = 0; j < 100; ++j)
+	for (uint32_t i = 0; i < CSC_RNG_LANES; ++i)
+	{
+		ASSERT (u[j * CSC_RNG_LANES + i] == test_xoshiro128pp (s[i]));
+	}
+}
+
+
+static void test_rng_determinism()
+{
+	uint32_t a[1000];
+	uint32_t b[1000];
+	struct csc_rng r1;
+	struct csc_rng r2;
+	csc_rng_init (&r1, 42);
+	csc_rng_init (&r2, 42);
+	csc_rng_u32 (&r1, 1000, a);
+	//Single values and batches gives the same sequence:
+	for (uint32_t i = 0; i < 7; ++i) {b[i] = csc_rng_next_u32 (&r2);}
+	csc_rng_u32 (&r2, 993, b + 7);
+	ASSERT (memcmp (a, b, sizeof (a)) == 0);
+	//Other seed:
+	csc_rng_init (&r2, 43);
+	csc_rng_u32 (&r2, 1000, b);
+	ASSERT (memcmp (a, b, sizeof (a)) != 0);
+	//Lanes are different:
+	for (uint32_t i = 1; i < CSC_RNG_LANES; ++i) {ASSERT (a[i] != a[0]);}
+	//Split streams are different from the parent and from each other:
+	struct csc_rng c1;
+	struct csc_rng c2;
+	csc_rng_init (&r1, 42);
+	csc_rng_split (&r1, &c1);
+	csc_rng_split (&r1, &c2);
+	uint32_t x[3][64];
+	csc_rng_u32 (&r1, 64, x[0]);
+	csc_rng_u32 (&c1, 64, x[1]);
+	csc_rng_u32 (&c2, 64, x[2]);
+	ASSERT (memcmp (x[0], x[1], sizeof (x[0])) != 0);
+	ASSERT (memcmp (x[0], x[2], sizeof (x[0])) != 0);
+	ASSERT (memcmp (x[1], x[2], sizeof (x[0])) != 0);
+	ASSERT (memcmp (x[0], a, sizeof (x[0])) != 0);
+	//A split of a split is different from the parent after the split:
+	struct csc_rng c3;
+	csc_rng_init (&r1, 42);
+	csc_rng_split (&r1, &c1);
+	csc_rng_split (&c1, &c3);
+	csc_rng_u32 (&r1, 64, x[0]);
+	csc_rng_u32 (&c1, 64, x[1]);
+	csc_rng_u32 (&c3, 64, x[2]);
+	ASSERT (memcmp (x[0], x[2], sizeof (x[0])) != 0);
+	ASSERT (memcmp (x[1], x[2], sizeof (x[0])) != 0);
+}
+
+
+static void test_rng_distribution()
+{
+	uint32_t const n = 1 << 20;
+	float * f = malloc (n * sizeof (float));
+	struct csc_rng r;
+	csc_rng_init (&r, 7);
+	csc_rng_f32 (&r, n, f);
+	double sum = 0;
+	uint32_t hist[16] = {0};
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		ASSERT (f[i] >= 0.0f && f[i] < 1.0f);
+		sum += f[i];
+		hist[(uint32_t)(f[i] * 16.0f)]++;
+	}
+	ASSERT (fabs (sum / n - 0.5) < 0.002);
+	double chi2 = 0;
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		double e = n / 16.0;
+		chi2 += (hist[i] - e) * (hist[i] - e) / e;
+	}
+	//15 degrees of freedom, p = 0.001:
+	ASSERT (chi2 < 37.7);
+	free (f);
+	//Mask is applied to all bits:
+	uint32_t u[1000];
+	uint32_t any = 0;
+	vu32_repeat_random_mask (1000, u, 0xF0F0F0F0);
+	for (uint32_t i = 0; i < 1000; ++i)
+	{
+		ASSERT ((u[i] & ~0xF0F0F0F0u) == 0);
+		any |= u[i];
+	}
+	ASSERT (any == 0xF0F0F0F0u);
+}
+
+
+static void * test_rng_thread (void * arg)
+{
+	vf32_random (64, arg);
+	return NULL;
+}
+
+
+static void * test_rng_thread_u32 (void * arg)
+{
+	csc_rng_u32 (csc_rng_default (), 64, arg);
+	return NULL;
+}
+
+
+static void test_rng_default()
+{
+	float a[64];
+	float b[64];
+	float c[64];
+	csc_rng_default_seed (99);
+	vf32_random (64, a);
+	csc_rng_default_seed (99);
+	vf32_random (64, b);
+	ASSERT (memcmp (a, b, sizeof (a)) == 0);
+	//Other threads gets other streams:
+	pthread_t t;
+	pthread_create (&t, NULL, test_rng_thread, c);
+	pthread_join (t, NULL);
+	ASSERT (memcmp (a, c, sizeof (a)) != 0);
+	//A split of the default generator is not the default generator of the next thread:
+	uint32_t x[2][64];
+	struct csc_rng child;
+	csc_rng_default_seed (99);
+	csc_rng_split (csc_rng_default (), &child);
+	csc_rng_u32 (&child, 64, x[0]);
+	pthread_create (&t, NULL, test_rng_thread_u32, x[1]);
+	pthread_join (t, NULL);
+	ASSERT (memcmp (x[0], x[1], sizeof (x[0])) != 0);
+}
+
+
+static void bench_rng()
+{
+	uint32_t const n = 1 << 24;
+	float * f = malloc (n * sizeof (float));
+	uint32_t * u = malloc (n * sizeof (uint32_t));
+	struct csc_rng r;
+	csc_rng_init (&r, 1);
+	struct timespec t0, t1, t2, t3;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	for (uint32_t i = 0; i < n; ++i) {f[i] = (float)rand() / (float)RAND_MAX;}
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	csc_rng_f32 (&r, n, f);
+	clock_gettime (CLOCK_MONOTONIC, &t2);
+	csc_rng_u32 (&r, n, u);
+	clock_gettime (CLOCK_MONOTONIC, &t3);
+	printf ("rand() %.1f M/s, csc_rng_f32 %.1f M/s, csc_rng_u32 %.1f M/s\n",
+	n / csc_crossos_seconds (&t0, &t1) * 1e-6, n / csc_crossos_seconds (&t1, &t2) * 1e-6, n / csc_crossos_seconds (&t2, &t3) * 1e-6);
+	free (f);
+	free (u);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_rng_reference();
+	test_rng_determinism();
+	test_rng_distribution();
+	test_rng_default();
+	bench_rng();
+
+	return EXIT_SUCCESS;
+}
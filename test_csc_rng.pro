@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_rng.h
+SOURCES += test_csc_rng.c
+LIBS += -lpthread
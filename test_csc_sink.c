@@ -0,0 +1,91 @@
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_sink.h"
+
+
+static void test_mem()
+{
+	char buf[8];
+	struct csc_sink sink;
+	csc_sink_init_mem (&sink, buf, sizeof (buf));
+	csc_sink_puts (&sink, "abc");
+	csc_sink_printf (&sink, "%i", 12);
+	ASSERT_EQ_U (sink.len, 5);
+	ASSERT (memcmp (buf, "abc12", 5) == 0);
+	csc_sink_puts (&sink, "defgh");
+	ASSERT_EQ_U (sink.len, 8);
+	ASSERT_EQ_U (sink.lost, 2);
+	ASSERT (csc_sink_reserve (&sink, 1) == NULL);
+}
+
+
+static void test_file()
+{
+	char buf[4];
+	char out[100] = {'\0'};
+	FILE * f = tmpfile();
+	ASSERT (f);
+	struct csc_sink sink;
+	csc_sink_init_file (&sink, buf, sizeof (buf), f);
+	csc_sink_puts (&sink, "Hello ");
+	csc_sink_printf (&sink, "%s %i", "World", 42);
+	csc_sink_putc (&sink, '!');
+	csc_sink_flush (&sink);
+	ASSERT_EQ_U (sink.lost, 0);
+	rewind (f);
+	size_t n = fread (out, 1, sizeof (out) - 1, f);
+	ASSERT_EQ_U (n, strlen ("Hello World 42!"));
+	ASSERTF (strcmp (out, "Hello World 42!") == 0, "%s", out);
+	fclose (f);
+}
+
+
+static void test_fd()
+{
+	char buf[8];
+	char out[100] = {'\0'};
+	int fd[2];
+	ASSERT (pipe (fd) == 0);
+	struct csc_sink sink;
+	csc_sink_init_fd (&sink, buf, sizeof (buf), fd[1]);
+	//Overflowing the buffer flushes the full buffer to the pipe and keeps the rest:
+	csc_sink_puts (&sink, "0123456789ABCDEFGHIJ");
+	ASSERT_EQ_U (sink.len, 4);
+	ssize_t n = read (fd[0], out, sizeof (out) - 1);
+	ASSERT_EQ_U (n, 16);
+	ASSERT (memcmp (out, "0123456789ABCDEF", 16) == 0);
+	//Reserving more than the free space flushes:
+	char * p = csc_sink_reserve (&sink, 6);
+	ASSERT (p == buf);
+	memcpy (p, "klmnop", 6);
+	csc_sink_commit (&sink, 6);
+	csc_sink_printf (&sink, "%i", 42);
+	csc_sink_flush (&sink);
+	ASSERT_EQ_U (sink.len, 0);
+	ASSERT_EQ_U (sink.lost, 0);
+	n = read (fd[0], out, sizeof (out) - 1);
+	ASSERT_EQ_U (n, 12);
+	ASSERT (memcmp (out, "GHIJklmnop42", 12) == 0);
+	close (fd[0]);
+	close (fd[1]);
+	//Failed writes are counted:
+	csc_sink_init_fd (&sink, buf, sizeof (buf), -1);
+	csc_sink_puts (&sink, "0123456789");
+	csc_sink_flush (&sink);
+	ASSERT_EQ_U (sink.lost, 10);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_mem();
+	test_file();
+	test_fd();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,7 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_sink.h
+SOURCES += test_csc_sink.c
\ No newline at end of file
@@ -20,6 +20,7 @@ int main (int argc, char * argv [])
 
 	{
 		test_strfrom_imax_cases();
+		test_strfrom_float_cases();
 	}
 
 	/*
@@ -0,0 +1,187 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_tabparse.h"
+
+
+static void test_tabparse_cases()
+{
+	{
+		char const * text =
+		"# x, y, id, name\n"
+		"1.5, -2, 7, a\r\n"
+		"\n"
+		"  2.25 ,3,65535,bc\n"
+		"3,, 9\n";
+		enum csc_type types[] = {CSC_TYPE_FLOAT, CSC_TYPE_I8, CSC_TYPE_U16, CSC_TYPE_CHAR};
+		struct csc_tabparse t;
+		csc_tabparse_init (&t, types, countof (types), ',');
+		ASSERT_EQ_U (csc_tabparse_run (&t, text, text + strlen (text), 1), 3);
+		float * x = t.col[0].data;
+		int8_t * y = t.col[1].data;
+		uint16_t * id = t.col[2].data;
+		char * name = t.col[3].data;
+		ASSERT (x[0] == 1.5f && x[1] == 2.25f && x[2] == 3.0f);
+		ASSERT (y[0] == -2 && y[1] == 3 && y[2] == 0);
+		ASSERT (id[0] == 7 && id[1] == 65535 && id[2] == 9);
+		ASSERT (name[0] == 'a' && name[1] == 0);
+		//Two characters in a char cell, missing y and name in the last row:
+		ASSERT_EQ_U (t.errors, 3);
+		csc_tabparse_free (&t);
+	}
+	{
+		char const * text = "1 2 3\n\t4\t5   6\n7 8\n";
+		enum csc_type types[] = {CSC_TYPE_U32, CSC_TYPE_U32, CSC_TYPE_DOUBLE};
+		struct csc_tabparse t;
+		csc_tabparse_init (&t, types, countof (types), 0);
+		ASSERT_EQ_U (csc_tabparse_run (&t, text, text + strlen (text), 4), 3);
+		uint32_t * a = t.col[0].data;
+		double * c = t.col[2].data;
+		ASSERT (a[0] == 1 && a[1] == 4 && a[2] == 7);
+		ASSERT (c[0] == 3.0 && c[1] == 6.0 && c[2] == 0.0);
+		ASSERT_EQ_U (t.errors, 1);
+		csc_tabparse_free (&t);
+	}
+	{
+		//Out of range values and trailing characters are errors:
+		char const * text =
+		"255 -128 18446744073709551615 1.5\n"
+		"256 -129 18446744073709551616 1.5x\n"
+		"1x +127 0x10 -\n";
+		enum csc_type types[] = {CSC_TYPE_U8, CSC_TYPE_I8, CSC_TYPE_U64, CSC_TYPE_FLOAT};
+		struct csc_tabparse t;
+		csc_tabparse_init (&t, types, countof (types), 0);
+		ASSERT_EQ_U (csc_tabparse_run (&t, text, text + strlen (text), 1), 3);
+		uint8_t * a = t.col[0].data;
+		int8_t * b = t.col[1].data;
+		uint64_t * c = t.col[2].data;
+		float * d = t.col[3].data;
+		ASSERT (a[0] == 255 && a[1] == 0 && a[2] == 0);
+		ASSERT (b[0] == -128 && b[1] == 0 && b[2] == 127);
+		ASSERT (c[0] == UINT64_MAX && c[1] == 0 && c[2] == 0);
+		ASSERT (d[0] == 1.5f && d[1] == 0.0f && d[2] == 0.0f);
+		ASSERT_EQ_U (t.errors, 7);
+		csc_tabparse_free (&t);
+	}
+	{
+		//Empty last cell on a CRLF line:
+		char const * text = "1.5,\r\n7,8\r\n";
+		enum csc_type types[] = {CSC_TYPE_FLOAT, CSC_TYPE_FLOAT};
+		struct csc_tabparse t;
+		csc_tabparse_init (&t, types, countof (types), ',');
+		ASSERT_EQ_U (csc_tabparse_run (&t, text, text + strlen (text), 1), 2);
+		float * a = t.col[0].data;
+		float * b = t.col[1].data;
+		ASSERT (a[0] == 1.5f && a[1] == 7.0f);
+		ASSERT (b[0] == 0.0f && b[1] == 8.0f);
+		ASSERT_EQ_U (t.errors, 1);
+		csc_tabparse_free (&t);
+	}
+}
+
+
+static char * test_table (uint32_t rows, size_t * size)
+{
+	char * text = malloc ((size_t)rows * 40 + 1);
+	char * o = text;
+	for (uint32_t i = 0; i < rows; ++i)
+	{
+		o += sprintf (o, "%u,%i,%.2f\n", i, (int)(i % 1000) - 500, (double)i * 0.25);
+	}
+	*size = (size_t)(o - text);
+	return text;
+}
+
+
+static void test_tabparse_threads()
+{
+	size_t size;
+	uint32_t rows = 200000;
+	char * text = test_table (rows, &size);
+	enum csc_type types[] = {CSC_TYPE_U32, CSC_TYPE_I16, CSC_TYPE_FLOAT};
+	for (uint32_t nthreads = 1; nthreads <= 8; ++nthreads)
+	{
+		struct csc_tabparse t;
+		csc_tabparse_init (&t, types, countof (types), ',');
+		ASSERT_EQ_U (csc_tabparse_run (&t, text, text + size, nthreads), rows);
+		ASSERT_EQ_U (t.errors, 0);
+		uint32_t * a = t.col[0].data;
+		int16_t * b = t.col[1].data;
+		float * c = t.col[2].data;
+		for (uint32_t i = 0; i < rows; ++i)
+		{
+			ASSERT (a[i] == i);
+			ASSERT (b[i] == (int)(i % 1000) - 500);
+			ASSERT (c[i] == (float)((double)i * 0.25));
+		}
+		csc_tabparse_free (&t);
+	}
+	free (text);
+}
+
+
+static void test_tabparse_file()
+{
+	char const * filename = "test_csc_tabparse.txt";
+	FILE * f = fopen (filename, "wb");
+	ASSERT (f);
+	fputs ("10\t-1.5\n20\t2.5", f);
+	fclose (f);
+	enum csc_type types[] = {CSC_TYPE_U64, CSC_TYPE_DOUBLE};
+	struct csc_tabparse t;
+	csc_tabparse_init (&t, types, countof (types), 0);
+	ASSERT (csc_tabparse_file (&t, filename, 2) == 2);
+	uint64_t * a = t.col[0].data;
+	double * b = t.col[1].data;
+	ASSERT (a[0] == 10 && a[1] == 20);
+	ASSERT (b[0] == -1.5 && b[1] == 2.5);
+	ASSERT_EQ_U (t.errors, 0);
+	csc_tabparse_free (&t);
+	remove (filename);
+	ASSERT (csc_tabparse_file (&t, filename, 1) == -1);
+}
+
+
+static void bench_tabparse()
+{
+	size_t size;
+	char * text = test_table (4000000, &size);
+	enum csc_type types[] = {CSC_TYPE_U32, CSC_TYPE_I16, CSC_TYPE_FLOAT};
+	for (uint32_t nthreads = 1; nthreads <= 8; nthreads *= 2)
+	{
+		struct csc_tabparse t;
+		csc_tabparse_init (&t, types, countof (types), ',');
+		struct timespec t0, t1;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		uint32_t rows = csc_tabparse_run (&t, text, text + size, nthreads);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		double dt = csc_crossos_seconds (&t0, &t1);
+		printf ("csc_tabparse_run %u threads: %u rows, %f s, %f MB/s\n", nthreads, rows, dt, (double)size / dt / 1e6);
+		csc_tabparse_free (&t);
+	}
+	free (text);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_tabparse_cases();
+	test_tabparse_threads();
+	test_tabparse_file();
+	bench_tabparse();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_tabparse.h
+SOURCES += test_csc_tabparse.c
+LIBS += -lpthread
@@ -0,0 +1,301 @@
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_tok_c.h"
+#include "csc_tok_c_parallel.h"
+#include <time.h>
+
+
+static void test_tok (char const * src, int const expect_type[], char const * expect_str[], uint32_t expect_n)
+{
+	struct csc_tok_c t;
+	struct csc_tok tok[4];
+	csc_tok_c_init (&t, src, src + strlen (src));
+	uint32_t k = 0;
+	while (1)
+	{
+		//Small batch size to test batch boundaries:
+		uint32_t n = csc_tok_c_next (&t, tok, countof (tok));
+		if (n == 0) {break;}
+		for (uint32_t i = 0; i < n; ++i, ++k)
+		{
+			ASSERT (k < expect_n);
+			uint32_t len = (uint32_t)(tok[i].b - tok[i].a);
+			ASSERTF (tok[i].type == expect_type[k], "%i: %s == %s", k, tok_type_tostr (tok[i].type), tok_type_tostr (expect_type[k]));
+			ASSERTF (len == strlen (expect_str[k]) && memcmp (tok[i].a, expect_str[k], len) == 0, "%.*s == %s", (int)len, tok[i].a, expect_str[k]);
+		}
+	}
+	ASSERT_EQ_U (k, expect_n);
+}
+
+
+static void test_tok_cases()
+{
+	{
+		char const * src = "const int x = 0x1F; // comment\nif (y >= 1.5e-3) {return \"a\\\"b\";}";
+		int type[] = {CSC_TOK_C_CONST, CSC_TOK_C_INT, CSC_TOK_C_IDENTIFIER, '=', CSC_TOK_C_LITERAL_INTEGER, ';', CSC_TOK_C_IF, '(', CSC_TOK_C_IDENTIFIER, '>', '=', CSC_TOK_C_LITERAL_FLOAT, ')', '{', CSC_TOK_C_RETURN, CSC_TOK_C_LITERAL_STRING, ';', '}'};
+		char const * str[] = {"const", "int", "x", "=", "0x1F", ";", "if", "(", "y", ">", "=", "1.5e-3", ")", "{", "return", "\"a\\\"b\"", ";", "}"};
+		test_tok (src, type, str, countof (type));
+	}
+	{
+		char const * src = "/* a\n b */ intx _Bool 'c' .5 a.b";
+		int type[] = {CSC_TOK_C_IDENTIFIER, CSC_TOK_C_BOOL, CSC_TOK_C_LITERAL_CHAR, CSC_TOK_C_LITERAL_FLOAT, CSC_TOK_C_IDENTIFIER, '.', CSC_TOK_C_IDENTIFIER};
+		char const * str[] = {"intx", "_Bool", "'c'", ".5", "a", ".", "b"};
+		test_tok (src, type, str, countof (type));
+	}
+	{
+		char const * src = "a\n  b\n/*\n\n*/c";
+		struct csc_tok_c t;
+		struct csc_tok tok[8];
+		csc_tok_c_init (&t, src, src + strlen (src));
+		uint32_t n = csc_tok_c_next (&t, tok, countof (tok));
+		ASSERT_EQ_U (n, 3);
+		ASSERT_EQ_U (tok[0].line, 1);
+		ASSERT_EQ_U (tok[0].col, 1);
+		ASSERT_EQ_U (tok[1].line, 2);
+		ASSERT_EQ_U (tok[1].col, 3);
+		ASSERT_EQ_U (tok[2].line, 5);
+		ASSERT_EQ_U (tok[2].col, 3);
+	}
+	{
+		//Escaped newline inside a literal:
+		char const * src = "char*s=\"a\\\nb\";\nint x;";
+		struct csc_tok_c t;
+		struct csc_tok tok[16];
+		csc_tok_c_init (&t, src, src + strlen (src));
+		uint32_t n = csc_tok_c_next (&t, tok, countof (tok));
+		ASSERT_EQ_U (n, 9);
+		ASSERT_EQ_U (tok[4].type, CSC_TOK_C_LITERAL_STRING);
+		ASSERT_EQ_U (tok[4].line, 1);
+		ASSERT_EQ_U (tok[5].line, 2);
+		ASSERT_EQ_U (tok[5].col, 3);
+		ASSERT_EQ_U (tok[6].type, CSC_TOK_C_INT);
+		ASSERT_EQ_U (tok[6].line, 3);
+		ASSERT_EQ_U (tok[6].col, 1);
+	}
+}
+
+
+struct test_stream_ctx
+{
+	struct csc_tok const * expect;
+	uint32_t expect_n;
+	uint32_t k;
+};
+
+
+static void test_stream_cb (struct csc_tok const tok[], uint32_t n, void * ptr)
+{
+	struct test_stream_ctx * ctx = ptr;
+	for (uint32_t i = 0; i < n; ++i, ctx->k++)
+	{
+		ASSERT (ctx->k < ctx->expect_n);
+		struct csc_tok const * x = ctx->expect + ctx->k;
+		uint32_t len = (uint32_t)(tok[i].b - tok[i].a);
+		ASSERTF (tok[i].type == x->type, "%i: %s == %s", ctx->k, tok_type_tostr (tok[i].type), tok_type_tostr (x->type));
+		ASSERTF ((len == (uint32_t)(x->b - x->a)) && (memcmp (tok[i].a, x->a, len) == 0), "%i: %.*s == %.*s", ctx->k, (int)len, tok[i].a, (int)(x->b - x->a), x->a);
+		ASSERTF (tok[i].line == x->line, "%i: %.*s line %i == %i", ctx->k, (int)len, tok[i].a, tok[i].line, x->line);
+		ASSERTF (tok[i].col == x->col, "%i: %.*s col %i == %i", ctx->k, (int)len, tok[i].a, tok[i].col, x->col);
+	}
+}
+
+
+//Feed the source split at (cut) and compare with the whole buffer tokenizer:
+static void test_stream_split (char const * src, uint32_t const cut[], uint32_t cut_n)
+{
+	uint32_t srcn = (uint32_t) strlen (src);
+	struct csc_tok expect[100];
+	struct csc_tok_c t;
+	csc_tok_c_init (&t, src, src + srcn);
+	uint32_t expect_n = csc_tok_c_next (&t, expect, countof (expect));
+	ASSERT (expect_n < countof (expect));
+	struct test_stream_ctx ctx = {expect, expect_n, 0};
+	struct csc_tok_c_stream s;
+	csc_tok_c_stream_init (&s, test_stream_cb, &ctx);
+	uint32_t i = 0;
+	for (uint32_t j = 0; j <= cut_n; ++j)
+	{
+		uint32_t q = (j < cut_n) ? cut[j] : srcn;
+		ASSERT (i <= q);
+		//Copy to a temporary chunk to make sure no token points into a old chunk:
+		char * buf = malloc (q - i + 1);
+		ASSERT (buf);
+		memcpy (buf, src + i, q - i);
+		//Empty chunks are passed as NULL:
+		csc_tok_c_stream_feed (&s, (q > i) ? buf : NULL, q - i, j == cut_n);
+		memset (buf, '#', q - i);
+		free (buf);
+		i = q;
+	}
+	csc_tok_c_stream_free (&s);
+	ASSERT_EQ_U (ctx.k, expect_n);
+}
+
+
+static int test_cmp_u32 (void const * a, void const * b)
+{
+	uint32_t x = *(uint32_t const *)a;
+	uint32_t y = *(uint32_t const *)b;
+	return (x > y) - (x < y);
+}
+
+
+//Feed sources split at random cut points and compare with the whole buffer tokenizer:
+static void test_stream_cases()
+{
+	{
+		//A carried '/' opens a block comment whose end is split over the next two chunks:
+		uint32_t cut0[] = {1, 7};
+		test_stream_split ("/* ** */x", cut0, countof (cut0));
+		uint32_t cut1[] = {3, 8};
+		test_stream_split ("a /* b */ c", cut1, countof (cut1));
+		uint32_t cut2[] = {1, 2, 3};
+		test_stream_split ("/**/x", cut2, countof (cut2));
+		//Empty last chunk completes a carried token:
+		uint32_t cut3[] = {5, 5};
+		test_stream_split ("a bcd", cut3, countof (cut3));
+		test_stream_split ("a \"bc", cut3, countof (cut3));
+	}
+	char const * src =
+	"/* block\n * comment */ int main (void)\n"
+	"{\n\tfloat x = .25e+3f; // line comment\n"
+	"\tchar const * s = \"a string with \\\" quote\";\n"
+	"\tchar const * t = \"escaped \\\n newline\";\n"
+	"\treturn x/2 >= 'c' ? 1 : 0x7FFFffff; /**/ }\n"
+	"/* ** * **/ y /*** / ***/ z // end";
+	uint32_t srcn = (uint32_t) strlen (src);
+	uint32_t seed = 12345;
+	for (uint32_t k = 0; k < 20000; ++k)
+	{
+		uint32_t cut[16];
+		seed = seed * 1664525u + 1013904223u;
+		uint32_t cut_n = (seed >> 16) % countof (cut);
+		for (uint32_t j = 0; j < cut_n; ++j)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			cut[j] = (seed >> 8) % (srcn + 1);
+		}
+		qsort (cut, cut_n, sizeof (uint32_t), test_cmp_u32);
+		test_stream_split (src, cut, cut_n);
+	}
+}
+
+
+//Source with long block comments so that some splits fall inside a comment:
+static char * test_source (size_t size, size_t * n)
+{
+	char const * line[] =
+	{
+	"static int foo_bar (uint32_t n, float const a[]) { for (i = 0; i < n; ++i) {sum += a[i] * 1.5f;} return 0x10; } // comment\n",
+	"char const * s = \"string with \\\" quote\"; char c = '\\n';\n",
+	"char const * t = \"escaped \\\nnewline\";\n",
+	"/* block comment\n int x = 1;\n * still comment\n*/ int y = 2;\n",
+	"\t\tx = y / z; /* short */ w = .5;\n",
+	};
+	char * src = malloc (size);
+	ASSERT (src);
+	size_t i = 0;
+	uint32_t k = 0;
+	while (1)
+	{
+		char const * l = line[(k * 7 + k / 3) % countof (line)];
+		if ((k % 101) == 0) {l = "/*\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n*/\n";}
+		size_t len = strlen (l);
+		if (i + len > size) {break;}
+		memcpy (src + i, l, len);
+		i += len;
+		k ++;
+	}
+	*n = i;
+	return src;
+}
+
+
+static void test_parallel_cases()
+{
+	size_t size;
+	char * src = test_source (4 * 1024 * 1024, &size);
+	//Expected tokens from the serial tokenizer:
+	uint32_t expect_n = 0;
+	uint32_t expect_cap = (uint32_t)(size / 2) + 1;
+	struct csc_tok * expect = malloc (expect_cap * sizeof (struct csc_tok));
+	ASSERT (expect);
+	{
+		struct csc_tok_c t;
+		csc_tok_c_init (&t, src, src + size);
+		while (1)
+		{
+			uint32_t n = csc_tok_c_next (&t, expect + expect_n, MIN (expect_cap - expect_n, 1000));
+			if (n == 0) {break;}
+			expect_n += n;
+		}
+		ASSERT (expect_n < expect_cap);
+	}
+	for (uint32_t threads = 1; threads <= 16; threads += 3)
+	{
+		uint32_t n = 0;
+		struct csc_tok * tok = csc_tok_c_parallel (src, src + size, threads, &n);
+		ASSERT_EQ_U (n, expect_n);
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			ASSERTF (tok[i].type == expect[i].type, "%i", i);
+			ASSERTF (tok[i].a == expect[i].a, "%i", i);
+			ASSERTF (tok[i].b == expect[i].b, "%i", i);
+			ASSERTF (tok[i].line == expect[i].line, "%i: line %i == %i", i, tok[i].line, expect[i].line);
+			ASSERTF (tok[i].col == expect[i].col, "%i: col %i == %i", i, tok[i].col, expect[i].col);
+		}
+		free (tok);
+	}
+	free (expect);
+	free (src);
+}
+
+
+static void bench_tok()
+{
+	size_t size;
+	char * src = test_source (64 * 1024 * 1024, &size);
+	struct timespec t0, t1;
+	{
+		struct csc_tok tok[1024];
+		struct csc_tok_c t;
+		csc_tok_c_init (&t, src, src + size);
+		uint64_t count = 0;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		while (1)
+		{
+			uint32_t n = csc_tok_c_next (&t, tok, countof (tok));
+			if (n == 0) {break;}
+			count += n;
+		}
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		double dt = csc_crossos_seconds (&t0, &t1);
+		printf ("csc_tok_c_next: %zu bytes, %ju tokens, %f s, %f MB/s\n", size, (uintmax_t)count, dt, (double)size / dt / 1e6);
+	}
+	for (uint32_t threads = 1; threads <= 8; threads *= 2)
+	{
+		uint32_t count = 0;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		struct csc_tok * tok = csc_tok_c_parallel (src, src + size, threads, &count);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		free (tok);
+		double dt = csc_crossos_seconds (&t0, &t1);
+		printf ("csc_tok_c_parallel %u threads: %zu bytes, %u tokens, %f s, %f MB/s\n", threads, size, count, dt, (double)size / dt / 1e6);
+	}
+	free (src);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_tok_cases();
+	test_stream_cases();
+	test_parallel_cases();
+	bench_tok();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_tok_c.h csc_tok_c_parallel.h
+SOURCES += test_csc_tok_c.c
+LIBS += -lpthread
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_type_str.h"
+
+
+static void test_desc_cases()
+{
+	ASSERT (strcmp (csc_type_tostr (CSC_TYPE_U16), "u16") == 0);
+	ASSERT (strcmp (csc_type_tostr (CSC_TYPE_STRING), "string") == 0);
+	ASSERT (strcmp (csc_type_tostr (CSC_TYPE_RESERVED0), "unknown") == 0);
+	ASSERT (csc_type_desc (CSC_TYPE_U16)->size == 2);
+	ASSERT (csc_type_desc (CSC_TYPE_I64)->align == _Alignof (int64_t));
+	ASSERT (csc_type_desc (CSC_TYPE_FLOAT)->flagset == NULL);
+
+	//Unaligned destination:
+	char mem[16] = {0};
+	uint64_t u64;
+	ASSERT (csc_type_parse (CSC_TYPE_U64, mem + 1, "0x123456789", NULL) == 1);
+	memcpy (&u64, mem + 1, sizeof (u64));
+	ASSERT (u64 == UINT64_C(0x123456789));
+
+	int8_t i8 = 0;
+	char const * end;
+	ASSERT (csc_type_parse (CSC_TYPE_I8, &i8, "-12x", &end) == 1);
+	ASSERT (i8 == -12);
+	ASSERT (*end == 'x');
+	ASSERT (csc_type_parse (CSC_TYPE_I8, &i8, "x", NULL) == 0);
+	ASSERT (i8 == -12);
+
+	double d = 0;
+	ASSERT (csc_type_parse (CSC_TYPE_DOUBLE, &d, "0.1", NULL) == 1);
+	ASSERT (d == 0.1);
+
+	char buf[32];
+	uint16_t u16 = 65535;
+	ASSERT (csc_type_desc (CSC_TYPE_U16)->format (buf, sizeof (buf), &u16) == 5);
+	ASSERT (strcmp (buf, "65535") == 0);
+
+	uint32_t flags = 1;
+	csc_type_desc (CSC_TYPE_U32)->flagset (&flags, 0x10);
+	ASSERT (flags == 0x11);
+	ASSERT (csc_type_desc (CSC_TYPE_U32)->flagget (&flags, 0x10) == 1);
+	ASSERT (csc_type_desc (CSC_TYPE_U32)->flagget (&flags, 0x20) == 0);
+
+	char const * cells[] = {"1", "2", "", "40000"};
+	uint16_t column[4] = {0, 0, 7, 0};
+	ASSERT (csc_type_parsev (CSC_TYPE_U16, column, cells, 4) == 3);
+	ASSERT (column[0] == 1 && column[1] == 2 && column[2] == 7 && column[3] == 40000);
+
+	char const * text = " 1.5, 2 ;-3\n4e1 x";
+	float values[8];
+	ASSERT (csc_type_parset (CSC_TYPE_FLOAT, values, 8, &text) == 4);
+	ASSERT (values[0] == 1.5f && values[1] == 2.0f && values[2] == -3.0f && values[3] == 40.0f);
+	ASSERT (strcmp (text, " x") == 0);
+
+	//Destinations does not need to be aligned:
+	char packed[1 + 4 * sizeof (double)];
+	char const * dcells[] = {"0.5", "-2", "3e3"};
+	ASSERT (csc_type_parsev (CSC_TYPE_DOUBLE, packed + 1, dcells, 3) == 3);
+	memcpy (&d, packed + 1 + 2 * sizeof (double), sizeof (double));
+	ASSERT (d == 3e3);
+	text = "1 2 3 4";
+	ASSERT (csc_type_parset (CSC_TYPE_DOUBLE, packed + 1, 4, &text) == 4);
+	memcpy (&d, packed + 1 + 3 * sizeof (double), sizeof (double));
+	ASSERT (d == 4.0);
+
+	char const * s = NULL;
+	ASSERT (csc_type_parse (CSC_TYPE_STRING, &s, "Bob", NULL) == 1);
+	ASSERT (strcmp (s, "Bob") == 0);
+}
+
+
+static void bench_parset()
+{
+	uint32_t n = 10 * 1000 * 1000;
+	char * text = malloc ((size_t)n * 7 + 1);
+	char * o = text;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		o += sprintf (o, "%u\n", (i * 2654435761u) & 0xFFFF);
+	}
+	uint16_t * column = malloc (n * sizeof (uint16_t));
+	struct timespec t0, t1;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	char const * p = text;
+	uint32_t m = csc_type_parset (CSC_TYPE_U16, column, n, &p);
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	ASSERT (m == n);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		ASSERT (column[i] == ((i * 2654435761u) & 0xFFFF));
+	}
+	double dt = csc_crossos_seconds (&t0, &t1);
+	printf ("csc_type_parset u16: %u values, %f s, %f MB/s\n", n, dt, (double)(o - text) / dt / 1e6);
+	free (column);
+	free (text);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_desc_cases();
+	bench_parset();
+
+	return EXIT_SUCCESS;
+}
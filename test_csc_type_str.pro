@@ -0,0 +1,7 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_type_str.h
+SOURCES += test_csc_type_str.c
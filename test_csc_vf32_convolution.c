@@ -0,0 +1,480 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_parallel.h"
+#include "csc_vf32_convolution.h"
+
+
+static void test_fill (uint32_t n, float v[], uint32_t seed)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v[i] = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+	}
+}
+
+
+//Reference convolution with the index computed for every tap:
+static void test_conv_naive (float pix2[], float const pix[], int32_t xn, int32_t yn, float const k[], int32_t kxn, int32_t kyn, enum csc_vf32_conv_border b)
+{
+	int32_t kxn0 = kxn / 2;
+	int32_t kyn0 = kyn / 2;
+	for (int32_t y = 0; y < yn; ++y)
+	for (int32_t x = 0; x < xn; ++x)
+	{
+		if (b == CSC_VF32_CONV_SKIP && (x < kxn0 || x >= xn - kxn0 || y < kyn0 || y >= yn - kyn0)) {continue;}
+		double sum = 0.0;
+		for (int32_t ky = 0; ky < kyn; ++ky)
+		for (int32_t kx = 0; kx < kxn; ++kx)
+		{
+			int32_t xx = csc_vf32_conv_index (x + kx - kxn0, xn, b);
+			int32_t yy = csc_vf32_conv_index (y + ky - kyn0, yn, b);
+			if (xx < 0 || yy < 0) {continue;}
+			sum += (double)pix[yy * xn + xx] * k[ky * kxn + kx];
+		}
+		pix2[y * xn + x] = (float)sum;
+	}
+}
+
+
+static float test_maxdiff (uint32_t n, float const a[], float const b[])
+{
+	float m = 0.0f;
+	for (uint32_t i = 0; i < n; ++i) {m = MAX (m, fabsf (a[i] - b[i]));}
+	return m;
+}
+
+
+static void test_conv_index()
+{
+	ASSERT (csc_vf32_conv_index (-1, 4, CSC_VF32_CONV_ZERO) == -1);
+	ASSERT (csc_vf32_conv_index (-2, 4, CSC_VF32_CONV_CLAMP) == 0);
+	ASSERT (csc_vf32_conv_index (5, 4, CSC_VF32_CONV_CLAMP) == 3);
+	ASSERT (csc_vf32_conv_index (-1, 4, CSC_VF32_CONV_MIRROR) == 1);
+	ASSERT (csc_vf32_conv_index (4, 4, CSC_VF32_CONV_MIRROR) == 2);
+	ASSERT (csc_vf32_conv_index (-7, 4, CSC_VF32_CONV_MIRROR) == 1);
+	ASSERT (csc_vf32_conv_index (3, 1, CSC_VF32_CONV_MIRROR) == 0);
+	ASSERT (csc_vf32_conv_index (-1, 4, CSC_VF32_CONV_WRAP) == 3);
+	ASSERT (csc_vf32_conv_index (9, 4, CSC_VF32_CONV_WRAP) == 1);
+}
+
+
+static void test_conv_factor()
+{
+	float kx[5] = {1, 4, 6, 4, 1};
+	float ky[3] = {-1, 0, 2};
+	float k[15];
+	for (int32_t i = 0; i < 3; ++i)
+	for (int32_t j = 0; j < 5; ++j)
+	{
+		k[i * 5 + j] = ky[i] * kx[j];
+	}
+	float fx[5];
+	float fy[3];
+	ASSERT (csc_vf32_conv_factor (k, 5, 3, fx, fy) == 1);
+	for (int32_t i = 0; i < 3; ++i)
+	for (int32_t j = 0; j < 5; ++j)
+	{
+		ASSERT (fabsf (fy[i] * fx[j] - k[i * 5 + j]) < 1e-5f);
+	}
+	k[7] += 0.5f;
+	ASSERT (csc_vf32_conv_factor (k, 5, 3, fx, fy) == 0);
+	float z[4] = {0};
+	ASSERT (csc_vf32_conv_factor (z, 2, 2, fx, fy) == 0);
+}
+
+
+static void test_conv_methods()
+{
+	int32_t const xn = 37;
+	int32_t const yn = 23;
+	int32_t const ksizes[][2] = {{1, 1}, {3, 3}, {5, 3}, {4, 2}, {7, 7}, {2, 5}};
+	enum csc_vf32_conv_border const borders[] = {CSC_VF32_CONV_SKIP, CSC_VF32_CONV_ZERO, CSC_VF32_CONV_CLAMP, CSC_VF32_CONV_MIRROR, CSC_VF32_CONV_WRAP};
+	enum csc_vf32_conv_method const methods[] = {CSC_VF32_CONV_AUTO, CSC_VF32_CONV_DIRECT, CSC_VF32_CONV_SEPARABLE, CSC_VF32_CONV_FFT};
+	float pix[xn * yn];
+	float r0[xn * yn];
+	float r1[xn * yn];
+	float k[49];
+	test_fill (xn * yn, pix, 1);
+	struct csc_parallel pool;
+	csc_parallel_init (&pool, 3);
+	for (uint32_t s = 0; s < countof (ksizes); ++s)
+	for (int separable = 0; separable < 2; ++separable)
+	{
+		int32_t kxn = ksizes[s][0];
+		int32_t kyn = ksizes[s][1];
+		test_fill (kxn * kyn, k, 10 + s);
+		if (separable)
+		{
+			float f[14];
+			test_fill (kxn + kyn, f, 20 + s);
+			for (int32_t i = 0; i < kyn; ++i)
+			for (int32_t j = 0; j < kxn; ++j)
+			{
+				k[i * kxn + j] = f[kxn + i] * f[j];
+			}
+		}
+		for (uint32_t b = 0; b < countof (borders); ++b)
+		for (uint32_t m = 0; m < countof (methods); ++m)
+		{
+			//Pixels not written by SKIP keeps their value:
+			vf32_set1 (xn * yn, r0, 5.0f);
+			vf32_set1 (xn * yn, r1, 5.0f);
+			test_conv_naive (r0, pix, xn, yn, k, kxn, kyn, borders[b]);
+			struct csc_vf32_conv c;
+			csc_vf32_conv_init (&c, k, kxn, kyn, borders[b], methods[m]);
+			ASSERT ((c.kx != NULL) == (separable || kxn == 1 || kyn == 1));
+			csc_vf32_conv_run (&c, r1, pix, xn, yn, (m & 1) ? &pool : NULL);
+			csc_vf32_conv_free (&c);
+			ASSERTF (test_maxdiff (xn * yn, r0, r1) < 1e-4f, "k %ix%i border %i method %i", kxn, kyn, b, m);
+		}
+	}
+	csc_parallel_free (&pool);
+}
+
+
+static void test_conv_legacy()
+{
+	int32_t const xn = 19;
+	int32_t const yn = 11;
+	float pix[xn * yn];
+	float r0[xn * yn];
+	float r1[xn * yn];
+	float k[15];
+	test_fill (xn * yn, pix, 2);
+	test_fill (15, k, 3);
+	vf32_set1 (xn * yn, r0, 0.0f);
+	vf32_set1 (xn * yn, r1, 0.0f);
+	test_conv_naive (r0, pix, xn, yn, k, 5, 3, CSC_VF32_CONV_SKIP);
+	vf32_convolution2d (r1, pix, xn, yn, k, 5, 3);
+	ASSERT (test_maxdiff (xn * yn, r0, r1) < 1e-5f);
+	//The 1D kernel is normalized without modifying it:
+	float q[40];
+	float u[40] = {0};
+	float k1[5] = {1, 2, 3, 2, 1};
+	test_fill (40, q, 4);
+	vf32_convolution1d (q, 40, u, k1, 5);
+	ASSERT (k1[2] == 3.0f);
+	float l = sqrtf (19.0f);
+	for (uint32_t i = 2; i < 38; ++i)
+	{
+		float sum = 0.0f;
+		for (uint32_t j = 0; j < 5; ++j) {sum += q[i - 2 + j] * k1[j] / l;}
+		ASSERT (fabsf (sum - u[i]) < 1e-5f);
+	}
+	ASSERT (u[0] == 0.0f && u[1] == 0.0f && u[38] == 0.0f && u[39] == 0.0f);
+}
+
+
+static void test_conv_large_fft()
+{
+	//Large kernel over a non power of 2 image:
+	int32_t const xn = 100;
+	int32_t const yn = 70;
+	int32_t const kn = 21;
+	float * pix = malloc (xn * yn * sizeof (float));
+	float * r0 = malloc (xn * yn * sizeof (float));
+	float * r1 = malloc (xn * yn * sizeof (float));
+	float * k = malloc (kn * kn * sizeof (float));
+	test_fill (xn * yn, pix, 5);
+	test_fill (kn * kn, k, 6);
+	struct csc_vf32_conv c;
+	csc_vf32_conv_init (&c, k, kn, kn, CSC_VF32_CONV_MIRROR, CSC_VF32_CONV_FFT);
+	test_conv_naive (r0, pix, xn, yn, k, kn, kn, CSC_VF32_CONV_MIRROR);
+	csc_vf32_conv_run (&c, r1, pix, xn, yn, NULL);
+	csc_vf32_conv_free (&c);
+	ASSERT (test_maxdiff (xn * yn, r0, r1) < 1e-3f);
+	//AUTO switches to FFT for large kernels:
+	csc_vf32_conv_init (&c, k, kn, kn, CSC_VF32_CONV_MIRROR, CSC_VF32_CONV_AUTO);
+	ASSERT (csc_vf32_conv_choose (&c, 512, 512, 512 + 94, 512 + 94) == CSC_VF32_CONV_DIRECT);
+	c.kxn = 95;
+	c.kyn = 95;
+	ASSERT (csc_vf32_conv_choose (&c, 512, 512, 512 + 94, 512 + 94) == CSC_VF32_CONV_FFT);
+	c.kxn = kn;
+	c.kyn = kn;
+	csc_vf32_conv_free (&c);
+	free (pix);
+	free (r0);
+	free (r1);
+	free (k);
+}
+
+
+static void test_conv_threads()
+{
+	//Large enough to be split into row blocks, the result does not depend on the split:
+	int32_t const xn = 300;
+	int32_t const yn = 200;
+	float * pix = malloc (xn * yn * sizeof (float));
+	float * r0 = malloc (xn * yn * sizeof (float));
+	float * r1 = malloc (xn * yn * sizeof (float));
+	float k[35];
+	test_fill (xn * yn, pix, 9);
+	for (int32_t i = 0; i < 35; ++i) {k[i] = (float)(i % 7 + 1) * (float)(i / 7 + 1);}
+	struct csc_parallel pool;
+	csc_parallel_init (&pool, 3);
+	ASSERT (csc_parallel_parts (&pool, (size_t)xn * yn) == 3);
+	for (enum csc_vf32_conv_method m = CSC_VF32_CONV_DIRECT; m <= CSC_VF32_CONV_FFT; ++m)
+	{
+		struct csc_vf32_conv c;
+		csc_vf32_conv_init (&c, k, 7, 5, CSC_VF32_CONV_CLAMP, m);
+		csc_vf32_conv_run (&c, r0, pix, xn, yn, NULL);
+		csc_vf32_conv_run (&c, r1, pix, xn, yn, &pool);
+		csc_vf32_conv_free (&c);
+		ASSERT (memcmp (r0, r1, xn * yn * sizeof (float)) == 0);
+	}
+	csc_parallel_free (&pool);
+	free (pix);
+	free (r0);
+	free (r1);
+}
+
+
+//Reference loops of the original vf32_convolution2d_masked and vf32_convolution2d_clean:
+static void test_masked_naive (float pix2[], float const pix[], float const mask[], int32_t xn, int32_t yn, float const k[], int32_t kxn, int32_t kyn)
+{
+	int32_t kxn0 = kxn / 2;
+	int32_t kyn0 = kyn / 2;
+	for (int32_t y = kyn0; y < (yn-kyn0); ++y)
+	for (int32_t x = kxn0; x < (xn-kxn0); ++x)
+	{
+		float sum = 0.0f;
+		for (int32_t ky = 0; ky < kyn; ++ky)
+		for (int32_t kx = 0; kx < kxn; ++kx)
+		{
+			int32_t index = (y + ky - kyn0) * xn + (x + kx - kxn0);
+			sum += mask[index] * pix[index] * k[ky * kxn + kx];
+		}
+		pix2[y * xn + x] = sum;
+	}
+}
+
+
+static void test_clean_naive (float pix2[], float const pix[], int32_t xn, int32_t yn, int32_t kxn, int32_t kyn)
+{
+	int32_t kxn0 = kxn / 2;
+	int32_t kyn0 = kyn / 2;
+	for (int32_t y = kyn0; y < (yn-kyn0); ++y)
+	for (int32_t x = kxn0; x < (xn-kxn0); ++x)
+	{
+		float sum = 1.0f;
+		for (int32_t ky = 0; ky < kyn; ++ky)
+		for (int32_t kx = 0; kx < kxn; ++kx)
+		{
+			sum *= pix[(y + ky - kyn0) * xn + (x + kx - kxn0)];
+		}
+		pix2[y * xn + x] = sum;
+	}
+}
+
+
+static void test_conv_masked()
+{
+	//Larger than one tile in both directions:
+	int32_t const xn = 600;
+	int32_t const yn = 75;
+	int32_t const ksizes[][2] = {{1, 1}, {3, 3}, {5, 3}, {4, 6}, {9, 9}};
+	float * pix = malloc (xn * yn * sizeof (float));
+	float * mask = malloc (xn * yn * sizeof (float));
+	float * r0 = malloc (xn * yn * sizeof (float));
+	float * r1 = malloc (xn * yn * sizeof (float));
+	float k[81];
+	test_fill (xn * yn, pix, 11);
+	for (int32_t i = 0; i < xn * yn; ++i) {mask[i] = (float)((i * 7) % 3 != 0);}
+	struct csc_parallel pool;
+	csc_parallel_init (&pool, 3);
+	for (uint32_t s = 0; s < countof (ksizes); ++s)
+	for (int separable = 0; separable < 2; ++separable)
+	{
+		int32_t kxn = ksizes[s][0];
+		int32_t kyn = ksizes[s][1];
+		test_fill (kxn * kyn, k, 30 + s);
+		if (separable)
+		{
+			for (int32_t i = 0; i < kxn * kyn; ++i) {k[i] = (float)(i % kxn + 1) * (float)(i / kxn + 1);}
+		}
+		vf32_set1 (xn * yn, r0, 5.0f);
+		vf32_set1 (xn * yn, r1, 5.0f);
+		test_masked_naive (r0, pix, mask, xn, yn, k, kxn, kyn);
+		vf32_convolution2d_masked (r1, pix, mask, xn, yn, k, kxn, kyn);
+		ASSERT (test_maxdiff (xn * yn, r0, r1) < 1e-3f);
+		//Threads and border modes:
+		struct csc_vf32_conv c;
+		csc_vf32_conv_init (&c, k, kxn, kyn, CSC_VF32_CONV_SKIP, CSC_VF32_CONV_AUTO);
+		vf32_set1 (xn * yn, r1, 5.0f);
+		csc_vf32_conv_run_masked (&c, r1, pix, mask, xn, yn, &pool);
+		ASSERT (test_maxdiff (xn * yn, r0, r1) < 1e-3f);
+		csc_vf32_conv_free (&c);
+		csc_vf32_conv_init (&c, k, kxn, kyn, CSC_VF32_CONV_WRAP, CSC_VF32_CONV_AUTO);
+		vvf32_hadamard (xn * yn, r1, pix, mask);
+		test_conv_naive (r0, r1, xn, yn, k, kxn, kyn, CSC_VF32_CONV_WRAP);
+		csc_vf32_conv_run_masked (&c, r1, pix, mask, xn, yn, &pool);
+		ASSERT (test_maxdiff (xn * yn, r0, r1) < 1e-3f);
+		csc_vf32_conv_free (&c);
+	}
+	csc_parallel_free (&pool);
+	free (pix);
+	free (mask);
+	free (r0);
+	free (r1);
+}
+
+
+static void test_conv_clean()
+{
+	int32_t const xn = 53;
+	int32_t const yn = 31;
+	int32_t const ksizes[][2] = {{1, 1}, {3, 3}, {5, 3}, {4, 2}, {7, 9}};
+	float pix[xn * yn];
+	float r0[xn * yn];
+	float r1[xn * yn];
+	for (uint32_t s = 0; s < countof (ksizes); ++s)
+	{
+		int32_t kxn = ksizes[s][0];
+		int32_t kyn = ksizes[s][1];
+		//Binary image with sparse zeros:
+		for (int32_t i = 0; i < xn * yn; ++i) {pix[i] = (float)((i * 37) % 101 != 0);}
+		vf32_set1 (xn * yn, r0, 5.0f);
+		vf32_set1 (xn * yn, r1, 5.0f);
+		test_clean_naive (r0, pix, xn, yn, kxn, kyn);
+		vf32_convolution2d_clean (r1, pix, xn, yn, kxn, kyn);
+		ASSERT (memcmp (r0, r1, sizeof (r0)) == 0);
+		//Values close to 1 to keep the product in range:
+		test_fill (xn * yn, pix, 40 + s);
+		for (int32_t i = 0; i < xn * yn; ++i) {pix[i] = 1.0f + pix[i] * 0.1f;}
+		test_clean_naive (r0, pix, xn, yn, kxn, kyn);
+		vf32_convolution2d_clean (r1, pix, xn, yn, kxn, kyn);
+		ASSERT (test_maxdiff (xn * yn, r0, r1) < 1e-4f);
+	}
+}
+
+
+static double bench_conv_run (float const k[], int32_t kn, enum csc_vf32_conv_method m, float r[], float const pix[], int32_t xn, int32_t yn)
+{
+	struct timespec t0, t1;
+	struct csc_vf32_conv c;
+	csc_vf32_conv_init (&c, k, kn, kn, CSC_VF32_CONV_CLAMP, m);
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	csc_vf32_conv_run (&c, r, pix, xn, yn, NULL);
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	csc_vf32_conv_free (&c);
+	return csc_crossos_seconds (&t0, &t1) * 1e3;
+}
+
+
+/*
+Milliseconds per 512x512 image over kernel sizes.
+The reference loop computes the index for every tap like the original vf32_convolution2d,
+reference, DIRECT, FFT and AUTO uses a random kernel and SEPARABLE uses a Gaussian kernel.
+*/
+static void bench_conv()
+{
+	int32_t const xn = 512;
+	int32_t const yn = 512;
+	int32_t const ksizes[] = {3, 5, 9, 15, 25, 41, 63, 95};
+	float * pix = malloc (xn * yn * sizeof (float));
+	float * r = malloc (xn * yn * sizeof (float));
+	float * k = malloc (95 * 95 * sizeof (float));
+	float * g = malloc (95 * 95 * sizeof (float));
+	test_fill (xn * yn, pix, 7);
+	for (uint32_t s = 0; s < countof (ksizes); ++s)
+	{
+		int32_t kn = ksizes[s];
+		test_fill (kn * kn, k, 8);
+		for (int32_t i = 0; i < kn; ++i)
+		for (int32_t j = 0; j < kn; ++j)
+		{
+			float di = (float)(i - kn / 2);
+			float dj = (float)(j - kn / 2);
+			g[i * kn + j] = expf (-(di * di + dj * dj) / (0.2f * kn * kn));
+		}
+		struct timespec t0, t1;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		test_conv_naive (r, pix, xn, yn, k, kn, kn, CSC_VF32_CONV_SKIP);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		printf ("%2ix%-2i reference %8.2f ms, DIRECT %7.2f ms, FFT %7.2f ms, AUTO %7.2f ms, SEPARABLE %6.2f ms\n", kn, kn,
+		csc_crossos_seconds (&t0, &t1) * 1e3,
+		bench_conv_run (k, kn, CSC_VF32_CONV_DIRECT, r, pix, xn, yn),
+		bench_conv_run (k, kn, CSC_VF32_CONV_FFT, r, pix, xn, yn),
+		bench_conv_run (k, kn, CSC_VF32_CONV_AUTO, r, pix, xn, yn),
+		bench_conv_run (g, kn, CSC_VF32_CONV_SEPARABLE, r, pix, xn, yn));
+	}
+	free (pix);
+	free (r);
+	free (k);
+	free (g);
+}
+
+
+/*
+Milliseconds per 1024x1024 image for the masked convolution and the windowed product.
+*/
+static void bench_masked_clean()
+{
+	int32_t const xn = 1024;
+	int32_t const yn = 1024;
+	float * pix = malloc (xn * yn * sizeof (float));
+	float * mask = malloc (xn * yn * sizeof (float));
+	float * r = malloc (xn * yn * sizeof (float));
+	float k[81];
+	test_fill (xn * yn, pix, 12);
+	test_fill (81, k, 13);
+	for (int32_t i = 0; i < xn * yn; ++i) {mask[i] = (float)(i % 5 != 0);}
+	for (int32_t kn = 3; kn <= 9; kn += 3)
+	{
+		struct timespec t0, t1, t2;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		test_masked_naive (r, pix, mask, xn, yn, k, kn, kn);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		vf32_convolution2d_masked (r, pix, mask, xn, yn, k, kn, kn);
+		clock_gettime (CLOCK_MONOTONIC, &t2);
+		printf ("masked %ix%i: reference %.2f ms, tiled %.2f ms\n", kn, kn, csc_crossos_seconds (&t0, &t1) * 1e3, csc_crossos_seconds (&t1, &t2) * 1e3);
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		test_clean_naive (r, mask, xn, yn, kn, kn);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		vf32_convolution2d_clean (r, mask, xn, yn, kn, kn);
+		clock_gettime (CLOCK_MONOTONIC, &t2);
+		printf ("clean %ix%i binary: reference %.2f ms, counting %.2f ms\n", kn, kn, csc_crossos_seconds (&t0, &t1) * 1e3, csc_crossos_seconds (&t1, &t2) * 1e3);
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		test_clean_naive (r, pix, xn, yn, kn, kn);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		vf32_convolution2d_clean (r, pix, xn, yn, kn, kn);
+		clock_gettime (CLOCK_MONOTONIC, &t2);
+		printf ("clean %ix%i: reference %.2f ms, product passes %.2f ms\n", kn, kn, csc_crossos_seconds (&t0, &t1) * 1e3, csc_crossos_seconds (&t1, &t2) * 1e3);
+	}
+	free (pix);
+	free (mask);
+	free (r);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_conv_index();
+	test_conv_factor();
+	test_conv_methods();
+	test_conv_legacy();
+	test_conv_large_fft();
+	test_conv_threads();
+	test_conv_masked();
+	test_conv_clean();
+	bench_conv();
+	bench_masked_clean();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,9 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_parallel.h
+HEADERS += csc_vf32_convolution.h
+SOURCES += test_csc_vf32_convolution.c
+LIBS += -lpthread
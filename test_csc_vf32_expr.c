@@ -0,0 +1,162 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_vf32.h"
+#include "csc_vf32_expr.h"
+
+
+static void test_fill (uint32_t n, float v[], uint32_t seed)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v[i] = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+	}
+}
+
+
+static void test_expr()
+{
+	uint32_t const nmax = 1000;
+	float * a = malloc (nmax * sizeof (float));
+	float * b = malloc (nmax * sizeof (float));
+	float * c = malloc (nmax * sizeof (float));
+	float * r0 = malloc (nmax * sizeof (float));
+	float * r1 = malloc (nmax * sizeof (float));
+	float * t = malloc (nmax * sizeof (float));
+	test_fill (nmax, a, 1);
+	test_fill (nmax, b, 2);
+	test_fill (nmax, c, 3);
+	for (uint32_t n = 0; n <= nmax; n += (n < 300) ? 1 : 233)
+	{
+		//Unfused:
+		vvf32_sub (n, t, a, b);
+		vsf32_mul (n, r0, t, 0.5f);
+		vsf32_add (n, r0, r0, 1.0f);
+		vvf32_macc (n, r0, t, c);
+		float d0 = vf32_dot (n, t, t);
+		float s0 = vf32_sum (n, r0);
+		float m0 = n ? vf32_max (n, r0) : -INFINITY;
+		//Fused:
+		float d1, s1, m1;
+		struct csc_vf32_expr e;
+		csc_vf32_expr_init (&e);
+		uint32_t x = csc_vf32_expr_sub (&e, csc_vf32_expr_input (&e, a), csc_vf32_expr_input (&e, b));
+		uint32_t y = csc_vf32_expr_adds (&e, csc_vf32_expr_muls (&e, x, 0.5f), 1.0f);
+		y = csc_vf32_expr_macc (&e, y, x, csc_vf32_expr_input (&e, c));
+		csc_vf32_expr_store (&e, y, r1);
+		csc_vf32_expr_dot (&e, x, x, &d1);
+		csc_vf32_expr_sum (&e, y, &s1);
+		csc_vf32_expr_max (&e, y, &m1);
+		csc_vf32_expr_eval (&e, n);
+		for (uint32_t i = 0; i < n; ++i) {ASSERT (r0[i] == r1[i]);}
+		ASSERT (fabsf (d0 - d1) <= 1e-4f * (1.0f + fabsf (d0)));
+		ASSERT (fabsf (s0 - s1) <= 1e-4f * (1.0f + fabsf (s0)));
+		ASSERT (m0 == m1);
+		if (n == 0) {ASSERT (s1 == 0.0f && d1 == 0.0f);}
+	}
+	{
+		//In place, the store is read by the following node:
+		uint32_t n = 700;
+		memcpy (r0, a, n * sizeof (float));
+		float s;
+		struct csc_vf32_expr e;
+		csc_vf32_expr_init (&e);
+		uint32_t x = csc_vf32_expr_input (&e, r0);
+		csc_vf32_expr_store (&e, csc_vf32_expr_macc (&e, x, x, csc_vf32_expr_input (&e, b)), r0);
+		csc_vf32_expr_sum (&e, x, &s);
+		csc_vf32_expr_eval (&e, n);
+		float s0 = 0;
+		for (uint32_t i = 0; i < n; ++i)
+		{
+			float z = a[i] + a[i] * b[i];
+			//The SIMD macc may be contracted to FMA:
+			ASSERT (fabsf (r0[i] - z) < 1e-6f);
+			s0 += z;
+		}
+		ASSERT (fabsf (s - s0) < 1e-3f);
+		//Store of a input node copies it:
+		csc_vf32_expr_init (&e);
+		csc_vf32_expr_store (&e, csc_vf32_expr_input (&e, c), r1);
+		csc_vf32_expr_eval (&e, n);
+		ASSERT (memcmp (r1, c, n * sizeof (float)) == 0);
+	}
+	free (a);
+	free (b);
+	free (c);
+	free (r0);
+	free (r1);
+	free (t);
+}
+
+
+/*
+r := (a - b) * s + c and |a - b|^2 on arrays larger than the cache.
+*/
+static void bench_expr()
+{
+	uint32_t const n = 1 << 24;
+	uint32_t const reps = 5;
+	float * a = malloc (n * sizeof (float));
+	float * b = malloc (n * sizeof (float));
+	float * c = malloc (n * sizeof (float));
+	float * r = malloc (n * sizeof (float));
+	test_fill (n, a, 4);
+	test_fill (n, b, 5);
+	test_fill (n, c, 6);
+	test_fill (n, r, 7);
+	float volatile sink = 0;
+	struct timespec t0, t1, t2;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	for (uint32_t j = 0; j < reps; ++j)
+	{
+		vvf32_sub (n, r, a, b);
+		sink += vf32_dot (n, r, r);
+		vsf32_mul (n, r, r, 0.5f);
+		vvf32_add (n, r, r, c);
+	}
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	for (uint32_t j = 0; j < reps; ++j)
+	{
+		float d;
+		struct csc_vf32_expr e;
+		csc_vf32_expr_init (&e);
+		uint32_t x = csc_vf32_expr_sub (&e, csc_vf32_expr_input (&e, a), csc_vf32_expr_input (&e, b));
+		csc_vf32_expr_dot (&e, x, x, &d);
+		csc_vf32_expr_store (&e, csc_vf32_expr_add (&e, csc_vf32_expr_muls (&e, x, 0.5f), csc_vf32_expr_input (&e, c)), r);
+		csc_vf32_expr_eval (&e, n);
+		sink += d;
+	}
+	clock_gettime (CLOCK_MONOTONIC, &t2);
+	double d0 = csc_crossos_seconds (&t0, &t1) / reps;
+	double d1 = csc_crossos_seconds (&t1, &t2) / reps;
+	printf ("r := (a - b) * s + c, |a - b|^2, n=%u: unfused %.2f ms, fused %.2f ms, %.2fx\n", n, d0 * 1e3, d1 * 1e3, d0 / d1);
+	UNUSED (sink);
+	free (a);
+	free (b);
+	free (c);
+	free (r);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_expr();
+	bench_expr();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,7 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_vf32_expr.h
+SOURCES += test_csc_vf32_expr.c
@@ -0,0 +1,167 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_vf32_misc.h"
+
+
+static void test_fill (uint32_t n, float v[], uint32_t seed)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v[i] = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+	}
+}
+
+
+//The original vf32_find_peaks, rescans the array for every peak and zeroes the array around each peak:
+static void test_find_peaks_rescan (float q[], uint32_t qn, uint32_t g[], uint32_t gn, uint32_t r, uint32_t margin)
+{
+	for (uint32_t gi = 0; gi < gn; ++gi)
+	{
+		float qmax = 0.0f;
+		uint32_t qimax = 0;
+		for (uint32_t qi = margin; qi < qn-margin; ++qi)
+		{
+			if (qmax < q[qi])
+			{
+				qmax = q[qi];
+				qimax = qi;
+			}
+		}
+		g[gi] = qimax;
+		uint32_t qi0 = r <= qimax ? (qimax-r) : 0;
+		uint32_t qi1 = MIN (qimax+r, qn);
+		for (uint32_t qi = qi0; qi < qi1; ++qi)
+		{
+			q[qi] = 0.0f;
+		}
+	}
+}
+
+
+//Greedy reference of the local maxima with suppression by an O(n^2) search:
+static uint32_t test_find_peaks_ref (float const q[], uint32_t qn, uint32_t g[], uint32_t gn, uint32_t r, uint32_t margin)
+{
+	uint8_t * used = calloc (qn, 1);
+	uint32_t gi = 0;
+	for (; gi < gn; ++gi)
+	{
+		uint32_t best = UINT32_MAX;
+		for (uint32_t i = margin; i + margin < qn; ++i)
+		{
+			int left = (i == margin) || (q[i] > q[i-1]);
+			int right = (i + margin + 1 == qn) || (q[i] >= q[i+1]);
+			if (used[i] || q[i] <= 0.0f || !left || !right) {continue;}
+			if (best == UINT32_MAX || q[i] > q[best]) {best = i;}
+		}
+		if (best == UINT32_MAX) {break;}
+		g[gi] = best;
+		used[best] = 1;
+		for (uint32_t i = (r <= best ? best - r : 0); i < MIN (best + r, qn); ++i) {used[i] = 1;}
+	}
+	free (used);
+	return gi;
+}
+
+
+static void test_find_peaks()
+{
+	//Random arrays against the reference, the array is not modified:
+	for (uint32_t n = 0; n < 300; n += 13)
+	for (uint32_t margin = 0; margin < 4; margin += 3)
+	for (uint32_t r = 0; r < 20; r += 7)
+	{
+		float q[300];
+		float q0[300];
+		uint32_t g0[8];
+		uint32_t g1[8];
+		test_fill (n, q, n + r);
+		memcpy (q0, q, sizeof (float) * n);
+		memset (g0, 0, sizeof (g0));
+		uint32_t m0 = test_find_peaks_ref (q, n, g0, 8, r, margin);
+		uint32_t m1 = vf32_find_peaks (q, n, g1, 8, r, margin);
+		ASSERT_EQ_U (m0, m1);
+		ASSERT (memcmp (g0, g1, sizeof (g0)) == 0);
+		ASSERT (memcmp (q0, q, sizeof (float) * n) == 0);
+	}
+	//Flat tops gives the leftmost element, edges of the range can be peaks:
+	float q[] = {0, 1, 3, 3, 1, 0, 2, 2, 2, -1, 5};
+	uint32_t g[4];
+	ASSERT_EQ_U (vf32_find_peaks (q, countof (q), g, 4, 1, 0), 3);
+	ASSERT_EQ_U (g[0], 10);
+	ASSERT_EQ_U (g[1], 2);
+	ASSERT_EQ_U (g[2], 6);
+	ASSERT_EQ_U (g[3], 0);
+	//Separated bumps gives the same peaks as the original:
+	uint32_t const n = 1000;
+	float a[1000];
+	float b[1000];
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		float x = (float)i;
+		a[i] = 3.0f * expf (-(x - 100.0f) * (x - 100.0f) / 50.0f) + 5.0f * expf (-(x - 420.0f) * (x - 420.0f) / 80.0f) + 4.0f * expf (-(x - 800.0f) * (x - 800.0f) / 20.0f);
+	}
+	memcpy (b, a, sizeof (a));
+	uint32_t g0[3];
+	uint32_t g1[3];
+	test_find_peaks_rescan (b, n, g0, 3, 60, 5);
+	ASSERT_EQ_U (vf32_find_peaks (a, n, g1, 3, 60, 5), 3);
+	ASSERT (memcmp (g0, g1, sizeof (g0)) == 0);
+	ASSERT_EQ_U (g1[0], 420);
+	ASSERT_EQ_U (g1[1], 800);
+	ASSERT_EQ_U (g1[2], 100);
+}
+
+
+/*
+Peaks of a noisy trace of 2^22 samples, the original rescans the trace for every peak.
+*/
+static void bench_find_peaks()
+{
+	uint32_t const n = 1 << 22;
+	float * q = malloc (n * sizeof (float));
+	float * tmp = malloc (n * sizeof (float));
+	uint32_t g[256];
+	test_fill (n, q, 5);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		q[i] = 0.2f * q[i] + sinf ((float)i * 0.001f) * sinf ((float)i * 0.00013f);
+	}
+	for (uint32_t gn = 4; gn <= 256; gn *= 8)
+	{
+		struct timespec t0, t1, t2;
+		memcpy (tmp, q, n * sizeof (float));
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		test_find_peaks_rescan (tmp, n, g, gn, 1000, 0);
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		vf32_find_peaks (q, n, g, gn, 1000, 0);
+		clock_gettime (CLOCK_MONOTONIC, &t2);
+		printf ("%3u peaks: rescan %8.2f ms, local max + heap %6.2f ms\n", gn, csc_crossos_seconds (&t0, &t1) * 1e3, csc_crossos_seconds (&t1, &t2) * 1e3);
+	}
+	free (q);
+	free (tmp);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_find_peaks();
+	bench_find_peaks();
+
+	return EXIT_SUCCESS;
+}
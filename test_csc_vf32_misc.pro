@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_vf32_misc.h
+HEADERS += csc_vf32_simd.h
+SOURCES += test_csc_vf32_misc.c
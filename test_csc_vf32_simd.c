@@ -0,0 +1,407 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_vf32.h"
+#include "csc_vf32_misc.h"
+
+#define TEST_N 100
+
+
+static void test_fill (uint32_t n, float v[], uint32_t seed)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v[i] = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+	}
+}
+
+
+static void test_equal (uint32_t n, float const a[], float const b[], float tol)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		ASSERTF (fabsf (a[i] - b[i]) <= tol, "%i: %f %f", i, a[i], b[i]);
+	}
+}
+
+
+/*
+Compare every backend against the scalar backend for all lengths up to TEST_N
+and for unaligned arrays.
+*/
+static void test_simd_backends()
+{
+	float a[TEST_N + 1];
+	float b[TEST_N + 1];
+	float r0[TEST_N + 1];
+	float r1[TEST_N + 1];
+	test_fill (TEST_N + 1, a, 1);
+	test_fill (TEST_N + 1, b, 2);
+	struct csc_vf32_simd_ops const * s = csc_vf32_simd_table + CSC_VF32_SIMD_SCALAR;
+	for (int level = CSC_VF32_SIMD_SSE2; level < CSC_VF32_SIMD_COUNT; ++level)
+	{
+		if (csc_vf32_simd_supported (level) == 0) {continue;}
+		struct csc_vf32_simd_ops const * o = csc_vf32_simd_table + level;
+		ASSERT (o->level == (enum csc_vf32_simd_level)level);
+		for (uint32_t k = 0; k < 2; ++k)
+		for (uint32_t n = 0; n <= TEST_N; ++n)
+		{
+			float const * x = a + k;
+			float const * y = b + k;
+			s->vv_add (n, r0, x, y); o->vv_add (n, r1, x, y); test_equal (n, r0, r1, 0);
+			s->vv_sub (n, r0, x, y); o->vv_sub (n, r1, x, y); test_equal (n, r0, r1, 0);
+			s->vv_mul (n, r0, x, y); o->vv_mul (n, r1, x, y); test_equal (n, r0, r1, 0);
+			s->vs_add (n, r0, x, 0.5f); o->vs_add (n, r1, x, 0.5f); test_equal (n, r0, r1, 0);
+			s->vs_sub (n, r0, x, 0.5f); o->vs_sub (n, r1, x, 0.5f); test_equal (n, r0, r1, 0);
+			s->vs_mul (n, r0, x, 0.5f); o->vs_mul (n, r1, x, 0.5f); test_equal (n, r0, r1, 0);
+			s->set1 (n, r0, 3.0f); o->set1 (n, r1, 3.0f); test_equal (n, r0, r1, 0);
+			s->cpy (n, r0, x); o->cpy (n, r1, x); test_equal (n, r0, r1, 0);
+			s->cpy (n, r1, r0);
+			s->vv_macc (n, r0, x, y); o->vv_macc (n, r1, x, y); test_equal (n, r0, r1, 1e-6f);
+			s->vs_macc (n, r0, x, 0.5f); o->vs_macc (n, r1, x, 0.5f); test_equal (n, r0, r1, 1e-6f);
+			uint32_t p0[TEST_N];
+			uint32_t p1[TEST_N];
+			uint32_t m = s->peaks (n, x, p0);
+			ASSERT (m <= n / 2);
+			ASSERT (m == o->peaks (n, x, p1));
+			ASSERT (memcmp (p0, p1, m * sizeof (uint32_t)) == 0);
+		}
+	}
+}
+
+
+static void test_simd_dispatch()
+{
+	float a[TEST_N];
+	float b[TEST_N];
+	float r[TEST_N];
+	test_fill (TEST_N, a, 3);
+	test_fill (TEST_N, b, 4);
+	for (int level = CSC_VF32_SIMD_SCALAR; level < CSC_VF32_SIMD_COUNT; ++level)
+	{
+		enum csc_vf32_simd_level l = csc_vf32_simd_select (level);
+		ASSERT ((int)l <= level);
+		ASSERT (csc_vf32_simd ()->level == l);
+		vf32_cpy (TEST_N, r, a);
+		//Output aliases an input:
+		vf32_acc (TEST_N, r, b);
+		for (uint32_t i = 0; i < TEST_N; ++i) {ASSERT (r[i] == a[i] + b[i]);}
+		vf32_decc (TEST_N, r, b);
+		vvf32_hadamard (TEST_N, r, r, b);
+		for (uint32_t i = 0; i < TEST_N; ++i) {ASSERT (r[i] == (a[i] + b[i] - b[i]) * b[i]);}
+		vf32_set1 (TEST_N, r, 2.0f);
+		vsf32_mul (TEST_N, r, r, 3.0f);
+		vsf32_add (TEST_N, r, r, 1.0f);
+		vsf32_sub (TEST_N, r, r, 2.0f);
+		for (uint32_t i = 0; i < TEST_N; ++i) {ASSERT (r[i] == 5.0f);}
+	}
+	csc_vf32_simd_select (CSC_VF32_SIMD_COUNT);
+}
+
+
+/*
+Reductions of every backend against the scalar backend.
+*/
+static void test_simd_reductions()
+{
+	float a[TEST_N + 1];
+	float b[TEST_N + 1];
+	test_fill (TEST_N + 1, a, 8);
+	test_fill (TEST_N + 1, b, 9);
+	struct csc_vf32_simd_ops const * s = csc_vf32_simd_table + CSC_VF32_SIMD_SCALAR;
+	for (int level = CSC_VF32_SIMD_SCALAR; level < CSC_VF32_SIMD_COUNT; ++level)
+	{
+		if (csc_vf32_simd_supported (level) == 0) {continue;}
+		struct csc_vf32_simd_ops const * o = csc_vf32_simd_table + level;
+		for (uint32_t k = 0; k < 2; ++k)
+		for (uint32_t n = 1; n <= TEST_N; ++n)
+		{
+			float const * x = a + k;
+			float const * y = b + k;
+			double sum = 0;
+			double dot = 0;
+			float max = x[0];
+			float maxabs = 0;
+			for (uint32_t i = 0; i < n; ++i)
+			{
+				sum += x[i];
+				dot += (double)x[i] * y[i];
+				max = x[i] > max ? x[i] : max;
+				maxabs = fabsf (x[i]) > maxabs ? fabsf (x[i]) : maxabs;
+			}
+			ASSERT (fabs (o->sum (n, x) - sum) < 1e-5);
+			ASSERT (fabs (o->sum_kahan (n, x) - sum) < 1e-6);
+			ASSERT (fabs (o->dot (n, x, y) - dot) < 1e-5);
+			ASSERT (fabs (o->dot_kahan (n, x, y) - dot) < 1e-5);
+			ASSERT (o->max (n, x) == max);
+			ASSERT (o->maxabs (n, x) == maxabs);
+			ASSERT (o->max (n, x) == s->max (n, x));
+		}
+	}
+	//NaN is ignored unless it is the first element, same as the original scalar loop:
+	float v[20] = {1.0f, 2.0f};
+	v[17] = NAN;
+	v[5] = -30.0f;
+	for (int level = CSC_VF32_SIMD_SCALAR; level < CSC_VF32_SIMD_COUNT; ++level)
+	{
+		if (csc_vf32_simd_supported (level) == 0) {continue;}
+		struct csc_vf32_simd_ops const * o = csc_vf32_simd_table + level;
+		ASSERT (o->max (20, v) == 2.0f);
+		ASSERT (o->maxabs (20, v) == 30.0f);
+	}
+}
+
+
+/*
+Summing many small values, a single float accumulator stops growing
+when the increments falls below its precision.
+*/
+static void test_simd_accuracy()
+{
+	uint32_t const n = 1 << 24;
+	float * a = malloc (n * sizeof (float));
+	for (uint32_t i = 0; i < n; ++i) {a[i] = 0.1f;}
+	double exact = (double)n * (double)0.1f;
+	float serial = 0.0f;
+	for (uint32_t i = 0; i < n; ++i) {serial += a[i];}
+	double e_serial = fabs (serial - exact) / exact;
+	double e_fast = fabs (csc_vf32_simd_sum (n, a, CSC_VF32_SIMD_SUM_FAST) - exact) / exact;
+	double e_pairwise = fabs (csc_vf32_simd_sum (n, a, CSC_VF32_SIMD_SUM_PAIRWISE) - exact) / exact;
+	double e_kahan = fabs (csc_vf32_simd_sum (n, a, CSC_VF32_SIMD_SUM_KAHAN) - exact) / exact;
+	printf ("relative error n=%u: serial %g, fast %g, pairwise %g, kahan %g\n", n, e_serial, e_fast, e_pairwise, e_kahan);
+	ASSERT (e_fast < e_serial);
+	ASSERT (e_pairwise < 1e-6);
+	ASSERT (e_kahan < 1e-6);
+	//Global mode:
+	csc_vf32_simd_set_summode (CSC_VF32_SIMD_SUM_KAHAN);
+	ASSERT (vf32_sum (n, a) == csc_vf32_simd_sum (n, a, CSC_VF32_SIMD_SUM_KAHAN));
+	ASSERT (vf32_dot (n, a, a) == csc_vf32_simd_dot (n, a, a, CSC_VF32_SIMD_SUM_KAHAN));
+	csc_vf32_simd_set_summode (CSC_VF32_SIMD_SUM_PAIRWISE);
+	ASSERT (vf32_sum (n, a) == csc_vf32_simd_sum (n, a, CSC_VF32_SIMD_SUM_PAIRWISE));
+	csc_vf32_simd_set_summode (CSC_VF32_SIMD_SUM_FAST);
+	free (a);
+}
+
+
+//The original vf32_addv and vf32_subv:
+static void test_addv_ref (int sub, uint32_t dim, float y[], uint32_t ys, float const a[], uint32_t as, float const b[], uint32_t bs, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		for (uint32_t c = 0; c < dim; ++c) {y[c] = sub ? a[c] - b[c] : a[c] + b[c];}
+		y += ys;
+		a += as;
+		b += bs;
+	}
+}
+
+
+static void test_strided()
+{
+	uint32_t const nmax = 300;
+	uint32_t const smax = 7;
+	float * a = malloc (nmax * smax * sizeof (float));
+	float * b = malloc (nmax * smax * sizeof (float));
+	float * y0 = malloc (nmax * smax * sizeof (float));
+	float * y1 = malloc (nmax * smax * sizeof (float));
+	test_fill (nmax * smax, a, 10);
+	test_fill (nmax * smax, b, 11);
+	for (int sub = 0; sub < 2; ++sub)
+	for (uint32_t dim = 1; dim <= 5; ++dim)
+	for (uint32_t n = 0; n <= nmax; n += (n < 10) ? 1 : 97)
+	{
+		uint32_t const strides[][3] =
+		{
+		{dim, dim, dim},
+		{dim, dim, 0},
+		{dim, 0, dim},
+		{dim + 1, dim, dim + 2},
+		{dim + 2, 0, dim},
+		{dim, dim + 1, 0},
+		};
+		for (uint32_t k = 0; k < countof (strides); ++k)
+		{
+			uint32_t const * st = strides[k];
+			test_fill (nmax * smax, y0, 12);
+			test_fill (nmax * smax, y1, 12);
+			test_addv_ref (sub, dim, y0, st[0], a, st[1], b, st[2], n);
+			(sub ? vf32_subv : vf32_addv) (dim, y1, st[0], a, st[1], b, st[2], n);
+			//The padding between the vectors is not written:
+			test_equal (nmax * smax, y0, y1, 0);
+		}
+		//In place with a repeated vector:
+		test_fill (nmax * smax, y0, 13);
+		test_fill (nmax * smax, y1, 13);
+		test_addv_ref (sub, dim, y0, dim, y0, dim, b, 0, n);
+		(sub ? vf32_subv : vf32_addv) (dim, y1, dim, y1, dim, b, 0, n);
+		test_equal (nmax * smax, y0, y1, 0);
+		//Accumulate into one vector:
+		for (uint32_t stride = dim; stride <= dim + 2; ++stride)
+		{
+			float r0[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+			float r1[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+			test_addv_ref (sub, dim, r0, 0, r0, 0, a, stride, n);
+			(sub ? vf32_subv : vf32_addv) (dim, r1, 0, r1, 0, a, stride, n);
+			test_equal (8, r0, r1, 1e-4f);
+		}
+	}
+	//Accumulation with a repeated input and with overlapping output falls back to the original order:
+	{
+		float r0[5] = {1, 2, 3, 4, 5};
+		float r1[5] = {1, 2, 3, 4, 5};
+		test_addv_ref (0, 2, r0, 0, r0, 0, r0 + 1, 1, 3);
+		vf32_addv (2, r1, 0, r1, 0, r1 + 1, 1, 3);
+		test_equal (5, r0, r1, 0);
+	}
+	for (uint32_t inc = 1; inc <= 3; ++inc)
+	{
+		test_fill (nmax * smax, y0, 14);
+		test_fill (nmax * smax, y1, 14);
+		for (uint32_t i = 0; i < 101; ++i) {y0[i*inc] = 9.0f;}
+		vf32_set1_strided (y1, 9.0f, 101, inc);
+		test_equal (nmax * smax, y0, y1, 0);
+	}
+	{
+		uint32_t const n = 250;
+		float mean0[3] = {0};
+		float mean1[3];
+		for (uint32_t i = 0; i < n; ++i)
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			mean0[c] += a[i*4 + c];
+		}
+		vf32_move_center_to_zero (3, a, 4, y1, 4, n, mean1);
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			ASSERT (fabsf (mean1[c] - mean0[c] / n) < 1e-5f);
+			ASSERT (y1[4*7 + c] == a[4*7 + c] - mean1[c]);
+		}
+	}
+	free (a);
+	free (b);
+	free (y0);
+	free (y1);
+}
+
+
+#define BENCH_KERNEL(name, flops, bytes, call) \
+{ \
+	struct timespec t0, t1; \
+	clock_gettime (CLOCK_MONOTONIC, &t0); \
+	for (uint32_t j = 0; j < reps; ++j) {call;} \
+	clock_gettime (CLOCK_MONOTONIC, &t1); \
+	double dt = csc_crossos_seconds (&t0, &t1); \
+	printf ("%-8s %-8s %8.2f GFLOP/s %8.2f GB/s\n", csc_vf32_simd_level_tostr (o->level), name, \
+	(double)(flops) * n * reps / dt * 1e-9, (double)(bytes) * n * reps / dt * 1e-9); \
+}
+
+
+/*
+Per kernel throughput with L1 resident arrays.
+*/
+static void bench_simd()
+{
+	uint32_t const n = 2048;
+	uint32_t const reps = 100000;
+	float * a = malloc (n * sizeof (float));
+	float * b = malloc (n * sizeof (float));
+	float * r = malloc (n * sizeof (float));
+	test_fill (n, a, 5);
+	test_fill (n, b, 6);
+	test_fill (n, r, 7);
+	for (int level = CSC_VF32_SIMD_SCALAR; level < CSC_VF32_SIMD_COUNT; ++level)
+	{
+		if (csc_vf32_simd_supported (level) == 0) {continue;}
+		struct csc_vf32_simd_ops const * o = csc_vf32_simd_table + level;
+		BENCH_KERNEL ("vv_add", 1, 12, o->vv_add (n, r, a, b));
+		BENCH_KERNEL ("vv_sub", 1, 12, o->vv_sub (n, r, a, b));
+		BENCH_KERNEL ("vv_mul", 1, 12, o->vv_mul (n, r, a, b));
+		BENCH_KERNEL ("vv_macc", 2, 16, o->vv_macc (n, r, a, b));
+		BENCH_KERNEL ("vs_add", 1, 8, o->vs_add (n, r, a, 1.0f));
+		BENCH_KERNEL ("vs_sub", 1, 8, o->vs_sub (n, r, a, 1.0f));
+		BENCH_KERNEL ("vs_mul", 1, 8, o->vs_mul (n, r, a, 1.0f));
+		BENCH_KERNEL ("vs_macc", 2, 12, o->vs_macc (n, r, a, 1e-9f));
+		BENCH_KERNEL ("set1", 0, 4, o->set1 (n, r, 1.0f));
+		BENCH_KERNEL ("cpy", 0, 8, o->cpy (n, r, a));
+		float volatile sink = 0;
+		BENCH_KERNEL ("sum", 1, 4, sink += o->sum (n, a));
+		BENCH_KERNEL ("sumkahan", 4, 4, sink += o->sum_kahan (n, a));
+		BENCH_KERNEL ("sumpair", 1, 4, sink += csc_vf32_simd_sum_pairwise (o, n, a));
+		BENCH_KERNEL ("dot", 2, 8, sink += o->dot (n, a, b));
+		BENCH_KERNEL ("dotkahan", 5, 8, sink += o->dot_kahan (n, a, b));
+		BENCH_KERNEL ("max", 1, 4, sink += o->max (n, a));
+		BENCH_KERNEL ("maxabs", 1, 4, sink += o->maxabs (n, a));
+		UNUSED (sink);
+	}
+	free (a);
+	free (b);
+	free (r);
+}
+
+
+/*
+vf32_move_center_to_zero on n points, compared to the original per vector loops.
+*/
+static void bench_strided()
+{
+	uint32_t const n = 1 << 20;
+	uint32_t const reps = 20;
+	float * x = malloc (n * 4 * sizeof (float));
+	float * y = malloc (n * 4 * sizeof (float));
+	test_fill (n * 4, x, 15);
+	for (uint32_t dim = 2; dim <= 4; ++dim)
+	for (uint32_t stride = dim; stride <= 4; stride += (4 - dim) ? (4 - dim) : 1)
+	{
+		float mean[4];
+		struct timespec t0, t1, t2;
+		clock_gettime (CLOCK_MONOTONIC, &t0);
+		for (uint32_t j = 0; j < reps; ++j)
+		{
+			memset (mean, 0, sizeof (mean));
+			test_addv_ref (0, dim, mean, 0, mean, 0, x, stride, n);
+			vsf32_mul (dim, mean, mean, 1.0f / (float)n);
+			test_addv_ref (1, dim, y, stride, x, stride, mean, 0, n);
+		}
+		clock_gettime (CLOCK_MONOTONIC, &t1);
+		for (uint32_t j = 0; j < reps; ++j)
+		{
+			vf32_move_center_to_zero (dim, x, stride, y, stride, n, mean);
+		}
+		clock_gettime (CLOCK_MONOTONIC, &t2);
+		double d0 = csc_crossos_seconds (&t0, &t1);
+		double d1 = csc_crossos_seconds (&t1, &t2);
+		printf ("vf32_move_center_to_zero dim=%u stride=%u: loop %.2f Mvec/s, strided %.2f Mvec/s\n",
+		dim, stride, (double)n * reps / d0 * 1e-6, (double)n * reps / d1 * 1e-6);
+	}
+	free (x);
+	free (y);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	test_simd_backends();
+	test_simd_dispatch();
+	test_simd_reductions();
+	test_simd_accuracy();
+	test_strided();
+	bench_simd();
+	bench_strided();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/*
+SPDX-License-Identifier: GPL-2.0
+SPDX-FileCopyrightText: 2021 Johan Söderlind Åström <johan.soderlind.astrom@gmail.com>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "csc_basic.h"
+#include "csc_assert.h"
+#include "csc_crossos.h"
+#include "csc_vf32_parallel.h"
+#include "csc_vf32_stats.h"
+#include "csc_vf32_misc.h"
+
+
+static void test_fill (uint32_t n, float v[], uint32_t seed)
+{
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		v[i] = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+	}
+}
+
+
+//Two pass reference in double precision:
+static void test_stats_ref (uint32_t n, float const x[], double * mean, double * var, double * pos, double * neg)
+{
+	double sum = 0.0, p = 0.0, q = 0.0;
+	uint32_t pn = 0, qn = 0;
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		sum += x[i];
+		if (x[i] > 0.0f) {p += x[i]; pn++;}
+		if (x[i] < 0.0f) {q += x[i]; qn++;}
+	}
+	*mean = sum / n;
+	double d2 = 0.0;
+	for (uint32_t i = 0; i < n; ++i) {d2 += (x[i] - *mean) * (x[i] - *mean);}
+	*var = d2 / n;
+	*pos = pn ? p / pn : 0.0;
+	*neg = qn ? q / qn : 0.0;
+}
+
+
+static void test_stats_check (struct csc_vf32_stats const * s, uint32_t n, float const x[])
+{
+	double mean, var, pos, neg;
+	test_stats_ref (n, x, &mean, &var, &pos, &neg);
+	float mn = x[0];
+	float mx = x[0];
+	for (uint32_t i = 1; i < n; ++i) {mn = MIN (mn, x[i]); mx = MAX (mx, x[i]);}
+	ASSERT (s->n == n);
+	ASSERT (fabs (csc_vf32_stats_mean (s) - mean) < 1e-5 * (1.0 + fabs (mean)));
+	ASSERT (fabs (csc_vf32_stats_variance (s) - var) < 1e-5 * (1.0 + var));
+	ASSERT (fabs (csc_vf32_stats_pos_mean (s) - pos) < 1e-5 * (1.0 + pos));
+	ASSERT (fabs (csc_vf32_stats_neg_mean (s) - neg) < 1e-5 * (1.0 - neg));
+	ASSERT (s->min == mn);
+	ASSERT (s->max == mx);
+}
+
+
+static void test_stats()
+{
+	uint32_t const n = 100003;
+	float * x = malloc (n * sizeof (float));
+	test_fill (n, x, 1);
+	//Offset values where a naive sum of squares loses precision:
+	for (uint32_t i = 0; i < n / 2; ++i) {x[i] = x[i] * 0.01f + 1000.0f;}
+	for (uint32_t len = 1; len < 600; len += 37)
+	{
+		struct csc_vf32_stats s;
+		csc_vf32_stats_init (&s);
+		csc_vf32_stats_update (&s, len, x + n - len);
+		test_stats_check (&s, len, x + n - len);
+	}
+	struct csc_vf32_stats s;
+	csc_vf32_stats_init (&s);
+	csc_vf32_stats_update (&s, n / 2, x);
+	test_stats_check (&s, n / 2, x);
+	double mean, var, pos, neg;
+	test_stats_ref (n / 2, x, &mean, &var, &pos, &neg);
+	ASSERT (fabs (csc_vf32_stats_variance (&s) - var) < 1e-3 * var);
+	//Chunks of any size and merging gives the stats of the whole array:
+	csc_vf32_stats_init (&s);
+	struct csc_vf32_stats t;
+	csc_vf32_stats_init (&t);
+	for (uint32_t i = 0, m = 1; i < n; i += m, m = m * 3 + 1)
+	{
+		struct csc_vf32_stats *u = (i < n / 3) ? &s : &t;
+		csc_vf32_stats_update (u, MIN (m, n - i), x + i);
+	}
+	csc_vf32_stats_merge (&s, &t);
+	test_stats_check (&s, n, x);
+	struct csc_parallel pool;
+	csc_parallel_init (&pool, 4);
+	csc_vf32_stats_init (&t);
+	csc_vf32_stats_update_parallel (&pool, &t, n, x);
+	test_stats_check (&t, n, x);
+	csc_parallel_free (&pool);
+	double v = csc_vf32_stats_variance (&t);
+	ASSERT (fabs (csc_vf32_stats_sample_variance (&t) - v * n / (n - 1)) < 1e-5 * v);
+	//Empty stats:
+	csc_vf32_stats_init (&s);
+	csc_vf32_stats_update (&s, 0, x);
+	ASSERT (s.n == 0);
+	ASSERT (csc_vf32_stats_mean (&s) == 0.0f);
+	ASSERT (csc_vf32_stats_variance (&s) == 0.0f);
+	free (x);
+}
+
+
+static void test_hist()
+{
+	float x[] = {-2.0f, -1.0f, -0.5f, 0.0f, 0.49f, 0.5f, 0.999999f, 1.0f, 3.0f, NAN};
+	struct csc_vf32_hist h;
+	csc_vf32_hist_init (&h, -1.0f, 1.0f, 4);
+	csc_vf32_hist_update (&h, countof (x), x);
+	ASSERT (h.under == 1);
+	ASSERT (h.over == 2);
+	ASSERT (h.nan == 1);
+	ASSERT (h.bins[0] == 1);
+	ASSERT (h.bins[1] == 1);
+	ASSERT (h.bins[2] == 2);
+	ASSERT (h.bins[3] == 2);
+	struct csc_vf32_hist h2;
+	csc_vf32_hist_init (&h2, -1.0f, 1.0f, 4);
+	csc_vf32_hist_update (&h2, 3, x);
+	csc_vf32_hist_merge (&h, &h2);
+	ASSERT (h.under == 2);
+	ASSERT (h.bins[0] == 2);
+	csc_vf32_hist_free (&h2);
+	//Counts over many blocks add up:
+	uint32_t const n = 5000;
+	float * y = malloc (n * sizeof (float));
+	test_fill (n, y, 2);
+	csc_vf32_hist_free (&h);
+	csc_vf32_hist_init (&h, -0.5f, 0.5f, 10);
+	csc_vf32_hist_update (&h, n, y);
+	uint64_t total = h.under + h.over + h.nan;
+	for (uint32_t i = 0; i < h.nbins; ++i) {total += h.bins[i];}
+	ASSERT (total == n);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		if (y[i] >= 0.1f && y[i] < 0.2f) {total--;}
+	}
+	ASSERT (n - total == h.bins[6]);
+	csc_vf32_hist_free (&h);
+	free (y);
+}
+
+
+static void test_remove_low_values()
+{
+	float q[] = {1.0f, 2.0f, 6.0f, 0.0f, -1.0f, -5.0f, -3.0f, 0.5f};
+	vf32_remove_low_values (q, countof (q));
+	//Positive mean 2.375 and negative mean -3:
+	float r[] = {0.0f, 0.0f, 6.0f, 0.0f, 0.0f, -5.0f, -3.0f, 0.0f};
+	ASSERT (memcmp (q, r, sizeof (q)) == 0);
+}
+
+
+/*
+Mean, variance, min, max and the positive and negative means of 2^24 floats,
+one pass of csc_vf32_stats against separate passes.
+*/
+static void bench_stats()
+{
+	uint32_t const n = 1 << 24;
+	float * x = malloc (n * sizeof (float));
+	test_fill (n, x, 3);
+	struct timespec t0, t1, t2;
+	clock_gettime (CLOCK_MONOTONIC, &t0);
+	float mean = vf32_avg (n, x);
+	float d2 = 0.0f, mn = x[0], mx = x[0], pos = 0.0f, neg = 0.0f, pn = 0.0f, nn = 0.0f;
+	for (uint32_t i = 0; i < n; ++i) {d2 += (x[i] - mean) * (x[i] - mean);}
+	for (uint32_t i = 0; i < n; ++i) {mn = MIN (mn, x[i]); mx = MAX (mx, x[i]);}
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		if (x[i] > 0.0f) {pos += x[i]; pn += 1.0f;}
+		else if (x[i] < 0.0f) {neg += x[i]; nn += 1.0f;}
+	}
+	clock_gettime (CLOCK_MONOTONIC, &t1);
+	struct csc_vf32_stats s;
+	csc_vf32_stats_init (&s);
+	csc_vf32_stats_update (&s, n, x);
+	clock_gettime (CLOCK_MONOTONIC, &t2);
+	float volatile sink = d2 + mn + mx + pos / pn + neg / nn + csc_vf32_stats_variance (&s);
+	UNUSED (sink);
+	printf ("stats of %u floats: separate passes %.2f ms, one pass %.2f ms\n", n, csc_crossos_seconds (&t0, &t1) * 1e3, csc_crossos_seconds (&t1, &t2) * 1e3);
+	free (x);
+}
+
+
+int main (int argc, char const * argv [])
+{
+	csc_crossos_enable_ansi_color();
+	ASSERT (argc);
+	ASSERT (argv);
+
+	//The scalar loops and the SSE2 kernels:
+	csc_vf32_simd_select (CSC_VF32_SIMD_SCALAR);
+	test_stats();
+	csc_vf32_simd_select (CSC_VF32_SIMD_COUNT);
+	test_stats();
+	test_hist();
+	test_remove_low_values();
+	bench_stats();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+HEADERS += csc_parallel.h
+HEADERS += csc_vf32_parallel.h
+HEADERS += csc_vf32_stats.h
+HEADERS += csc_vf32_misc.h
+SOURCES += test_csc_vf32_stats.c
+LIBS += -lpthread